@@ -6,6 +6,7 @@
 #define CLIENT_SRC_CLIENT_H
 
 #include <netinet/in.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 /**
@@ -16,6 +17,25 @@
  * <li>char *server_ip: the IP address of the server</li>
  * <li>in_port_t server_port: the port number of the server</li>
  * <li>int server_fd: file descriptor for socket of connected server</li>
+ * <li>int version: the protocol version to speak; lowered to what the server speaks once connected</li>
+ * <li>unsigned int window: the most files sent but not yet acknowledged, or 0 not to ask for acknowledgements</li>
+ * <li>unsigned int retries: the most times to reconnect after losing the connection, resuming
+ * large files where the server left off; 0 not to ask to resume</li>
+ * <li>int skip_stored: whether to send each file's digest first, so the server can skip content it
+ * already stores</li>
+ * <li>int delta: whether to send large files as differences from the version the server stores</li>
+ * <li>int compress: whether to compress data that shrinks</li>
+ * <li>int zerocopy: whether to send mapped files with MSG_ZEROCOPY rather than sendfile</li>
+ * <li>unsigned int connections: the number of connections files are sent over at once, large
+ * files in stripes across all of them</li>
+ * <li>char *manifest_dir: the directory keeping a manifest of the files each server acknowledged,
+ * so files unchanged since are not sent again; or NULL</li>
+ * <li>struct manifest *manifest: the manifest for this server, shared by every connection, once
+ * connected; or NULL</li>
+ * <li>int watch: whether to keep the connection open once the files are sent, watching the
+ * directories named and sending each file changed in them</li>
+ * <li>unsigned int debounce: the milliseconds a changed file must be left alone before it is sent</li>
+ * <li>uint16_t features: the v2 features both sides speak, once connected</li>
  * </ul>
  * </p>
  */
@@ -24,6 +44,19 @@ struct client_settings
     char *server_ip;
     in_port_t server_port;
     int server_fd;
+    int version;
+    unsigned int window;
+    unsigned int retries;
+    int skip_stored;
+    int delta;
+    int compress;
+    int zerocopy;
+    unsigned int connections;
+    char *manifest_dir;
+    struct manifest *manifest;
+    int watch;
+    unsigned int debounce;
+    uint16_t features;
 };
 
 /**
@@ -38,4 +71,24 @@ struct client_settings
  */
 void run_client(int argc, char *argv[], struct client_settings *set);
 
+/**
+ * connect_client
+ * <p>
+ * Creates a socket and connects to a server specified by the port number and IP address in
+ * client_settings.
+ * </p>
+ * @param set - client_settings *: pointer to the settings for this server
+ */
+void connect_client(struct client_settings *set);
+
+/**
+ * reconnect_client
+ * <p>
+ * Close the connection to the server and connect again.
+ * </p>
+ * @param set - client_settings *: pointer to the settings for this server
+ * @return 0 on success, -1 if the server could not be reached
+ */
+int reconnect_client(struct client_settings *set);
+
 #endif //CLIENT_SRC_CLIENT_H
@@ -10,7 +10,9 @@
 /**
  * send_files
  * <p>
- * Send files to the server specified in client_settings.
+ * Send files to the server specified in client_settings. If the client was told to watch, keep
+ * the connection open afterwards and send files as they change in the directories named, until
+ * SIGINT or SIGTERM.
  * </p>
  * @param argc - int: the number of command line arguments
  * @param argv - char **: the command line arguments
@@ -0,0 +1,99 @@
+#ifndef CLIENT_SRC_DELTA_H
+#define CLIENT_SRC_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * What delta_find returns when no block of the base file matches.
+ */
+#define DELTA_NO_MATCH SIZE_MAX
+
+/**
+ * delta_index
+ * <p>
+ * Struct storing the block signatures of a base file the server sent, indexed by weak checksum.
+ * <ul>
+ * <li>uint8_t *sigs: PROTO_SIG_SIZE bytes for each block</li>
+ * <li>size_t blocks: the number of blocks</li>
+ * <li>uint32_t block_size: the size of the blocks</li>
+ * <li>size_t *heads: for each slot of weak checksums, the first block in it, or DELTA_NO_MATCH</li>
+ * <li>size_t *next: for each block, the next block in its slot, or DELTA_NO_MATCH</li>
+ * <li>size_t mask: the number of slots, less one</li>
+ * </ul>
+ * </p>
+ */
+struct delta_index
+{
+    uint8_t *sigs;
+    size_t blocks;
+    uint32_t block_size;
+    size_t *heads;
+    size_t *next;
+    size_t mask;
+};
+
+/**
+ * delta_index_open
+ * <p>
+ * Index the block signatures of a base file.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: delta_index_open dynamically allocates memory. Must close the index with delta_index_close!
+ * </h3>
+ * </p>
+ * @param index - delta_index *: the index
+ * @param sigs - uint8_t *: the signatures, which the index takes over
+ * @param blocks - size_t: the number of blocks
+ * @param block_size - uint32_t: the size of the blocks
+ */
+void delta_index_open(struct delta_index *index, uint8_t *sigs, size_t blocks, uint32_t block_size);
+
+/**
+ * delta_index_close
+ * <p>
+ * Free an index and its signatures.
+ * </p>
+ * @param index - delta_index *: the index
+ */
+void delta_index_close(struct delta_index *index);
+
+/**
+ * delta_find
+ * <p>
+ * Find a block of the base file holding the same bytes as a block of the new file. The strong
+ * checksum is only computed once a weak checksum matches.
+ * </p>
+ * @param index - delta_index *: the index
+ * @param weak - uint32_t: the weak checksum of the block
+ * @param block - uint8_t *: the block, block_size bytes
+ * @return the matching block, or DELTA_NO_MATCH
+ */
+size_t delta_find(const struct delta_index *index, uint32_t weak, const uint8_t *block);
+
+/**
+ * delta_weak
+ * <p>
+ * Compute the weak checksum of a block, as the protocol defines it.
+ * </p>
+ * @param data - uint8_t *: the block
+ * @param len - size_t: the number of bytes in the block
+ * @return the checksum
+ */
+uint32_t delta_weak(const uint8_t *data, size_t len);
+
+/**
+ * delta_roll
+ * <p>
+ * Move a block's weak checksum one byte along: drop its first byte and add the byte after it.
+ * </p>
+ * @param weak - uint32_t: the checksum of the block
+ * @param out - uint8_t: the block's first byte
+ * @param in - uint8_t: the byte following the block
+ * @param len - size_t: the number of bytes in the block
+ * @return the checksum of the block one byte along
+ */
+uint32_t delta_roll(uint32_t weak, uint8_t out, uint8_t in, size_t len);
+
+#endif //CLIENT_SRC_DELTA_H
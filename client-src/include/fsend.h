@@ -0,0 +1,71 @@
+#ifndef CLIENT_SRC_FSEND_H
+#define CLIENT_SRC_FSEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The smallest piece of a mapped file sent with MSG_ZEROCOPY. Pinning pages and taking the
+ * completion cost more than copying anything smaller.
+ */
+#define FSEND_ZEROCOPY_MIN (16 * 1024)
+
+/**
+ * The most of a file mapped at once for zero-copy sends, so the client's resident memory does not
+ * grow with the file.
+ */
+#define FSEND_MAP_WINDOW (8 * 1024 * 1024)
+
+/**
+ * fsend_enable_zerocopy
+ * <p>
+ * Allow MSG_ZEROCOPY sends on a socket.
+ * </p>
+ * @param sock - int: the socket
+ * @return 0 on success, -1 if the kernel does not support it
+ */
+int fsend_enable_zerocopy(int sock);
+
+/**
+ * fsend_file
+ * <p>
+ * Send part of a file with sendfile, so its bytes go from the page cache to the socket without
+ * passing through the client's memory. A file sendfile cannot read is read and sent through a
+ * small buffer instead.
+ * </p>
+ * @param sock - int: the socket
+ * @param fd - int: file descriptor for the file
+ * @param offset - uint64_t: where in the file to start
+ * @param len - uint64_t: the number of bytes to send
+ * @return 0 on success, -1 if the connection was lost
+ */
+int fsend_file(int sock, int fd, uint64_t offset, uint64_t len);
+
+/**
+ * fsend_zerocopy
+ * <p>
+ * Send part of a file with MSG_ZEROCOPY, so the kernel sends straight from the pages of a mapping
+ * of it. The file is mapped FSEND_MAP_WINDOW bytes at a time; the kernel holds on to the pages it
+ * still sends from, but the file's bytes must not change until fsend_flush returns.
+ * </p>
+ * @param sock - int: the socket, on which fsend_enable_zerocopy succeeded
+ * @param fd - int: file descriptor for the file
+ * @param offset - uint64_t: where in the file to start
+ * @param len - uint64_t: the number of bytes to send
+ * @param pending - uint32_t *: the number of zero-copy sends not yet completed, increased
+ * @return 0 on success, -1 if the connection was lost
+ */
+int fsend_zerocopy(int sock, int fd, uint64_t offset, uint64_t len, uint32_t *pending);
+
+/**
+ * fsend_flush
+ * <p>
+ * Wait until the kernel is done with the pages of every zero-copy send.
+ * </p>
+ * @param sock - int: the socket
+ * @param pending - uint32_t *: the number of zero-copy sends not yet completed, set to 0
+ * @return 0 on success, -1 if the connection was lost
+ */
+int fsend_flush(int sock, uint32_t *pending);
+
+#endif //CLIENT_SRC_FSEND_H
@@ -0,0 +1,24 @@
+#ifndef CLIENT_SRC_LZ_H
+#define CLIENT_SRC_LZ_H
+
+#include <stddef.h>
+
+/**
+ * The most bytes lz_compress may produce from len bytes, when nothing repeats.
+ */
+#define LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+/**
+ * lz_compress
+ * <p>
+ * Compress a buffer into one block of the LZ4 block format: a greedy match finder over a hash of
+ * every 4 bytes, fast enough to keep up with the network rather than squeeze out every byte.
+ * </p>
+ * @param src - char *: the bytes to compress
+ * @param len - size_t: the number of bytes in src
+ * @param dst - char *: the memory to hold the block, of at least LZ_BOUND(len) bytes
+ * @return the number of bytes in the block
+ */
+size_t lz_compress(const char *src, size_t len, char *dst);
+
+#endif //CLIENT_SRC_LZ_H
@@ -0,0 +1,122 @@
+#ifndef CLIENT_SRC_MANIFEST_H
+#define CLIENT_SRC_MANIFEST_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * The size of the key naming a file in a manifest: the first bytes of the SHA-256 of its path.
+ */
+#define MANIFEST_KEY_SIZE 16
+
+/**
+ * The size of a file's content digest in a manifest, a SHA-256.
+ */
+#define MANIFEST_DIGEST_SIZE 32
+
+/**
+ * The number of entries a new manifest has room for. The table doubles as it fills.
+ */
+#define MANIFEST_MIN_SLOTS 4096
+
+/**
+ * manifest_file
+ * <p>
+ * Struct storing what a manifest knows of a file, as laid out in the manifest itself.
+ * <ul>
+ * <li>uint8_t key[]: the key naming the file; all zeros in an empty slot</li>
+ * <li>uint64_t size: the file's size</li>
+ * <li>int64_t mtime_sec: the seconds of the file's modification time</li>
+ * <li>int64_t mtime_nsec: the nanoseconds of the file's modification time</li>
+ * <li>uint64_t ino: the file's inode number</li>
+ * <li>uint64_t dev: the device holding the file</li>
+ * <li>uint8_t digest[]: the SHA-256 of the file's content, if the client took it to send the file;
+ * otherwise all zeros</li>
+ * </ul>
+ * </p>
+ */
+struct manifest_file
+{
+    uint8_t key[MANIFEST_KEY_SIZE];
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    uint64_t dev;
+    uint8_t digest[MANIFEST_DIGEST_SIZE];
+};
+
+/**
+ * manifest
+ * <p>
+ * Opaque struct storing the manifest of the files a server has acknowledged: a file of a header
+ * then a hash table of manifest_file entries, mapped and used in place, so opening it takes no
+ * more than mapping it whatever its size. It is in the client's byte order, as only this machine
+ * reads it. Only one client uses a manifest at a time.
+ * </p>
+ */
+struct manifest;
+
+/**
+ * manifest_open
+ * <p>
+ * Open, or create, the manifest kept in a directory for a server.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: manifest_open dynamically allocates memory. Must close the manifest with manifest_close!
+ * </h3>
+ * </p>
+ * @param dir - char *: the directory holding the manifests
+ * @param server_ip - char *: the server's IP address
+ * @param server_port - in_port_t: the server's port
+ * @return the manifest, or NULL if another client is using it
+ */
+struct manifest *manifest_open(const char *dir, const char *server_ip, in_port_t server_port);
+
+/**
+ * manifest_describe
+ * <p>
+ * Fill in what the manifest would record of a file as it is now, its digest left unknown.
+ * </p>
+ * @param m - manifest *: the manifest
+ * @param path - char *: the file's path, made absolute against the directory the client started in
+ * @param st - stat *: the file's status
+ * @param file - manifest_file *: the entry to fill in
+ */
+void manifest_describe(const struct manifest *m, const char *path, const struct stat *st, struct manifest_file *file);
+
+/**
+ * manifest_unchanged
+ * <p>
+ * Check whether the manifest records a file exactly as described, so it need not be sent again.
+ * Safe to call from any thread.
+ * </p>
+ * @param m - manifest *: the manifest
+ * @param file - manifest_file *: the file as it is now, from manifest_describe
+ * @return 1 if the file is unchanged since it was acknowledged, 0 otherwise
+ */
+int manifest_unchanged(struct manifest *m, const struct manifest_file *file);
+
+/**
+ * manifest_record
+ * <p>
+ * Record a file the server has acknowledged, replacing what was recorded of it before. Safe to
+ * call from any thread.
+ * </p>
+ * @param m - manifest *: the manifest
+ * @param file - manifest_file *: the file as it was sent, from manifest_describe
+ */
+void manifest_record(struct manifest *m, const struct manifest_file *file);
+
+/**
+ * manifest_close
+ * <p>
+ * Unmap and close a manifest, letting other clients use it.
+ * </p>
+ * @param m - manifest *: the manifest
+ */
+void manifest_close(struct manifest *m);
+
+#endif //CLIENT_SRC_MANIFEST_H
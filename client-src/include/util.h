@@ -5,6 +5,8 @@
 #ifndef CLIENT_UTIL_H
 #define CLIENT_UTIL_H
 
+#include <stddef.h>
+
 /**
  * set_string
  * <p>
@@ -24,4 +26,35 @@
  */
 void set_string(char **str, const char *new_str);
 
+/**
+ * join_path
+ * <p>
+ * Join a directory's path and the name of an entry in it.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: join_path dynamically allocates memory. Must free the pointer it returns!
+ * </h3>
+ * </p>
+ * @param dir - char *: the directory's path
+ * @param name - char *: the entry's name
+ * @return the entry's path
+ */
+char *join_path(const char *dir, const char *name);
+
+/**
+ * name_offset
+ * <p>
+ * Find where in a file's path the name sent to the server starts. A file found under one of the
+ * roots of a walk or watch keeps its path from the root's own directory down, such as "tree/a/f"
+ * for "/home/u/tree/a/f" under "/home/u/tree", so the server can store the tree as it is; a root
+ * with no name of its own, such as "." or "/", is left out. Any other file is sent by its base name.
+ * </p>
+ * @param roots - char **: the paths of the directories at the top of the trees
+ * @param n_roots - size_t: the number of directories
+ * @param path - char *: the file's path
+ * @return the offset of the name in path
+ */
+size_t name_offset(char *const roots[], size_t n_roots, const char *path);
+
 #endif //CLIENT_UTIL_H
@@ -0,0 +1,77 @@
+#ifndef CLIENT_SRC_WALK_H
+#define CLIENT_SRC_WALK_H
+
+#include <stddef.h>
+
+/**
+ * The number of threads walking directories and prefetching their files.
+ */
+#define WALK_READERS 4
+
+/**
+ * The most files found and prefetched but not yet taken to be sent. Readers wait once it is full,
+ * so a large tree is held in memory only a little ahead of the connection.
+ */
+#define WALK_QUEUE_DEPTH 128
+
+/**
+ * The most bytes of each file the kernel is asked to read ahead of it being sent. Anything past
+ * this is left to the kernel's own readahead once sending starts.
+ */
+#define WALK_PREFETCH_MAX (1024 * 1024)
+
+/**
+ * walk
+ * <p>
+ * Opaque struct storing a walk of directory trees. Reader threads list the directories, stat each
+ * entry and have the kernel start reading each regular file, queueing its path for the senders.
+ * Entries that are neither regular files nor directories, symbolic links included, are skipped, as
+ * are directories and files that cannot be read, which are reported.
+ * </p>
+ */
+struct walk;
+
+/**
+ * walk_open
+ * <p>
+ * Start WALK_READERS threads walking directory trees.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: walk_open dynamically allocates memory. Must close the walk with walk_close!
+ * </h3>
+ * </p>
+ * @param roots - char **: the paths of the directories at the top of the trees
+ * @param n_roots - size_t: the number of directories
+ * @return the walk
+ */
+struct walk *walk_open(char *const roots[], size_t n_roots);
+
+/**
+ * walk_next
+ * <p>
+ * Take the next regular file found, waiting for a reader if none is queued. Safe to call from any
+ * number of threads at once.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: walk_next dynamically allocates memory. Must free the pointer it returns!
+ * </h3>
+ * </p>
+ * @param w - walk *: the walk
+ * @param name_off - size_t *: pointer to the memory to hold where in the path the name sent to the
+ *                   server starts, as name_offset finds it
+ * @return the file's path, or NULL once every tree has been walked and every file taken
+ */
+char *walk_next(struct walk *w, size_t *name_off);
+
+/**
+ * walk_close
+ * <p>
+ * Wait for the reader threads to finish and free the walk. Call once walk_next returned NULL.
+ * </p>
+ * @param w - walk *: the walk
+ */
+void walk_close(struct walk *w);
+
+#endif //CLIENT_SRC_WALK_H
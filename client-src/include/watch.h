@@ -0,0 +1,101 @@
+#ifndef CLIENT_SRC_WATCH_H
+#define CLIENT_SRC_WATCH_H
+
+#include <stddef.h>
+
+/**
+ * The most bytes of inotify events read at once.
+ */
+#define WATCH_EVENT_BUF_SIZE (64 * 1024)
+
+/**
+ * The number of changed files a watch first has room to index; the index doubles as needed.
+ */
+#define WATCH_MIN_BUCKETS 256
+
+/**
+ * watch
+ * <p>
+ * Opaque struct storing a watch of directory trees with inotify. Every directory in the trees is
+ * watched, directories made or moved into them later included. A regular file closed after being
+ * written, or moved into a tree, is a change; changes to one path are coalesced, and a change is
+ * due once the file has been left alone for the debounce time. Symbolic links are not followed.
+ * </p>
+ */
+struct watch;
+
+/**
+ * watch_open
+ * <p>
+ * Start watching directory trees. Files already in them are not changes.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: watch_open dynamically allocates memory. Must close the watch with watch_close!
+ * </h3>
+ * </p>
+ * @param roots - char **: the paths of the directories at the top of the trees
+ * @param n_roots - size_t: the number of directories
+ * @param debounce - unsigned int: the milliseconds a file must be left alone before its change is due
+ * @return the watch
+ */
+struct watch *watch_open(char *const roots[], size_t n_roots, unsigned int debounce);
+
+/**
+ * watch_fd
+ * <p>
+ * Get the file descriptor that is readable when events are waiting for watch_read.
+ * </p>
+ * @param w - watch *: the watch
+ * @return the file descriptor
+ */
+int watch_fd(const struct watch *w);
+
+/**
+ * watch_read
+ * <p>
+ * Read every event waiting and turn it into changes. A directory made or moved into a tree is
+ * watched and every file in it is a change. If the kernel dropped events, every file in the trees
+ * is a change.
+ * </p>
+ * @param w - watch *: the watch
+ */
+void watch_read(struct watch *w);
+
+/**
+ * watch_timeout
+ * <p>
+ * Get how long until the next change is due.
+ * </p>
+ * @param w - watch *: the watch
+ * @return the milliseconds to wait, 0 if a change is due, or -1 if there is no change
+ */
+int watch_timeout(const struct watch *w);
+
+/**
+ * watch_next
+ * <p>
+ * Take the path of a file whose change is due, oldest first.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: watch_next dynamically allocates memory. Must free the pointer it returns!
+ * </h3>
+ * </p>
+ * @param w - watch *: the watch
+ * @param name_off - size_t *: pointer to the memory to hold where in the path the name sent to the
+ *                   server starts, as name_offset finds it
+ * @return the file's path, or NULL if no change is due
+ */
+char *watch_next(struct watch *w, size_t *name_off);
+
+/**
+ * watch_close
+ * <p>
+ * Stop watching and free the watch and any changes not yet taken.
+ * </p>
+ * @param w - watch *: the watch
+ */
+void watch_close(struct watch *w);
+
+#endif //CLIENT_SRC_WATCH_H
@@ -4,10 +4,14 @@
 
 #include "client.h"
 #include "error.h"
+#include "fsend.h"
+#include "proto.h"
 #include "util.h"
 #include <arpa/inet.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -15,6 +19,31 @@
 
 #define DEFAULT_PORT 5000
 
+/**
+ * The default number of files sent but not yet acknowledged.
+ */
+#define DEFAULT_WINDOW 16
+
+/**
+ * The largest window of unacknowledged files.
+ */
+#define MAX_WINDOW 4096
+
+/**
+ * The most times the client may be told to reconnect.
+ */
+#define MAX_RETRIES 1000
+
+/**
+ * The most connections the client may send files over at once.
+ */
+#define MAX_CONNECTIONS 16
+
+/**
+ * The longest a changed file may have to be left alone before it is sent, in milliseconds.
+ */
+#define MAX_DEBOUNCE 60000
+
 /**
  * set_simple_defaults
  * <p>
@@ -61,17 +90,41 @@ void check_ip(char *ip, int base);
 in_port_t parse_port(const char *buffer, int base);
 
 /**
- * connect_client
+ * parse_count
+ * <p>
+ * Check a user input count, such as a number of connections, to ensure it is within parameters.
+ * Namely, that it is at least min and at most max.
+ * </p>
+ * @param buffer - char *: string containing the count
+ * @param base - int: base in which to interpret the count
+ * @param min - long: the smallest count allowed
+ * @param max - long: the largest count allowed
+ * @return the count
+ */
+unsigned int parse_count(const char *buffer, int base, long min, long max);
+
+/**
+ * open_connection
  * <p>
- * Creates a socket and connects to a server specified by the port number and IP address in
- * client_settings.
+ * Create a socket and connect it to the server.
  * </p>
  * @param set - client_settings *: pointer to the settings for this server
+ * @return 0 on success, -1 if the server could not be reached
  */
-void connect_client(struct client_settings *set);
+int open_connection(struct client_settings *set);
 
 void run_client(int argc, char *argv[], struct client_settings *set)
 {
+    struct sigaction sa;
+
+    // sendfile cannot be told MSG_NOSIGNAL, so a server that leaves must show up as EPIPE instead
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sa.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &sa, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 2);
+    }
     set_simple_defaults(set);
     read_args(argc, argv, set);
     connect_client(set);
@@ -81,6 +134,9 @@ void set_simple_defaults(struct client_settings *set)
 {
     memset(set, 0, sizeof(struct client_settings)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
     set->server_port = DEFAULT_PORT;
+    set->version = PROTO_VERSION;
+    set->window = DEFAULT_WINDOW;
+    set->connections = 1;
 }
 
 void read_args(int argc, char *argv[], struct client_settings *set)
@@ -88,7 +144,7 @@ void read_args(int argc, char *argv[], struct client_settings *set)
     const int base = 10;
     int c;
 
-    while ((c = getopt(argc, argv, ":s:p:")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
+    while ((c = getopt(argc, argv, ":s:p:V:W:r:j:M:w:HdzZ")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
     {
         switch (c)
         {
@@ -103,6 +159,57 @@ void read_args(int argc, char *argv[], struct client_settings *set)
                 set->server_port = parse_port(optarg, base);
                 break;
             }
+            case 'V':
+            {
+                set->version = (int) parse_count(optarg, base, 1, PROTO_VERSION);
+                break;
+            }
+            case 'W':
+            {
+                set->window = parse_count(optarg, base, 0, MAX_WINDOW);
+                break;
+            }
+            case 'r':
+            {
+                set->retries = parse_count(optarg, base, 0, MAX_RETRIES);
+                break;
+            }
+            case 'j':
+            {
+                set->connections = parse_count(optarg, base, 1, MAX_CONNECTIONS);
+                break;
+            }
+            case 'M':
+            {
+                set->manifest_dir = optarg;
+                break;
+            }
+            case 'w':
+            {
+                set->watch = 1;
+                set->debounce = parse_count(optarg, base, 0, MAX_DEBOUNCE);
+                break;
+            }
+            case 'H':
+            {
+                set->skip_stored = 1;
+                break;
+            }
+            case 'd':
+            {
+                set->delta = 1;
+                break;
+            }
+            case 'z':
+            {
+                set->compress = 1;
+                break;
+            }
+            case 'Z':
+            {
+                set->zerocopy = 1;
+                break;
+            }
             case ':':
             {
                 fatal_message(__FILE__, __func__, __LINE__, "\"Option requires an operand\"",
@@ -122,7 +229,7 @@ void read_args(int argc, char *argv[], struct client_settings *set)
     }
     if (set->server_ip == NULL)
     {
-        fatal_message(__FILE__, __func__, __LINE__, "Usage: client -s <ip-address> -p <port> <files...>", 2);
+        fatal_message(__FILE__, __func__, __LINE__, "Usage: client -s <ip-address> -p <port> [-V <protocol-version>] [-W <window>] [-r <retries>] [-j <connections>] [-M <manifest-dir>] [-w <debounce-ms>] [-H] [-d] [-z] [-Z] <files or directories...>", 2);
     }
 }
 
@@ -221,7 +328,57 @@ in_port_t parse_port(const char *buffer, int base)
     return port;
 }
 
+unsigned int parse_count(const char *buffer, int base, long min, long max) // NOLINT(bugprone-easily-swappable-parameters)
+{
+    char *end;
+    long sl;
+    const char *msg;
+
+    errno = 0;
+    sl = strtol(buffer, &end, base);
+
+    if (end == buffer)
+    {
+        msg = "not a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "%s: extra characters at end of input";
+    } else if ((LONG_MIN == sl || LONG_MAX == sl) && ERANGE == errno)
+    {
+        msg = "out of range of type long";
+    } else if (sl > max)
+    {
+        msg = "greater than the maximum";
+    } else if (sl < min)
+    {
+        msg = "less than the minimum";
+    } else
+    {
+        msg = NULL;
+    }
+    if (msg)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, msg, 2);
+    }
+
+    return (unsigned int) sl;
+}
+
 void connect_client(struct client_settings *set)
+{
+    if (open_connection(set) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+int reconnect_client(struct client_settings *set)
+{
+    close(set->server_fd);
+    return open_connection(set);
+}
+
+int open_connection(struct client_settings *set)
 {
     struct sockaddr_in addr;
 
@@ -241,6 +398,17 @@ void connect_client(struct client_settings *set)
 
     if (connect(set->server_fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in)) == -1)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        int err = errno;
+
+        close(set->server_fd);
+        set->server_fd = -1;
+        errno = err;
+        return -1;
+    }
+    if (set->zerocopy && fsend_enable_zerocopy(set->server_fd) == -1)
+    {
+        printf("Zero-copy sends are not supported; using sendfile\n");
+        set->zerocopy = 0;
     }
+    return 0;
 }
@@ -3,15 +3,609 @@
 //
 
 #include "comm.h"
+#include "delta.h"
 #include "error.h"
+#include "fsend.h"
+#include "lz.h"
+#include "manifest.h"
+#include "proto.h"
+#include "sha256.h"
+#include "util.h"
+#include "walk.h"
+#include "watch.h"
+#include <endian.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+/**
+ * The size of the buffer through which a file is read and sent in v2, and so of the largest data
+ * frame sent.
+ */
+#define CHUNK_SIZE (256 * 1024)
+
+/**
+ * The size of the buffer holding a chunk, then room to compress it behind its decompressed size.
+ */
+#define CHUNK_BUF_SIZE (CHUNK_SIZE + sizeof(uint32_t) + LZ_BOUND(CHUNK_SIZE))
+
+/**
+ * The smallest data frame worth compressing.
+ */
+#define COMPRESS_MIN_SIZE 128
+
+/**
+ * Data is sent compressed only if that saves at least 1 byte in this many.
+ */
+#define COMPRESS_MIN_SAVING 8
+
+/**
+ * The number of data frames of a file sent without trying to compress them after one did not
+ * shrink enough; data that does not compress rarely does a chunk later.
+ */
+#define COMPRESS_SKIP 16
+
+/**
+ * The smallest file sent on a resumable stream. Smaller files are cheaper to send again than to
+ * hash twice.
+ */
+#define RESUME_MIN_SIZE (1024 * 1024)
+
+/**
+ * The smallest file sent as a delta. Smaller files are cheaper to send whole than to wait on the
+ * signatures of.
+ */
+#define DELTA_MIN_SIZE (1024 * 1024)
+
+/**
+ * The smallest file sent in stripes when the client has more than one connection. Smaller files
+ * go whole to one connection, as many of them keep every connection busy anyway.
+ */
+#define STRIPE_MIN_SIZE (16 * 1024 * 1024)
+
+/**
+ * The number of files a connection first has room for; the room doubles as needed.
+ */
+#define DEFAULT_JOBS 16
+
+/**
+ * The number of seconds to wait before reconnecting to the server.
+ */
+#define RETRY_DELAY 1
+
+/**
+ * Cleared by SIGINT or SIGTERM to stop watching for changes.
+ */
+static volatile sig_atomic_t watching;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * job
+ * <p>
+ * Struct storing one file, or one stripe of a file, for a connection to send.
+ * <ul>
+ * <li>const char *file_name: the file name</li>
+ * <li>size_t name_off: where in file_name the name the server stores the file under starts</li>
+ * <li>int striped: whether only a stripe of the file is sent</li>
+ * <li>uint8_t transfer_id[]: the transfer ID naming the whole file of a stripe</li>
+ * <li>uint64_t size: the size of the whole file of a stripe</li>
+ * <li>uint64_t offset: where in the file a stripe starts</li>
+ * <li>uint64_t len: the size of a stripe</li>
+ * <li>struct manifest_file entry: the whole file of a stripe as it was when cut into stripes, if
+ * the client keeps a manifest</li>
+ * </ul>
+ * </p>
+ */
+struct job
+{
+    const char *file_name;
+    size_t name_off;
+    int striped;
+    uint8_t transfer_id[PROTO_TRANSFER_ID_SIZE];
+    uint64_t size;
+    uint64_t offset;
+    uint64_t len;
+    struct manifest_file entry;
+};
+
+/**
+ * unacked
+ * <p>
+ * Struct storing one file sent but not yet acknowledged by the server.
+ * <ul>
+ * <li>uint32_t stream: the stream that carried the file</li>
+ * <li>char *file_name: a copy of the file name, as a file found in a directory is freed once sent</li>
+ * <li>uint64_t len: the number of bytes sent</li>
+ * <li>int record: whether to record the file in the manifest once acknowledged</li>
+ * <li>struct manifest_file entry: the file as it was before it was sent</li>
+ * <li>struct job job: the file or stripe as it was handed to send_job, naming file_name, to send
+ * again if the connection is lost before it is acknowledged</li>
+ * </ul>
+ * </p>
+ */
+struct unacked
+{
+    uint32_t stream;
+    char *file_name;
+    uint64_t len;
+    int record;
+    struct manifest_file entry;
+    struct job job;
+};
+
+/**
+ * ack_window
+ * <p>
+ * Struct storing the files sent but not yet acknowledged. Once it is full, nothing more is sent
+ * until the server acknowledges a file, so the server's pace of storing files holds back the
+ * client rather than only the socket's buffers filling.
+ * <ul>
+ * <li>struct unacked *files: the files</li>
+ * <li>size_t n: the number of files</li>
+ * <li>size_t cap: the most files, the window</li>
+ * </ul>
+ * </p>
+ */
+struct ack_window
+{
+    struct unacked *files;
+    size_t n;
+    size_t cap;
+};
+
+/**
+ * lane
+ * <p>
+ * Struct storing one connection to the server and the files it sends, on a thread of its own if
+ * the client has more than one.
+ * <ul>
+ * <li>struct client_settings set: the settings, with the connection's own socket</li>
+ * <li>struct job *jobs: the files to send, in order</li>
+ * <li>size_t n: the number of files</li>
+ * <li>size_t cap: the room for files</li>
+ * <li>struct walk *walk: the walk of the directories named, shared by every connection, which
+ * take its files once their own are sent; or NULL</li>
+ * <li>pthread_t thread: the thread sending the files</li>
+ * </ul>
+ * </p>
+ */
+struct lane
+{
+    struct client_settings set;
+    struct job *jobs;
+    size_t n;
+    size_t cap;
+    struct walk *walk;
+    pthread_t thread;
+};
+
+/**
+ * negotiate
+ * <p>
+ * Send a v2 hello and wait for the server's answer. On success, set the version and features to
+ * the ones both speak. Acknowledgements are asked for if the window is not 0, resumable uploads
+ * if the client may reconnect, stripes if it has more than one connection, and skipping stored
+ * content, deltas and compression if the client was told to.
+ * </p>
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the server closed the connection because it only speaks v1
+ */
+int negotiate(struct client_settings *set);
+
+/**
+ * send_v1
+ * <p>
+ * Send the files over v1, one after another, walking any directories named.
+ * </p>
+ * @param argc - int: the number of command line arguments
+ * @param argv - char **: the command line arguments, the files from optind on
+ * @param set - client_settings *: pointer to the settings for this client
+ */
+void send_v1(int argc, char *argv[], const struct client_settings *set);
+
+/**
+ * send_lanes
+ * <p>
+ * Send the files over v2 across the client's connections, then close every connection but the
+ * first.
+ * </p>
+ * @param argc - int: the number of command line arguments
+ * @param argv - char **: the command line arguments, the files from optind on
+ * @param set - client_settings *: pointer to the settings for this client, connected and negotiated
+ */
+void send_lanes(int argc, char *argv[], struct client_settings *set);
+
+/**
+ * open_watch
+ * <p>
+ * Start watching the directories named. Files named are sent once but not watched.
+ * </p>
+ * @param argc - int: the number of command line arguments
+ * @param argv - char **: the command line arguments, the files from optind on
+ * @param debounce - unsigned int: the milliseconds a changed file must be left alone before it is sent
+ * @return the watch
+ */
+struct watch *open_watch(int argc, char *argv[], unsigned int debounce);
+
+/**
+ * send_changes
+ * <p>
+ * Until SIGINT or SIGTERM, send each file the watch finds changed over the first connection, on a
+ * stream of its own as in send_jobs. Acknowledgements are taken as they arrive. A connection the
+ * server closes while the client waits for changes is reconnected like one lost while sending,
+ * and the retries are counted afresh after every file sent.
+ * </p>
+ * @param watch - watch *: the watch
+ * @param set - client_settings *: pointer to the settings for this client
+ */
+void send_changes(struct watch *watch, struct client_settings *set);
+
+/**
+ * stop_watching
+ * <p>
+ * Signal handler clearing the watching flag.
+ * </p>
+ * @param sig - int: the signal
+ */
+void stop_watching(int sig);
+
+/**
+ * open_lanes
+ * <p>
+ * Share the files out among the client's connections, opening and negotiating every connection
+ * past the first. A regular file of at least STRIPE_MIN_SIZE bytes is cut into one stripe per
+ * connection, each a multiple of CHUNK_SIZE bytes but the last; every other file goes whole to the
+ * next connection in turn. Stripes skip the digest, delta and resume a whole file would be sent
+ * with, so while any of those was granted every file goes whole. Directories are walked while the files are sent, each file found going
+ * whole to whichever connection is free first. A file to be striped that the manifest records as
+ * unchanged is left out here.
+ * </p>
+ * @param argc - int: the number of command line arguments
+ * @param argv - char **: the command line arguments, the files from optind on
+ * @param set - client_settings *: pointer to the settings for this client, connected and negotiated
+ * @return the connections, set->connections of them
+ */
+struct lane *open_lanes(int argc, char *argv[], const struct client_settings *set);
+
+/**
+ * add_job
+ * <p>
+ * Add a file, or a stripe of one, to the files a connection sends.
+ * </p>
+ * @param lane - lane *: the connection
+ * @param job - job *: the file
+ */
+void add_job(struct lane *lane, const struct job *job);
+
+/**
+ * run_lane
+ * <p>
+ * Thread start routine calling send_jobs.
+ * </p>
+ * @param arg - void *: the lane
+ * @return NULL
+ */
+void *run_lane(void *arg);
+
+/**
+ * send_jobs
+ * <p>
+ * Send a connection's files over v2, one stream each, keeping at most a window of them
+ * unacknowledged and reconnecting whenever the connection is lost. Then send files found by the
+ * walk until it is over.
+ * </p>
+ * @param lane - lane *: the connection
+ */
+void send_jobs(struct lane *lane);
+
+/**
+ * send_job
+ * <p>
+ * Send a file, or a stripe of one, on its own stream once the window has room, reconnecting as
+ * often as it takes, and add it to the window. A regular file the manifest records as unchanged is
+ * skipped without being opened.
+ * </p>
+ * @param job - job *: the file
+ * @param stream - uint32_t: the stream
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes through which the file is read and compressed
+ * @param win - ack_window *: the files not yet acknowledged
+ * @param retries - unsigned int *: the number of retries left
+ * @param set - client_settings *: pointer to the settings for this connection
+ */
+void send_job(const struct job *job, uint32_t stream, char *chunk, struct ack_window *win, unsigned int *retries,
+              struct client_settings *set);
+
+/**
+ * resume_connection
+ * <p>
+ * Connect to the server again after losing the connection, waiting RETRY_DELAY seconds before
+ * each try, until it answers or the retries run out. Files sent but not yet acknowledged are sent
+ * again on their own streams, a resumable one from wherever the server left off, as whether the
+ * server stored them is unknown. A stripe cannot be sent twice, so one not yet acknowledged is
+ * only reported.
+ * </p>
+ * @param win - ack_window *: the files not yet acknowledged, holding those sent again
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes through which the files are read and compressed
+ * @param retries - unsigned int *: the number of retries left
+ * @param set - client_settings *: pointer to the settings for this client
+ */
+void resume_connection(struct ack_window *win, char *chunk, unsigned int *retries, struct client_settings *set);
+
+/**
+ * send_stream
+ * <p>
+ * Send a file on a v2 stream: an open frame with its name and size, data frames of up to
+ * CHUNK_SIZE bytes as the file is read, then an end frame. A file that is not a regular file,
+ * such as a pipe, is sent with its size unknown until it ends. A regular file of at least
+ * RESUME_MIN_SIZE bytes is sent on a resumable stream if the server allows it. If the server
+ * may skip content it has, a regular file's digest is sent first and its data only if needed.
+ * A regular file of at least DELTA_MIN_SIZE bytes is sent as a delta instead if the server allows
+ * it. Data frames are compressed if the server allows it and the data shrinks. A regular file
+ * whose bytes the client needs neither to hash nor to compress is sent with send_raw.
+ * </p>
+ * @param file_name - char*: the file name
+ * @param name - char*: the name the server stores the file under, the end of file_name
+ * @param stream - uint32_t: the stream
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes through which the file is read and compressed
+ * @param win - ack_window *: the files not yet acknowledged
+ * @param set - client_settings *: pointer to the settings for this client
+ * @param sent - uint64_t *: pointer to the memory to hold the number of bytes of data sent
+ * @param digest - uint8_t[]: the buffer to hold the file's digest if it was taken to send the
+ *                 file, otherwise zeroed; of PROTO_DIGEST_SIZE bytes
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_stream(const char *file_name, const char *name, uint32_t stream, char *chunk, struct ack_window *win,
+                const struct client_settings *set, uint64_t *sent, uint8_t digest[PROTO_DIGEST_SIZE]);
+
+/**
+ * send_stripe
+ * <p>
+ * Send a stripe of a file on a v2 stream: an open frame with the file's name and size followed by
+ * the transfer ID, offset and size of the stripe, the stripe's data frames, then an end frame.
+ * </p>
+ * @param job - job *: the stripe
+ * @param stream - uint32_t: the stream
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes through which the stripe is read and compressed
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_stripe(const struct job *job, uint32_t stream, char *chunk, const struct client_settings *set);
+
+/**
+ * send_raw
+ * <p>
+ * Send part of a regular file in data frames without reading it into the client: each frame's
+ * bytes go from the page cache to the socket with sendfile or, if the client was told to, with
+ * MSG_ZEROCOPY.
+ * </p>
+ * @param fd - int: file descriptor for the file
+ * @param offset - uint64_t: where in the file to start
+ * @param len - uint64_t: the number of bytes to send
+ * @param stream - uint32_t: the stream
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_raw(int fd, uint64_t offset, uint64_t len, uint32_t stream, const struct client_settings *set);
+
+/**
+ * open_announced
+ * <p>
+ * Open a stream whose open frame carries a transfer ID, the file's digest or both, and wait for
+ * the server to answer: whether it already stores the content, or else how much of the file it
+ * already holds.
+ * </p>
+ * @param file_name - char*: the file name
+ * @param name - char*: the name the server stores the file under, the end of file_name
+ * @param st - stat *: the file's status
+ * @param stream - uint32_t: the stream
+ * @param flags - uint8_t: PROTO_FLAG_RESUME, PROTO_FLAG_HASH or both
+ * @param digest - uint8_t[]: the digest of the file if hashed, of PROTO_DIGEST_SIZE bytes
+ * @param win - ack_window *: the files not yet acknowledged, whose acknowledgements may come first
+ * @param set - client_settings *: pointer to the settings for this client
+ * @param offset - uint64_t *: pointer to the memory to hold the number of bytes the server holds
+ * @return 1 if the server already stores the content and the stream is over, 0 if the data is
+ *         needed, -1 if the connection was lost
+ */
+int open_announced(const char *file_name, const char *name, const struct stat *st, uint32_t stream, uint8_t flags,
+                   const uint8_t digest[PROTO_DIGEST_SIZE], struct ack_window *win,
+                   const struct client_settings *set, uint64_t *offset);
+
+/**
+ * send_delta
+ * <p>
+ * Send a file on a delta stream: wait for the signatures of the version the server stores, then
+ * roll the weak checksum along the file a byte at a time, sending each block the server already
+ * has as a copy frame and everything between as data frames.
+ * </p>
+ * @param fd - int: file descriptor for the file, a regular file
+ * @param file_name - char*: the file name
+ * @param name - char*: the name the server stores the file under, the end of file_name
+ * @param size - uint64_t: the size of the file
+ * @param stream - uint32_t: the stream
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes through which data is compressed
+ * @param win - ack_window *: the files not yet acknowledged, whose acknowledgements may come first
+ * @param set - client_settings *: pointer to the settings for this client
+ * @param digest - uint8_t[]: the buffer to hold the digest of the file, of PROTO_DIGEST_SIZE bytes
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_delta(int fd, const char *file_name, const char *name, uint64_t size, uint32_t stream, char *chunk,
+               struct ack_window *win, const struct client_settings *set, uint8_t digest[PROTO_DIGEST_SIZE]);
+
+/**
+ * recv_sigs
+ * <p>
+ * Wait for the signatures answering a delta stream's open and index them.
+ * </p>
+ * @param stream - uint32_t: the stream
+ * @param win - ack_window *: the files not yet acknowledged, whose acknowledgements may come first
+ * @param set - client_settings *: pointer to the settings for this client
+ * @param index - delta_index *: the index to open
+ * @return 0 on success, -1 if the connection was lost
+ */
+int recv_sigs(uint32_t stream, struct ack_window *win, const struct client_settings *set, struct delta_index *index);
+
+/**
+ * send_literal
+ * <p>
+ * Send bytes of a delta stream's file that no block of the base file holds, in data frames of up
+ * to CHUNK_SIZE bytes.
+ * </p>
+ * @param stream - uint32_t: the stream
+ * @param data - uint8_t *: the bytes
+ * @param len - uint64_t: the number of bytes
+ * @param hash - sha256_ctx *: the hash of the whole file, to which the bytes are added
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes through which data is compressed
+ * @param skip - unsigned int *: the number of frames of the file left to send without compressing
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_literal(uint32_t stream, const uint8_t *data, uint64_t len, struct sha256_ctx *hash, char *chunk,
+                 unsigned int *skip, const struct client_settings *set);
+
+/**
+ * send_data
+ * <p>
+ * Send a data frame, compressed if the server allows it and the data shrinks enough. After data
+ * that does not, the next COMPRESS_SKIP frames of the file are sent as they are.
+ * </p>
+ * @param stream - uint32_t: the stream
+ * @param data - char *: the data, at most CHUNK_SIZE bytes
+ * @param len - size_t: the number of bytes of data
+ * @param chunk - char *: buffer of CHUNK_BUF_SIZE bytes, whose part past CHUNK_SIZE is used to
+ *                compress the data
+ * @param skip - unsigned int *: the number of frames of the file left to send without compressing
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_data(uint32_t stream, const char *data, size_t len, char *chunk, unsigned int *skip,
+              const struct client_settings *set);
+
+/**
+ * hash_file
+ * <p>
+ * Take the digest of a whole file, then rewind it to be sent.
+ * </p>
+ * @param fd - int: file descriptor for the file
+ * @param chunk - char *: buffer of CHUNK_SIZE bytes through which the file is read
+ * @param digest - uint8_t[]: the buffer to hold the digest, of PROTO_DIGEST_SIZE bytes
+ */
+void hash_file(int fd, char *chunk, uint8_t digest[PROTO_DIGEST_SIZE]);
+
+/**
+ * make_transfer_id
+ * <p>
+ * Derive a file's transfer ID from its path, size, modification time and inode, so the file gets
+ * the same ID each time it is sent until it changes.
+ * </p>
+ * @param file_name - char*: the file name
+ * @param st - stat *: the file's status
+ * @param id - uint8_t[]: the buffer to hold the ID, of PROTO_TRANSFER_ID_SIZE bytes
+ */
+void make_transfer_id(const char *file_name, const struct stat *st, uint8_t id[PROTO_TRANSFER_ID_SIZE]);
+
+/**
+ * make_stripe_id
+ * <p>
+ * Derive the transfer ID naming the stripes of a file. Unlike a resumable stream's, it differs
+ * between runs of the client and between times the file is named, so stripes of two sends of one
+ * file are never taken for parts of the same upload.
+ * </p>
+ * @param file_name - char*: the file name
+ * @param st - stat *: the file's status
+ * @param arg - int: the position of the file among the command line arguments
+ * @param id - uint8_t[]: the buffer to hold the ID, of PROTO_TRANSFER_ID_SIZE bytes
+ */
+void make_stripe_id(const char *file_name, const struct stat *st, int arg, uint8_t id[PROTO_TRANSFER_ID_SIZE]);
+
+/**
+ * drop_stream
+ * <p>
+ * Close a file whose stream was cut off by a lost connection. A file that is not a regular file
+ * cannot be read again, so losing its stream ends the client.
+ * </p>
+ * @param fd - int: file descriptor for the file
+ * @param size - uint64_t: the size of the file, or PROTO_SIZE_UNKNOWN
+ * @return -1
+ */
+int drop_stream(int fd, uint64_t size);
+
+/**
+ * collect_acks
+ * <p>
+ * Receive every acknowledgement that has already arrived, then keep waiting for more until no
+ * more than max_pending files are unacknowledged.
+ * </p>
+ * @param win - ack_window *: the files not yet acknowledged
+ * @param max_pending - size_t: the most files that may be left unacknowledged
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the connection was lost
+ */
+int collect_acks(struct ack_window *win, size_t max_pending, const struct client_settings *set);
+
+/**
+ * recv_reply
+ * <p>
+ * Receive one frame from the server: an acknowledgement, whose file is taken out of the window
+ * and recorded in the manifest if the client keeps one, or the answer to an open that carried a transfer ID or digest or opened a delta. The block size
+ * and signatures following a PROTO_FRAME_SIGS are left for the caller to receive.
+ * </p>
+ * @param win - ack_window *: the files not yet acknowledged
+ * @param stream - uint32_t *: pointer to the memory to hold the frame's stream
+ * @param len - uint64_t *: pointer to the memory to hold the frame's len field
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return the type of the frame, or 0 if the connection was lost
+ */
+int recv_reply(struct ack_window *win, uint32_t *stream, uint64_t *len, const struct client_settings *set);
+
+/**
+ * send_frame
+ * <p>
+ * Send a v2 frame header and its payload together.
+ * </p>
+ * @param type - enum proto_frame: the type of the frame
+ * @param flags - uint8_t: the frame's flags
+ * @param stream - uint32_t: the stream
+ * @param len - uint64_t: the frame's len field
+ * @param payload - void *: the bytes following the header, or NULL
+ * @param payload_len - size_t: the number of bytes of payload
+ * @param set - client_settings *: pointer to the settings for this client
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_frame(enum proto_frame type, uint8_t flags, uint32_t stream, uint64_t len, const void *payload,
+               size_t payload_len, const struct client_settings *set);
+
+/**
+ * send_all
+ * <p>
+ * Send every byte of a list of buffers, however many calls it takes.
+ * </p>
+ * @param fd - int: the socket
+ * @param iov - iovec *: the buffers, which are used up
+ * @param iov_cnt - int: the number of buffers
+ * @return 0 on success, -1 if the connection was lost
+ */
+int send_all(int fd, struct iovec *iov, int iov_cnt);
+
+/**
+ * recv_all
+ * <p>
+ * Receive exactly len bytes.
+ * </p>
+ * @param fd - int: the socket
+ * @param buf - void *: the buffer to hold the bytes
+ * @param len - size_t: the number of bytes
+ * @return 0 on success, -1 if the connection was closed or lost first
+ */
+int recv_all(int fd, void *buf, size_t len);
+
 /**
  * send_file_name
  * <p>
@@ -27,55 +621,1329 @@
  */
 void send_file_name(const char *file_name, const struct client_settings *set);
 
-/**
- * get_f_data_len
- * <p>
- * Get the length of the file at file_name.
- * </p>
- * @param file_name - char *: the name of the file for which to get the length
- * @return the length of the file
- */
-uint32_t get_f_data_len(const char *file_name);
+/**
+ * send_file_data
+ * <p>
+ * Send the file data to the server:
+ * <ol>
+ * <li>Get the size of the file (f_data_len),</li>
+ * <li>Send 4 bytes as the length of the file,</li>
+ * <li>Send f_data_len bytes of the file, straight from the page cache with sendfile or, if the
+ * client was told to, with MSG_ZEROCOPY.</li>
+ * </ol>
+ * </p>
+ * @param file_name - char*: the file name
+ * @param set - client_settings *: pointer to the settings for this client
+ */
+void send_file_data(const char *file_name, const struct client_settings *set);
+
+void send_files(int argc, char *argv[], struct client_settings *set)
+{
+    struct watch *watch = NULL;
+
+    // A server that only speaks v1 drops the connection at the hello, so start over in v1
+    if (set->version >= 2 && negotiate(set) == -1)
+    {
+        printf("Server only speaks protocol v1\n");
+        close(set->server_fd);
+        connect_client(set);
+        set->version = 1;
+    }
+    if (set->connections > 1 && !(set->features & PROTO_FEATURE_STRIPE))
+    {
+        printf("Server does not take files over several connections; using one\n");
+        set->connections = 1;
+    }
+    // Only a file the server acknowledged is known to be stored, so there is nothing to record without acknowledgements
+    if (set->manifest_dir != NULL && !(set->features & PROTO_FEATURE_ACK))
+    {
+        printf("Server does not acknowledge files; sending every file without a manifest\n");
+    } else if (set->manifest_dir != NULL
+               && (set->manifest = manifest_open(set->manifest_dir, set->server_ip, set->server_port)) == NULL)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Another client is using the manifest for this server", 4);
+    }
+
+    // Directories are watched before they are sent, so a file written while they are is sent again
+    if (set->watch)
+    {
+        watch = open_watch(argc, argv, set->debounce);
+    }
+    if (set->version < 2)
+    {
+        send_v1(argc, argv, set);
+    } else
+    {
+        send_lanes(argc, argv, set);
+    }
+    if (watch != NULL)
+    {
+        send_changes(watch, set);
+        watch_close(watch);
+    }
+    if (set->manifest != NULL)
+    {
+        manifest_close(set->manifest);
+        set->manifest = NULL;
+    }
+    optind = argc;
+}
+
+void send_v1(int argc, char *argv[], const struct client_settings *set)
+{
+    for (int arg = optind; arg < argc; ++arg)
+    {
+        struct stat st;
+        struct walk *walk;
+        char *path;
+        size_t name_off;
+
+        if (stat(argv[arg], &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (!S_ISDIR(st.st_mode))
+        {
+            send_file_name(argv[arg] + name_offset(NULL, 0, argv[arg]), set);
+
+            send_file_data(argv[arg], set);
+
+            printf("Sent to server: %s\n", argv[arg]);
+        } else
+        {
+            walk = walk_open(&argv[arg], 1);
+            while ((path = walk_next(walk, &name_off)) != NULL)
+            {
+                send_file_name(path + name_off, set);
+                send_file_data(path, set);
+                printf("Sent to server: %s\n", path);
+                free(path);
+            }
+            walk_close(walk);
+        }
+    }
+}
+
+void send_lanes(int argc, char *argv[], struct client_settings *set)
+{
+    struct lane *lanes;
+
+    lanes = open_lanes(argc, argv, set);
+    for (unsigned int i = 1; i < set->connections; ++i)
+    {
+        int err;
+
+        if ((err = pthread_create(&lanes[i].thread, NULL, run_lane, &lanes[i])) != 0)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+        }
+    }
+    // The first connection is the one the client opened, so its files are sent from here
+    send_jobs(&lanes[0]);
+    set->server_fd = lanes[0].set.server_fd;
+    free(lanes[0].jobs);
+    for (unsigned int i = 1; i < set->connections; ++i)
+    {
+        pthread_join(lanes[i].thread, NULL);
+        close(lanes[i].set.server_fd);
+        free(lanes[i].jobs);
+    }
+    if (lanes[0].walk != NULL)
+    {
+        walk_close(lanes[0].walk);
+    }
+    free(lanes);
+}
+
+struct watch *open_watch(int argc, char *argv[], unsigned int debounce)
+{
+    struct watch *watch;
+    char **roots;
+    size_t n_roots = 0;
+
+    if ((roots = (char **) malloc((size_t) (argc - optind) * sizeof(char *))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (int arg = optind; arg < argc; ++arg)
+    {
+        struct stat st;
+
+        if (stat(argv[arg], &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            roots[n_roots++] = argv[arg];
+        }
+    }
+    if (n_roots == 0)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Watching needs a directory to watch", 2);
+    }
+    watch = watch_open(roots, n_roots, debounce);
+    free(roots);
+    return watch;
+}
+
+void send_changes(struct watch *watch, struct client_settings *set)
+{
+    struct ack_window win = {NULL, 0, 0};
+    struct sigaction sa;
+    struct job job;
+    char *chunk;
+    char *path;
+    size_t name_off;
+    uint32_t stream = 0;
+    unsigned int retries = set->retries;
+
+    // Blocking calls are restarted, so only the wait for changes notices the signal
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sa.sa_handler = stop_watching;
+    watching = 1;
+    if (sigaction(SIGINT, &sa, NULL) == -1 || sigaction(SIGTERM, &sa, NULL) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 2);
+    }
+
+    if ((chunk = (char *) malloc(CHUNK_BUF_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if (set->features & PROTO_FEATURE_ACK)
+    {
+        win.cap = set->window;
+        if ((win.files = (struct unacked *) malloc(win.cap * sizeof(struct unacked))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+    }
+    memset(&job, 0, sizeof(struct job)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+
+    printf("Watching for changes\n");
+    while (watching)
+    {
+        struct pollfd pfds[2];
+
+        pfds[0].fd = watch_fd(watch);
+        pfds[0].events = POLLIN;
+        pfds[1].fd = set->server_fd;
+        pfds[1].events = POLLIN;
+        if (poll(pfds, 2, watch_timeout(watch)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (pfds[0].revents & POLLIN)
+        {
+            watch_read(watch);
+        }
+        // Nothing but acknowledgements is sent unasked, so with none owed the server can only have closed the connection
+        if (pfds[1].revents != 0 && (win.n == 0 || collect_acks(&win, win.cap, set) == -1))
+        {
+            if (set->version < 2)
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "Lost the connection to the server", 4);
+            }
+            resume_connection(&win, chunk, &retries, set);
+        }
+
+        while ((path = watch_next(watch, &name_off)) != NULL)
+        {
+            if (set->version < 2)
+            {
+                send_file_name(path + name_off, set);
+                send_file_data(path, set);
+                printf("Sent to server: %s\n", path);
+            } else
+            {
+                job.file_name = path;
+                job.name_off = name_off;
+                send_job(&job, stream++, chunk, &win, &retries, set);
+                retries = set->retries;
+            }
+            free(path);
+        }
+    }
+
+    printf("Stopped watching\n");
+    while (win.cap > 0 && collect_acks(&win, 0, set) == -1)
+    {
+        resume_connection(&win, chunk, &retries, set);
+    }
+    free(win.files);
+    free(chunk);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+void stop_watching(int sig)
+{
+    watching = 0;
+}
+
+#pragma GCC diagnostic pop
+
+struct lane *open_lanes(int argc, char *argv[], const struct client_settings *set)
+{
+    struct lane *lanes;
+    struct walk *walk = NULL;
+    char **roots;
+    size_t n_roots = 0;
+    unsigned int next = 0;
+    int striping = !(set->features & (PROTO_FEATURE_HAVE | PROTO_FEATURE_DELTA | PROTO_FEATURE_RESUME));
+
+    if ((lanes = (struct lane *) calloc(set->connections, sizeof(struct lane))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (unsigned int i = 0; i < set->connections; ++i)
+    {
+        lanes[i].set = *set;
+        if (i == 0)
+        {
+            continue;
+        }
+        connect_client(&lanes[i].set);
+        if (negotiate(&lanes[i].set) == -1 || lanes[i].set.features != set->features)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "Server granted different features to another connection", 4);
+        }
+    }
+
+    if ((roots = (char **) malloc((size_t) (argc - optind) * sizeof(char *))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (int arg = optind; arg < argc; ++arg)
+    {
+        struct job job;
+        struct stat st;
+
+        memset(&job, 0, sizeof(struct job)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        job.file_name = argv[arg];
+        job.name_off = name_offset(NULL, 0, argv[arg]);
+        if (stat(argv[arg], &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            roots[n_roots++] = argv[arg];
+            continue;
+        }
+        if (set->connections == 1)
+        {
+            add_job(&lanes[0], &job);
+            continue;
+        }
+        if (!striping || !S_ISREG(st.st_mode) || (uint64_t) st.st_size < STRIPE_MIN_SIZE)
+        {
+            add_job(&lanes[next], &job);
+            next = (next + 1) % set->connections;
+            continue;
+        }
+
+        // Every stripe of a file is checked here, so it is sent whole or not at all
+        if (set->manifest != NULL)
+        {
+            manifest_describe(set->manifest, argv[arg], &st, &job.entry);
+            if (manifest_unchanged(set->manifest, &job.entry))
+            {
+                printf("Unchanged since last sent: %s\n", argv[arg]);
+                continue;
+            }
+        }
+        // Stripes end on chunk boundaries, so every data frame but a stripe's last is full
+        job.striped = 1;
+        job.size = (uint64_t) st.st_size;
+        job.len = (job.size + set->connections - 1) / set->connections;
+        job.len = (job.len + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+        make_stripe_id(argv[arg], &st, arg, job.transfer_id);
+        for (unsigned int i = 0; i < set->connections && job.offset < job.size; ++i)
+        {
+            struct job stripe = job;
+
+            stripe.len = job.size - job.offset < job.len ? job.size - job.offset : job.len;
+            add_job(&lanes[i], &stripe);
+            job.offset += stripe.len;
+        }
+    }
+
+    // The readers start at once, so the first files found are ready by the time the named ones are sent
+    if (n_roots > 0)
+    {
+        walk = walk_open(roots, n_roots);
+    }
+    for (unsigned int i = 0; i < set->connections; ++i)
+    {
+        lanes[i].walk = walk;
+    }
+    free(roots);
+    return lanes;
+}
+
+void add_job(struct lane *lane, const struct job *job)
+{
+    if (lane->n == lane->cap)
+    {
+        lane->cap = lane->cap == 0 ? DEFAULT_JOBS : lane->cap * 2;
+        if ((lane->jobs = (struct job *) realloc(lane->jobs, lane->cap * sizeof(struct job))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+    }
+    lane->jobs[lane->n++] = *job;
+}
+
+void *run_lane(void *arg)
+{
+    send_jobs((struct lane *) arg);
+    return NULL;
+}
+
+void send_jobs(struct lane *lane)
+{
+    struct client_settings *set = &lane->set;
+    struct ack_window win = {NULL, 0, 0};
+    char *chunk;
+    uint32_t stream = 0;
+    unsigned int retries = set->retries;
+
+    if ((chunk = (char *) malloc(CHUNK_BUF_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if (set->features & PROTO_FEATURE_ACK)
+    {
+        win.cap = set->window;
+        if ((win.files = (struct unacked *) malloc(win.cap * sizeof(struct unacked))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+    }
+
+    for (size_t i = 0; i < lane->n; ++i)
+    {
+        send_job(&lane->jobs[i], stream++, chunk, &win, &retries, set);
+    }
+    if (lane->walk != NULL)
+    {
+        struct job job;
+        char *path;
+
+        memset(&job, 0, sizeof(struct job)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        while ((path = walk_next(lane->walk, &job.name_off)) != NULL)
+        {
+            job.file_name = path;
+            send_job(&job, stream++, chunk, &win, &retries, set);
+            free(path);
+        }
+    }
+    while (win.cap > 0 && collect_acks(&win, 0, set) == -1)
+    {
+        resume_connection(&win, chunk, &retries, set);
+    }
+    free(win.files);
+    free(chunk);
+}
+
+int negotiate(struct client_settings *set)
+{
+    uint8_t hello[sizeof(uint16_t) + PROTO_HELLO_SIZE];
+    uint8_t answer[PROTO_HELLO_SIZE];
+    struct iovec iov;
+    uint32_t magic = htonl(PROTO_MAGIC);
+    uint16_t version = htons((uint16_t) set->version);
+    uint16_t features = htons((set->window > 0 ? PROTO_FEATURE_ACK : 0) | (set->retries > 0 ? PROTO_FEATURE_RESUME : 0)
+                              | (set->skip_stored ? PROTO_FEATURE_HAVE : 0) | (set->delta ? PROTO_FEATURE_DELTA : 0)
+                              | (set->compress ? PROTO_FEATURE_COMPRESS : 0)
+                              | (set->connections > 1 ? PROTO_FEATURE_STRIPE : 0));
+
+    // A zero name length, which no v1 file has, then the magic, version and features
+    memset(hello, 0, sizeof(uint16_t)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    memcpy(hello + sizeof(uint16_t), &magic, sizeof(uint32_t));
+    memcpy(hello + sizeof(uint16_t) + sizeof(uint32_t), &version, sizeof(uint16_t));
+    memcpy(hello + 2 * sizeof(uint16_t) + sizeof(uint32_t), &features, sizeof(uint16_t));
+    iov.iov_base = hello;
+    iov.iov_len = sizeof(hello);
+    if (send_all(set->server_fd, &iov, 1) == -1)
+    {
+        return -1;
+    }
+
+    if (recv_all(set->server_fd, answer, sizeof(answer)) == -1)
+    {
+        return -1;
+    }
+    memcpy(&magic, answer, sizeof(uint32_t));
+    memcpy(&version, answer + sizeof(uint32_t), sizeof(uint16_t));
+    memcpy(&set->features, answer + sizeof(uint32_t) + sizeof(uint16_t), sizeof(uint16_t));
+    if (ntohl(magic) != PROTO_MAGIC || ntohs(version) < 2)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server answered the hello with nonsense", 4);
+    }
+    set->version = ntohs(version) < set->version ? ntohs(version) : set->version;
+    set->features = ntohs(set->features) & ntohs(features);
+    return 0;
+}
+
+void send_job(const struct job *job, uint32_t stream, char *chunk, struct ack_window *win, unsigned int *retries,
+              struct client_settings *set)
+{
+    struct manifest_file entry = job->entry;
+    uint64_t sent = job->len;
+    int record = job->striped;
+
+    if (set->manifest != NULL && !job->striped)
+    {
+        struct stat st;
+
+        // Only a regular file's status says whether its content changed
+        if (stat(job->file_name, &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (S_ISREG(st.st_mode))
+        {
+            manifest_describe(set->manifest, job->file_name, &st, &entry);
+            if (manifest_unchanged(set->manifest, &entry))
+            {
+                printf("Unchanged since last sent: %s\n", job->file_name);
+                return;
+            }
+            record = 1;
+        }
+    }
+
+    if (win->cap > 0 && collect_acks(win, win->cap - 1, set) == -1)
+    {
+        resume_connection(win, chunk, retries, set);
+    }
+    // A file cut off is sent again on the new connection, from where the server left off if resumable
+    while ((job->striped ? send_stripe(job, stream, chunk, set)
+                         : send_stream(job->file_name, job->file_name + job->name_off, stream, chunk, win, set, &sent,
+                                       entry.digest)) == -1)
+    {
+        resume_connection(win, chunk, retries, set);
+    }
+    if (win->cap > 0)
+    {
+        // Each file gets its own stream, so every acknowledgement names exactly one file
+        win->files[win->n].stream = stream;
+        if ((win->files[win->n].file_name = strdup(job->file_name)) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        win->files[win->n].len = sent;
+        win->files[win->n].record = set->manifest != NULL && record;
+        win->files[win->n].entry = entry;
+        win->files[win->n].job = *job;
+        win->files[win->n].job.file_name = win->files[win->n].file_name;
+        ++win->n;
+    }
+
+    if (job->striped)
+    {
+        printf("Sent to server: %s, bytes %llu to %llu\n", job->file_name, // NOLINT(google-runtime-int) : printf
+               (unsigned long long) job->offset, (unsigned long long) (job->offset + job->len));
+    } else
+    {
+        printf("Sent to server: %s\n", job->file_name);
+    }
+}
+
+void resume_connection(struct ack_window *win, char *chunk, unsigned int *retries, struct client_settings *set)
+{
+    uint16_t features = set->features;
+    struct unacked *lost = NULL;
+    size_t n_lost = win->n;
+
+    // Taken out of the window, which acknowledgements on the new connection rearrange as they arrive
+    if (n_lost > 0)
+    {
+        if ((lost = (struct unacked *) malloc(n_lost * sizeof(struct unacked))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        memcpy(lost, win->files, n_lost * sizeof(struct unacked));
+    }
+    win->n = 0;
+
+    do
+    {
+        if (*retries == 0)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "Lost the connection to the server", 4);
+        }
+        --*retries;
+        printf("Lost the connection to the server; reconnecting.\n");
+        sleep(RETRY_DELAY);
+    } while (reconnect_client(set) == -1 || negotiate(set) == -1);
+
+    // The window was sized for the features granted the first time
+    if (set->features != features)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server granted different features after reconnecting", 4);
+    }
+
+    // Each keeps its stream, which no other file sent on the new connection uses
+    for (size_t i = 0; i < n_lost; ++i)
+    {
+        if (lost[i].job.striped)
+        {
+            printf("Not acknowledged before the connection was lost: %s\n", lost[i].file_name);
+        } else
+        {
+            printf("Not acknowledged before the connection was lost; sending again: %s\n", lost[i].file_name);
+            send_job(&lost[i].job, lost[i].stream, chunk, win, retries, set);
+        }
+        free(lost[i].file_name);
+    }
+    free(lost);
+}
+
+int send_stream(const char *file_name, const char *name, uint32_t stream, char *chunk, struct ack_window *win,
+                const struct client_settings *set, uint64_t *sent, uint8_t digest[PROTO_DIGEST_SIZE])
+{
+    struct sha256_ctx hash;
+    struct stat st;
+    uint64_t size;
+    uint64_t offset = 0;
+    uint64_t pos = 0;
+    uint8_t flags = 0;
+    unsigned int skip = 0;
+    int fd;
+
+    if ((fd = open(file_name, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    size = S_ISREG(st.st_mode) ? (uint64_t) st.st_size : PROTO_SIZE_UNKNOWN;
+    memset(digest, 0, PROTO_DIGEST_SIZE); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    if ((set->features & PROTO_FEATURE_DELTA) && size != PROTO_SIZE_UNKNOWN && size >= DELTA_MIN_SIZE)
+    {
+        if (send_delta(fd, file_name, name, size, stream, chunk, win, set, digest) == -1)
+        {
+            return drop_stream(fd, size);
+        }
+        close(fd);
+        *sent = size;
+        return 0;
+    }
+    if ((set->features & PROTO_FEATURE_HAVE) && size != PROTO_SIZE_UNKNOWN)
+    {
+        flags |= PROTO_FLAG_HASH;
+        hash_file(fd, chunk, digest);
+    }
+    if ((set->features & PROTO_FEATURE_RESUME) && size != PROTO_SIZE_UNKNOWN && size >= RESUME_MIN_SIZE)
+    {
+        flags |= PROTO_FLAG_RESUME;
+        sha256_init(&hash);
+    }
+
+    if (flags != 0)
+    {
+        int ret_val;
+
+        if ((ret_val = open_announced(file_name, name, &st, stream, flags, digest, win, set, &offset)) == -1)
+        {
+            return drop_stream(fd, size);
+        }
+        if (ret_val == 1)
+        {
+            printf("Already stored by server: %s\n", file_name);
+            close(fd);
+            *sent = size;
+            return 0;
+        }
+    } else if (send_frame(PROTO_FRAME_OPEN, 0, stream, size, name, strlen(name), set) == -1)
+    {
+        return drop_stream(fd, size);
+    }
+
+    if (size != PROTO_SIZE_UNKNOWN && !(flags & PROTO_FLAG_RESUME) && !(set->features & PROTO_FEATURE_COMPRESS))
+    {
+        if (send_raw(fd, 0, size, stream, set) == -1)
+        {
+            return drop_stream(fd, size);
+        }
+        pos = size;
+    }
+    // A hashed file's digest is already taken, so what the server already holds is not read at all
+    if ((flags & PROTO_FLAG_HASH) && offset > 0)
+    {
+        if (lseek(fd, (off_t) offset, SEEK_SET) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        pos = offset;
+    }
+    while (pos < size)
+    {
+        // What the server already holds is read only to be hashed
+        uint64_t end = pos < offset ? offset : size;
+        size_t len = end - pos < CHUNK_SIZE ? (size_t) (end - pos) : CHUNK_SIZE;
+        ssize_t ret_val;
+
+        if ((ret_val = read(fd, chunk, len)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ret_val == 0)
+        {
+            if (size != PROTO_SIZE_UNKNOWN)
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "File shrank while being sent", 4);
+            }
+            break;
+        }
+        if (flags == PROTO_FLAG_RESUME)
+        {
+            sha256_update(&hash, chunk, (size_t) ret_val);
+        }
+        if (pos >= offset && send_data(stream, chunk, (size_t) ret_val, chunk, &skip, set) == -1)
+        {
+            return drop_stream(fd, size);
+        }
+        pos += (uint64_t) ret_val;
+    }
+
+    if (flags & PROTO_FLAG_RESUME)
+    {
+        // A hashed file's digest was taken before it was sent
+        if (!(flags & PROTO_FLAG_HASH))
+        {
+            sha256_digest(&hash, digest);
+        }
+        if (send_frame(PROTO_FRAME_END, PROTO_FLAG_RESUME, stream, pos, digest, PROTO_DIGEST_SIZE, set) == -1)
+        {
+            return drop_stream(fd, size);
+        }
+    } else if (send_frame(PROTO_FRAME_END, 0, stream, pos, NULL, 0, set) == -1)
+    {
+        return drop_stream(fd, size);
+    }
+    close(fd);
+    *sent = pos;
+    return 0;
+}
+
+int send_stripe(const struct job *job, uint32_t stream, char *chunk, const struct client_settings *set)
+{
+    const char *name = job->file_name + job->name_off;
+    size_t name_len = strlen(name);
+    uint64_t be_offset = htobe64(job->offset);
+    uint64_t be_len = htobe64(job->len);
+    struct stat st;
+    unsigned int skip = 0;
+    char *payload;
+    int ret_val;
+    int fd;
+
+    if ((fd = open(job->file_name, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((uint64_t) st.st_size != job->size)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "File changed size while being sent in stripes", 4);
+    }
+
+    if ((payload = (char *) malloc(name_len + PROTO_STRIPE_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(payload, name, name_len);
+    memcpy(payload + name_len, job->transfer_id, PROTO_TRANSFER_ID_SIZE);
+    memcpy(payload + name_len + PROTO_TRANSFER_ID_SIZE, &be_offset, sizeof(uint64_t));
+    memcpy(payload + name_len + PROTO_TRANSFER_ID_SIZE + sizeof(uint64_t), &be_len, sizeof(uint64_t));
+    ret_val = send_frame(PROTO_FRAME_OPEN, PROTO_FLAG_STRIPE, stream, job->size, payload, name_len + PROTO_STRIPE_SIZE, set);
+    free(payload);
+    if (ret_val == -1)
+    {
+        return drop_stream(fd, job->size);
+    }
+
+    if (!(set->features & PROTO_FEATURE_COMPRESS))
+    {
+        if (send_raw(fd, job->offset, job->len, stream, set) == -1)
+        {
+            return drop_stream(fd, job->size);
+        }
+    } else
+    {
+        for (uint64_t pos = 0; pos < job->len;)
+        {
+            size_t len = job->len - pos < CHUNK_SIZE ? (size_t) (job->len - pos) : CHUNK_SIZE;
+            ssize_t got;
+
+            if ((got = pread(fd, chunk, len, (off_t) (job->offset + pos))) == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+            }
+            if (got == 0)
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "File shrank while being sent", 4);
+            }
+            if (send_data(stream, chunk, (size_t) got, chunk, &skip, set) == -1)
+            {
+                return drop_stream(fd, job->size);
+            }
+            pos += (uint64_t) got;
+        }
+    }
 
-/**
- * send_file_data
- * <p>
- * Send the file data to the server:
- * <ol>
- * <li>Get the size of the file (f_data_len),</li>
- * <li>Send 4 bytes as the length of the file,</li>
- * <li>Read the file information into a buffer of f_data_len size,</li>
- * <li>Send f_data_len bytes of buffer as the file.</li>
- * </ol>
- * </p>
- * @param file_name - char*: the file name
- * @param set - client_settings *: pointer to the settings for this client
- */
-void send_file_data(const char *file_name, const struct client_settings *set);
+    if (send_frame(PROTO_FRAME_END, 0, stream, job->len, NULL, 0, set) == -1)
+    {
+        return drop_stream(fd, job->size);
+    }
+    close(fd);
+    return 0;
+}
 
-/**
- * read_file
- * <p>
- * Creates a buffer of f_data_len size, then reads the file at file_name into that buffer.
- * </p>
- * @param file_name - char*: the file name
- * @param f_data_len - uint32_t: the length of the file
- * @param data_buffer - char **: pointer to buffer to hold file data
- */
-void read_file(const char *file_name, uint32_t f_data_len, char **file_data);
+int send_raw(int fd, uint64_t offset, uint64_t len, uint32_t stream, const struct client_settings *set)
+{
+    uint32_t pending = 0;
+    uint64_t pos = 0;
+    int ret_val = 0;
 
-void send_files(int argc, char *argv[], struct client_settings *set)
+    while (pos < len && ret_val == 0)
+    {
+        size_t n = len - pos < CHUNK_SIZE ? (size_t) (len - pos) : CHUNK_SIZE;
+
+        if ((ret_val = send_frame(PROTO_FRAME_DATA, 0, stream, n, NULL, 0, set)) == 0)
+        {
+            ret_val = set->zerocopy && n >= FSEND_ZEROCOPY_MIN
+                      ? fsend_zerocopy(set->server_fd, fd, offset + pos, n, &pending)
+                      : fsend_file(set->server_fd, fd, offset + pos, n);
+        }
+        pos += n;
+    }
+    // The kernel may still be sending from the file's pages
+    if (fsend_flush(set->server_fd, &pending) == -1)
+    {
+        ret_val = -1;
+    }
+    return ret_val;
+}
+
+int open_announced(const char *file_name, const char *name, const struct stat *st, uint32_t stream, uint8_t flags,
+                   const uint8_t digest[PROTO_DIGEST_SIZE], struct ack_window *win,
+                   const struct client_settings *set, uint64_t *offset)
+{
+    size_t name_len = strlen(name);
+    size_t payload_len = name_len;
+    uint32_t reply_stream;
+    char *payload;
+    int type;
+
+    if ((payload = (char *) malloc(name_len + PROTO_TRANSFER_ID_SIZE + PROTO_DIGEST_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(payload, name, name_len);
+    if (flags & PROTO_FLAG_RESUME)
+    {
+        make_transfer_id(file_name, st, (uint8_t *) payload + payload_len);
+        payload_len += PROTO_TRANSFER_ID_SIZE;
+    }
+    if (flags & PROTO_FLAG_HASH)
+    {
+        memcpy(payload + payload_len, digest, PROTO_DIGEST_SIZE);
+        payload_len += PROTO_DIGEST_SIZE;
+    }
+    if (send_frame(PROTO_FRAME_OPEN, flags, stream, (uint64_t) st->st_size, payload, payload_len, set) == -1)
+    {
+        free(payload);
+        return -1;
+    }
+    free(payload);
+
+    // Acknowledgements of earlier files may arrive before the answer
+    while ((type = recv_reply(win, &reply_stream, offset, set)) == PROTO_FRAME_ACK)
+    {
+    }
+    if (type == 0)
+    {
+        return -1;
+    }
+    if (reply_stream != stream || *offset > (uint64_t) st->st_size
+        || (type == PROTO_FRAME_HAVE && !(flags & PROTO_FLAG_HASH)))
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server answered an open that does not fit the file", 4);
+    }
+    if (type == PROTO_FRAME_HAVE)
+    {
+        return 1;
+    }
+    if (*offset > 0)
+    {
+        printf("Resuming %s from byte %llu\n", file_name, (unsigned long long) *offset); // NOLINT(google-runtime-int) : printf
+    }
+    return 0;
+}
+
+int send_delta(int fd, const char *file_name, const char *name, uint64_t size, uint32_t stream, char *chunk,
+               struct ack_window *win, const struct client_settings *set, uint8_t digest[PROTO_DIGEST_SIZE])
+{
+    struct delta_index index;
+    struct sha256_ctx hash;
+    const uint8_t *data;
+    uint64_t literal = 0;
+    uint64_t lit_start = 0;
+    uint64_t pos = 0;
+    uint32_t weak = 0;
+    unsigned int skip = 0;
+    int ret_val = 0;
+
+    if (send_frame(PROTO_FRAME_OPEN, PROTO_FLAG_DELTA, stream, size, name, strlen(name), set) == -1
+        || recv_sigs(stream, win, set, &index) == -1)
+    {
+        return -1;
+    }
+    // The checksum is rolled over the whole file, so it is mapped rather than read through a buffer
+    if ((data = (const uint8_t *) mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    madvise((void *) (uintptr_t) data, (size_t) size, MADV_SEQUENTIAL);
+
+    sha256_init(&hash);
+    if (index.blocks > 0 && size >= index.block_size)
+    {
+        weak = delta_weak(data, index.block_size);
+    }
+    while (ret_val == 0 && index.blocks > 0 && pos + index.block_size <= size)
+    {
+        size_t match = delta_find(&index, weak, data + pos);
+
+        if (match == DELTA_NO_MATCH)
+        {
+            if (pos + index.block_size < size)
+            {
+                weak = delta_roll(weak, data[pos], data[pos + index.block_size], index.block_size);
+            }
+            // A long run of changed bytes goes out as it is found, not once it ends
+            if (++pos - lit_start == CHUNK_SIZE)
+            {
+                ret_val = send_literal(stream, data + lit_start, pos - lit_start, &hash, chunk, &skip, set);
+                literal += pos - lit_start;
+                lit_start = pos;
+            }
+            continue;
+        }
+
+        ret_val = send_literal(stream, data + lit_start, pos - lit_start, &hash, chunk, &skip, set);
+        literal += pos - lit_start;
+        if (ret_val == 0)
+        {
+            ret_val = send_frame(PROTO_FRAME_COPY, 0, stream, (uint64_t) match, NULL, 0, set);
+        }
+        sha256_update(&hash, data + pos, index.block_size);
+        pos += index.block_size;
+        lit_start = pos;
+        if (pos + index.block_size <= size)
+        {
+            weak = delta_weak(data + pos, index.block_size);
+        }
+    }
+    if (ret_val == 0)
+    {
+        ret_val = send_literal(stream, data + lit_start, size - lit_start, &hash, chunk, &skip, set);
+        literal += size - lit_start;
+    }
+    munmap((void *) (uintptr_t) data, (size_t) size);
+    delta_index_close(&index);
+
+    sha256_digest(&hash, digest);
+    if (ret_val == -1 || send_frame(PROTO_FRAME_END, PROTO_FLAG_DELTA, stream, size, digest, PROTO_DIGEST_SIZE, set) == -1)
+    {
+        return -1;
+    }
+    printf("Sent %s as a delta: %llu of %llu bytes literal\n", file_name, (unsigned long long) literal, // NOLINT(google-runtime-int) : printf
+           (unsigned long long) size);
+    return 0;
+}
+
+int recv_sigs(uint32_t stream, struct ack_window *win, const struct client_settings *set, struct delta_index *index)
+{
+    uint64_t base_size;
+    uint32_t reply_stream;
+    uint32_t block_size;
+    uint8_t *sigs;
+    size_t blocks;
+    int type;
+
+    // Acknowledgements of earlier files may arrive before the answer
+    while ((type = recv_reply(win, &reply_stream, &base_size, set)) == PROTO_FRAME_ACK)
+    {
+    }
+    if (type == 0)
+    {
+        return -1;
+    }
+    if (type != PROTO_FRAME_SIGS || reply_stream != stream)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server answered an open that does not fit the file", 4);
+    }
+    if (recv_all(set->server_fd, &block_size, sizeof(uint32_t)) == -1)
+    {
+        return -1;
+    }
+    if ((block_size = ntohl(block_size)) == 0)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server sent signatures of blocks of no size", 4);
+    }
+
+    blocks = (size_t) (base_size / block_size);
+    if ((sigs = (uint8_t *) malloc(blocks * PROTO_SIG_SIZE + 1)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if (recv_all(set->server_fd, sigs, blocks * PROTO_SIG_SIZE) == -1)
+    {
+        free(sigs);
+        return -1;
+    }
+    delta_index_open(index, sigs, blocks, block_size);
+    return 0;
+}
+
+int send_literal(uint32_t stream, const uint8_t *data, uint64_t len, struct sha256_ctx *hash, char *chunk,
+                 unsigned int *skip, const struct client_settings *set)
+{
+    sha256_update(hash, data, (size_t) len);
+    while (len > 0)
+    {
+        size_t n = len < CHUNK_SIZE ? (size_t) len : CHUNK_SIZE;
+
+        if (send_data(stream, (const char *) data, n, chunk, skip, set) == -1)
+        {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int send_data(uint32_t stream, const char *data, size_t len, char *chunk, unsigned int *skip,
+              const struct client_settings *set)
+{
+    char *pack = chunk + CHUNK_SIZE;
+    size_t pack_len;
+    uint32_t raw_len;
+
+    if (!(set->features & PROTO_FEATURE_COMPRESS) || len < COMPRESS_MIN_SIZE)
+    {
+        return send_frame(PROTO_FRAME_DATA, 0, stream, len, data, len, set);
+    }
+    if (*skip > 0)
+    {
+        --*skip;
+        return send_frame(PROTO_FRAME_DATA, 0, stream, len, data, len, set);
+    }
+
+    pack_len = sizeof(uint32_t) + lz_compress(data, len, pack + sizeof(uint32_t));
+    if (pack_len > len - len / COMPRESS_MIN_SAVING)
+    {
+        // Already compressed or random; the server would spend more decompressing than the link saves
+        *skip = COMPRESS_SKIP;
+        return send_frame(PROTO_FRAME_DATA, 0, stream, len, data, len, set);
+    }
+    raw_len = htonl((uint32_t) len);
+    memcpy(pack, &raw_len, sizeof(uint32_t));
+    return send_frame(PROTO_FRAME_DATA, PROTO_FLAG_COMPRESSED, stream, pack_len, pack, pack_len, set);
+}
+
+void hash_file(int fd, char *chunk, uint8_t digest[PROTO_DIGEST_SIZE])
 {
-    while (argc > optind)
+    struct sha256_ctx hash;
+    ssize_t ret_val;
+
+    sha256_init(&hash);
+    while ((ret_val = read(fd, chunk, CHUNK_SIZE)) != 0)
+    {
+        if (ret_val == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        sha256_update(&hash, chunk, (size_t) ret_val);
+    }
+    sha256_digest(&hash, digest);
+    if (lseek(fd, 0, SEEK_SET) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+void make_transfer_id(const char *file_name, const struct stat *st, uint8_t id[PROTO_TRANSFER_ID_SIZE])
+{
+    struct sha256_ctx hash;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint64_t meta[5];   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : The fields below
+    char *path;
+
+    if ((path = realpath(file_name, NULL)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    meta[0] = (uint64_t) st->st_size;
+    meta[1] = (uint64_t) st->st_mtim.tv_sec;
+    meta[2] = (uint64_t) st->st_mtim.tv_nsec;
+    meta[3] = (uint64_t) st->st_dev;
+    meta[4] = (uint64_t) st->st_ino;    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : The fields above
+
+    sha256_init(&hash);
+    sha256_update(&hash, path, strlen(path) + 1);
+    sha256_update(&hash, meta, sizeof(meta));
+    sha256_digest(&hash, digest);
+    memcpy(id, digest, PROTO_TRANSFER_ID_SIZE);
+    free(path);
+}
+
+void make_stripe_id(const char *file_name, const struct stat *st, int arg, uint8_t id[PROTO_TRANSFER_ID_SIZE])
+{
+    struct sha256_ctx hash;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint64_t salt[2];
+
+    make_transfer_id(file_name, st, id);
+    salt[0] = (uint64_t) getpid();
+    salt[1] = (uint64_t) arg;
+
+    sha256_init(&hash);
+    sha256_update(&hash, id, PROTO_TRANSFER_ID_SIZE);
+    sha256_update(&hash, salt, sizeof(salt));
+    sha256_digest(&hash, digest);
+    memcpy(id, digest, PROTO_TRANSFER_ID_SIZE);
+}
+
+int drop_stream(int fd, uint64_t size)
+{
+    close(fd);
+    if (size == PROTO_SIZE_UNKNOWN)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Lost the connection to the server while sending a file that cannot be read again", 4);
+    }
+    return -1;
+}
+
+int collect_acks(struct ack_window *win, size_t max_pending, const struct client_settings *set)
+{
+    for (;;)
+    {
+        struct pollfd pfd;
+        uint32_t stream;
+        uint64_t len;
+        int ready;
+        int type;
+
+        pfd.fd = set->server_fd;
+        pfd.events = POLLIN;
+        if ((ready = poll(&pfd, 1, win->n > max_pending ? -1 : 0)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ready == 0)
+        {
+            return 0;
+        }
+        if (win->n == 0)
+        {
+            // Nothing is owed, so the server can only be closing the connection
+            return 0;
+        }
+        if ((type = recv_reply(win, &stream, &len, set)) == 0)
+        {
+            return -1;
+        }
+        if (type != PROTO_FRAME_ACK)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "Server answered an open it was not waiting on", 4);
+        }
+    }
+}
+
+int recv_reply(struct ack_window *win, uint32_t *stream, uint64_t *len, const struct client_settings *set)
+{
+    uint8_t hdr[PROTO_FRAME_SIZE];
+    uint16_t name_len;
+    char *save_name;
+    size_t i;
+
+    if (recv_all(set->server_fd, hdr, sizeof(hdr)) == -1)
+    {
+        return 0;
+    }
+    memcpy(&name_len, hdr + 2, sizeof(uint16_t));
+    memcpy(stream, hdr + 4, sizeof(uint32_t));     // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+    memcpy(len, hdr + 8, sizeof(uint64_t));        // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+    name_len = ntohs(name_len);
+    *stream = ntohl(*stream);
+    *len = be64toh(*len);
+    // Signatures are left for the caller to read
+    if (hdr[0] == PROTO_FRAME_OFFSET || hdr[0] == PROTO_FRAME_HAVE || hdr[0] == PROTO_FRAME_SIGS)
+    {
+        return hdr[0];
+    }
+    if (hdr[0] != PROTO_FRAME_ACK)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server sent a frame of unknown type", 4);
+    }
+
+    if ((save_name = (char *) calloc(name_len + 1, sizeof(char))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if (recv_all(set->server_fd, save_name, name_len) == -1)
+    {
+        free(save_name);
+        return 0;
+    }
+
+    for (i = 0; i < win->n && win->files[i].stream != *stream; ++i)
+    {
+    }
+    if (i == win->n)
     {
-        send_file_name(argv[optind], set);
+        fatal_message(__FILE__, __func__, __LINE__, "Server acknowledged a file that was not sent", 4);
+    }
+    if (*len != win->files[i].len)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Server stored a different number of bytes than were sent", 4);
+    }
+    printf("Stored by server: %s as %s\n", win->files[i].file_name, save_name);
+    if (win->files[i].record)
+    {
+        manifest_record(set->manifest, &win->files[i].entry);
+    }
+    free(win->files[i].file_name);
+    win->files[i] = win->files[--win->n];
+    free(save_name);
+    return PROTO_FRAME_ACK;
+}
+
+int send_frame(enum proto_frame type, uint8_t flags, uint32_t stream, uint64_t len, const void *payload,
+               size_t payload_len, const struct client_settings *set)
+{
+    uint8_t hdr[PROTO_FRAME_SIZE];
+    struct iovec iov[2];
+    uint16_t name_len = 0;
+
+    // The transfer ID, digest and stripe an open may carry follow its name but are not counted in name_len
+    if (type == PROTO_FRAME_OPEN)
+    {
+        size_t extra = (flags & PROTO_FLAG_RESUME ? PROTO_TRANSFER_ID_SIZE : 0) + (flags & PROTO_FLAG_HASH ? PROTO_DIGEST_SIZE : 0)
+                       + (flags & PROTO_FLAG_STRIPE ? PROTO_STRIPE_SIZE : 0);
+
+        name_len = htons((uint16_t) (payload_len - extra));
+    }
+    stream = htonl(stream);
+    len = htobe64(len);
+    hdr[0] = (uint8_t) type;
+    hdr[1] = flags;
+    memcpy(hdr + 2, &name_len, sizeof(uint16_t));
+    memcpy(hdr + 4, &stream, sizeof(uint32_t));    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+    memcpy(hdr + 8, &len, sizeof(uint64_t));       // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = (void *) (uintptr_t) payload;
+    iov[1].iov_len = payload_len;
+    return send_all(set->server_fd, iov, payload_len > 0 ? 2 : 1);
+}
+
+int send_all(int fd, struct iovec *iov, int iov_cnt)
+{
+    while (iov_cnt > 0)
+    {
+        struct msghdr msg;
+        ssize_t ret_val;
+
+        memset(&msg, 0, sizeof(struct msghdr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t) iov_cnt;
+        if ((ret_val = sendmsg(fd, &msg, MSG_NOSIGNAL)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EPIPE || errno == ECONNRESET || errno == ETIMEDOUT)
+            {
+                return -1;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+
+        // Skip what was sent, which may end partway through a buffer
+        while (iov_cnt > 0 && (size_t) ret_val >= iov->iov_len)
+        {
+            ret_val -= (ssize_t) iov->iov_len;
+            ++iov;
+            --iov_cnt;
+        }
+        if (iov_cnt > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + ret_val;
+            iov->iov_len -= (size_t) ret_val;
+        }
+    }
+    return 0;
+}
 
-        send_file_data(argv[optind], set);
+int recv_all(int fd, void *buf, size_t len)
+{
+    size_t got = 0;
 
-        printf("Sent to server: %s\n", argv[optind]);
+    while (got < len)
+    {
+        ssize_t ret_val;
 
-        optind++;
+        if ((ret_val = recv(fd, (char *) buf + got, len - got, 0)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // A server that refuses the hello may reset the connection rather than close it
+            if (errno == ECONNRESET || errno == ETIMEDOUT)
+            {
+                return -1;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ret_val == 0)
+        {
+            return -1;
+        }
+        got += (size_t) ret_val;
     }
+    return 0;
 }
 
 void send_file_name(const char *file_name, const struct client_settings *set)
@@ -107,61 +1975,43 @@ void send_file_name(const char *file_name, const struct client_settings *set)
 void send_file_data(const char *file_name, const struct client_settings *set)
 {
     uint32_t f_data_len;
-    char *file_data;
-    ssize_t ret_val;
-    ssize_t bytes_sent = 0;
+    struct stat st;
+    int ret_val;
+    int fd;
 
-    // Send the file length
-    f_data_len = get_f_data_len(file_name);
-    f_data_len = htonl(f_data_len);
-    if (send(set->server_fd, &f_data_len, sizeof(uint32_t), 0) == -1)
+    if ((fd = open(file_name, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
-    f_data_len = ntohl(f_data_len);
-
-    // Read the file data into a buffer
-    read_file(file_name, f_data_len, &file_data);
-
-    // Send the buffer of file data
-    while (bytes_sent < f_data_len)
+    if ((uint64_t) st.st_size > UINT32_MAX)
     {
-        if ((ret_val = send(set->server_fd, file_data + bytes_sent, f_data_len - bytes_sent, 0)) == -1)
-        {
-            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
-        }
-        bytes_sent += ret_val;
+        fatal_message(__FILE__, __func__, __LINE__, "File too large for protocol v1", 4);
     }
 
-    free(file_data);
-}
-
-uint32_t get_f_data_len(const char *file_name)
-{
-    uint32_t f_data_len;
-    struct stat st;
-    if (stat(file_name, &st) == -1)
+    // Send the file length
+    f_data_len = htonl((uint32_t) st.st_size);
+    if (send(set->server_fd, &f_data_len, sizeof(uint32_t), 0) == -1)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
-    f_data_len = st.st_size;
-    return f_data_len;
-}
+    f_data_len = ntohl(f_data_len);
 
-void read_file(const char *file_name, uint32_t f_data_len, char **file_data)
-{
-    int fd_ofile;
-    if ((fd_ofile = open(file_name, O_RDONLY | O_CLOEXEC)) == -1)
+    // Send the file, never holding more of it than the kernel does
+    if (set->zerocopy && f_data_len >= FSEND_ZEROCOPY_MIN)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
-    }
-    if ((*file_data = (char *) calloc(f_data_len + 1, sizeof(char))) == NULL)
+        uint32_t pending = 0;
+
+        if ((ret_val = fsend_zerocopy(set->server_fd, fd, 0, f_data_len, &pending)) == 0)
+        {
+            ret_val = fsend_flush(set->server_fd, &pending);
+        }
+    } else
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        ret_val = fsend_file(set->server_fd, fd, 0, f_data_len);
     }
-    if (read(fd_ofile, *file_data, f_data_len) == -1)
+    if (ret_val == -1)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        fatal_message(__FILE__, __func__, __LINE__, "Server closed the connection", 4);
     }
-    close(fd_ofile);
+    close(fd);
 }
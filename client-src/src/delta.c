@@ -0,0 +1,139 @@
+#include "delta.h"
+#include "error.h"
+#include "proto.h"
+#include "sha256.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * slot_of
+ * <p>
+ * Spread a weak checksum over the index's slots. Its low half is a plain sum of bytes, so it is
+ * mixed before being cut down.
+ * </p>
+ * @param index - delta_index *: the index
+ * @param weak - uint32_t: the weak checksum
+ * @return the slot
+ */
+static size_t slot_of(const struct delta_index *index, uint32_t weak);
+
+/**
+ * sig_weak
+ * <p>
+ * Read the weak checksum from a block's signature.
+ * </p>
+ * @param index - delta_index *: the index
+ * @param block - size_t: the block
+ * @return the weak checksum
+ */
+static uint32_t sig_weak(const struct delta_index *index, size_t block);
+
+void delta_index_open(struct delta_index *index, uint8_t *sigs, size_t blocks, uint32_t block_size)
+{
+    size_t slots = 1;
+
+    // At least twice as many slots as blocks keeps the chains short
+    while (slots < 2 * blocks)
+    {
+        slots <<= 1;
+    }
+    index->sigs = sigs;
+    index->blocks = blocks;
+    index->block_size = block_size;
+    index->mask = slots - 1;
+    if ((index->heads = (size_t *) malloc(slots * sizeof(size_t))) == NULL
+        || (index->next = (size_t *) malloc((blocks + 1) * sizeof(size_t))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (size_t i = 0; i < slots; ++i)
+    {
+        index->heads[i] = DELTA_NO_MATCH;
+    }
+    // Filled from the end, so the first of several identical blocks is found first
+    for (size_t i = blocks; i > 0; --i)
+    {
+        size_t slot = slot_of(index, sig_weak(index, i - 1));
+
+        index->next[i - 1] = index->heads[slot];
+        index->heads[slot] = i - 1;
+    }
+}
+
+void delta_index_close(struct delta_index *index)
+{
+    free(index->sigs);
+    free(index->heads);
+    free(index->next);
+    index->sigs = NULL;
+    index->heads = NULL;
+    index->next = NULL;
+}
+
+size_t delta_find(const struct delta_index *index, uint32_t weak, const uint8_t *block)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    int hashed = 0;
+
+    for (size_t i = index->heads[slot_of(index, weak)]; i != DELTA_NO_MATCH; i = index->next[i])
+    {
+        if (sig_weak(index, i) != weak)
+        {
+            continue;
+        }
+        if (!hashed)
+        {
+            struct sha256_ctx hash;
+
+            sha256_init(&hash);
+            sha256_update(&hash, block, index->block_size);
+            sha256_digest(&hash, digest);
+            hashed = 1;
+        }
+        if (memcmp(index->sigs + i * PROTO_SIG_SIZE + sizeof(uint32_t), digest, PROTO_SIG_SIZE - sizeof(uint32_t)) == 0)
+        {
+            return i;
+        }
+    }
+    return DELTA_NO_MATCH;
+}
+
+uint32_t delta_weak(const uint8_t *data, size_t len)
+{
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        a += data[i];
+        b += (uint32_t) (len - i) * data[i];
+    }
+    return (a & 0xffffU) | (b << 16); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Two 16-bit sums
+}
+
+uint32_t delta_roll(uint32_t weak, uint8_t out, uint8_t in, size_t len)
+{
+    uint32_t a = weak & 0xffffU;      // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Two 16-bit sums
+    uint32_t b = weak >> 16;          // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Two 16-bit sums
+
+    // Both sums are kept modulo 2^16, which wrapping 32-bit arithmetic preserves
+    a = a - out + in;
+    b = b - (uint32_t) len * out + a;
+    return (a & 0xffffU) | (b << 16); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Two 16-bit sums
+}
+
+static size_t slot_of(const struct delta_index *index, uint32_t weak)
+{
+    weak = (weak ^ (weak >> 16)) * 0x45d9f3bU;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Integer hash mixing
+    weak ^= weak >> 16;                         // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Integer hash mixing
+    return (size_t) weak & index->mask;
+}
+
+static uint32_t sig_weak(const struct delta_index *index, size_t block)
+{
+    uint32_t weak;
+
+    memcpy(&weak, index->sigs + block * PROTO_SIG_SIZE, sizeof(uint32_t));
+    return ntohl(weak);
+}
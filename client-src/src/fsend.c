@@ -0,0 +1,321 @@
+#include "fsend.h"
+#include "error.h"
+#include <time.h> // Before linux/errqueue.h, which uses struct timespec
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * The most bytes asked of one sendfile call; Linux sends no more than about 2 GiB at a time.
+ */
+#define FSEND_MAX_CALL (1024 * 1024 * 1024)
+
+/**
+ * The size of the buffer through which a file sendfile cannot read is sent.
+ */
+#define FSEND_COPY_SIZE (64 * 1024)
+
+/**
+ * send_copied
+ * <p>
+ * Send part of a file by reading it into a buffer, for files sendfile cannot read.
+ * </p>
+ * @param sock - int: the socket
+ * @param fd - int: file descriptor for the file
+ * @param offset - off_t: where in the file to start
+ * @param len - uint64_t: the number of bytes to send
+ * @return 0 on success, -1 if the connection was lost
+ */
+static int send_copied(int sock, int fd, off_t offset, uint64_t len);
+
+/**
+ * reap_completions
+ * <p>
+ * Take every zero-copy completion waiting on the socket's error queue.
+ * </p>
+ * @param sock - int: the socket
+ * @param pending - uint32_t *: the number of zero-copy sends not yet completed, decreased
+ * @return the number of completions taken, or -1 if the connection was lost
+ */
+static int reap_completions(int sock, uint32_t *pending);
+
+/**
+ * lost_connection
+ * <p>
+ * Check whether a send failed because the server went away.
+ * </p>
+ * @param err - int: the errno of the failed send
+ * @return 1 if the connection was lost, 0 otherwise
+ */
+static int lost_connection(int err);
+
+/**
+ * send_mapped
+ * <p>
+ * Send mapped bytes with MSG_ZEROCOPY.
+ * </p>
+ * @param sock - int: the socket
+ * @param data - char *: the bytes to send
+ * @param len - size_t: the number of bytes
+ * @param pending - uint32_t *: the number of zero-copy sends not yet completed, increased
+ * @return 0 on success, -1 if the connection was lost
+ */
+static int send_mapped(int sock, const char *data, size_t len, uint32_t *pending);
+
+int fsend_enable_zerocopy(int sock)
+{
+    int on = 1;
+
+    return setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+}
+
+int fsend_file(int sock, int fd, uint64_t offset, uint64_t len)
+{
+    off_t pos = (off_t) offset;
+
+    while (len > 0)
+    {
+        size_t n = len < FSEND_MAX_CALL ? (size_t) len : FSEND_MAX_CALL;
+        ssize_t ret_val;
+
+        if ((ret_val = sendfile(sock, fd, &pos, n)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS)
+            {
+                return send_copied(sock, fd, pos, len);
+            }
+            if (lost_connection(errno))
+            {
+                return -1;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ret_val == 0)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "File shrank while being sent", 4);
+        }
+        len -= (uint64_t) ret_val;
+    }
+    return 0;
+}
+
+int fsend_zerocopy(int sock, int fd, uint64_t offset, uint64_t len, uint32_t *pending)
+{
+    uint64_t page_mask = (uint64_t) sysconf(_SC_PAGESIZE) - 1;
+
+    while (len > 0)
+    {
+        // Mappings start on a page, so the window may begin a little before the bytes it sends
+        uint64_t start = offset & ~page_mask;
+        size_t skip = (size_t) (offset - start);
+        size_t n = len < FSEND_MAP_WINDOW - skip ? (size_t) len : FSEND_MAP_WINDOW - skip;
+        char *map;
+        int ret_val;
+
+        if ((map = (char *) mmap(NULL, skip + n, PROT_READ, MAP_SHARED, fd, (off_t) start)) == MAP_FAILED)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        ret_val = send_mapped(sock, map + skip, n, pending);
+        munmap(map, skip + n);
+        if (ret_val == -1)
+        {
+            return -1;
+        }
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int fsend_flush(int sock, uint32_t *pending)
+{
+    while (*pending > 0)
+    {
+        struct pollfd pfd;
+        int err;
+        socklen_t err_len = sizeof(err);
+        int ret_val;
+
+        if ((ret_val = reap_completions(sock, pending)) == -1)
+        {
+            return -1;
+        }
+        if (ret_val > 0)
+        {
+            continue;
+        }
+
+        // Completions arrive as the server acknowledges the bytes; an error queue wakes poll by itself
+        pfd.fd = sock;
+        pfd.events = 0;
+        if (poll(&pfd, 1, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if ((pfd.revents & POLLHUP) || getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &err_len) == -1 || err != 0)
+        {
+            // A dead connection drops its queued bytes, so nothing is left using the pages
+            if (reap_completions(sock, pending) <= 0)
+            {
+                *pending = 0;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int send_mapped(int sock, const char *data, size_t len, uint32_t *pending)
+{
+    while (len > 0)
+    {
+        ssize_t ret_val;
+
+        if ((ret_val = send(sock, data, len, MSG_ZEROCOPY | MSG_NOSIGNAL)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // Every pinned send is charged to the socket until it completes, so make room and retry
+            if (errno == ENOBUFS && *pending > 0)
+            {
+                if (fsend_flush(sock, pending) == -1)
+                {
+                    return -1;
+                }
+                continue;
+            }
+            if (lost_connection(errno))
+            {
+                return -1;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        ++*pending;
+        data += ret_val;
+        len -= (size_t) ret_val;
+    }
+    return 0;
+}
+
+static int send_copied(int sock, int fd, off_t offset, uint64_t len)
+{
+    char *buf;
+
+    if ((buf = (char *) malloc(FSEND_COPY_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    while (len > 0)
+    {
+        size_t n = len < FSEND_COPY_SIZE ? (size_t) len : FSEND_COPY_SIZE;
+        ssize_t got;
+        ssize_t put = 0;
+
+        if ((got = pread(fd, buf, n, offset)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (got == 0)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "File shrank while being sent", 4);
+        }
+        while (put < got)
+        {
+            ssize_t ret_val;
+
+            if ((ret_val = send(sock, buf + put, (size_t) (got - put), MSG_NOSIGNAL)) == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                if (lost_connection(errno))
+                {
+                    free(buf);
+                    return -1;
+                }
+                fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+            }
+            put += ret_val;
+        }
+        offset += got;
+        len -= (uint64_t) got;
+    }
+    free(buf);
+    return 0;
+}
+
+static int reap_completions(int sock, uint32_t *pending)
+{
+    int reaped = 0;
+
+    for (;;)
+    {
+        char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+
+        memset(&msg, 0, sizeof(struct msghdr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return reaped;
+            }
+            if (lost_connection(errno))
+            {
+                return -1;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            struct sock_extended_err serr;
+
+            if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR)
+            {
+                continue;
+            }
+            memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+            if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            {
+                continue;
+            }
+            // One notification covers the inclusive range of sends numbered ee_info to ee_data
+            *pending -= serr.ee_data - serr.ee_info + 1;
+            ++reaped;
+        }
+    }
+}
+
+static int lost_connection(int err)
+{
+    return err == EPIPE || err == ECONNRESET || err == ETIMEDOUT;
+}
@@ -0,0 +1,187 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The number of bits of the match finder's hash.
+ */
+#define LZ_HASH_BITS 14
+
+/**
+ * The shortest match the format can express.
+ */
+#define LZ_MIN_MATCH 4
+
+/**
+ * The format ends every block with at least this many literals.
+ */
+#define LZ_LAST_LITERALS 5
+
+/**
+ * The last match must start at least this many bytes before the end of the block.
+ */
+#define LZ_MATCH_LIMIT 12
+
+/**
+ * The farthest back a match may reach.
+ */
+#define LZ_MAX_OFFSET 65535
+
+/**
+ * The largest length held in a token's nibble; longer lengths continue in the bytes that follow.
+ */
+#define LZ_NIBBLE_MAX 15
+
+/**
+ * read32
+ * <p>
+ * Read 4 bytes, however they are aligned.
+ * </p>
+ * @param p - char *: the bytes
+ * @return the bytes as a word
+ */
+static uint32_t read32(const char *p);
+
+/**
+ * read64
+ * <p>
+ * Read 8 bytes, however they are aligned.
+ * </p>
+ * @param p - char *: the bytes
+ * @return the bytes as a word
+ */
+static uint64_t read64(const char *p);
+
+/**
+ * hash32
+ * <p>
+ * Hash 4 bytes into a slot of the match finder's table.
+ * </p>
+ * @param word - uint32_t: the bytes
+ * @return the slot
+ */
+static uint32_t hash32(uint32_t word);
+
+/**
+ * put_length
+ * <p>
+ * Write the part of a length that does not fit in its token's nibble.
+ * </p>
+ * @param dst - char *: where to write
+ * @param len - size_t: the length, at least LZ_NIBBLE_MAX
+ * @return pointer to the byte after the ones written
+ */
+static char *put_length(char *dst, size_t len);
+
+/**
+ * put_sequence
+ * <p>
+ * Write a sequence: a token, a run of literals, then a match unless it is the block's last.
+ * </p>
+ * @param dst - char *: where to write
+ * @param lit - char *: the literals
+ * @param lit_len - size_t: the number of literals
+ * @param offset - size_t: how far back the match starts, or 0 for the last sequence
+ * @param match_len - size_t: the length of the match
+ * @return pointer to the byte after the sequence
+ */
+static char *put_sequence(char *dst, const char *lit, size_t lit_len, size_t offset, size_t match_len);
+
+size_t lz_compress(const char *src, size_t len, char *dst)
+{
+    uint32_t table[1U << LZ_HASH_BITS];
+    char *out = dst;
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    // Slots hold a position plus one, so 0 is empty
+    memset(table, 0, sizeof(table)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    while (len > LZ_MATCH_LIMIT && pos < len - LZ_MATCH_LIMIT)
+    {
+        uint32_t word = read32(src + pos);
+        uint32_t slot = hash32(word);
+        size_t ref = table[slot];
+        size_t match_len = LZ_MIN_MATCH;
+
+        table[slot] = (uint32_t) pos + 1;
+        if (ref == 0 || pos - (ref - 1) > LZ_MAX_OFFSET || read32(src + ref - 1) != word)
+        {
+            // The longer nothing has matched, the faster the search moves on
+            pos += 1 + ((pos - anchor) >> 6); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Skip one more byte every 64 misses
+            continue;
+        }
+        --ref;
+        // Compare a word at a time, then find the differing byte
+        while (pos + match_len + sizeof(uint64_t) <= len - LZ_LAST_LITERALS
+               && read64(src + ref + match_len) == read64(src + pos + match_len))
+        {
+            match_len += sizeof(uint64_t);
+        }
+        while (pos + match_len < len - LZ_LAST_LITERALS && src[ref + match_len] == src[pos + match_len])
+        {
+            ++match_len;
+        }
+        out = put_sequence(out, src + anchor, pos - anchor, pos - ref, match_len);
+        pos += match_len;
+        anchor = pos;
+    }
+    out = put_sequence(out, src + anchor, len - anchor, 0, 0);
+    return (size_t) (out - dst);
+}
+
+static uint32_t read32(const char *p)
+{
+    uint32_t word;
+
+    memcpy(&word, p, sizeof(uint32_t));
+    return word;
+}
+
+static uint64_t read64(const char *p)
+{
+    uint64_t word;
+
+    memcpy(&word, p, sizeof(uint64_t));
+    return word;
+}
+
+static uint32_t hash32(uint32_t word)
+{
+    return (word * 2654435761U) >> (32 - LZ_HASH_BITS); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Knuth's multiplicative hash
+}
+
+static char *put_length(char *dst, size_t len)
+{
+    for (len -= LZ_NIBBLE_MAX; len >= UINT8_MAX; len -= UINT8_MAX)
+    {
+        *dst++ = (char) UINT8_MAX;
+    }
+    *dst++ = (char) len;
+    return dst;
+}
+
+static char *put_sequence(char *dst, const char *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+    char *token = dst++;
+    size_t match_code = offset > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+    *token = (char) ((lit_len < LZ_NIBBLE_MAX ? lit_len : LZ_NIBBLE_MAX) << 4 // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : High nibble
+                     | (match_code < LZ_NIBBLE_MAX ? match_code : LZ_NIBBLE_MAX));
+    if (lit_len >= LZ_NIBBLE_MAX)
+    {
+        dst = put_length(dst, lit_len);
+    }
+    memcpy(dst, lit, lit_len);
+    dst += lit_len;
+    if (offset == 0)
+    {
+        return dst;
+    }
+    *dst++ = (char) (offset & UINT8_MAX);
+    *dst++ = (char) (offset >> 8); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Little-endian offset
+    if (match_code >= LZ_NIBBLE_MAX)
+    {
+        dst = put_length(dst, match_code);
+    }
+    return dst;
+}
@@ -0,0 +1,374 @@
+#include "manifest.h"
+#include "error.h"
+#include "sha256.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * The first bytes of every manifest: "MANI".
+ */
+#define MANIFEST_MAGIC 0x4D414E49U
+
+/**
+ * The layout of the manifest; one written in another is started over.
+ */
+#define MANIFEST_VERSION 1
+
+/**
+ * The largest share of a manifest's slots filled before it doubles, as a fraction of 4.
+ */
+#define MANIFEST_MAX_LOAD 3
+
+/**
+ * manifest_header
+ * <p>
+ * Struct storing the start of a manifest, followed by its slots.
+ * <ul>
+ * <li>uint32_t magic: MANIFEST_MAGIC</li>
+ * <li>uint32_t version: MANIFEST_VERSION</li>
+ * <li>uint32_t entry_size: the size of a manifest_file</li>
+ * <li>uint32_t reserved: 0</li>
+ * <li>uint64_t slots: the number of slots, a power of 2</li>
+ * <li>uint64_t used: the number of slots holding a file</li>
+ * </ul>
+ * </p>
+ */
+struct manifest_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint32_t reserved;
+    uint64_t slots;
+    uint64_t used;
+};
+
+struct manifest
+{
+    pthread_mutex_t lock;
+    char *path;
+    char *cwd;
+    int fd;
+    struct manifest_header *hdr;
+    struct manifest_file *slots;
+};
+
+/**
+ * check_header
+ * <p>
+ * Check that a manifest was written by this client's layout and is whole.
+ * </p>
+ * @param fd - int: file descriptor for the manifest
+ * @return 1 if it can be mapped as it is, 0 otherwise
+ */
+static int check_header(int fd);
+
+/**
+ * create_table
+ * <p>
+ * Empty a manifest and give it room for a number of files.
+ * </p>
+ * @param fd - int: file descriptor for the manifest
+ * @param slots - uint64_t: the number of slots, a power of 2
+ */
+static void create_table(int fd, uint64_t slots);
+
+/**
+ * map_table
+ * <p>
+ * Map a whole manifest.
+ * </p>
+ * @param m - manifest *: the manifest, whose fd is set and whose header and slots are set here
+ */
+static void map_table(struct manifest *m);
+
+/**
+ * unmap_table
+ * <p>
+ * Unmap a whole manifest.
+ * </p>
+ * @param m - manifest *: the manifest
+ */
+static void unmap_table(const struct manifest *m);
+
+/**
+ * find_slot
+ * <p>
+ * Find the slot holding a file, or the empty slot where it belongs.
+ * </p>
+ * @param hdr - manifest_header *: the manifest's header
+ * @param slots - manifest_file *: the manifest's slots
+ * @param key - uint8_t *: the file's key, of MANIFEST_KEY_SIZE bytes
+ * @return the slot
+ */
+static struct manifest_file *find_slot(const struct manifest_header *hdr, struct manifest_file *slots, const uint8_t *key);
+
+/**
+ * is_empty
+ * <p>
+ * Check whether a slot holds no file.
+ * </p>
+ * @param slot - manifest_file *: the slot
+ * @return 1 if it is empty, 0 otherwise
+ */
+static int is_empty(const struct manifest_file *slot);
+
+/**
+ * grow_table
+ * <p>
+ * Double a manifest's slots. The larger table is written beside the manifest and renamed over it,
+ * so a client stopped partway leaves the old one whole.
+ * </p>
+ * @param m - manifest *: the manifest
+ */
+static void grow_table(struct manifest *m);
+
+struct manifest *manifest_open(const char *dir, const char *server_ip, in_port_t server_port)
+{
+    struct manifest *m;
+    struct stat st;
+    int len;
+
+    if ((m = (struct manifest *) calloc(1, sizeof(struct manifest))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if (mkdir(dir, S_IRWXU) == -1 && errno != EEXIST)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    len = snprintf(NULL, 0, "%s/%s_%u.manifest", dir, server_ip, (unsigned int) server_port);
+    if ((m->path = (char *) malloc((size_t) len + 1)) == NULL || (m->cwd = getcwd(NULL, 0)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    snprintf(m->path, (size_t) len + 1, "%s/%s_%u.manifest", dir, server_ip, (unsigned int) server_port);
+
+    if ((m->fd = open(m->path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if (flock(m->fd, LOCK_EX | LOCK_NB) == -1)
+    {
+        if (errno != EWOULDBLOCK)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        close(m->fd);
+        free(m->cwd);
+        free(m->path);
+        free(m);
+        return NULL;
+    }
+    if (fstat(m->fd, &st) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if (st.st_size == 0 || !check_header(m->fd))
+    {
+        if (st.st_size != 0)
+        {
+            printf("Manifest %s is not one this client can read; starting it over\n", m->path);
+        }
+        create_table(m->fd, MANIFEST_MIN_SLOTS);
+    }
+    map_table(m);
+    pthread_mutex_init(&m->lock, NULL);
+    return m;
+}
+
+void manifest_describe(const struct manifest *m, const char *path, const struct stat *st, struct manifest_file *file)
+{
+    struct sha256_ctx hash;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    memset(file, 0, sizeof(struct manifest_file)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+
+    // The path is not resolved, which would cost a lookup per component of it for every file
+    sha256_init(&hash);
+    if (path[0] != '/')
+    {
+        sha256_update(&hash, m->cwd, strlen(m->cwd));
+        sha256_update(&hash, "/", 1);
+    }
+    sha256_update(&hash, path, strlen(path));
+    sha256_digest(&hash, digest);
+    memcpy(file->key, digest, MANIFEST_KEY_SIZE);
+
+    file->size = (uint64_t) st->st_size;
+    file->mtime_sec = (int64_t) st->st_mtim.tv_sec;
+    file->mtime_nsec = (int64_t) st->st_mtim.tv_nsec;
+    file->ino = (uint64_t) st->st_ino;
+    file->dev = (uint64_t) st->st_dev;
+}
+
+int manifest_unchanged(struct manifest *m, const struct manifest_file *file)
+{
+    const struct manifest_file *slot;
+    int unchanged;
+
+    pthread_mutex_lock(&m->lock);
+    slot = find_slot(m->hdr, m->slots, file->key);
+    unchanged = !is_empty(slot) && slot->size == file->size && slot->mtime_sec == file->mtime_sec
+                && slot->mtime_nsec == file->mtime_nsec && slot->ino == file->ino && slot->dev == file->dev;
+    pthread_mutex_unlock(&m->lock);
+    return unchanged;
+}
+
+void manifest_record(struct manifest *m, const struct manifest_file *file)
+{
+    struct manifest_file *slot;
+
+    pthread_mutex_lock(&m->lock);
+    if ((m->hdr->used + 1) * 4 > m->hdr->slots * MANIFEST_MAX_LOAD)
+    {
+        grow_table(m);
+    }
+    slot = find_slot(m->hdr, m->slots, file->key);
+    if (is_empty(slot))
+    {
+        ++m->hdr->used;
+    }
+    *slot = *file;
+    pthread_mutex_unlock(&m->lock);
+}
+
+void manifest_close(struct manifest *m)
+{
+    unmap_table(m);
+    close(m->fd);
+    pthread_mutex_destroy(&m->lock);
+    free(m->cwd);
+    free(m->path);
+    free(m);
+}
+
+static int check_header(int fd)
+{
+    struct manifest_header hdr;
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr))
+    {
+        return 0;
+    }
+    return hdr.magic == MANIFEST_MAGIC && hdr.version == MANIFEST_VERSION
+           && hdr.entry_size == sizeof(struct manifest_file) && hdr.slots >= MANIFEST_MIN_SLOTS
+           && (hdr.slots & (hdr.slots - 1)) == 0 && hdr.used < hdr.slots
+           && (uint64_t) st.st_size == sizeof(hdr) + hdr.slots * sizeof(struct manifest_file);
+}
+
+static void create_table(int fd, uint64_t slots)
+{
+    struct manifest_header hdr;
+
+    // Truncating to nothing first leaves every slot zero, which is empty
+    if (ftruncate(fd, 0) == -1
+        || ftruncate(fd, (off_t) (sizeof(struct manifest_header) + slots * sizeof(struct manifest_file))) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    memset(&hdr, 0, sizeof(hdr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    hdr.magic = MANIFEST_MAGIC;
+    hdr.version = MANIFEST_VERSION;
+    hdr.entry_size = sizeof(struct manifest_file);
+    hdr.slots = slots;
+    if (pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr))
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+static void map_table(struct manifest *m)
+{
+    struct manifest_header hdr;
+    char *map;
+
+    if (pread(m->fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr))
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((map = (char *) mmap(NULL, sizeof(hdr) + hdr.slots * sizeof(struct manifest_file), PROT_READ | PROT_WRITE,
+                             MAP_SHARED, m->fd, 0)) == MAP_FAILED)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    m->hdr = (struct manifest_header *) (void *) map;
+    m->slots = (struct manifest_file *) (void *) (map + sizeof(struct manifest_header));
+}
+
+static void unmap_table(const struct manifest *m)
+{
+    munmap(m->hdr, sizeof(struct manifest_header) + m->hdr->slots * sizeof(struct manifest_file));
+}
+
+static struct manifest_file *find_slot(const struct manifest_header *hdr, struct manifest_file *slots, const uint8_t *key)
+{
+    uint64_t mask = hdr->slots - 1;
+    uint64_t i;
+
+    // The key is already a hash, so its first bytes pick the slot
+    memcpy(&i, key, sizeof(uint64_t));
+    for (i &= mask; !is_empty(&slots[i]) && memcmp(slots[i].key, key, MANIFEST_KEY_SIZE) != 0; i = (i + 1) & mask)
+    {
+    }
+    return &slots[i];
+}
+
+static int is_empty(const struct manifest_file *slot)
+{
+    static const uint8_t empty[MANIFEST_KEY_SIZE] = {0};
+
+    return memcmp(slot->key, empty, MANIFEST_KEY_SIZE) == 0;
+}
+
+static void grow_table(struct manifest *m)
+{
+    struct manifest bigger;
+    char *tmp_path;
+    size_t len = strlen(m->path);
+
+    if ((tmp_path = (char *) malloc(len + sizeof(".new"))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(tmp_path, m->path, len);
+    memcpy(tmp_path + len, ".new", sizeof(".new"));
+
+    if ((bigger.fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR)) == -1
+        || flock(bigger.fd, LOCK_EX) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    create_table(bigger.fd, m->hdr->slots * 2);
+    map_table(&bigger);
+    for (uint64_t i = 0; i < m->hdr->slots; ++i)
+    {
+        if (!is_empty(&m->slots[i]))
+        {
+            *find_slot(bigger.hdr, bigger.slots, m->slots[i].key) = m->slots[i];
+        }
+    }
+    bigger.hdr->used = m->hdr->used;
+    if (rename(tmp_path, m->path) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    free(tmp_path);
+
+    unmap_table(m);
+    close(m->fd);
+    m->fd = bigger.fd;
+    m->hdr = bigger.hdr;
+    m->slots = bigger.slots;
+}
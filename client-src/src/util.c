@@ -28,3 +28,56 @@ void set_string(char **str, const char *new_str)
 
     strcpy(*str, new_str);
 }
+
+char *join_path(const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path;
+
+    // A root given with a trailing slash needs no other
+    if (dir_len > 0 && dir[dir_len - 1] == '/')
+    {
+        --dir_len;
+    }
+    if ((path = (char *) malloc(dir_len + 1 + name_len + 1)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
+
+size_t name_offset(char *const roots[], size_t n_roots, const char *path)
+{
+    const char *base;
+
+    for (size_t i = 0; i < n_roots; ++i)
+    {
+        size_t root_len = strlen(roots[i]);
+        size_t start;
+
+        // A root given with a trailing slash is joined without it
+        if (root_len > 0 && roots[i][root_len - 1] == '/')
+        {
+            --root_len;
+        }
+        if (strncmp(path, roots[i], root_len) != 0 || path[root_len] != '/')
+        {
+            continue;
+        }
+        for (start = root_len; start > 0 && roots[i][start - 1] != '/'; --start)
+        {
+        }
+        if (start == root_len || strncmp(roots[i] + start, ".", root_len - start) == 0
+            || strncmp(roots[i] + start, "..", root_len - start) == 0)
+        {
+            return root_len + 1;
+        }
+        return start;
+    }
+    base = strrchr(path, '/');
+    return base == NULL ? 0 : (size_t) (base + 1 - path);
+}
@@ -0,0 +1,321 @@
+#include "walk.h"
+#include "error.h"
+#include "util.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct walk
+{
+    pthread_mutex_t lock;
+    pthread_cond_t dir_ready;
+    pthread_cond_t file_ready;
+    pthread_cond_t file_taken;
+    char **roots;
+    size_t n_roots;
+    char **dirs;
+    size_t n_dirs;
+    size_t cap_dirs;
+    unsigned int busy;
+    int done;
+    char *files[WALK_QUEUE_DEPTH];
+    size_t head;
+    size_t n_files;
+    pthread_t readers[WALK_READERS];
+};
+
+/**
+ * walk_reader
+ * <p>
+ * Thread start routine: take directories and scan them until no directory is left and no other
+ * reader may find one.
+ * </p>
+ * @param arg - void *: the walk
+ * @return NULL
+ */
+static void *walk_reader(void *arg);
+
+/**
+ * take_dir
+ * <p>
+ * Take a directory to scan, waiting while other readers may still find one.
+ * </p>
+ * @param w - walk *: the walk
+ * @return the directory's path, or NULL once the walk is over
+ */
+static char *take_dir(struct walk *w);
+
+/**
+ * finish_dir
+ * <p>
+ * Mark a directory scanned, ending the walk if it was the last.
+ * </p>
+ * @param w - walk *: the walk
+ */
+static void finish_dir(struct walk *w);
+
+/**
+ * scan_dir
+ * <p>
+ * Queue every subdirectory of a directory to be scanned and prefetch and queue every regular file
+ * in it. A directory or entry that cannot be read is reported and skipped.
+ * </p>
+ * @param w - walk *: the walk
+ * @param path - char *: the directory's path
+ */
+static void scan_dir(struct walk *w, const char *path);
+
+/**
+ * prefetch_file
+ * <p>
+ * Open a file and have the kernel start reading its first WALK_PREFETCH_MAX bytes.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory holding the file
+ * @param name - char *: the file's name in the directory
+ * @return 0 on success, -1 if the file cannot be opened, with errno set
+ */
+static int prefetch_file(int dir_fd, const char *name);
+
+/**
+ * push_dir
+ * <p>
+ * Queue a directory to be scanned.
+ * </p>
+ * @param w - walk *: the walk
+ * @param path - char *: the directory's path, which the walk takes over
+ */
+static void push_dir(struct walk *w, char *path);
+
+/**
+ * push_file
+ * <p>
+ * Queue a file for the senders, waiting while the queue is full.
+ * </p>
+ * @param w - walk *: the walk
+ * @param path - char *: the file's path, which the walk takes over
+ */
+static void push_file(struct walk *w, char *path);
+
+struct walk *walk_open(char *const roots[], size_t n_roots)
+{
+    struct walk *w;
+
+    if ((w = (struct walk *) calloc(1, sizeof(struct walk))) == NULL
+        || (w->roots = (char **) malloc(n_roots * sizeof(char *))) == NULL
+        || (w->dirs = (char **) malloc(n_roots * sizeof(char *))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->dir_ready, NULL);
+    pthread_cond_init(&w->file_ready, NULL);
+    pthread_cond_init(&w->file_taken, NULL);
+    w->cap_dirs = n_roots;
+    for (size_t i = 0; i < n_roots; ++i)
+    {
+        if ((w->roots[w->n_roots++] = strdup(roots[i])) == NULL
+            || (w->dirs[w->n_dirs++] = strdup(roots[i])) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+    }
+
+    for (size_t i = 0; i < WALK_READERS; ++i)
+    {
+        int err;
+
+        if ((err = pthread_create(&w->readers[i], NULL, walk_reader, w)) != 0)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+        }
+    }
+    return w;
+}
+
+char *walk_next(struct walk *w, size_t *name_off)
+{
+    char *path = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->n_files == 0 && !w->done)
+    {
+        pthread_cond_wait(&w->file_ready, &w->lock);
+    }
+    if (w->n_files > 0)
+    {
+        path = w->files[w->head];
+        w->head = (w->head + 1) % WALK_QUEUE_DEPTH;
+        --w->n_files;
+        pthread_cond_signal(&w->file_taken);
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (path != NULL)
+    {
+        *name_off = name_offset(w->roots, w->n_roots, path);
+    }
+    return path;
+}
+
+void walk_close(struct walk *w)
+{
+    for (size_t i = 0; i < WALK_READERS; ++i)
+    {
+        pthread_join(w->readers[i], NULL);
+    }
+    pthread_cond_destroy(&w->file_taken);
+    pthread_cond_destroy(&w->file_ready);
+    pthread_cond_destroy(&w->dir_ready);
+    pthread_mutex_destroy(&w->lock);
+    for (size_t i = 0; i < w->n_roots; ++i)
+    {
+        free(w->roots[i]);
+    }
+    free(w->roots);
+    free(w->dirs);
+    free(w);
+}
+
+static void *walk_reader(void *arg)
+{
+    struct walk *w = (struct walk *) arg;
+    char *path;
+
+    while ((path = take_dir(w)) != NULL)
+    {
+        scan_dir(w, path);
+        free(path);
+        finish_dir(w);
+    }
+    return NULL;
+}
+
+static char *take_dir(struct walk *w)
+{
+    char *path = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->n_dirs == 0 && !w->done)
+    {
+        pthread_cond_wait(&w->dir_ready, &w->lock);
+    }
+    // The most recently found directory is scanned first, so the queue stays as short as the tree is deep
+    if (w->n_dirs > 0)
+    {
+        path = w->dirs[--w->n_dirs];
+        ++w->busy;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return path;
+}
+
+static void finish_dir(struct walk *w)
+{
+    pthread_mutex_lock(&w->lock);
+    if (--w->busy == 0 && w->n_dirs == 0)
+    {
+        // No reader is left to find another directory or file
+        w->done = 1;
+        pthread_cond_broadcast(&w->dir_ready);
+        pthread_cond_broadcast(&w->file_ready);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void scan_dir(struct walk *w, const char *path)
+{
+    DIR *dir;
+    struct dirent *ent;
+
+    if ((dir = opendir(path)) == NULL)
+    {
+        printf("Could not read %s: %s; skipped it\n", path, strerror(errno)); // NOLINT(concurrency-mt-unsafe) : Message only
+        return;
+    }
+    for (errno = 0; (ent = readdir(dir)) != NULL; errno = 0) // NOLINT(concurrency-mt-unsafe) : Each reader has its own DIR
+    {
+        unsigned char type = ent->d_type;
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+        if (type == DT_UNKNOWN)
+        {
+            // Some file systems leave the type to be looked up
+            struct stat st;
+
+            if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+            {
+                printf("Could not read %s/%s: %s; skipped it\n", path, ent->d_name, strerror(errno)); // NOLINT(concurrency-mt-unsafe) : Message only
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR)
+        {
+            push_dir(w, join_path(path, ent->d_name));
+        } else if (type == DT_REG)
+        {
+            if (prefetch_file(dirfd(dir), ent->d_name) == -1)
+            {
+                printf("Could not read %s/%s: %s; skipped it\n", path, ent->d_name, strerror(errno)); // NOLINT(concurrency-mt-unsafe) : Message only
+                continue;
+            }
+            push_file(w, join_path(path, ent->d_name));
+        }
+    }
+    // The entries read so far were queued; the rest of the directory is given up
+    if (errno != 0)
+    {
+        printf("Could not read all of %s: %s; skipped the rest\n", path, strerror(errno)); // NOLINT(concurrency-mt-unsafe) : Message only
+    }
+    closedir(dir);
+}
+
+static int prefetch_file(int dir_fd, const char *name)
+{
+    int fd;
+
+    // Opening reads the inode the sender will stat; the advice starts reading the data without waiting on it
+    if ((fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return -1;
+    }
+    posix_fadvise(fd, 0, WALK_PREFETCH_MAX, POSIX_FADV_WILLNEED);
+    close(fd);
+    return 0;
+}
+
+static void push_dir(struct walk *w, char *path)
+{
+    pthread_mutex_lock(&w->lock);
+    if (w->n_dirs == w->cap_dirs)
+    {
+        w->cap_dirs = w->cap_dirs == 0 ? WALK_READERS : w->cap_dirs * 2;
+        if ((w->dirs = (char **) realloc(w->dirs, w->cap_dirs * sizeof(char *))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+    }
+    w->dirs[w->n_dirs++] = path;
+    pthread_cond_signal(&w->dir_ready);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void push_file(struct walk *w, char *path)
+{
+    pthread_mutex_lock(&w->lock);
+    while (w->n_files == WALK_QUEUE_DEPTH)
+    {
+        pthread_cond_wait(&w->file_taken, &w->lock);
+    }
+    w->files[(w->head + w->n_files) % WALK_QUEUE_DEPTH] = path;
+    ++w->n_files;
+    pthread_cond_signal(&w->file_ready);
+    pthread_mutex_unlock(&w->lock);
+}
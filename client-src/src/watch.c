@@ -0,0 +1,599 @@
+#include "watch.h"
+#include "error.h"
+#include "util.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The events watched on every directory: files written or moved in or out, and directories made
+ * or removed under it.
+ */
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/**
+ * The number of milliseconds in a second.
+ */
+#define MS_PER_SEC 1000
+
+/**
+ * The number of nanoseconds in a millisecond.
+ */
+#define NS_PER_MS 1000000
+
+/**
+ * change
+ * <p>
+ * Struct storing a file changed but not yet taken. Changes are kept in the order they are due,
+ * and indexed by path so another event on the file moves its change to the back.
+ * <ul>
+ * <li>char *path: the file's path</li>
+ * <li>uint64_t hash: the hash of the path</li>
+ * <li>uint64_t due: the monotonic time in milliseconds at which the change is due</li>
+ * <li>struct change *prev: the change due before this one, or NULL</li>
+ * <li>struct change *next: the change due after this one, or NULL</li>
+ * <li>struct change *chain: the next change in the same bucket of the index, or NULL</li>
+ * </ul>
+ * </p>
+ */
+struct change
+{
+    char *path;
+    uint64_t hash;
+    uint64_t due;
+    struct change *prev;
+    struct change *next;
+    struct change *chain;
+};
+
+struct watch
+{
+    int fd;
+    unsigned int debounce;
+    char **roots;
+    size_t n_roots;
+    char **dirs;
+    size_t cap_dirs;
+    struct change **buckets;
+    size_t n_buckets;
+    size_t n_changes;
+    struct change *head;
+    struct change *tail;
+    char *events;
+};
+
+/**
+ * add_tree
+ * <p>
+ * Watch a directory and every directory under it. A directory removed before it can be watched is
+ * skipped.
+ * </p>
+ * @param w - watch *: the watch
+ * @param path - char *: the directory's path
+ * @param changed - int: whether every regular file found is a change
+ */
+static void add_tree(struct watch *w, const char *path, int changed);
+
+/**
+ * forget_tree
+ * <p>
+ * Stop watching a directory and every directory under it, as it was moved and its watches would
+ * report its files under the old path.
+ * </p>
+ * @param w - watch *: the watch
+ * @param path - char *: the directory's path
+ */
+static void forget_tree(struct watch *w, const char *path);
+
+/**
+ * handle_event
+ * <p>
+ * Turn an inotify event into changes.
+ * </p>
+ * @param w - watch *: the watch
+ * @param ev - inotify_event *: the event
+ */
+static void handle_event(struct watch *w, const struct inotify_event *ev);
+
+/**
+ * set_dir
+ * <p>
+ * Remember the path of the directory a watch descriptor names.
+ * </p>
+ * @param w - watch *: the watch
+ * @param wd - int: the watch descriptor
+ * @param path - char *: the directory's path
+ */
+static void set_dir(struct watch *w, int wd, const char *path);
+
+/**
+ * mark_changed
+ * <p>
+ * Make a file's change due the debounce time from now, coalescing it with any change to the file
+ * not yet taken.
+ * </p>
+ * @param w - watch *: the watch
+ * @param path - char *: the file's path, which the watch takes over
+ */
+static void mark_changed(struct watch *w, char *path);
+
+/**
+ * drop_change
+ * <p>
+ * Forget the change to a file removed or moved away, if any.
+ * </p>
+ * @param w - watch *: the watch
+ * @param path - char *: the file's path
+ */
+static void drop_change(struct watch *w, const char *path);
+
+/**
+ * find_change
+ * <p>
+ * Find where the index holds a file's change, or would.
+ * </p>
+ * @param w - watch *: the watch
+ * @param path - char *: the file's path
+ * @param hash - uint64_t: the hash of the path
+ * @return the link pointing at the change, or at NULL if the file has none
+ */
+static struct change **find_change(const struct watch *w, const char *path, uint64_t hash);
+
+/**
+ * remove_change
+ * <p>
+ * Take a change out of the index and the order changes are due in, without freeing it.
+ * </p>
+ * @param w - watch *: the watch
+ * @param c - change *: the change
+ */
+static void remove_change(struct watch *w, struct change *c);
+
+/**
+ * append_change
+ * <p>
+ * Put a change last in the order changes are due in.
+ * </p>
+ * @param w - watch *: the watch
+ * @param c - change *: the change
+ */
+static void append_change(struct watch *w, struct change *c);
+
+/**
+ * grow_buckets
+ * <p>
+ * Double the buckets of the index of changes.
+ * </p>
+ * @param w - watch *: the watch
+ */
+static void grow_buckets(struct watch *w);
+
+/**
+ * hash_path
+ * <p>
+ * Hash a path with 64-bit FNV-1a.
+ * </p>
+ * @param path - char *: the path
+ * @return the hash
+ */
+static uint64_t hash_path(const char *path);
+
+/**
+ * now_ms
+ * <p>
+ * Get the monotonic time in milliseconds.
+ * </p>
+ * @return the time
+ */
+static uint64_t now_ms(void);
+
+struct watch *watch_open(char *const roots[], size_t n_roots, unsigned int debounce)
+{
+    struct watch *w;
+
+    if ((w = (struct watch *) calloc(1, sizeof(struct watch))) == NULL
+        || (w->roots = (char **) malloc(n_roots * sizeof(char *))) == NULL
+        || (w->buckets = (struct change **) calloc(WATCH_MIN_BUCKETS, sizeof(struct change *))) == NULL
+        || (w->events = (char *) malloc(WATCH_EVENT_BUF_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if ((w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    w->debounce = debounce;
+    w->n_buckets = WATCH_MIN_BUCKETS;
+    w->n_roots = n_roots;
+    for (size_t i = 0; i < n_roots; ++i)
+    {
+        if ((w->roots[i] = strdup(roots[i])) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        add_tree(w, roots[i], 0);
+    }
+    return w;
+}
+
+int watch_fd(const struct watch *w)
+{
+    return w->fd;
+}
+
+void watch_read(struct watch *w)
+{
+    ssize_t got;
+
+    while ((got = read(w->fd, w->events, WATCH_EVENT_BUF_SIZE)) != -1)
+    {
+        const char *p = w->events;
+
+        while (p < w->events + got)
+        {
+            const struct inotify_event *ev = (const struct inotify_event *) (const void *) p;
+
+            handle_event(w, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    if (errno != EAGAIN && errno != EINTR)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+int watch_timeout(const struct watch *w)
+{
+    uint64_t now;
+
+    if (w->head == NULL)
+    {
+        return -1;
+    }
+    now = now_ms();
+    return w->head->due > now ? (int) (w->head->due - now) : 0;
+}
+
+char *watch_next(struct watch *w, size_t *name_off)
+{
+    uint64_t now = now_ms();
+
+    while (w->head != NULL && w->head->due <= now)
+    {
+        struct change *c = w->head;
+        struct stat st;
+        char *path = c->path;
+
+        remove_change(w, c);
+        free(c);
+        // The file may have been removed, or replaced by something other than a regular file, since the event
+        if (lstat(path, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            *name_off = name_offset(w->roots, w->n_roots, path);
+            return path;
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+void watch_close(struct watch *w)
+{
+    while (w->head != NULL)
+    {
+        struct change *c = w->head;
+
+        remove_change(w, c);
+        free(c->path);
+        free(c);
+    }
+    for (size_t i = 0; i < w->cap_dirs; ++i)
+    {
+        free(w->dirs[i]);
+    }
+    for (size_t i = 0; i < w->n_roots; ++i)
+    {
+        free(w->roots[i]);
+    }
+    close(w->fd);
+    free(w->events);
+    free(w->buckets);
+    free(w->dirs);
+    free(w->roots);
+    free(w);
+}
+
+static void add_tree(struct watch *w, const char *path, int changed)
+{
+    DIR *dir;
+    struct dirent *ent;
+    int wd;
+
+    // The directory is watched before it is listed, so a file written in between is found either way
+    if ((wd = inotify_add_watch(w->fd, path, WATCH_MASK)) == -1)
+    {
+        if (errno == ENOENT || errno == ENOTDIR)
+        {
+            return;
+        }
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    set_dir(w, wd, path);
+
+    if ((dir = opendir(path)) == NULL)
+    {
+        if (errno == ENOENT || errno == ENOTDIR)
+        {
+            return;
+        }
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    for (errno = 0; (ent = readdir(dir)) != NULL; errno = 0) // NOLINT(concurrency-mt-unsafe) : No threads here
+    {
+        unsigned char type = ent->d_type;
+
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+        if (type == DT_UNKNOWN)
+        {
+            struct stat st;
+
+            if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+            {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR)
+        {
+            char *sub = join_path(path, ent->d_name);
+
+            add_tree(w, sub, changed);
+            free(sub);
+        } else if (type == DT_REG && changed)
+        {
+            mark_changed(w, join_path(path, ent->d_name));
+        }
+    }
+    if (errno != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    closedir(dir);
+}
+
+static void forget_tree(struct watch *w, const char *path)
+{
+    size_t len = strlen(path);
+
+    for (size_t i = 0; i < w->cap_dirs; ++i)
+    {
+        if (w->dirs[i] != NULL && strncmp(w->dirs[i], path, len) == 0
+            && (w->dirs[i][len] == '\0' || w->dirs[i][len] == '/'))
+        {
+            inotify_rm_watch(w->fd, (int) i);
+            free(w->dirs[i]);
+            w->dirs[i] = NULL;
+        }
+    }
+}
+
+static void handle_event(struct watch *w, const struct inotify_event *ev)
+{
+    char *path;
+
+    if (ev->mask & IN_Q_OVERFLOW)
+    {
+        printf("Missed changes to the watched directories; treating every file as changed\n");
+        for (size_t i = 0; i < w->n_roots; ++i)
+        {
+            add_tree(w, w->roots[i], 1);
+        }
+        return;
+    }
+    if (ev->wd < 0 || (size_t) ev->wd >= w->cap_dirs || w->dirs[ev->wd] == NULL)
+    {
+        // A directory forgotten after it was moved may still have had events queued
+        return;
+    }
+    if (ev->mask & IN_IGNORED)
+    {
+        free(w->dirs[ev->wd]);
+        w->dirs[ev->wd] = NULL;
+        return;
+    }
+    if (ev->len == 0)
+    {
+        return;
+    }
+
+    path = join_path(w->dirs[ev->wd], ev->name);
+    if (ev->mask & IN_ISDIR)
+    {
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            add_tree(w, path, 1);
+        } else if (ev->mask & IN_MOVED_FROM)
+        {
+            forget_tree(w, path);
+        }
+        free(path);
+    } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        mark_changed(w, path);
+    } else
+    {
+        if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            drop_change(w, path);
+        }
+        free(path);
+    }
+}
+
+static void set_dir(struct watch *w, int wd, const char *path)
+{
+    if ((size_t) wd >= w->cap_dirs)
+    {
+        size_t cap = w->cap_dirs * 2 > (size_t) wd ? w->cap_dirs * 2 : (size_t) wd + 1;
+
+        if ((w->dirs = (char **) realloc(w->dirs, cap * sizeof(char *))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        memset(w->dirs + w->cap_dirs, 0, (cap - w->cap_dirs) * sizeof(char *)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        w->cap_dirs = cap;
+    }
+    // Watching a directory again, as after missed events, gives the same descriptor
+    free(w->dirs[wd]);
+    if ((w->dirs[wd] = strdup(path)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+}
+
+static void mark_changed(struct watch *w, char *path)
+{
+    uint64_t hash = hash_path(path);
+    struct change **link = find_change(w, path, hash);
+    struct change *c = *link;
+
+    if (c != NULL)
+    {
+        free(path);
+        remove_change(w, c);
+    } else
+    {
+        if ((c = (struct change *) malloc(sizeof(struct change))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        c->path = path;
+        c->hash = hash;
+    }
+    c->due = now_ms() + w->debounce;
+    if (w->n_changes + 1 > w->n_buckets)
+    {
+        grow_buckets(w);
+    }
+    link = find_change(w, c->path, hash);
+    c->chain = NULL;
+    *link = c;
+    ++w->n_changes;
+    append_change(w, c);
+}
+
+static void drop_change(struct watch *w, const char *path)
+{
+    struct change *c = *find_change(w, path, hash_path(path));
+
+    if (c != NULL)
+    {
+        remove_change(w, c);
+        free(c->path);
+        free(c);
+    }
+}
+
+static struct change **find_change(const struct watch *w, const char *path, uint64_t hash)
+{
+    struct change **link = &w->buckets[hash & (w->n_buckets - 1)];
+
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->path, path) != 0))
+    {
+        link = &(*link)->chain;
+    }
+    return link;
+}
+
+static void remove_change(struct watch *w, struct change *c)
+{
+    *find_change(w, c->path, c->hash) = c->chain;
+    --w->n_changes;
+    if (c->prev != NULL)
+    {
+        c->prev->next = c->next;
+    } else
+    {
+        w->head = c->next;
+    }
+    if (c->next != NULL)
+    {
+        c->next->prev = c->prev;
+    } else
+    {
+        w->tail = c->prev;
+    }
+}
+
+static void append_change(struct watch *w, struct change *c)
+{
+    // Every change is due the same time after its event, so the last event's is due last
+    c->prev = w->tail;
+    c->next = NULL;
+    if (w->tail != NULL)
+    {
+        w->tail->next = c;
+    } else
+    {
+        w->head = c;
+    }
+    w->tail = c;
+}
+
+static void grow_buckets(struct watch *w)
+{
+    struct change **old = w->buckets;
+    size_t n_old = w->n_buckets;
+
+    w->n_buckets *= 2;
+    if ((w->buckets = (struct change **) calloc(w->n_buckets, sizeof(struct change *))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (size_t i = 0; i < n_old; ++i)
+    {
+        struct change *c = old[i];
+
+        while (c != NULL)
+        {
+            struct change *next = c->chain;
+            struct change **link = &w->buckets[c->hash & (w->n_buckets - 1)];
+
+            c->chain = *link;
+            *link = c;
+            c = next;
+        }
+    }
+    free(old);
+}
+
+static uint64_t hash_path(const char *path)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : FNV offset basis
+
+    for (; *path != '\0'; ++path)
+    {
+        hash ^= (uint8_t) *path;
+        hash *= 0x100000001B3ULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : FNV prime
+    }
+    return hash;
+}
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * MS_PER_SEC + (uint64_t) ts.tv_nsec / NS_PER_MS;
+}
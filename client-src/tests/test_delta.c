@@ -0,0 +1,217 @@
+#include "delta.h"
+#include "proto.h"
+#include "sha256.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The size of the blocks signed in the test base file.
+ */
+#define TEST_BLOCK_SIZE 4096
+
+/**
+ * The number of blocks in the test base file.
+ */
+#define TEST_BLOCKS 8
+
+/**
+ * The number of bytes the weak checksum rolls over, the whole base file.
+ */
+#define TEST_ROLL_LEN (TEST_BLOCKS * TEST_BLOCK_SIZE)
+
+/**
+ * A mask for the low 16 bits, where each half of the weak checksum is kept.
+ */
+#define LOW_16 0xffffU
+
+static int failures;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static uint64_t rng = 88172645463325252ULL; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift seed
+
+/**
+ * check
+ * <p>
+ * Count and report a failed check.
+ * </p>
+ * @param ok - int: whether the check passed
+ * @param what - char *: what was checked
+ */
+static void check(int ok, const char *what);
+
+/**
+ * fill_random
+ * <p>
+ * Fill a buffer from a fixed-seed xorshift generator, so every run tests the same bytes.
+ * </p>
+ * @param buf - uint8_t *: the buffer
+ * @param len - size_t: the number of bytes to fill
+ */
+static void fill_random(uint8_t *buf, size_t len);
+
+/**
+ * weak_by_definition
+ * <p>
+ * Compute the weak checksum straight from the protocol's definition: a is the sum of the bytes
+ * and b the sum of each byte times its distance from the end, both modulo 2^16.
+ * </p>
+ * @param data - uint8_t *: the block
+ * @param len - size_t: the number of bytes in the block
+ * @return the checksum, a in the low half and b in the high half
+ */
+static uint32_t weak_by_definition(const uint8_t *data, size_t len);
+
+/**
+ * test_weak
+ * <p>
+ * Compare delta_weak with the definition for blocks of several sizes.
+ * </p>
+ * @param data - uint8_t *: random bytes, TEST_ROLL_LEN of them
+ */
+static void test_weak(const uint8_t *data);
+
+/**
+ * test_roll
+ * <p>
+ * Roll the weak checksum over every window of several sizes and compare it with the checksum
+ * computed afresh at each window.
+ * </p>
+ * @param data - uint8_t *: random bytes, TEST_ROLL_LEN of them
+ */
+static void test_roll(const uint8_t *data);
+
+/**
+ * test_find
+ * <p>
+ * Sign a base file as the server does, then find each of its blocks, and find no block whose
+ * bytes changed.
+ * </p>
+ * @param data - uint8_t *: random bytes, TEST_ROLL_LEN of them
+ */
+static void test_find(const uint8_t *data);
+
+int main(void)
+{
+    uint8_t *data;
+
+    if ((data = (uint8_t *) malloc(TEST_ROLL_LEN)) == NULL)
+    {
+        check(0, "allocate data");
+        return EXIT_FAILURE;
+    }
+    fill_random(data, TEST_ROLL_LEN);
+    test_weak(data);
+    test_roll(data);
+    test_find(data);
+    free(data);
+    printf("delta: %d failed\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void check(int ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static void fill_random(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        rng ^= rng << 13; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift64
+        rng ^= rng >> 7;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift64
+        rng ^= rng << 17; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift64
+        buf[i] = (uint8_t) rng;
+    }
+}
+
+static uint32_t weak_by_definition(const uint8_t *data, size_t len)
+{
+    uint64_t a = 0;
+    uint64_t b = 0;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        a += data[i];
+        b += (uint64_t) (len - i) * data[i];
+    }
+    return (uint32_t) (a & LOW_16) | (uint32_t) (b & LOW_16) << 16; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : High half
+}
+
+static void test_weak(const uint8_t *data)
+{
+    static const size_t lens[] = {0, 1, 2, 255, 256, TEST_BLOCK_SIZE, TEST_ROLL_LEN};
+    uint8_t ones[TEST_BLOCK_SIZE];
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+    {
+        check(delta_weak(data, lens[i]) == weak_by_definition(data, lens[i]), "weak checksum of random bytes");
+    }
+
+    // Every byte at its largest makes both sums wrap
+    memset(ones, 0xff, sizeof(ones)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Not a POSIX function
+    check(delta_weak(ones, sizeof(ones)) == weak_by_definition(ones, sizeof(ones)), "weak checksum of 0xff bytes");
+}
+
+static void test_roll(const uint8_t *data)
+{
+    static const size_t lens[] = {1, 16, 1000, TEST_BLOCK_SIZE};
+
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+    {
+        size_t len = lens[i];
+        uint32_t weak = delta_weak(data, len);
+        int same = 1;
+
+        for (size_t at = 0; at + len < TEST_ROLL_LEN; ++at)
+        {
+            weak = delta_roll(weak, data[at], data[at + len], len);
+            same &= weak == delta_weak(data + at + 1, len);
+        }
+        check(same, "rolled weak checksum");
+    }
+}
+
+static void test_find(const uint8_t *data)
+{
+    struct delta_index index;
+    uint8_t *sigs;
+    uint8_t block[TEST_BLOCK_SIZE];
+
+    if ((sigs = (uint8_t *) malloc(TEST_BLOCKS * PROTO_SIG_SIZE)) == NULL)
+    {
+        check(0, "allocate signatures");
+        return;
+    }
+    for (size_t i = 0; i < TEST_BLOCKS; ++i)
+    {
+        struct sha256_ctx ctx;
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        uint32_t weak = htonl(delta_weak(data + i * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE));
+
+        sha256_init(&ctx);
+        sha256_update(&ctx, data + i * TEST_BLOCK_SIZE, TEST_BLOCK_SIZE);
+        sha256_digest(&ctx, digest);
+        memcpy(sigs + i * PROTO_SIG_SIZE, &weak, sizeof(weak));
+        memcpy(sigs + i * PROTO_SIG_SIZE + sizeof(weak), digest, PROTO_SIG_SIZE - sizeof(weak));
+    }
+    delta_index_open(&index, sigs, TEST_BLOCKS, TEST_BLOCK_SIZE);
+
+    for (size_t i = 0; i < TEST_BLOCKS; ++i)
+    {
+        const uint8_t *base = data + i * TEST_BLOCK_SIZE;
+
+        check(delta_find(&index, delta_weak(base, TEST_BLOCK_SIZE), base) == i, "block of the base file");
+    }
+
+    // Passing the old weak checksum leaves only the strong checksum to turn the changed block away
+    memcpy(block, data, sizeof(block));
+    block[TEST_BLOCK_SIZE / 2] ^= 1U;
+    check(delta_find(&index, delta_weak(data, TEST_BLOCK_SIZE), block) == DELTA_NO_MATCH, "changed block, old weak checksum");
+    check(delta_find(&index, delta_weak(block, TEST_BLOCK_SIZE), block) == DELTA_NO_MATCH, "changed block");
+    check(delta_find(&index, delta_weak(data + 1, TEST_BLOCK_SIZE), data + 1) == DELTA_NO_MATCH, "block off the base's boundaries");
+    delta_index_close(&index);
+}
@@ -0,0 +1,137 @@
+#ifndef SERVER_SRC_ACK_H
+#define SERVER_SRC_ACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The longest time, in milliseconds, an acknowledgement waits for room in a client's socket before
+ * the client is dropped for not reading them.
+ */
+#define ACK_SEND_TIMEOUT_MS 5000
+
+/**
+ * ack_chan
+ * <p>
+ * Opaque struct storing the way back to a client that asked for acknowledgements, resumable
+ * uploads or to skip content the server has. Files are reported as saved on whichever thread finishes them, possibly after the
+ * connection has closed, so the channel holds its own descriptor for the socket and lives until
+ * the last file holding it is reported.
+ * </p>
+ */
+struct ack_chan;
+
+/**
+ * ack_info
+ * <p>
+ * Struct storing what to acknowledge once a file is saved.
+ * <ul>
+ * <li>struct ack_chan *chan: the channel to the client, or NULL if the client takes no acks</li>
+ * <li>uint32_t stream: the stream that carried the file</li>
+ * <li>const char *save_name: the name the file was stored under</li>
+ * </ul>
+ * </p>
+ */
+struct ack_info
+{
+    struct ack_chan *chan;
+    uint32_t stream;
+    const char *save_name;
+};
+
+/**
+ * ack_open
+ * <p>
+ * Create the acknowledgement channel for a client.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: ack_open dynamically allocates memory. Must release the channel with ack_release!
+ * </h3>
+ * </p>
+ * @param fd - int: file descriptor for socket of connected client
+ * @return the channel, holding one reference, or NULL if the socket cannot be duplicated
+ */
+struct ack_chan *ack_open(int fd);
+
+/**
+ * ack_hold
+ * <p>
+ * Take another reference to a channel, for a file that will be reported later.
+ * </p>
+ * @param chan - ack_chan *: the channel, or NULL
+ * @return the channel
+ */
+struct ack_chan *ack_hold(struct ack_chan *chan);
+
+/**
+ * ack_release
+ * <p>
+ * Drop a reference to a channel, closing it with the last one.
+ * </p>
+ * @param chan - ack_chan *: the channel, or NULL
+ */
+void ack_release(struct ack_chan *chan);
+
+/**
+ * ack_send
+ * <p>
+ * Acknowledge a saved file. Safe to call from any thread. A client that leaves no room for the
+ * acknowledgement within ACK_SEND_TIMEOUT_MS is dropped, since it is not reading them.
+ * </p>
+ * @param ack - ack_info *: what to acknowledge
+ * @param len - uint64_t: the size of the file
+ */
+void ack_send(const struct ack_info *ack, uint64_t len);
+
+/**
+ * ack_offset
+ * <p>
+ * Tell the client where the data of a resumable stream resumes, as ack_send would send an
+ * acknowledgement.
+ * </p>
+ * @param chan - ack_chan *: the channel
+ * @param stream - uint32_t: the stream
+ * @param offset - uint64_t: the number of bytes of the file the server already holds
+ */
+void ack_offset(struct ack_chan *chan, uint32_t stream, uint64_t offset);
+
+/**
+ * ack_have
+ * <p>
+ * Tell the client the content of a hashed stream's file is already stored, so its data is not
+ * needed.
+ * </p>
+ * @param chan - ack_chan *: the channel
+ * @param stream - uint32_t: the stream
+ * @param len - uint64_t: the size of the file
+ */
+void ack_have(struct ack_chan *chan, uint32_t stream, uint64_t len);
+
+/**
+ * ack_sigs
+ * <p>
+ * Send the client the block signatures of a delta stream's base file, as ack_send would send an
+ * acknowledgement.
+ * </p>
+ * @param chan - ack_chan *: the channel
+ * @param stream - uint32_t: the stream
+ * @param base_size - uint64_t: the size of the base file, 0 if there is none
+ * @param block_size - uint32_t: the size of the base file's blocks
+ * @param sigs - uint8_t *: PROTO_SIG_SIZE bytes for each whole block of the base file
+ * @param sigs_len - size_t: the number of bytes of sigs
+ */
+void ack_sigs(struct ack_chan *chan, uint32_t stream, uint64_t base_size, uint32_t block_size, uint8_t *sigs,
+              size_t sigs_len);
+
+/**
+ * ack_drop
+ * <p>
+ * Drop the client from any thread, when a file it sent cannot be saved. Nothing more is sent on the
+ * channel, and the connection's thread closes the connection as it would any other that left.
+ * </p>
+ * @param chan - ack_chan *: the channel, or NULL
+ */
+void ack_drop(struct ack_chan *chan);
+
+#endif //SERVER_SRC_ACK_H
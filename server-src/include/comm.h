@@ -13,6 +13,10 @@
  * While the running flag is set, accept connections from clients. Receive information from
  * clients and store that information in client-specific directories.
  * </p>
+ * <p>
+ * Clients are served one at a time or concurrently from an event loop, as chosen by the io_mode
+ * in server_settings.
+ * </p>
  * @param set - server_settings *: pointer to the settings for this server
  */
 void recv_clients(struct server_settings *set);
@@ -0,0 +1,333 @@
+#ifndef SERVER_SRC_CONN_H
+#define SERVER_SRC_CONN_H
+
+#include "ack.h"
+#include "proto.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The size of the buffer through which file data is moved from a socket to its file. Memory used
+ * per upload is bounded by this, not by the size of the file.
+ */
+#define CONN_BUF_SIZE (64 * 1024)
+
+/**
+ * conn_io
+ * <p>
+ * Struct storing the scratch resources a thread lends to conn_recv for moving file data. They are
+ * only used during the call, so one conn_io can be shared by every connection of a thread.
+ * <ul>
+ * <li>char *buf: buffer through which file data is copied</li>
+ * <li>size_t buf_size: the size of buf</li>
+ * <li>int pipe_fds[]: pipe through which file data is spliced without entering user space;
+ * both -1 to copy through buf instead</li>
+ * <li>struct writer_stream *stream: buffers through which file data is handed to the disk-writer
+ * threads, or NULL to write on this thread</li>
+ * <li>struct writer_pool *pool: the threads to which work too slow for this thread is handed</li>
+ * <li>int direct_io: whether files written on this thread use direct I/O</li>
+ * <li>int dedup: whether files are hashed as they arrive so each content is stored once</li>
+ * <li>int sized_only: whether files must announce their size, as the segment store needs</li>
+ * <li>uint16_t features: the v2 features offered to clients</li>
+ * </ul>
+ * </p>
+ */
+struct conn_io
+{
+    char *buf;
+    size_t buf_size;
+    int pipe_fds[2];
+    struct writer_stream *stream;
+    struct writer_pool *pool;
+    int direct_io;
+    int dedup;
+    int sized_only;
+    uint16_t features;
+};
+
+/**
+ * The most files one connection may be receiving at once.
+ */
+#define CONN_MAX_FILES PROTO_MAX_STREAMS
+
+/**
+ * conn_state
+ * <p>
+ * The part of the protocol a connection is currently waiting to receive.
+ * <ul>
+ * <li>CONN_NAME_LEN: 2 bytes as the [file-name-length], or 0 to begin a v2 hello</li>
+ * <li>CONN_NAME: [file-name-length] bytes as the file name</li>
+ * <li>CONN_DATA_LEN: 4 bytes as the [file-size]</li>
+ * <li>CONN_DATA: bytes of the current file's data: the whole file in v1, one frame's worth in v2</li>
+ * <li>CONN_HELLO: the rest of a v2 hello</li>
+ * <li>CONN_FRAME: a v2 frame header</li>
+ * <li>CONN_FRAME_NAME: the file name of a v2 open frame, then the transfer ID of a resumable one
+ * and the digest of a hashed one, or the transfer ID, offset and size of a stripe</li>
+ * <li>CONN_FRAME_DIGEST: the digest following the end frame of a resumable or delta v2 stream</li>
+ * <li>CONN_FRAME_PACKED: the payload of a compressed v2 data frame</li>
+ * </ul>
+ * </p>
+ */
+enum conn_state
+{
+    CONN_NAME_LEN,
+    CONN_NAME,
+    CONN_DATA_LEN,
+    CONN_DATA,
+    CONN_HELLO,
+    CONN_FRAME,
+    CONN_FRAME_NAME,
+    CONN_FRAME_DIGEST,
+    CONN_FRAME_PACKED
+};
+
+/**
+ * conn_event
+ * <p>
+ * What conn_decode found in the bytes it was given. Every file event is about the connection's cur file.
+ * <ul>
+ * <li>CONN_EV_NONE: every byte was consumed without completing anything</li>
+ * <li>CONN_EV_HELLO: the client asked for protocol v2; answer with conn_greet</li>
+ * <li>CONN_EV_FILE: the header of a file is complete; its file_name and size are set</li>
+ * <li>CONN_EV_DATA: a span of the file's data, decompressed if it came compressed</li>
+ * <li>CONN_EV_COPY: the file's next bytes are its base file's block number copy</li>
+ * <li>CONN_EV_END: the file is complete</li>
+ * <li>CONN_EV_ERROR: the client broke the protocol; the connection's error says how</li>
+ * </ul>
+ * </p>
+ */
+enum conn_event
+{
+    CONN_EV_NONE,
+    CONN_EV_HELLO,
+    CONN_EV_FILE,
+    CONN_EV_DATA,
+    CONN_EV_COPY,
+    CONN_EV_END,
+    CONN_EV_ERROR
+};
+
+/**
+ * conn_file
+ * <p>
+ * Struct storing one file a client is sending. In v1 there is only ever one; in v2 there is one
+ * per open stream.
+ * <ul>
+ * <li>int open: whether the file is being received</li>
+ * <li>uint32_t stream: the v2 stream carrying the file</li>
+ * <li>char *file_name: the file name</li>
+ * <li>uint64_t size: the size of the file, or PROTO_SIZE_UNKNOWN until it ends; for a stripe, the
+ * size of the stripe</li>
+ * <li>uint64_t recv_len: the number of bytes of the name or data received</li>
+ * <li>int save_fd: file descriptor for the file being saved, or -1</li>
+ * <li>struct writer_file *wfile: the file being saved by a disk writer, or NULL</li>
+ * <li>struct direct_file *direct: the direct I/O state of save_fd, or NULL if it is written as usual</li>
+ * <li>char *save_path: the name of the file being saved, relative to the connection's dir_fd</li>
+ * <li>struct sha256_ctx *hash: the hash of the file's data, or NULL if files are neither
+ * deduplicated, resumable nor deltas</li>
+ * <li>int resumable: whether the file's stream is resumable</li>
+ * <li>int hashed: whether the file's open carried its digest</li>
+ * <li>int partial: whether save_fd is a partial file kept if the upload is cut off</li>
+ * <li>uint8_t transfer_id[]: the transfer ID of a resumable stream or a stripe</li>
+ * <li>uint8_t digest[]: the digest the client sent for the whole file of a resumable, hashed or
+ * delta stream</li>
+ * <li>int delta: whether the file's stream is a delta</li>
+ * <li>int base_fd: file descriptor for the base file of a delta stream, or -1</li>
+ * <li>uint32_t block_size: the size of the base file's blocks</li>
+ * <li>uint64_t blocks: the number of whole blocks in the base file</li>
+ * <li>uint64_t copy: the block named by the last CONN_EV_COPY</li>
+ * <li>char *block: a buffer of block_size bytes through which blocks are copied, or NULL</li>
+ * <li>int striped: whether the file's stream is a stripe of a larger file</li>
+ * <li>uint64_t stripe_offset: where in the whole file the stripe starts</li>
+ * <li>uint64_t stripe_size: the size of the whole file</li>
+ * <li>struct stripe *stripe: the whole file, while the stripe is received, or NULL</li>
+ * </ul>
+ * </p>
+ */
+struct conn_file
+{
+    int open;
+    uint32_t stream;
+    char *file_name;
+    uint64_t size;
+    uint64_t recv_len;
+    int save_fd;
+    struct writer_file *wfile;
+    struct direct_file *direct;
+    char *save_path;
+    struct sha256_ctx *hash;
+    int resumable;
+    int hashed;
+    int partial;
+    uint8_t transfer_id[PROTO_TRANSFER_ID_SIZE];
+    uint8_t digest[PROTO_DIGEST_SIZE];
+    int delta;
+    int base_fd;
+    uint32_t block_size;
+    uint64_t blocks;
+    uint64_t copy;
+    char *block;
+    int striped;
+    uint64_t stripe_offset;
+    uint64_t stripe_size;
+    struct stripe *stripe;
+};
+
+/**
+ * conn
+ * <p>
+ * Struct storing the protocol state of one connected client.
+ * <ul>
+ * <li>int fd: file descriptor for socket of connected client</li>
+ * <li>enum conn_state state: the part of the protocol being received</li>
+ * <li>int version: the protocol version the client speaks, or 0 until its first header</li>
+ * <li>uint16_t features: the v2 features the client asked for, then those both sides speak once
+ * the hello is answered</li>
+ * <li>struct ack_chan *acks: the channel for acknowledging saved files and resume offsets, or NULL
+ * if the client takes neither</li>
+ * <li>char addr_str[]: the client's IP address</li>
+ * <li>in_port_t port: the client's port number</li>
+ * <li>char *save_dir: the directory to which files will be saved for this client</li>
+ * <li>int dir_fd: file descriptor for save_dir, owned by the save directory cache</li>
+ * <li>uint8_t hdr[]: bytes received so far of the current header</li>
+ * <li>size_t hdr_recv: the number of bytes in hdr</li>
+ * <li>uint16_t f_name_len: the length of the file name being received</li>
+ * <li>struct conn_file files[]: the files being received</li>
+ * <li>struct conn_file *cur: the file the current header, data or event belongs to</li>
+ * <li>uint64_t data_left: the number of bytes of data left in the current span</li>
+ * <li>struct conn_file *done: a file reported complete, cleared by the next conn_decode</li>
+ * <li>struct conn_file *held: the file whose disk writer buffer may be partly filled, or NULL</li>
+ * <li>char *packed: the payload of the compressed data frame being received, or NULL until the
+ * first one</li>
+ * <li>size_t packed_len: the size of that payload</li>
+ * <li>char *unpacked: the data decompressed from it, PROTO_COMPRESS_MAX bytes, or NULL</li>
+ * <li>const char *error: what the client did wrong, once conn_decode reports CONN_EV_ERROR</li>
+ * </ul>
+ * </p>
+ */
+struct conn
+{
+    int fd;
+    enum conn_state state;
+    int version;
+    uint16_t features;
+    struct ack_chan *acks;
+    char addr_str[INET_ADDRSTRLEN];
+    in_port_t port;
+    char *save_dir;
+    int dir_fd;
+    uint8_t hdr[PROTO_FRAME_SIZE];
+    size_t hdr_recv;
+    uint16_t f_name_len;
+    struct conn_file files[CONN_MAX_FILES];
+    struct conn_file *cur;
+    uint64_t data_left;
+    struct conn_file *done;
+    struct conn_file *held;
+    char *packed;
+    size_t packed_len;
+    char *unpacked;
+    const char *error;
+};
+
+/**
+ * conn_open
+ * <p>
+ * Create the state for a newly accepted client and open the client's save directory.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: conn_open dynamically allocates memory. Must release the connection with conn_close!
+ * </h3>
+ * </p>
+ * @param fd - int: file descriptor for socket of connected client
+ * @param client_addr - sockaddr_in *: the client's address
+ * @param wr_dir - char *: the base write directory stored in server_settings
+ * @return the connection, or NULL, with the socket closed, if the save directory cannot be opened
+ */
+struct conn *conn_open(int fd, const struct sockaddr_in *client_addr, const char *wr_dir);
+
+/**
+ * conn_recv
+ * <p>
+ * Receive whatever the client has sent without blocking, advancing the protocol state. File data
+ * is streamed to the file as it arrives: copied through io's buffer, spliced through io's pipe,
+ * or received into io's writer buffers and handed to a disk writer. The file is opened once its
+ * size is known. A file cut off by a disconnect is discarded when the connection is closed.
+ * </p>
+ * @param c - conn *: the connection
+ * @param io - conn_io *: the scratch resources through which file data is moved
+ * @return 1 if the connection is still open, 0 if the client left or the connection failed
+ */
+int conn_recv(struct conn *c, const struct conn_io *io);
+
+/**
+ * conn_greet
+ * <p>
+ * Answer a client's v2 hello, after conn_decode reports CONN_EV_HELLO, with the features both
+ * sides speak. If they include any feature the server answers frames for, open the connection's
+ * acknowledgement channel.
+ * </p>
+ * @param c - conn *: the connection
+ * @param offered - uint16_t: the features this server offers
+ * @return 0 on success, -1 if the answer could not be sent or its acknowledgement channel opened
+ */
+int conn_greet(struct conn *c, uint16_t offered);
+
+/**
+ * conn_io_open
+ * <p>
+ * Allocate the scratch resources for conn_recv. If the settings ask for splicing, create a pipe
+ * sized to CONN_BUF_SIZE; if they have a writer pool, create the buffers for handing data to it.
+ * If they ask for direct I/O, files written on this thread bypass the page cache; if they ask for
+ * deduplication, files are hashed as they arrive. Resumable uploads, deltas and stripes are offered
+ * with the files store, and skipping content the server has with deduplication too.
+ * </p>
+ * @param io - conn_io *: the scratch resources to initialize
+ * @param set - server_settings *: pointer to the settings for this server
+ */
+void conn_io_open(struct conn_io *io, const struct server_settings *set);
+
+/**
+ * conn_io_close
+ * <p>
+ * Free the scratch resources for conn_recv, waiting for the disk writers to finish with them.
+ * </p>
+ * @param io - conn_io *: the scratch resources
+ */
+void conn_io_close(struct conn_io *io);
+
+/**
+ * conn_decode
+ * <p>
+ * Decode the protocol from bytes the caller has already received, stopping at the first event.
+ * Both protocol versions are understood; the first header decides which one the client speaks.
+ * Data is not copied: a CONN_EV_DATA event points into buf, or into the connection's unpacked
+ * buffer for a compressed frame, valid until the next call. The file stays valid until the call
+ * after CONN_EV_END. Call repeatedly until it returns CONN_EV_NONE, since CONN_EV_END may be
+ * reported without consuming any bytes.
+ * </p>
+ * @param c - conn *: the connection
+ * @param buf - char *: the received bytes
+ * @param len - size_t: the number of bytes in buf
+ * @param consumed - size_t *: pointer to the memory to hold the number of bytes of buf used
+ * @param data - char **: pointer to the memory to hold the start of a CONN_EV_DATA span
+ * @param data_len - size_t *: pointer to the memory to hold the length of a CONN_EV_DATA span
+ * @return the event found
+ */
+enum conn_event conn_decode(struct conn *c, const char *buf, size_t len, size_t *consumed,
+                            const char **data, size_t *data_len);
+
+/**
+ * conn_close
+ * <p>
+ * Close the client's socket and free the connection, discarding any partly received file.
+ * </p>
+ * @param c - conn *: the connection
+ */
+void conn_close(struct conn *c);
+
+#endif //SERVER_SRC_CONN_H
@@ -0,0 +1,72 @@
+#ifndef SERVER_SRC_DELTA_H
+#define SERVER_SRC_DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The smallest block into which a base file is cut.
+ */
+#define DELTA_MIN_BLOCK 4096
+
+/**
+ * The largest block into which a base file is cut.
+ */
+#define DELTA_MAX_BLOCK (128 * 1024)
+
+/**
+ * delta_block_size
+ * <p>
+ * Choose the block size for a base file: about the square root of its size, as a power of two
+ * between DELTA_MIN_BLOCK and DELTA_MAX_BLOCK, which balances the signatures sent against the
+ * literal bytes a change costs.
+ * </p>
+ * @param size - uint64_t: the size of the base file
+ * @return the block size
+ */
+uint32_t delta_block_size(uint64_t size);
+
+/**
+ * delta_weak
+ * <p>
+ * Compute the weak checksum of a block, as the protocol defines it.
+ * </p>
+ * @param data - uint8_t *: the block
+ * @param len - size_t: the number of bytes in the block
+ * @return the checksum
+ */
+uint32_t delta_weak(const uint8_t *data, size_t len);
+
+/**
+ * delta_sigs
+ * <p>
+ * Read a base file and compute the PROTO_SIG_SIZE signature of each of its whole blocks.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: delta_sigs dynamically allocates memory. Must free the pointer passed as the last parameter!
+ * </h3>
+ * </p>
+ * @param base_fd - int: file descriptor for the base file
+ * @param blocks - uint64_t: the number of whole blocks in the base file
+ * @param block_size - uint32_t: the size of the blocks
+ * @param sigs - uint8_t **: pointer to the memory to hold blocks * PROTO_SIG_SIZE bytes of
+ *               signatures, or NULL if the file was cut short under us
+ * @return 0 on success, -1 if the file was cut short under us
+ */
+int delta_sigs(int base_fd, uint64_t blocks, uint32_t block_size, uint8_t **sigs);
+
+/**
+ * delta_read_block
+ * <p>
+ * Read one whole block of a base file.
+ * </p>
+ * @param base_fd - int: file descriptor for the base file
+ * @param block - char *: the memory to hold the block
+ * @param block_size - uint32_t: the size of the blocks
+ * @param index - uint64_t: the block to read
+ * @return 0 on success, -1 if the file was cut short under us
+ */
+int delta_read_block(int base_fd, char *block, uint32_t block_size, uint64_t index);
+
+#endif //SERVER_SRC_DELTA_H
@@ -0,0 +1,92 @@
+#ifndef SERVER_SRC_DIRECT_H
+#define SERVER_SRC_DIRECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The alignment O_DIRECT requires of buffers, file offsets and write lengths. It is at least the
+ * logical block size of every common device.
+ */
+#define DIRECT_ALIGN 4096
+
+/**
+ * The size of each pooled buffer, and so of each direct write.
+ */
+#define DIRECT_BUF_SIZE (1024 * 1024)
+
+/**
+ * The smallest file written with direct I/O. A direct write waits for the device, which costs a
+ * small file more than the few pages it would leave in the page cache.
+ */
+#define DIRECT_MIN_SIZE (64 * 1024)
+
+/**
+ * direct_file
+ * <p>
+ * Opaque struct storing a file being written with direct I/O, and the aligned buffer in which its
+ * data is gathered into whole blocks.
+ * </p>
+ */
+struct direct_file;
+
+/**
+ * direct_open
+ * <p>
+ * Switch an open file to direct I/O, so its data bypasses the page cache, and take a buffer from
+ * the pool for it. The file must be empty and written only through direct_write from then on.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: direct_open dynamically allocates memory. Must release the file with direct_finish or direct_discard!
+ * </h3>
+ * </p>
+ * @param save_fd - int: file descriptor for the file
+ * @param size - uint64_t: the size the file will have
+ * @return the file, or NULL if the file is too small for direct I/O or its filesystem does not
+ *         support it; write it as usual instead
+ */
+struct direct_file *direct_open(int save_fd, uint64_t size);
+
+/**
+ * direct_write
+ * <p>
+ * Append data to the file. Data is written once a whole buffer has been gathered. If the
+ * filesystem turns out to reject direct writes, the file falls back to buffered writes.
+ * </p>
+ * @param df - direct_file *: the file
+ * @param data - char *: the data
+ * @param len - size_t: the number of bytes of data
+ */
+void direct_write(struct direct_file *df, const char *data, size_t len);
+
+/**
+ * direct_finish
+ * <p>
+ * Write the data still gathered, return the buffer to the pool and free the file. The whole
+ * blocks are written directly; the unaligned tail, which O_DIRECT cannot write, is written
+ * through the page cache. The file descriptor is left open.
+ * </p>
+ * @param df - direct_file *: the file
+ */
+void direct_finish(struct direct_file *df);
+
+/**
+ * direct_discard
+ * <p>
+ * Drop the data still gathered, return the buffer to the pool and free the file. The file
+ * descriptor is left open.
+ * </p>
+ * @param df - direct_file *: the file
+ */
+void direct_discard(struct direct_file *df);
+
+/**
+ * direct_pool_free
+ * <p>
+ * Free every buffer in the pool. Call once no file is being written.
+ * </p>
+ */
+void direct_pool_free(void);
+
+#endif //SERVER_SRC_DIRECT_H
@@ -0,0 +1,73 @@
+#ifndef SERVER_SRC_DURABLE_H
+#define SERVER_SRC_DURABLE_H
+
+#include "ack.h"
+#include <stdint.h>
+
+/**
+ * The default longest time, in milliseconds, a group commit waits for more files before syncing.
+ */
+#define DURABLE_DEF_GROUP_MS 10
+
+/**
+ * The default number of file bytes after which a group commit syncs without waiting out its window.
+ */
+#define DURABLE_DEF_GROUP_BYTES (32UL * 1024 * 1024)
+
+/**
+ * durability
+ * <p>
+ * When a saved file is made durable, and so when it is reported as saved.
+ * <ul>
+ * <li>DURABILITY_NONE: never sync; report a file once it is written</li>
+ * <li>DURABILITY_FILE: sync each file and its directory before reporting it</li>
+ * <li>DURABILITY_GROUP: gather the files finished within a short window or byte budget, sync them
+ * together with one syncfs, then report them all</li>
+ * </ul>
+ * </p>
+ */
+enum durability
+{
+    DURABILITY_NONE,
+    DURABILITY_FILE,
+    DURABILITY_GROUP
+};
+
+/**
+ * durable_start
+ * <p>
+ * Set the durability mode. Under DURABILITY_GROUP, start the thread that commits groups.
+ * </p>
+ * @param mode - enum durability: the durability mode
+ * @param group_ms - unsigned int: the longest a group waits for more files, in milliseconds
+ * @param group_bytes - uint64_t: the number of file bytes that ends a group early
+ */
+void durable_start(enum durability mode, unsigned int group_ms, uint64_t group_bytes);
+
+/**
+ * durable_stop
+ * <p>
+ * Commit every file still waiting in a group, then stop the group commit thread.
+ * </p>
+ */
+void durable_stop(void);
+
+/**
+ * durable_save
+ * <p>
+ * Finish a completely written file: make it durable as the mode requires and report it as saved
+ * only once it is, acknowledging it to the client if the client asked. Safe to call from any
+ * thread; under DURABILITY_GROUP it returns at once and the report follows the group's sync.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory holding the file
+ * @param save_fd - int: file descriptor for the file, which is closed; or -1 if the caller has
+ *                  already closed it and, under DURABILITY_FILE, synced it and its directory
+ * @param save_dir - char *: the directory's path, for the report
+ * @param file_name - char *: the name the client sent, for the report
+ * @param len - uint64_t: the size of the file
+ * @param ack - ack_info *: what to acknowledge to the client; its channel, if any, is held until then
+ */
+void durable_save(int dir_fd, int save_fd, const char *save_dir, const char *file_name, uint64_t len,
+                  const struct ack_info *ack);
+
+#endif //SERVER_SRC_DURABLE_H
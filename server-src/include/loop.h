@@ -0,0 +1,24 @@
+#ifndef SERVER_SRC_LOOP_H
+#define SERVER_SRC_LOOP_H
+
+#include "server.h"
+#include <signal.h>
+
+/**
+ * run_event_loop
+ * <p>
+ * While the running flag is set, serve every connected client from non-blocking epoll event
+ * loops. New connections are accepted as they arrive and each client's files are received as its
+ * bytes arrive, so a slow client never holds up the others.
+ * </p>
+ * <p>
+ * One event loop runs per worker in server_settings: the first on the calling thread and the rest
+ * on their own threads. Each is an epoll loop, or an io_uring loop when the io_mode is IO_MODE_URING. Each owns its listening socket and connection table, so workers share no
+ * locks.
+ * </p>
+ * @param set - server_settings *: pointer to the settings for this server
+ * @param running - sig_atomic_t *: the flag cleared by the signal handler to stop the server
+ */
+void run_event_loop(struct server_settings *set, const volatile sig_atomic_t *running);
+
+#endif //SERVER_SRC_LOOP_H
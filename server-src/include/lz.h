@@ -0,0 +1,26 @@
+#ifndef SERVER_SRC_LZ_H
+#define SERVER_SRC_LZ_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * The most bytes a compressor may produce from len bytes, when nothing repeats.
+ */
+#define LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+/**
+ * lz_decompress
+ * <p>
+ * Decompress one block of the LZ4 block format. The block comes from the client, so every length
+ * and offset in it is checked against the buffers before it is used.
+ * </p>
+ * @param src - char *: the block
+ * @param len - size_t: the number of bytes in the block
+ * @param dst - char *: the memory to hold the bytes
+ * @param cap - size_t: the number of bytes dst can hold
+ * @return the number of bytes decompressed, or -1 if the block is malformed or does not fit
+ */
+ssize_t lz_decompress(const char *src, size_t len, char *dst, size_t cap);
+
+#endif //SERVER_SRC_LZ_H
@@ -0,0 +1,99 @@
+#ifndef SERVER_SRC_MPSC_H
+#define SERVER_SRC_MPSC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+
+/**
+ * mpsc_node
+ * <p>
+ * Struct linking an item into an mpsc_queue. Embed it as the first member of the item.
+ * </p>
+ */
+struct mpsc_node
+{
+    struct mpsc_node *_Atomic next;
+};
+
+/**
+ * mpsc_queue
+ * <p>
+ * Struct storing an intrusive, unbounded, lock-free queue that any number of threads push to and
+ * one thread pops from. A push links its node with one atomic exchange, then counts it under the
+ * lock; the consumer sleeps on a condition variable while the queue is empty. The condition
+ * variable keeps CLOCK_MONOTONIC, so a change to the wall clock does not stretch or cut short a
+ * timed wait.
+ * <ul>
+ * <li>struct mpsc_node *head: the node most recently pushed</li>
+ * <li>struct mpsc_node *tail: the next node to pop, touched only by the consumer</li>
+ * <li>struct mpsc_node stub: placeholder node keeping the list non-empty</li>
+ * <li>pthread_mutex_t lock: lock guarding items</li>
+ * <li>pthread_cond_t ready: signalled as a node is pushed</li>
+ * <li>size_t items: the number of nodes pushed and not yet popped</li>
+ * </ul>
+ * </p>
+ */
+struct mpsc_queue
+{
+    struct mpsc_node *_Atomic head;
+    struct mpsc_node *tail;
+    struct mpsc_node stub;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    size_t items;
+};
+
+/**
+ * mpsc_init
+ * <p>
+ * Initialize an empty queue.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ */
+void mpsc_init(struct mpsc_queue *q);
+
+/**
+ * mpsc_destroy
+ * <p>
+ * Release the resources of an empty queue.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ */
+void mpsc_destroy(struct mpsc_queue *q);
+
+/**
+ * mpsc_push
+ * <p>
+ * Add a node to the back of the queue. Safe to call from any thread.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ * @param node - mpsc_node *: the node
+ */
+void mpsc_push(struct mpsc_queue *q, struct mpsc_node *node);
+
+/**
+ * mpsc_pop
+ * <p>
+ * Remove the node at the front of the queue, waiting for one to be pushed if the queue is empty.
+ * Only the queue's one consumer thread may call this.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ * @return the node
+ */
+struct mpsc_node *mpsc_pop(struct mpsc_queue *q);
+
+/**
+ * mpsc_pop_until
+ * <p>
+ * Remove the node at the front of the queue, waiting no later than deadline for one to be pushed.
+ * Only the queue's one consumer thread may call this.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ * @param deadline - timespec *: the latest time to wait until, by CLOCK_MONOTONIC
+ * @return the node, or NULL if the deadline passed with the queue empty
+ */
+struct mpsc_node *mpsc_pop_until(struct mpsc_queue *q, const struct timespec *deadline);
+
+#endif //SERVER_SRC_MPSC_H
@@ -0,0 +1,239 @@
+#ifndef SERVER_SRC_PROTO_H
+#define SERVER_SRC_PROTO_H
+
+#include <stdint.h>
+
+/*
+ * Protocol v1: for each file, 2 bytes of name length, the name, 4 bytes of data length, the data.
+ *
+ * Protocol v2: the client opens with 2 zero bytes, which is never a valid v1 name length, then
+ * the rest of a hello: 4 bytes of PROTO_MAGIC, 2 bytes of the highest version it speaks and 2
+ * bytes of features it wants. The server answers with PROTO_MAGIC, the version both speak and the
+ * features both support; a server that only speaks v1 closes the connection instead. Everything
+ * after the hello is a sequence of frames, each a PROTO_FRAME_SIZE header followed by its payload:
+ *
+ *   offset size field
+ *   0      1    type: a proto_frame
+ *   1      1    flags: PROTO_FRAME_OPEN: PROTO_FLAG_RESUME, PROTO_FLAG_HASH, both, PROTO_FLAG_DELTA,
+ *                                       PROTO_FLAG_STRIPE or 0;
+ *                      PROTO_FRAME_DATA: PROTO_FLAG_COMPRESSED or 0;
+ *                      PROTO_FRAME_END: PROTO_FLAG_RESUME, PROTO_FLAG_DELTA or 0; otherwise 0
+ *   2      2    name_len: PROTO_FRAME_OPEN and PROTO_FRAME_ACK: the length of the name that follows;
+ *                         otherwise 0
+ *   4      4    stream: the stream the frame belongs to, chosen by the client
+ *   8      8    len: PROTO_FRAME_OPEN: the size of the whole file, or PROTO_SIZE_UNKNOWN;
+ *                    PROTO_FRAME_DATA: the number of data bytes that follow, compressed if
+ *                                      PROTO_FLAG_COMPRESSED;
+ *                    PROTO_FRAME_END: the number of data bytes sent for the stream, counting
+ *                                     those the server already held; for a stripe, its size;
+ *                    PROTO_FRAME_ACK: the number of data bytes stored, or of the stripe;
+ *                    PROTO_FRAME_OFFSET: the number of data bytes the server already holds;
+ *                    PROTO_FRAME_HAVE: the size of the file;
+ *                    PROTO_FRAME_SIGS: the size of the base file, 0 if there is none;
+ *                    PROTO_FRAME_COPY: the index of the base file's block to copy
+ *
+ * A stream carries one file from its open to its end. Up to PROTO_MAX_STREAMS streams may be open
+ * at once and their frames may be interleaved; a stream's ID may be reused once it has ended.
+ * Every number is big-endian.
+ *
+ * Given PROTO_FEATURE_ACK, the server sends a PROTO_FRAME_ACK for each file once it is stored as
+ * durably as the server is configured to store it, in whatever order files finish. Its name_len
+ * and the name that follows give the name the file was stored under. A client that wants to tell
+ * acks apart does not reuse a stream's ID until the stream is acknowledged.
+ *
+ * Given PROTO_FEATURE_RESUME, a file of known size may be opened with PROTO_FLAG_RESUME: its name
+ * is followed by a PROTO_TRANSFER_ID_SIZE transfer ID the client chooses, the same each time it
+ * tries to send the same file. The server keeps what it receives under that ID if the connection
+ * drops, and answers the open with a PROTO_FRAME_OFFSET saying how much it already holds; the
+ * client waits for it, then sends the data from there. The stream's end frame also carries
+ * PROTO_FLAG_RESUME and is followed by the PROTO_DIGEST_SIZE SHA-256 digest of the whole file,
+ * which the server checks before storing the file.
+ *
+ * Given PROTO_FEATURE_HAVE, a file of known size may be opened with PROTO_FLAG_HASH: its name, and
+ * transfer ID if resumable, are followed by the PROTO_DIGEST_SIZE SHA-256 digest of the whole
+ * file. If the server already stores that content it answers with PROTO_FRAME_HAVE, stores the
+ * file under its name without its data, and the stream is over; the client sends nothing more on
+ * it. Otherwise it answers with PROTO_FRAME_OFFSET as for a resumable open, 0 unless the stream is
+ * resumable, and the data follows as usual. The server checks the data against the digest.
+ *
+ * Given PROTO_FEATURE_DELTA, a file of known size may be opened with PROTO_FLAG_DELTA alone. The
+ * server picks the latest version it stores under that name as the base file and answers with a
+ * PROTO_FRAME_SIGS followed by 4 bytes of block size, then a PROTO_SIG_SIZE signature for each
+ * whole block of the base file, in order: 4 bytes of weak checksum, then the first
+ * PROTO_SIG_SIZE - 4 bytes of the block's SHA-256 digest. The weak checksum of bytes x[0..n-1] is
+ * a | b << 16, where a is the sum of x[i] and b the sum of (n - i) * x[i], each modulo 2^16, so it
+ * can be rolled along the new file a byte at a time. The client then builds the file from
+ * PROTO_FRAME_DATA frames of literal bytes and PROTO_FRAME_COPY frames, each naming a whole block
+ * of the base file to append. The stream's end frame carries PROTO_FLAG_DELTA and is followed by
+ * the PROTO_DIGEST_SIZE SHA-256 digest of the whole file, which the server checks before storing it.
+ *
+ * Given PROTO_FEATURE_COMPRESS, any data frame may carry PROTO_FLAG_COMPRESSED: its payload is 4
+ * bytes of the number of data bytes it holds, at most PROTO_COMPRESS_MAX, then those bytes as one
+ * block of the LZ4 block format. Each frame is compressed on its own. Everything else that counts
+ * data bytes, such as an end frame's len or an offset, counts them uncompressed.
+ *
+ * Given PROTO_FEATURE_STRIPE, a file of known size may be sent in stripes, byte ranges on streams
+ * of any of the client's connections, each opened with PROTO_FLAG_STRIPE alone. Its name is
+ * followed by a PROTO_TRANSFER_ID_SIZE transfer ID naming the whole file, the same on every
+ * stripe, then 8 bytes of where in the file the stripe starts and 8 bytes of its size. The stripe's
+ * data frames carry its bytes and its end frame's len is its size. Stripes may not share bytes.
+ * Once every byte of the file is received the server stores it once, under one name, and
+ * acknowledges every stripe on the connection that sent it; until then no stripe is acknowledged.
+ * A file no stripe of which arrives for a while is discarded.
+ */
+
+/**
+ * The magic number that follows the zero name length of a v2 hello: "TCP2".
+ */
+#define PROTO_MAGIC 0x54435032U
+
+/**
+ * The highest protocol version spoken here.
+ */
+#define PROTO_VERSION 2
+
+/**
+ * Hello feature: acknowledge each file once it is stored.
+ */
+#define PROTO_FEATURE_ACK 0x1U
+
+/**
+ * Hello feature: keep partly received files so their upload can resume.
+ */
+#define PROTO_FEATURE_RESUME 0x2U
+
+/**
+ * Hello feature: skip the data of files whose content the server already stores.
+ */
+#define PROTO_FEATURE_HAVE 0x4U
+
+/**
+ * Hello feature: send changed files as differences from the version the server stores.
+ */
+#define PROTO_FEATURE_DELTA 0x8U
+
+/**
+ * Hello feature: compress data frames.
+ */
+#define PROTO_FEATURE_COMPRESS 0x10U
+
+/**
+ * Hello feature: send large files in stripes, across several connections.
+ */
+#define PROTO_FEATURE_STRIPE 0x20U
+
+/**
+ * The features spoken here.
+ */
+#define PROTO_FEATURES (PROTO_FEATURE_ACK | PROTO_FEATURE_RESUME | PROTO_FEATURE_HAVE | PROTO_FEATURE_DELTA \
+                        | PROTO_FEATURE_COMPRESS | PROTO_FEATURE_STRIPE)
+
+/**
+ * The features under which the server writes to the client: acknowledgements, and the answers to
+ * resumable, hashed and delta opens. Compression and stripes alone need no answer.
+ */
+#define PROTO_FEATURES_ANSWERED (PROTO_FEATURE_ACK | PROTO_FEATURE_RESUME | PROTO_FEATURE_HAVE | PROTO_FEATURE_DELTA)
+
+/**
+ * Frame flag: the stream is resumable; its open carries a transfer ID and its end a digest.
+ */
+#define PROTO_FLAG_RESUME 0x1U
+
+/**
+ * Frame flag: the open carries the digest of the file, so the server can say it already has it.
+ */
+#define PROTO_FLAG_HASH 0x2U
+
+/**
+ * Frame flag: the stream is a delta; its data is built from blocks of the stored file and its end
+ * carries a digest.
+ */
+#define PROTO_FLAG_DELTA 0x4U
+
+/**
+ * Frame flag: the data frame's bytes are compressed.
+ */
+#define PROTO_FLAG_COMPRESSED 0x8U
+
+/**
+ * Frame flag: the stream is a stripe of a file; its open carries a transfer ID, an offset and a size.
+ */
+#define PROTO_FLAG_STRIPE 0x10U
+
+/**
+ * The size of a transfer ID.
+ */
+#define PROTO_TRANSFER_ID_SIZE 16
+
+/**
+ * The size of what follows a stripe's name: its transfer ID, offset and size.
+ */
+#define PROTO_STRIPE_SIZE (PROTO_TRANSFER_ID_SIZE + 2 * sizeof(uint64_t))
+
+/**
+ * The size of the SHA-256 digest ending a resumable stream or following the name of a hashed open.
+ */
+#define PROTO_DIGEST_SIZE 32
+
+/**
+ * The size of a block's signature in a PROTO_FRAME_SIGS.
+ */
+#define PROTO_SIG_SIZE 20
+
+/**
+ * The most data bytes one compressed data frame may hold.
+ */
+#define PROTO_COMPRESS_MAX (256 * 1024)
+
+/**
+ * The size of a hello after its leading zero name length, and of the server's answer.
+ */
+#define PROTO_HELLO_SIZE 8
+
+/**
+ * The size of a frame header.
+ */
+#define PROTO_FRAME_SIZE 16
+
+/**
+ * The size of a file whose size is not known when its stream is opened.
+ */
+#define PROTO_SIZE_UNKNOWN UINT64_MAX
+
+/**
+ * The most streams a client may have open at once.
+ */
+#define PROTO_MAX_STREAMS 16
+
+/**
+ * proto_frame
+ * <p>
+ * The type of a v2 frame.
+ * <ul>
+ * <li>PROTO_FRAME_OPEN: start a file on a stream; the file name follows</li>
+ * <li>PROTO_FRAME_DATA: the next bytes of a stream's file follow</li>
+ * <li>PROTO_FRAME_END: the stream's file is complete</li>
+ * <li>PROTO_FRAME_ACK: sent by the server: the stream's file is stored; its stored name follows</li>
+ * <li>PROTO_FRAME_OFFSET: sent by the server: where the data of a resumable or hashed stream
+ * resumes</li>
+ * <li>PROTO_FRAME_HAVE: sent by the server: the content of a hashed stream's file is already
+ * stored, and so is the file</li>
+ * <li>PROTO_FRAME_SIGS: sent by the server: the block size and signatures of a delta stream's base
+ * file follow</li>
+ * <li>PROTO_FRAME_COPY: append a block of the base file to a delta stream's file</li>
+ * </ul>
+ * </p>
+ */
+enum proto_frame
+{
+    PROTO_FRAME_OPEN = 1,
+    PROTO_FRAME_DATA = 2,
+    PROTO_FRAME_END = 3,
+    PROTO_FRAME_ACK = 4,
+    PROTO_FRAME_OFFSET = 5,
+    PROTO_FRAME_HAVE = 6,
+    PROTO_FRAME_SIGS = 7,
+    PROTO_FRAME_COPY = 8
+};
+
+#endif //SERVER_SRC_PROTO_H
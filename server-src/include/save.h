@@ -5,7 +5,76 @@
 #ifndef SERVER_SAVE_H
 #define SERVER_SAVE_H
 
+#include "sha256.h"
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/stat.h>
+
+/**
+ * The permissions given to saved directories and files.
+ */
+#define WR_DIR_FLAGS (S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+
+/**
+ * The smallest file for which disk space is reserved up front. Smaller files are written in one
+ * or two writes, which the filesystem can place contiguously without help.
+ */
+#define SAVE_PREALLOC_MIN (64 * 1024)
+
+/**
+ * The directory, inside the write directory, holding the blobs of the content-addressed store.
+ */
+#define SAVE_BLOB_DIR "blobs"
+
+/**
+ * The directory, inside the write directory, holding partly received files kept so their upload
+ * can resume.
+ */
+#define SAVE_PARTIAL_DIR "partial"
+
+/**
+ * The number of seconds a partial file may go unwritten before it is removed, since the client
+ * that sent it is not coming back to resume it.
+ */
+#define SAVE_PARTIAL_MAX_AGE (24 * 60 * 60)
+
+/**
+ * save_store
+ * <p>
+ * How saved files are laid out on disk.
+ * <ul>
+ * <li>SAVE_STORE_FILES: one file per upload, in a directory per client</li>
+ * <li>SAVE_STORE_SEGMENTS: uploads appended to large segment files, found through an index; see
+ * segment.h</li>
+ * </ul>
+ * </p>
+ */
+enum save_store
+{
+    SAVE_STORE_FILES,
+    SAVE_STORE_SEGMENTS
+};
+
+/**
+ * save_store_open
+ * <p>
+ * Choose how saved files are laid out. Call before any client directory is opened.
+ * </p>
+ * @param store - enum save_store: the layout
+ * @param wr_dir - char *: the base write directory stored in server_settings
+ * @param sync - int: whether each file is synced as it is finished, for stores that must order
+ *               their own writes
+ * @param dedup - int: whether files are stored once per content with dedup_file
+ */
+void save_store_open(enum save_store store, const char *wr_dir, int sync, int dedup);
+
+/**
+ * save_store_close
+ * <p>
+ * Close the store chosen by save_store_open. Every file must have been finished or discarded.
+ * </p>
+ */
+void save_store_close(void);
 
 /**
  * create_dir_str
@@ -30,17 +99,236 @@ void create_dir_str(char **save_dir, const char *wr_dir, const char *client_addr
 void create_dir(const char *save_dir);
 
 /**
- * write_to_dir
+ * open_save_dir
+ * <p>
+ * Get a file descriptor for a client's save directory, creating the directory if needed. Each
+ * directory is opened once and cached for every later connection from the same IP address, so
+ * files are then created relative to it without resolving the write directory's path again.
+ * In the segment store, the descriptor stands for the client rather than a directory of its own.
+ * </p>
+ * <p>
+ * The descriptor belongs to the cache: do not close it. It stays open until close_save_dirs.
+ * </p>
+ * @param wr_dir - char *: the base write directory stored in server_settings
+ * @param client_addr_str - char *: the client's IP address
+ * @return file descriptor for the client's save directory, or -1 with errno set if it cannot be opened
+ */
+int open_save_dir(const char *wr_dir, const char *client_addr_str);
+
+/**
+ * close_save_dirs
+ * <p>
+ * Close every cached save directory.
+ * </p>
+ */
+void close_save_dirs(void);
+
+/**
+ * create_save_path
+ * <p>
+ * Create the name under which a file will be saved in a directory: the file name, with a version
+ * number added if a file by that name already exists. Each call claims a new version from the
+ * directory's version index, so calling it again after a collision yields the next version.
+ * </p>
+ * <p>
+ * A file name given as a relative path has its subdirectories made under the directory.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: create_save_path dynamically allocates memory. Must free the pointer passed as the first parameter!
+ * </h3>
+ * </p>
+ * @param save_file_name - char **: pointer to the string to hold the name, relative to dir_fd
+ * @param dir_fd - int: file descriptor for the directory from open_save_dir
+ * @param file_name - char *: the name of the file
+ */
+void create_save_path(char **save_file_name, int dir_fd, const char *file_name);
+
+/**
+ * sync_save_dirs
+ * <p>
+ * Sync the directories holding a saved file's name: each subdirectory of a nested name, then the
+ * directory itself.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory from open_save_dir
+ * @param file_name - char *: the name of the file, relative to dir_fd
+ * @return 0 on success, -1 on failure with errno set
+ */
+int sync_save_dirs(int dir_fd, const char *file_name);
+
+/**
+ * open_save_file
+ * <p>
+ * Create and open for writing the file to which file_name will be saved in a directory. The
+ * versioned name is claimed with O_EXCL, so concurrent uploads of the same name never share a file.
+ * In the segment store, room for the file is reserved in a segment instead.
+ * </p>
  * <p>
- * Save the file information in data_buffer to the directory path specified by save_dir under
- * the name file_name.
+ * <h3>
+ * WARNING: open_save_file dynamically allocates memory. Must free the pointer passed as the last parameter!
+ * </h3>
  * </p>
- * @param save_dir - char *: the directory to which the file will be saved
+ * @param dir_fd - int: file descriptor for the directory from open_save_dir
  * @param file_name - char *: the name of the file
+ * @param size - uint64_t: the size the client announced for the file
+ * @param save_file_name - char **: pointer to the string to hold the name of the opened file, relative to dir_fd
+ * @return file descriptor for the opened file, or -1 with errno set if it cannot be created
+ */
+int open_save_file(int dir_fd, const char *file_name, uint64_t size, char **save_file_name);
+
+/**
+ * preallocate_file
+ * <p>
+ * Reserve disk space for the whole file before its data arrives, so the filesystem can allocate
+ * one contiguous extent instead of extending the file piece by piece as concurrent uploads
+ * interleave. The file's size is left unchanged until the data is written.
+ * </p>
+ * @param save_fd - int: file descriptor for the file
+ * @param len - uint64_t: the size the file will have
+ */
+void preallocate_file(int save_fd, uint64_t len);
+
+/**
+ * write_to_file
+ * <p>
+ * Write all data_buf_size bytes of data_buffer to the file, retrying short writes.
+ * </p>
+ * @param save_fd - int: file descriptor for the file
  * @param data_buffer - char *: the file information
- * @param data_buf_size - uint32_t: the size of the file
+ * @param data_buf_size - size_t: the number of bytes to write
+ */
+void write_to_file(int save_fd, const char *data_buffer, size_t data_buf_size);
+
+/**
+ * finish_save_file
+ * <p>
+ * Record a completely written file in the store, before it is made durable and closed.
+ * </p>
+ * @param save_fd - int: file descriptor for the file
  */
-void write_to_dir(char *save_dir, const char *file_name, const char *data_buffer, uint32_t data_buf_size);
+void finish_save_file(int save_fd);
 
+/**
+ * dedup_file
+ * <p>
+ * Store a completely written file's content only once. The first file with a given content
+ * becomes its blob, linked under SAVE_BLOB_DIR by its SHA-256 digest. A later file with the same
+ * content is dropped and its name made a hard link to that blob instead, so its data is never
+ * kept; if it is dropped before writeback, it never reaches the disk. Files store only.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory holding the file
+ * @param save_fd - int *: pointer to the file descriptor for the file, or NULL if it is closed;
+ *                  a dropped file's descriptor is replaced by one for the blob
+ * @param save_file_name - char *: the name of the file, relative to dir_fd
+ * @param digest - char *: the SHA-256 digest of the file's content, as hexadecimal
+ * @return 1 if the content was already stored and the file now links to it, 0 if the file became the blob
+ */
+int dedup_file(int dir_fd, int *save_fd, const char *save_file_name, const char *digest);
+
+/**
+ * link_blob
+ * <p>
+ * Store a file whose content is already a blob without receiving it, by linking the blob under
+ * the next free version of the file's name. Files store only.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: link_blob dynamically allocates memory. Must free the pointer passed as the last parameter!
+ * </h3>
+ * </p>
+ * @param dir_fd - int: file descriptor for the client's directory from open_save_dir
+ * @param file_name - char *: the name of the file
+ * @param digest - char *: the SHA-256 digest of the file's content, as hexadecimal
+ * @param size - uint64_t: the size of the file
+ * @param save_file_name - char **: pointer to the string to hold the name of the file, relative to dir_fd
+ * @return file descriptor for the file, read-only, or -1 if no blob of that size holds the content
+ */
+int link_blob(int dir_fd, const char *file_name, const char *digest, uint64_t size, char **save_file_name);
+
+/**
+ * open_base_file
+ * <p>
+ * Open the latest version of a file stored in a directory, the base a delta is built against.
+ * Versions whose upload was abandoned are passed over. Files store only.
+ * </p>
+ * @param dir_fd - int: file descriptor for the client's directory from open_save_dir
+ * @param file_name - char *: the name of the file
+ * @return file descriptor for the file, read-only, or -1 if no version is stored
+ */
+int open_base_file(int dir_fd, const char *file_name);
+
+/**
+ * open_partial_file
+ * <p>
+ * Open the file in SAVE_PARTIAL_DIR holding what a client has sent of a resumable upload, creating
+ * it if there is none, and position it to take the rest. The upload's hash is restored from where
+ * keep_partial_file left it, so the data already held is never read again; anything held past that
+ * point, or a file whose hash was not kept, is dropped. The file is locked for as long as it is
+ * open, so only one connection receives into it at a time. Now and then, partial files older than
+ * SAVE_PARTIAL_MAX_AGE are removed first. Files store only.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: open_partial_file dynamically allocates memory. Must free the pointer passed as the last parameter!
+ * </h3>
+ * </p>
+ * @param client_addr_str - char *: the client's IP address
+ * @param transfer_id - uint8_t *: the upload's transfer ID, of PROTO_TRANSFER_ID_SIZE bytes
+ * @param size - uint64_t: the size of the whole file
+ * @param hash - sha256_ctx *: the upload's hash, just started, to hold the hash of the data already held
+ * @param offset - uint64_t *: pointer to the memory to hold the number of bytes already held
+ * @param partial_name - char **: pointer to the string to hold the name of the file in SAVE_PARTIAL_DIR
+ * @return file descriptor for the file, readable and writable, or -1 if another connection is receiving into it
+ * or it cannot be opened
+ */
+int open_partial_file(const char *client_addr_str, const uint8_t *transfer_id, uint64_t size,
+                      struct sha256_ctx *hash, uint64_t *offset, char **partial_name);
+
+/**
+ * keep_partial_file
+ * <p>
+ * Close a partial file whose upload was cut off, keeping the hash of what it holds beside it so
+ * open_partial_file can resume the upload without reading the data again.
+ * </p>
+ * @param save_fd - int: file descriptor for the file
+ * @param partial_name - char *: the name of the file in SAVE_PARTIAL_DIR
+ * @param hash - sha256_ctx *: the hash of everything the file holds
+ */
+void keep_partial_file(int save_fd, const char *partial_name, const struct sha256_ctx *hash);
+
+/**
+ * finish_partial_file
+ * <p>
+ * Move a completely received partial file into the client's directory under the next free
+ * version of its name, and remove its kept hash. The file stays open.
+ * </p>
+ * @param dir_fd - int: file descriptor for the client's directory from open_save_dir
+ * @param save_file_name - char **: pointer to the name of the file in SAVE_PARTIAL_DIR, replaced by
+ *                         its name relative to dir_fd on success
+ * @param file_name - char *: the name of the file
+ * @return 0 on success, -1 if the partial file is no longer in SAVE_PARTIAL_DIR
+ */
+int finish_partial_file(int dir_fd, char **save_file_name, const char *file_name);
+
+/**
+ * discard_partial_file
+ * <p>
+ * Close and remove a partial file and its kept hash, so its upload starts over.
+ * </p>
+ * @param save_fd - int: file descriptor for the file
+ * @param partial_name - char *: the name of the file in SAVE_PARTIAL_DIR
+ */
+void discard_partial_file(int save_fd, const char *partial_name);
+
+/**
+ * discard_file
+ * <p>
+ * Close and remove a file that was only partly received.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory holding the file
+ * @param save_fd - int: file descriptor for the file
+ * @param save_file_name - char *: the name of the file, relative to dir_fd
+ */
+void discard_file(int dir_fd, int save_fd, const char *save_file_name);
 
 #endif //SERVER_SAVE_H
@@ -0,0 +1,158 @@
+#ifndef SERVER_SRC_SEGMENT_H
+#define SERVER_SRC_SEGMENT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The directory, inside the write directory, holding the segments and their index.
+ */
+#define SEGMENT_DIR "segments"
+
+/**
+ * The name of the index inside SEGMENT_DIR.
+ */
+#define SEGMENT_INDEX "index.dat"
+
+/**
+ * The size after which a segment is closed to new files. A larger file gets a segment of its own.
+ */
+#define SEGMENT_MAX_SIZE (256UL * 1024 * 1024)
+
+/**
+ * The size of the buffer needed by segment_file_name.
+ */
+#define SEGMENT_NAME_SIZE 32
+
+/**
+ * segment_record
+ * <p>
+ * Struct storing one index record: where the body of one saved file lies. On disk each record is
+ * a 32 byte header of big-endian fields (an FNV-1a checksum of the rest of the record, the client
+ * and name lengths as 16 bits, the version and segment as 32 bits, the offset and length as 64 bits)
+ * followed by the client and name bytes.
+ * <ul>
+ * <li>char *client: the IP address of the client that sent the file</li>
+ * <li>char *name: the name the client sent</li>
+ * <li>unsigned int version: the file's version among the client's files of that name</li>
+ * <li>uint32_t segment: the number of the segment holding the body</li>
+ * <li>uint64_t offset: the offset of the body in the segment</li>
+ * <li>uint64_t len: the length of the body</li>
+ * </ul>
+ * </p>
+ */
+struct segment_record
+{
+    char *client;
+    char *name;
+    unsigned int version;
+    uint32_t segment;
+    uint64_t offset;
+    uint64_t len;
+};
+
+/**
+ * segment_store_open
+ * <p>
+ * Open the segment store in the write directory, creating it if needed. The index is read to
+ * recover every client's versions; a record cut off by a crash is dropped. New files go to a new
+ * segment, so segments written before are never appended to.
+ * </p>
+ * @param wr_dir_fd - int: file descriptor for the write directory
+ * @param sync - int: whether each file's data, then its index record, is synced before it is finished
+ */
+void segment_store_open(int wr_dir_fd, int sync);
+
+/**
+ * segment_store_close
+ * <p>
+ * Close the segment store. Every file must have been finished or discarded.
+ * </p>
+ */
+void segment_store_close(void);
+
+/**
+ * segment_client
+ * <p>
+ * Get a file descriptor standing for a client in the store. It refers to the segment directory,
+ * so it can be synced like a client's save directory, and tells the client's files apart.
+ * </p>
+ * @param client_addr_str - char *: the client's IP address
+ * @return file descriptor for the client, which the caller closes once the store is closed
+ */
+int segment_client(const char *client_addr_str);
+
+/**
+ * segment_open
+ * <p>
+ * Claim the client's next version of a file and reserve room for its body in the current segment.
+ * The returned descriptor is positioned at the reserved room, so the body is written to it like
+ * any file, and must be passed to segment_finish or segment_discard before it is closed.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: segment_open dynamically allocates memory. Must free the pointer passed as the last parameter!
+ * </h3>
+ * </p>
+ * @param client_fd - int: file descriptor from segment_client
+ * @param file_name - char *: the name of the file
+ * @param size - uint64_t: the size of the file
+ * @param save_file_name - char **: pointer to the string to hold the name of this version of the file
+ * @return file descriptor for writing the body
+ */
+int segment_open(int client_fd, const char *file_name, uint64_t size, char **save_file_name);
+
+/**
+ * segment_preallocate
+ * <p>
+ * Reserve disk space for the room of a file opened by segment_open.
+ * </p>
+ * @param save_fd - int: file descriptor from segment_open
+ */
+void segment_preallocate(int save_fd);
+
+/**
+ * segment_finish
+ * <p>
+ * Append the index record of a completely written file, making it part of the store.
+ * </p>
+ * @param save_fd - int: file descriptor from segment_open, which is left open
+ */
+void segment_finish(int save_fd);
+
+/**
+ * segment_discard
+ * <p>
+ * Give up the room of a partly written file, returning its disk space to the filesystem.
+ * </p>
+ * @param save_fd - int: file descriptor from segment_open, which is left open
+ */
+void segment_discard(int save_fd);
+
+/**
+ * segment_read_record
+ * <p>
+ * Read the next record from an index.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: segment_read_record dynamically allocates memory. Must free the client and name of the record!
+ * </h3>
+ * </p>
+ * @param index - FILE *: the index, positioned at a record
+ * @param rec - segment_record *: pointer to the memory to hold the record
+ * @return 1 if a record was read, 0 at the end of the index or at a record that is incomplete or corrupt
+ */
+int segment_read_record(FILE *index, struct segment_record *rec);
+
+/**
+ * segment_file_name
+ * <p>
+ * Format the name of a segment inside SEGMENT_DIR.
+ * </p>
+ * @param name - char[]: the buffer to hold the name, of SEGMENT_NAME_SIZE bytes
+ * @param segment - uint32_t: the number of the segment
+ */
+void segment_file_name(char name[SEGMENT_NAME_SIZE], uint32_t segment);
+
+#endif //SERVER_SRC_SEGMENT_H
@@ -5,9 +5,48 @@
 #ifndef COMP3980ASS2_INIT_SERVER_H
 #define COMP3980ASS2_INIT_SERVER_H
 
+#include "durable.h"
+#include "save.h"
 #include <netinet/in.h>
 #include <sys/types.h>
 
+/**
+ * io_mode
+ * <p>
+ * The strategy the server uses to receive files from clients.
+ * <ul>
+ * <li>IO_MODE_BLOCKING: accept one client at a time and block until it disconnects</li>
+ * <li>IO_MODE_EPOLL: serve every client concurrently from a non-blocking epoll event loop</li>
+ * <li>IO_MODE_URING: serve every client concurrently through io_uring; only available when built
+ * with HAVE_IO_URING</li>
+ * </ul>
+ * </p>
+ */
+enum io_mode
+{
+    IO_MODE_BLOCKING,
+    IO_MODE_EPOLL,
+    IO_MODE_URING
+};
+
+/**
+ * worker
+ * <p>
+ * Struct storing the sockets owned by one worker thread. Each worker listens on its own
+ * SO_REUSEPORT socket bound to the server's address, so the kernel spreads new connections across
+ * workers without any shared lock.
+ * <ul>
+ * <li>int fd_listen_sock: file descriptor for socket listening for connections</li>
+ * <li>int fd_client_sock: file descriptor for socket of connected client</li>
+ * </ul>
+ * </p>
+ */
+struct worker
+{
+    int fd_listen_sock;
+    int fd_client_sock;
+};
+
 /**
  * server_settings
  * <p>
@@ -16,8 +55,20 @@
  * <li>char *ip: the IP address</li>
  * <li>char *wr_dir: the base save directory for incoming files</li>
  * <li>in_port_t port: the port number</li>
- * <li>int fd_listen_sock: file descriptor for socket listening for connections</li>
- * <li>int fd_client_sock: file descriptor for socket of connected client</li>
+ * <li>enum io_mode io_mode: the strategy used to receive files from clients</li>
+ * <li>unsigned int n_workers: the number of worker threads</li>
+ * <li>struct worker *workers: the sockets of each worker thread</li>
+ * <li>int use_splice: whether file data is spliced from socket to file rather than copied</li>
+ * <li>unsigned int n_writers: the number of disk-writer threads; 0 to write on the network threads</li>
+ * <li>unsigned int queue_depth: the number of buffers each network thread may queue for the writers</li>
+ * <li>struct writer_pool *writer_pool: the disk-writer threads, which also take slow work off the
+ * network threads; at least one while clients are received</li>
+ * <li>enum durability durability: when saved files are synced and reported</li>
+ * <li>unsigned int group_ms: the longest a group commit waits for more files, in milliseconds</li>
+ * <li>uint64_t group_bytes: the number of file bytes that ends a group commit early</li>
+ * <li>int direct_io: whether saved files are written with O_DIRECT, bypassing the page cache</li>
+ * <li>enum save_store store: how saved files are laid out on disk</li>
+ * <li>int dedup: whether files are hashed as they arrive and each content is stored once</li>
  * </ul>
  * </p>
  */
@@ -26,8 +77,19 @@ struct server_settings
     char *ip;
     char *wr_dir;
     in_port_t port;
-    int fd_listen_sock;
-    int fd_client_sock;
+    enum io_mode io_mode;
+    unsigned int n_workers;
+    struct worker *workers;
+    int use_splice;
+    unsigned int n_writers;
+    unsigned int queue_depth;
+    struct writer_pool *writer_pool;
+    enum durability durability;
+    unsigned int group_ms;
+    uint64_t group_bytes;
+    int direct_io;
+    enum save_store store;
+    int dedup;
 };
 
 /**
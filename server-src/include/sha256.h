@@ -0,0 +1,90 @@
+#ifndef SERVER_SRC_SHA256_H
+#define SERVER_SRC_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The size of a SHA-256 digest in bytes.
+ */
+#define SHA256_DIGEST_SIZE 32
+
+/**
+ * The size of a SHA-256 digest written as hexadecimal, with its null byte.
+ */
+#define SHA256_HEX_SIZE (2 * SHA256_DIGEST_SIZE + 1)
+
+/**
+ * The size of a SHA-256 block in bytes.
+ */
+#define SHA256_BLOCK_SIZE 64
+
+/**
+ * sha256_ctx
+ * <p>
+ * Struct storing the state of a SHA-256 hash of data received in pieces.
+ * <ul>
+ * <li>uint32_t state[]: the hash of the blocks so far</li>
+ * <li>uint64_t len: the number of bytes hashed</li>
+ * <li>uint8_t block[]: bytes not yet making up a whole block</li>
+ * </ul>
+ * </p>
+ */
+struct sha256_ctx
+{
+    uint32_t state[8];
+    uint64_t len;
+    uint8_t block[SHA256_BLOCK_SIZE];
+};
+
+/**
+ * sha256_init
+ * <p>
+ * Start a new hash.
+ * </p>
+ * @param ctx - sha256_ctx *: the hash
+ */
+void sha256_init(struct sha256_ctx *ctx);
+
+/**
+ * sha256_update
+ * <p>
+ * Add data to a hash.
+ * </p>
+ * @param ctx - sha256_ctx *: the hash
+ * @param data - void *: the data
+ * @param len - size_t: the number of bytes of data
+ */
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len);
+
+/**
+ * sha256_digest
+ * <p>
+ * Finish a hash and write its digest.
+ * </p>
+ * @param ctx - sha256_ctx *: the hash, which must be started again before reuse
+ * @param digest - uint8_t[]: the buffer to hold the digest, of SHA256_DIGEST_SIZE bytes
+ */
+void sha256_digest(struct sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+/**
+ * sha256_final
+ * <p>
+ * Finish a hash and write its digest as hexadecimal.
+ * </p>
+ * @param ctx - sha256_ctx *: the hash, which must be started again before reuse
+ * @param hex - char[]: the buffer to hold the digest, of SHA256_HEX_SIZE bytes
+ */
+void sha256_final(struct sha256_ctx *ctx, char hex[SHA256_HEX_SIZE]);
+
+/**
+ * sha256_hex
+ * <p>
+ * Write a digest as hexadecimal.
+ * </p>
+ * @param digest - uint8_t[]: the digest, of SHA256_DIGEST_SIZE bytes
+ * @param hex - char[]: the buffer to hold the digest, of SHA256_HEX_SIZE bytes
+ */
+void sha256_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE]);
+
+#endif //SERVER_SRC_SHA256_H
@@ -0,0 +1,82 @@
+#ifndef SERVER_SRC_STRIPE_H
+#define SERVER_SRC_STRIPE_H
+
+#include "ack.h"
+#include "writer.h"
+#include <stdint.h>
+
+/**
+ * The number of seconds a striped file may go without any of its stripes being received before it
+ * is given up on and discarded, since the client that sent the rest of it is not coming back.
+ */
+#define STRIPE_IDLE_SECS 60
+
+/**
+ * stripe
+ * <p>
+ * Opaque struct storing a file a client sends in stripes, byte ranges on streams of any of its
+ * connections. The file is saved under one name as the stripes arrive, each written in place
+ * through a descriptor of its own; once every byte is received it is stored like any other file.
+ * </p>
+ */
+struct stripe;
+
+/**
+ * stripe_join
+ * <p>
+ * Start receiving a stripe of a file, claiming the file's save name if it is the first stripe to
+ * arrive. Safe to call from any thread. Files store only.
+ * </p>
+ * @param client_addr_str - char *: the client's IP address
+ * @param dir_fd - int: file descriptor for the client's directory from open_save_dir
+ * @param transfer_id - uint8_t *: the transfer ID naming the whole file, of PROTO_TRANSFER_ID_SIZE bytes
+ * @param file_name - char *: the name of the file
+ * @param size - uint64_t: the size of the whole file
+ * @param offset - uint64_t: where in the file the stripe starts
+ * @param len - uint64_t: the size of the stripe
+ * @param save_fd - int *: pointer to the memory to hold a descriptor for the file, positioned at
+ *                  offset, which the caller closes
+ * @return the file, or NULL if the stripe does not fit the stripes already received of it, or the
+ * file system cannot hold the file's name
+ */
+struct stripe *stripe_join(const char *client_addr_str, int dir_fd, const uint8_t *transfer_id, const char *file_name,
+                           uint64_t size, uint64_t offset, uint64_t len, int *save_fd);
+
+/**
+ * stripe_end
+ * <p>
+ * Record a completely written stripe. If it was the file's last, have a writer store the file as
+ * conn_save would and report it on behalf of every stripe, acknowledging each to whichever
+ * connection sent it.
+ * </p>
+ * @param s - stripe *: the file, which the stripe no longer holds
+ * @param offset - uint64_t: where in the file the stripe starts
+ * @param len - uint64_t: the size of the stripe
+ * @param ack - ack_info *: what to acknowledge for the stripe; its channel, if any, is held until then
+ * @param save_dir - char *: the client's directory's path, for the report
+ * @param dedup - int: whether the file's content is stored once with dedup_file
+ * @param pool - writer_pool *: the threads to which storing the finished file is handed
+ * @return 0 on success, -1 if another stream already sent the same bytes
+ */
+int stripe_end(struct stripe *s, uint64_t offset, uint64_t len, const struct ack_info *ack, const char *save_dir,
+               int dedup, struct writer_pool *pool);
+
+/**
+ * stripe_leave
+ * <p>
+ * Give up a stripe that was cut off. The file keeps what its other stripes sent, so the stripe can
+ * be sent again, for STRIPE_IDLE_SECS after the last of its stripes is received.
+ * </p>
+ * @param s - stripe *: the file
+ */
+void stripe_leave(struct stripe *s);
+
+/**
+ * stripe_discard_all
+ * <p>
+ * Discard every file whose stripes are not all received. Call once no connection is left.
+ * </p>
+ */
+void stripe_discard_all(void);
+
+#endif //SERVER_SRC_STRIPE_H
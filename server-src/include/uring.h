@@ -0,0 +1,26 @@
+#ifndef SERVER_SRC_URING_H
+#define SERVER_SRC_URING_H
+
+#include "server.h"
+#include <signal.h>
+
+/**
+ * serve_worker_uring
+ * <p>
+ * While the running flag is set, accept and serve clients on one worker's listening socket through
+ * an io_uring instead of an epoll event loop.
+ * </p>
+ * <p>
+ * Connections are accepted by one multishot accept. Each client is read by one multishot receive
+ * into a ring of provided buffers, and file data is written straight from those buffers. Each
+ * connection's opens, writes and closes are submitted as linked chains, so a whole upload costs a
+ * handful of io_uring_enter calls rather than several system calls per chunk.
+ * </p>
+ * @param set - server_settings *: pointer to the settings for this server
+ * @param w - worker *: the worker's sockets
+ * @param running - sig_atomic_t *: the flag cleared by the signal handler to stop the server
+ */
+void serve_worker_uring(const struct server_settings *set, const struct worker *w,
+                        const volatile sig_atomic_t *running);
+
+#endif //SERVER_SRC_URING_H
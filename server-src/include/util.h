@@ -10,7 +10,7 @@
 /**
  * cleanup
  * <p>
- * Free dynamically allocated memory in server settings.
+ * Close the workers' listening sockets and free dynamically allocated memory in server settings.
  * </p>
  * @param sets - server_settings *: pointer to the settings for this server
  */
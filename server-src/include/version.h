@@ -0,0 +1,95 @@
+#ifndef SERVER_SRC_VERSION_H
+#define SERVER_SRC_VERSION_H
+
+/**
+ * The most bytes a version adds to a file name: "-v" and the digits of the largest unsigned int.
+ */
+#define VERSION_SUFFIX_MAX 12
+
+/**
+ * version_claim
+ * <p>
+ * Claim the next free version of file_name in a directory: 1 for the name itself, then 2, 3, ... for
+ * the name with a "-vN" suffix. Each call claims a new version, so concurrent uploads of one name
+ * are given different versions.
+ * </p>
+ * <p>
+ * Each directory's versions are found by one readdir scan the first time it is used, then kept in
+ * memory and updated as versions are claimed, so choosing a version does not touch the disk.
+ * </p>
+ * <p>
+ * A file name may be a relative path, such as "dir/file"; the subdirectory's versions are found by
+ * a scan of its own the first time a name in it is used.
+ * </p>
+ * <p>
+ * Directories are told apart by descriptor, so dir_fd must stay open for as long as the index is
+ * used, as the descriptors cached by open_save_dir do.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory to which the file will be saved
+ * @param file_name - char *: the name of the file
+ * @return the claimed version
+ */
+unsigned int version_claim(int dir_fd, const char *file_name);
+
+/**
+ * version_latest
+ * <p>
+ * Find the highest version of file_name claimed in a directory, as version_claim keeps count. The
+ * upload that claimed it may not have finished, or may have been abandoned.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory to which the file is saved
+ * @param file_name - char *: the name of the file
+ * @return the version, or 0 if none is claimed
+ */
+unsigned int version_latest(int dir_fd, const char *file_name);
+
+/**
+ * version_ext
+ * <p>
+ * Find the extension of a file name, before which a version suffix is placed. A name with no
+ * extension, or whose only dot is its first character, gets the suffix at its end. Only the last
+ * component of a relative path is searched for the extension.
+ * </p>
+ * @param file_name - char *: the name of the file
+ * @return pointer to the extension's dot, or to the terminating null byte if there is none
+ */
+const char *version_ext(const char *file_name);
+
+/**
+ * version_dirs
+ * <p>
+ * Make the directories that hold a file name given as a relative path, such as "a" and "a/b" for
+ * "a/b/file". Directories that already exist are kept; one that cannot be made is left for the
+ * open of the file to report.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory the path is relative to
+ * @param file_name - char *: the name of the file
+ */
+void version_dirs(int dir_fd, const char *file_name);
+
+/**
+ * version_name
+ * <p>
+ * Create the name under which one version of a file is saved: the file name itself for version 1,
+ * otherwise the name with "-vN" placed before its extension.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: version_name dynamically allocates memory. Must free the pointer passed as the first parameter!
+ * </h3>
+ * </p>
+ * @param save_file_name - char **: pointer to the string to hold the name; any string it holds is freed
+ * @param file_name - char *: the name of the file
+ * @param version - unsigned int: the version
+ */
+void version_name(char **save_file_name, const char *file_name, unsigned int version);
+
+/**
+ * version_index_free
+ * <p>
+ * Free the version index of every directory.
+ * </p>
+ */
+void version_index_free(void);
+
+#endif //SERVER_SRC_VERSION_H
@@ -0,0 +1,183 @@
+#ifndef SERVER_SRC_WRITER_H
+#define SERVER_SRC_WRITER_H
+
+#include "ack.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The default number of buffers each network thread may have queued for the writers at once.
+ */
+#define WRITER_DEF_QUEUE_DEPTH 64
+
+/**
+ * writer_pool
+ * <p>
+ * Opaque struct storing the disk-writer threads. Network threads hand file data to the writers
+ * instead of writing it themselves, so a slow disk never stalls receiving on other connections.
+ * </p>
+ */
+struct writer_pool;
+
+/**
+ * writer_stream
+ * <p>
+ * Opaque struct storing one network thread's buffers for handing data to a writer_pool. The
+ * number of buffers is the thread's queue depth: when all of them are queued, the thread waits for
+ * a writer to return one, which holds back receiving until the disk catches up.
+ * </p>
+ */
+struct writer_stream;
+
+/**
+ * writer_file
+ * <p>
+ * Opaque struct storing one file being saved through a writer_stream. Every operation on a file is
+ * performed in order by the same writer thread.
+ * </p>
+ */
+struct writer_file;
+
+/**
+ * writer_pool_open
+ * <p>
+ * Start the disk-writer threads.
+ * </p>
+ * <p>
+ * <h3>
+ * WARNING: writer_pool_open dynamically allocates memory. Must release the pool with writer_pool_close!
+ * </h3>
+ * </p>
+ * @param n_writers - unsigned int: the number of writer threads
+ * @param direct_io - int: whether the writers write files with direct I/O
+ * @return the pool
+ */
+struct writer_pool *writer_pool_open(unsigned int n_writers, int direct_io);
+
+/**
+ * writer_pool_close
+ * <p>
+ * Finish every queued operation, then stop the writer threads and free the pool. Every stream of
+ * the pool must be closed first.
+ * </p>
+ * @param pool - writer_pool *: the pool
+ */
+void writer_pool_close(struct writer_pool *pool);
+
+/**
+ * writer_pool_run
+ * <p>
+ * Have one of the writers call run(arg) between its file operations, for work too slow to do on
+ * a network thread. The pool finishes every queued call before writer_pool_close returns.
+ * </p>
+ * @param pool - writer_pool *: the pool
+ * @param run - void (*)(void *): the function to call
+ * @param arg - void *: the argument passed to run, which it owns
+ */
+void writer_pool_run(struct writer_pool *pool, void (*run)(void *), void *arg);
+
+/**
+ * writer_stream_open
+ * <p>
+ * Create the buffers through which one network thread hands data to the pool.
+ * </p>
+ * @param pool - writer_pool *: the pool
+ * @param depth - unsigned int: the number of buffers
+ * @param buf_size - size_t: the size of each buffer
+ * @return the stream
+ */
+struct writer_stream *writer_stream_open(struct writer_pool *pool, unsigned int depth, size_t buf_size);
+
+/**
+ * writer_stream_close
+ * <p>
+ * Wait for the writers to return every buffer of the stream, then free it.
+ * </p>
+ * @param stream - writer_stream *: the stream
+ */
+void writer_stream_close(struct writer_stream *stream);
+
+/**
+ * writer_file_open
+ * <p>
+ * Begin saving a file. The writer creates the file under the next free version of file_name in
+ * the directory and reserves its space, then reports it as saved once writer_file_close is reached.
+ * </p>
+ * @param stream - writer_stream *: the calling thread's stream
+ * @param dir_fd - int: file descriptor for the directory from open_save_dir
+ * @param save_dir - char *: the directory's path, for messages
+ * @param file_name - char *: the name of the file
+ * @param size - uint64_t: the size the client announced for the file
+ * @return the file
+ */
+struct writer_file *writer_file_open(struct writer_stream *stream, int dir_fd, const char *save_dir,
+                                     const char *file_name, uint64_t size);
+
+/**
+ * writer_file_space
+ * <p>
+ * Get memory into which the next bytes of the file can be placed, such as by receiving straight
+ * into it, waiting for a free buffer if none is held. Follow with writer_file_commit.
+ * </p>
+ * @param file - writer_file *: the file
+ * @param len - size_t *: pointer to the memory to hold the number of bytes available
+ * @return pointer to the memory
+ */
+char *writer_file_space(struct writer_file *file, size_t *len);
+
+/**
+ * writer_file_commit
+ * <p>
+ * Account for len bytes placed in the memory from writer_file_space. A full buffer is handed to
+ * the writer at once.
+ * </p>
+ * @param file - writer_file *: the file
+ * @param len - size_t: the number of bytes placed
+ */
+void writer_file_commit(struct writer_file *file, size_t len);
+
+/**
+ * writer_file_write
+ * <p>
+ * Copy data into the file's buffers, handing each to the writer as it fills.
+ * </p>
+ * @param file - writer_file *: the file
+ * @param data - char *: the data
+ * @param len - size_t: the number of bytes of data
+ */
+void writer_file_write(struct writer_file *file, const char *data, size_t len);
+
+/**
+ * writer_file_flush
+ * <p>
+ * Hand the file's partly filled buffer, if any, to the writer. Call before leaving a file idle so
+ * that no buffer is held while waiting on the network.
+ * </p>
+ * @param file - writer_file *: the file
+ */
+void writer_file_flush(struct writer_file *file);
+
+/**
+ * writer_file_close
+ * <p>
+ * Finish the file: the writer writes what is left, closes the file and reports it as saved,
+ * acknowledging it on the client's channel if there is one. Given the file's digest, the writer
+ * also stores its content only once with dedup_file. The file must not be used again.
+ * </p>
+ * @param file - writer_file *: the file
+ * @param digest - char *: the SHA-256 digest of the file's data as hexadecimal, or NULL not to deduplicate it
+ * @param acks - ack_chan *: the client's acknowledgement channel, or NULL; held until the file is reported
+ * @param stream - uint32_t: the stream that carried the file, for the acknowledgement
+ */
+void writer_file_close(struct writer_file *file, const char *digest, struct ack_chan *acks, uint32_t stream);
+
+/**
+ * writer_file_discard
+ * <p>
+ * Abandon a partly received file: the writer closes and removes it. The file must not be used again.
+ * </p>
+ * @param file - writer_file *: the file
+ */
+void writer_file_discard(struct writer_file *file);
+
+#endif //SERVER_SRC_WRITER_H
@@ -0,0 +1,274 @@
+#include "ack.h"
+#include "error.h"
+#include "proto.h"
+#include <arpa/inet.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct ack_chan
+{
+    int fd;
+    atomic_uint refs;
+    pthread_mutex_t lock;
+    int broken;
+};
+
+/**
+ * send_reply
+ * <p>
+ * Send one frame to the client, whole, unless the channel is already broken. The name is copied in
+ * after the header, so the frame goes out from one buffer.
+ * </p>
+ * @param chan - ack_chan *: the channel
+ * @param type - enum proto_frame: the type of the frame
+ * @param stream - uint32_t: the stream
+ * @param len - uint64_t: the frame's len field
+ * @param name - char *: the name following the header, or NULL; a stored file's name, so shorter than PATH_MAX
+ */
+static void send_reply(struct ack_chan *chan, enum proto_frame type, uint32_t stream, uint64_t len, const char *name);
+
+/**
+ * fill_header
+ * <p>
+ * Fill in a frame header for the client.
+ * </p>
+ * @param hdr - uint8_t[]: the header, PROTO_FRAME_SIZE bytes
+ * @param type - enum proto_frame: the type of the frame
+ * @param name_len - size_t: the length of the name following the header
+ * @param stream - uint32_t: the stream
+ * @param len - uint64_t: the frame's len field
+ */
+static void fill_header(uint8_t hdr[PROTO_FRAME_SIZE], enum proto_frame type, size_t name_len, uint32_t stream,
+                        uint64_t len);
+
+/**
+ * send_locked
+ * <p>
+ * Send a whole frame, holding the channel's lock so no other frame is sent in the middle of it,
+ * unless the channel is already broken.
+ * </p>
+ * @param chan - ack_chan *: the channel
+ * @param iov - iovec *: the frame's buffers, which are used up
+ * @param iov_cnt - int: the number of buffers
+ */
+static void send_locked(struct ack_chan *chan, struct iovec *iov, int iov_cnt);
+
+/**
+ * send_ack
+ * <p>
+ * Send every byte of a frame without blocking the thread indefinitely.
+ * </p>
+ * @param fd - int: the socket
+ * @param iov - iovec *: the frame's buffers, which are used up
+ * @param iov_cnt - int: the number of buffers
+ * @return 0 on success, -1 if the client left or stopped reading
+ */
+static int send_ack(int fd, struct iovec *iov, int iov_cnt);
+
+struct ack_chan *ack_open(int fd)
+{
+    struct ack_chan *chan;
+    int err;
+
+    if ((chan = (struct ack_chan *) malloc(sizeof(struct ack_chan))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    // A descriptor of its own keeps the socket from being closed, and its number reused, under a late ack
+    if ((chan->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1)
+    {
+        free(chan);
+        return NULL;
+    }
+    if ((err = pthread_mutex_init(&chan->lock, NULL)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    atomic_init(&chan->refs, 1);
+    chan->broken = 0;
+    return chan;
+}
+
+struct ack_chan *ack_hold(struct ack_chan *chan)
+{
+    if (chan != NULL)
+    {
+        atomic_fetch_add_explicit(&chan->refs, 1, memory_order_relaxed);
+    }
+    return chan;
+}
+
+void ack_release(struct ack_chan *chan)
+{
+    if (chan == NULL || atomic_fetch_sub_explicit(&chan->refs, 1, memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+    close(chan->fd);
+    pthread_mutex_destroy(&chan->lock);
+    free(chan);
+}
+
+void ack_send(const struct ack_info *ack, uint64_t len)
+{
+    send_reply(ack->chan, PROTO_FRAME_ACK, ack->stream, len, ack->save_name);
+}
+
+void ack_offset(struct ack_chan *chan, uint32_t stream, uint64_t offset)
+{
+    send_reply(chan, PROTO_FRAME_OFFSET, stream, offset, NULL);
+}
+
+void ack_have(struct ack_chan *chan, uint32_t stream, uint64_t len)
+{
+    send_reply(chan, PROTO_FRAME_HAVE, stream, len, NULL);
+}
+
+void ack_sigs(struct ack_chan *chan, uint32_t stream, uint64_t base_size, uint32_t block_size, uint8_t *sigs,
+              size_t sigs_len)
+{
+    uint8_t hdr[PROTO_FRAME_SIZE];
+    struct iovec iov[3];
+    uint32_t block_size_be = htonl(block_size);
+
+    fill_header(hdr, PROTO_FRAME_SIGS, 0, stream, base_size);
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = sizeof(hdr);
+    iov[1].iov_base = &block_size_be;
+    iov[1].iov_len = sizeof(uint32_t);
+    iov[2].iov_base = sigs;
+    iov[2].iov_len = sigs_len;
+    send_locked(chan, iov, sigs_len > 0 ? 3 : 2);
+}
+
+static void send_reply(struct ack_chan *chan, enum proto_frame type, uint32_t stream, uint64_t len, const char *name)
+{
+    uint8_t frame[PROTO_FRAME_SIZE + PATH_MAX];
+    struct iovec iov;
+    size_t name_len = name != NULL ? strlen(name) : 0;
+
+    if (name_len > PATH_MAX)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                      69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+    }
+    fill_header(frame, type, name_len, stream, len);
+    if (name_len > 0)
+    {
+        memcpy(frame + PROTO_FRAME_SIZE, name, name_len);
+    }
+    iov.iov_base = frame;
+    iov.iov_len = PROTO_FRAME_SIZE + name_len;
+    send_locked(chan, &iov, 1);
+}
+
+static void fill_header(uint8_t hdr[PROTO_FRAME_SIZE], enum proto_frame type, size_t name_len, uint32_t stream,
+                        uint64_t len)
+{
+    uint16_t name_len_be = htons((uint16_t) name_len);
+
+    stream = htonl(stream);
+    len = htobe64(len);
+    hdr[0] = (uint8_t) type;
+    hdr[1] = 0;
+    memcpy(hdr + 2, &name_len_be, sizeof(uint16_t));
+    memcpy(hdr + 4, &stream, sizeof(uint32_t));    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+    memcpy(hdr + 8, &len, sizeof(uint64_t));       // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+}
+
+void ack_drop(struct ack_chan *chan)
+{
+    int err;
+
+    if (chan == NULL)
+    {
+        return;
+    }
+    if ((err = pthread_mutex_lock(&chan->lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    chan->broken = 1;
+    shutdown(chan->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&chan->lock);
+}
+
+static void send_locked(struct ack_chan *chan, struct iovec *iov, int iov_cnt)
+{
+    int err;
+
+    // Replies to one client come from every thread that finishes its files; each goes out whole
+    if ((err = pthread_mutex_lock(&chan->lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    if (!chan->broken && send_ack(chan->fd, iov, iov_cnt) == -1)
+    {
+        // Wake the connection's thread, which drops the client as it would any other that left
+        chan->broken = 1;
+        shutdown(chan->fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&chan->lock);
+}
+
+static int send_ack(int fd, struct iovec *iov, int iov_cnt)
+{
+    while (iov_cnt > 0)
+    {
+        struct msghdr msg;
+        ssize_t ret_val;
+
+        memset(&msg, 0, sizeof(struct msghdr)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        msg.msg_iov = iov;
+        msg.msg_iovlen = (size_t) iov_cnt;
+        if ((ret_val = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL)) == -1)
+        {
+            struct pollfd pfd;
+            int ready;
+
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                return -1;
+            }
+            // The client holds back no more files than its window, so a full socket means it stopped reading
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            while ((ready = poll(&pfd, 1, ACK_SEND_TIMEOUT_MS)) == -1 && errno == EINTR)
+            {
+            }
+            if (ready <= 0)
+            {
+                printf("A client stopped reading acknowledgements; dropping it.\n");
+                return -1;
+            }
+            continue;
+        }
+
+        while (iov_cnt > 0 && (size_t) ret_val >= iov->iov_len)
+        {
+            ret_val -= (ssize_t) iov->iov_len;
+            ++iov;
+            --iov_cnt;
+        }
+        if (iov_cnt > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + ret_val;
+            iov->iov_len -= (size_t) ret_val;
+        }
+    }
+    return 0;
+}
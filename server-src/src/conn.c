@@ -0,0 +1,1609 @@
+#define _GNU_SOURCE
+#include "conn.h"
+#include "ack.h"
+#include "delta.h"
+#include "direct.h"
+#include "durable.h"
+#include "error.h"
+#include "lz.h"
+#include "proto.h"
+#include "save.h"
+#include "sha256.h"
+#include "stripe.h"
+#include "version.h"
+#include "writer.h"
+#include <endian.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of recv calls made for one connection before yielding to other connections.
+ */
+#define CONN_RECV_BURST 16
+
+/**
+ * sigs_task
+ * <p>
+ * Struct storing what a writer needs to send a delta stream's signatures in the background.
+ * <ul>
+ * <li>int base_fd: file descriptor of the task's own for the base file, or -1 if there is none</li>
+ * <li>uint64_t base_size: the size of the base file</li>
+ * <li>uint32_t block_size: the size of each signed block</li>
+ * <li>uint64_t blocks: the number of whole blocks in the base file</li>
+ * <li>struct ack_chan *acks: the client's acknowledgement channel, held until the task ends</li>
+ * <li>uint32_t stream: the delta stream</li>
+ * </ul>
+ * </p>
+ */
+struct sigs_task
+{
+    int base_fd;
+    uint64_t base_size;
+    uint32_t block_size;
+    uint64_t blocks;
+    struct ack_chan *acks;
+    uint32_t stream;
+};
+
+/**
+ * conn_dst
+ * <p>
+ * Get the memory into which the next header bytes from the client should be copied, and how many
+ * bytes the current part of the protocol still needs.
+ * </p>
+ * @param c - conn *: the connection
+ * @param len - size_t *: pointer to the memory to hold the number of bytes still needed
+ * @return pointer to the memory to copy into
+ */
+static void *conn_dst(struct conn *c, size_t *len);
+
+/**
+ * splice_data
+ * <p>
+ * Move up to len bytes of file data from the client's socket into the file through a pipe, so the
+ * data never enters user space.
+ * </p>
+ * @param c - conn *: the connection
+ * @param save_fd - int: file descriptor for the file
+ * @param pipe_fds - int[]: the pipe
+ * @param len - size_t: the most bytes to move
+ * @return the number of bytes moved, 0 if the client left, or -1 with errno set
+ */
+static ssize_t splice_data(const struct conn *c, int save_fd, const int pipe_fds[2], size_t len);
+
+/**
+ * decode_header
+ * <p>
+ * Copy up to len bytes of a header or file name from buf into the connection, moving to the next
+ * part of the protocol when the current part is complete.
+ * </p>
+ * @param c - conn *: the connection
+ * @param buf - char *: the received bytes
+ * @param len - size_t: the number of bytes in buf
+ * @param consumed - size_t *: pointer to the memory to hold the number of bytes of buf used
+ * @return CONN_EV_HELLO, CONN_EV_FILE or CONN_EV_END when the header completes one, CONN_EV_DATA
+ *         when the payload of a compressed data frame is complete, CONN_EV_ERROR on a protocol
+ *         error, otherwise CONN_EV_NONE
+ */
+static enum conn_event decode_header(struct conn *c, const char *buf, size_t len, size_t *consumed);
+
+/**
+ * decode_frame
+ * <p>
+ * Act on a complete v2 frame header: start a file, point the connection at a stream's data or
+ * end a file.
+ * </p>
+ * @param c - conn *: the connection
+ * @return CONN_EV_END at the end of a file, CONN_EV_ERROR on a protocol error, otherwise CONN_EV_NONE
+ */
+static enum conn_event decode_frame(struct conn *c);
+
+/**
+ * unpack_frame
+ * <p>
+ * Decompress a complete compressed data frame into the connection's unpacked buffer.
+ * </p>
+ * @param c - conn *: the connection
+ * @param data_len - size_t *: pointer to the memory to hold the number of bytes decompressed
+ * @return CONN_EV_DATA, or CONN_EV_ERROR if the frame is malformed or too large for its file
+ */
+static enum conn_event unpack_frame(struct conn *c, size_t *data_len);
+
+/**
+ * decode_stripe
+ * <p>
+ * Take the transfer ID, offset and size following a stripe's name. From then on the file's size is
+ * the stripe's, as the stream carries only the stripe.
+ * </p>
+ * @param file - conn_file *: the file, whose size is that of the whole file
+ * @param name_len - size_t *: pointer to the length of the name and what follows it, reduced to
+ *                   the length of the name
+ * @return 0 on success, -1 if the stripe is empty or does not lie within the file
+ */
+static int decode_stripe(struct conn_file *file, size_t *name_len);
+
+/**
+ * find_file
+ * <p>
+ * Find the open file on a v2 stream.
+ * </p>
+ * @param c - conn *: the connection
+ * @param stream - uint32_t: the stream
+ * @return the file, or NULL if the stream is not open
+ */
+static struct conn_file *find_file(struct conn *c, uint32_t stream);
+
+/**
+ * start_file
+ * <p>
+ * Make the connection's cur file open and allocate its name for f_name_len bytes.
+ * </p>
+ * @param c - conn *: the connection
+ */
+static void start_file(struct conn *c);
+
+/**
+ * check_file_name
+ * <p>
+ * Check the received file name, so a file can only be saved inside the client's directory. A relative
+ * path of plain directory names, such as a walked tree sends, is kept, and its directories are made
+ * when the file is saved; any other path, such as one that is absolute or climbs with "..", is
+ * reduced to its last component. The last component must leave room for a version suffix within
+ * NAME_MAX.
+ * </p>
+ * @param file - conn_file *: the file, whose name is complete
+ * @param name_len - size_t: the number of bytes received as the name
+ * @return 0 on success, -1 if the name holds a NUL byte, names no file or is too long to version
+ */
+static int check_file_name(struct conn_file *file, size_t name_len);
+
+/**
+ * conn_busy
+ * <p>
+ * Check whether the client is partway through sending something.
+ * </p>
+ * @param c - conn *: the connection
+ * @return 1 if a header or file is incomplete, otherwise 0
+ */
+static int conn_busy(const struct conn *c);
+
+/**
+ * conn_consume
+ * <p>
+ * Decode every header and every span of file data in len received bytes, opening, writing and
+ * saving files as they complete. One receive can hold many small files.
+ * </p>
+ * @param c - conn *: the connection
+ * @param io - conn_io *: the scratch resources, whose stream, if any, receives the files
+ * @param buf - char *: the received bytes
+ * @param len - size_t: the number of bytes in buf
+ * @return 0 on success, -1 if the client broke the protocol
+ */
+static int conn_consume(struct conn *c, const struct conn_io *io, const char *buf, size_t len);
+
+/**
+ * conn_start
+ * <p>
+ * Open the file a client has just announced, or have a disk writer do so.
+ * </p>
+ * @param c - conn *: the connection
+ * @param io - conn_io *: the scratch resources
+ * @param file - conn_file *: the file
+ * @return 0 on success, -1 with the connection's error set if the file cannot be saved
+ */
+static int conn_start(struct conn *c, const struct conn_io *io, struct conn_file *file);
+
+/**
+ * conn_have
+ * <p>
+ * Store a hashed file at once if its content is already stored, and tell the client whether its
+ * data is needed.
+ * </p>
+ * @param c - conn *: the connection
+ * @param file - conn_file *: the file
+ * @return 1 if the file was stored and its stream is over, 0 if its data is needed
+ */
+static int conn_have(struct conn *c, struct conn_file *file);
+
+/**
+ * conn_resume
+ * <p>
+ * Open the partial file of a resumable upload, restore the hash of what it already holds, and
+ * tell the client where to resume.
+ * </p>
+ * @param c - conn *: the connection
+ * @param file - conn_file *: the file, its hash started
+ * @return 0 on success, -1 if the file system cannot hold the file's name
+ */
+static int conn_resume(struct conn *c, struct conn_file *file);
+
+/**
+ * conn_delta
+ * <p>
+ * Start receiving the file of a delta stream: open the base file, the latest version stored under
+ * the file's name, and the file for the new version, then have a writer send the client the
+ * base's signatures, as reading and hashing all of it would hold up every other connection.
+ * </p>
+ * @param c - conn *: the connection
+ * @param io - conn_io *: the thread's resources, whose pool sends the signatures
+ * @param file - conn_file *: the file
+ * @return 0 on success, -1 if the file system cannot hold the file's name
+ */
+static int conn_delta(struct conn *c, const struct conn_io *io, struct conn_file *file);
+
+/**
+ * send_sigs
+ * <p>
+ * Writer task: sign the blocks of a delta stream's base file and send the signatures to the
+ * client, then free the task.
+ * </p>
+ * @param arg - void *: the sigs_task
+ */
+static void send_sigs(void *arg);
+
+/**
+ * conn_copy
+ * <p>
+ * Append the block of the base file named by a copy frame to a delta stream's file.
+ * </p>
+ * @param file - conn_file *: the file
+ * @return 0 on success, -1 if the base file no longer holds the block
+ */
+static int conn_copy(struct conn_file *file);
+
+/**
+ * conn_hold
+ * <p>
+ * Get a file's disk writer for new data. A connection holds a partly filled writer buffer for only
+ * one file at a time, so the buffer of the file it last wrote is handed off first.
+ * </p>
+ * @param c - conn *: the connection
+ * @param file - conn_file *: the file, saved by a disk writer
+ * @return the file's writer_file
+ */
+static struct writer_file *conn_hold(struct conn *c, struct conn_file *file);
+
+/**
+ * conn_idle
+ * <p>
+ * Hand any partly filled writer buffer to the disk writer before waiting on the client again.
+ * </p>
+ * @param c - conn *: the connection
+ */
+static void conn_idle(struct conn *c);
+
+/**
+ * conn_save
+ * <p>
+ * Close a completed file and report it, acknowledging it if the client asked, once durable; or
+ * have its disk writer do so. A resumable file that does not match its digest, or whose partial
+ * file was removed under it, is discarded. A stripe is only recorded, until the last of its file's
+ * stripes completes the file.
+ * </p>
+ * @param c - conn *: the connection
+ * @param io - conn_io *: the scratch resources
+ * @param file - conn_file *: the file
+ * @return 0 on success, -1 with the connection's error set if the file was discarded or the stripe
+ * overlaps another
+ */
+static int conn_save(struct conn *c, const struct conn_io *io, struct conn_file *file);
+
+/**
+ * conn_discard
+ * <p>
+ * Throw away whatever of a file has been received.
+ * </p>
+ * @param c - conn *: the connection
+ * @param file - conn_file *: the file
+ */
+static void conn_discard(struct conn *c, struct conn_file *file);
+
+/**
+ * reset_file
+ * <p>
+ * Free a file's name and clear everything its stream set, marking it unused. Its hash is kept for
+ * the next file that needs one.
+ * </p>
+ * @param file - conn_file *: the file
+ */
+static void reset_file(struct conn_file *file);
+
+struct conn *conn_open(int fd, const struct sockaddr_in *client_addr, const char *wr_dir)
+{
+    struct conn *c;
+
+    if ((c = (struct conn *) calloc(1, sizeof(struct conn))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    c->fd = fd;
+    c->state = CONN_NAME_LEN;
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        c->files[i].save_fd = -1;
+        c->files[i].base_fd = -1;
+    }
+    c->port = ntohs(client_addr->sin_port);
+    if (inet_ntop(AF_INET, &client_addr->sin_addr, c->addr_str, sizeof(c->addr_str)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    printf("\n%s:%d connected.\n\n", c->addr_str, c->port);
+
+    create_dir_str(&c->save_dir, wr_dir, c->addr_str);
+    if ((c->dir_fd = open_save_dir(wr_dir, c->addr_str)) == -1)
+    {
+        printf("%s:%d dropped: could not open %s: %s\n", c->addr_str, c->port, c->save_dir, strerror(errno)); // NOLINT(concurrency-mt-unsafe) : Message only
+        close(fd);
+        free(c->save_dir);
+        free(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+int conn_recv(struct conn *c, const struct conn_io *io)
+{
+    for (int burst = 0; burst < CONN_RECV_BURST; ++burst)
+    {
+        struct conn_file *file = c->cur;
+        ssize_t ret_val;
+        int in_data;
+
+        // Headers are always received into the buffer, so one recv can carry several small files
+        in_data = c->state == CONN_DATA && c->data_left > 0;
+        if (in_data && io->pipe_fds[0] != -1 && file->hash == NULL)
+        {
+            size_t len = c->data_left < io->buf_size ? (size_t) c->data_left : io->buf_size;
+            ret_val = splice_data(c, file->save_fd, io->pipe_fds, len);
+        } else if (in_data && file->wfile != NULL)
+        {
+            // Receive straight into the writer's buffer so the data is not copied again
+            size_t len;
+            char *dst = writer_file_space(conn_hold(c, file), &len);
+
+            len = c->data_left < len ? (size_t) c->data_left : len;
+            ret_val = recv(c->fd, dst, len, 0);
+            if (ret_val > 0 && file->hash != NULL)
+            {
+                sha256_update(file->hash, dst, (size_t) ret_val);
+            }
+        } else
+        {
+            in_data = 0;
+            ret_val = recv(c->fd, io->buf, io->buf_size, 0);
+        }
+        if (ret_val == -1)
+        {
+            // An interrupted blocking receive yields so the caller can check whether to stop
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                conn_idle(c);
+                return 1;
+            }
+            printf("%s:%d dropped: %s\n", c->addr_str, c->port, strerror(errno)); // NOLINT(concurrency-mt-unsafe) : Message only
+            return 0;
+        }
+
+        if (ret_val == 0)
+        {
+            if (conn_busy(c))
+            {
+                printf("%s:%d disconnected mid-file.\n", c->addr_str, c->port);
+            }
+            return 0;
+        }
+
+        if (in_data)
+        {
+            if (file->wfile != NULL)
+            {
+                writer_file_commit(file->wfile, (size_t) ret_val);
+            }
+            file->recv_len += (uint64_t) ret_val;
+            c->data_left -= (uint64_t) ret_val;
+            ret_val = 0;
+        }
+        if (conn_consume(c, io, io->buf, (size_t) ret_val) == -1)
+        {
+            printf("%s:%d %s.\n", c->addr_str, c->port, c->error);
+            return 0;
+        }
+    }
+    conn_idle(c);
+    return 1;
+}
+
+int conn_greet(struct conn *c, uint16_t offered)
+{
+    uint8_t hello[PROTO_HELLO_SIZE];
+    uint32_t magic = htonl(PROTO_MAGIC);
+    uint16_t version = htons(PROTO_VERSION);
+    uint16_t features;
+
+    c->features &= offered;
+    features = htons(c->features);
+    // Only a client that is answered needs the channel
+    if ((c->features & PROTO_FEATURES_ANSWERED) && (c->acks = ack_open(c->fd)) == NULL)
+    {
+        return -1;
+    }
+
+    memcpy(hello, &magic, sizeof(uint32_t));
+    memcpy(hello + sizeof(uint32_t), &version, sizeof(uint16_t));
+    memcpy(hello + sizeof(uint32_t) + sizeof(uint16_t), &features, sizeof(uint16_t));
+
+    // The answer is the first thing sent on the socket, so its buffer always has room
+    return send(c->fd, hello, sizeof(hello), MSG_NOSIGNAL) == (ssize_t) sizeof(hello) ? 0 : -1;
+}
+
+void conn_io_open(struct conn_io *io, const struct server_settings *set)
+{
+    io->buf_size = CONN_BUF_SIZE;
+    if ((io->buf = (char *) malloc(io->buf_size)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    io->pipe_fds[0] = -1;
+    io->pipe_fds[1] = -1;
+    if (set->use_splice)
+    {
+        if (pipe2(io->pipe_fds, O_CLOEXEC) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        // A pipe the size of the buffer lets one splice move as much as one recv would
+        fcntl(io->pipe_fds[1], F_SETPIPE_SZ, CONN_BUF_SIZE);
+    }
+
+    io->direct_io = set->direct_io;
+    io->dedup = set->dedup;
+    io->sized_only = set->store == SAVE_STORE_SEGMENTS;
+    // A partial file is kept under its own name until complete, and a delta's base is found by name;
+    // a segment allows neither
+    io->features = set->store == SAVE_STORE_FILES ? PROTO_FEATURES : PROTO_FEATURE_ACK | PROTO_FEATURE_COMPRESS;
+    if (!set->dedup)
+    {
+        // Without blobs there is no content to look a digest up in
+        io->features &= (uint16_t) ~PROTO_FEATURE_HAVE;
+    }
+    if (set->io_mode == IO_MODE_BLOCKING)
+    {
+        // One connection is served at a time, so a file's other stripes would never arrive
+        io->features &= (uint16_t) ~PROTO_FEATURE_STRIPE;
+    }
+    io->pool = set->writer_pool;
+    io->stream = NULL;
+    if (set->n_writers > 0)
+    {
+        io->stream = writer_stream_open(set->writer_pool, set->queue_depth, CONN_BUF_SIZE);
+    }
+}
+
+void conn_io_close(struct conn_io *io)
+{
+    if (io->pipe_fds[0] != -1)
+    {
+        close(io->pipe_fds[0]);
+        close(io->pipe_fds[1]);
+    }
+    if (io->stream != NULL)
+    {
+        writer_stream_close(io->stream);
+    }
+    free(io->buf);
+}
+
+enum conn_event conn_decode(struct conn *c, const char *buf, size_t len, size_t *consumed,
+                            const char **data, size_t *data_len)
+{
+    size_t used = 0;
+
+    *consumed = 0;
+    if (c->done != NULL)
+    {
+        reset_file(c->done);
+        c->done = NULL;
+    }
+
+    while (c->state != CONN_DATA || c->data_left == 0)
+    {
+        enum conn_event ev;
+        size_t n;
+
+        // A span of data is over: in v1 it was the whole file, in v2 another frame follows
+        if (c->state == CONN_DATA)
+        {
+            if (c->version == 1)
+            {
+                c->state = CONN_NAME_LEN;
+                c->done = c->cur;
+                *consumed = used;
+                return CONN_EV_END;
+            }
+            c->state = CONN_FRAME;
+        }
+
+        if (used == len)
+        {
+            *consumed = used;
+            return CONN_EV_NONE;
+        }
+        ev = decode_header(c, buf + used, len - used, &n);
+        used += n;
+        if (ev == CONN_EV_DATA)
+        {
+            // Only a compressed frame completes as a header would
+            ev = unpack_frame(c, data_len);
+            *data = c->unpacked;
+        }
+        if (ev != CONN_EV_NONE)
+        {
+            *consumed = used;
+            return ev;
+        }
+    }
+    *consumed = used;
+
+    if (used == len)
+    {
+        return CONN_EV_NONE;
+    }
+
+    *data = buf + used;
+    *data_len = len - used < c->data_left ? len - used : (size_t) c->data_left;
+    c->data_left -= *data_len;
+    c->cur->recv_len += *data_len;
+    *consumed = used + *data_len;
+    return CONN_EV_DATA;
+}
+
+void conn_close(struct conn *c)
+{
+    printf("%s:%d left.\n", c->addr_str, c->port);
+
+    close(c->fd);
+    ack_release(c->acks);
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        struct conn_file *file = &c->files[i];
+
+        if (file->save_fd != -1 && file->partial)
+        {
+            printf("%s:%d kept %llu bytes of %s to resume.\n", c->addr_str, c->port, // NOLINT(google-runtime-int) : printf
+                   (unsigned long long) file->recv_len, file->file_name);
+            keep_partial_file(file->save_fd, file->save_path, file->hash);
+            file->save_fd = -1;
+        }
+        conn_discard(c, file);
+        reset_file(file);
+        free(file->hash);
+    }
+    free(c->packed);
+    free(c->unpacked);
+    free(c->save_dir);
+    free(c);
+}
+
+static ssize_t splice_data(const struct conn *c, int save_fd, const int pipe_fds[2], size_t len)
+{
+    ssize_t in_pipe;
+    ssize_t ret_val;
+
+    // The pipe is always empty here, so only the socket's own blocking mode decides whether this waits
+    if ((in_pipe = splice(c->fd, NULL, pipe_fds[1], NULL, len, SPLICE_F_MOVE)) <= 0)
+    {
+        return in_pipe;
+    }
+
+    // Drain the pipe completely so it is empty for the next connection that uses it
+    for (ssize_t moved = 0; moved < in_pipe; moved += ret_val)
+    {
+        if ((ret_val = splice(pipe_fds[0], NULL, save_fd, NULL, (size_t) (in_pipe - moved), SPLICE_F_MOVE)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                ret_val = 0;
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+    }
+    return in_pipe;
+}
+
+static void *conn_dst(struct conn *c, size_t *len)
+{
+    switch (c->state)
+    {
+        case CONN_NAME_LEN:
+        {
+            *len = sizeof(uint16_t) - c->hdr_recv;
+            return c->hdr + c->hdr_recv;
+        }
+        case CONN_NAME:
+        case CONN_FRAME_NAME:
+        {
+            *len = c->f_name_len - c->cur->recv_len;
+            return c->cur->file_name + c->cur->recv_len;
+        }
+        case CONN_DATA_LEN:
+        {
+            *len = sizeof(uint32_t) - c->hdr_recv;
+            return c->hdr + c->hdr_recv;
+        }
+        case CONN_HELLO:
+        {
+            *len = PROTO_HELLO_SIZE - c->hdr_recv;
+            return c->hdr + c->hdr_recv;
+        }
+        case CONN_FRAME:
+        {
+            *len = PROTO_FRAME_SIZE - c->hdr_recv;
+            return c->hdr + c->hdr_recv;
+        }
+        case CONN_FRAME_DIGEST:
+        {
+            *len = PROTO_DIGEST_SIZE - c->hdr_recv;
+            return c->cur->digest + c->hdr_recv;
+        }
+        case CONN_FRAME_PACKED:
+        {
+            *len = c->packed_len - c->hdr_recv;
+            return c->packed + c->hdr_recv;
+        }
+        case CONN_DATA:
+        default:
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                          69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+        }
+    }
+}
+
+static enum conn_event decode_header(struct conn *c, const char *buf, size_t len, size_t *consumed)
+{
+    size_t need;
+    char *dst;
+
+    dst = (char *) conn_dst(c, &need);
+    *consumed = len < need ? len : need;
+    memcpy(dst, buf, *consumed);
+
+    switch (c->state)
+    {
+        case CONN_NAME_LEN:
+        {
+            uint16_t f_name_len;
+
+            if ((c->hdr_recv += *consumed) < sizeof(uint16_t))
+            {
+                return CONN_EV_NONE;
+            }
+            memcpy(&f_name_len, c->hdr, sizeof(uint16_t));
+            c->f_name_len = ntohs(f_name_len);
+            c->hdr_recv = 0;
+            if (c->f_name_len == 0)
+            {
+                // Only a client's first header may begin a hello
+                if (c->version != 0)
+                {
+                    c->error = "sent an empty file name";
+                    return CONN_EV_ERROR;
+                }
+                c->state = CONN_HELLO;
+                return CONN_EV_NONE;
+            }
+            c->version = 1;
+            c->cur = &c->files[0];
+            start_file(c);
+            c->state = CONN_NAME;
+            return CONN_EV_NONE;
+        }
+        case CONN_NAME:
+        case CONN_FRAME_NAME:
+        {
+            size_t name_len = c->f_name_len;
+
+            if ((c->cur->recv_len += *consumed) < c->f_name_len)
+            {
+                return CONN_EV_NONE;
+            }
+            // The name is followed by the transfer ID, then the digest, of streams that carry them, or
+            // by a stripe's transfer ID, offset and size
+            if (c->cur->hashed)
+            {
+                name_len -= PROTO_DIGEST_SIZE;
+                memcpy(c->cur->digest, c->cur->file_name + name_len, PROTO_DIGEST_SIZE);
+            }
+            if (c->cur->resumable)
+            {
+                name_len -= PROTO_TRANSFER_ID_SIZE;
+                memcpy(c->cur->transfer_id, c->cur->file_name + name_len, PROTO_TRANSFER_ID_SIZE);
+            }
+            if (c->cur->striped && decode_stripe(c->cur, &name_len) == -1)
+            {
+                c->error = "sent a stripe outside its file";
+                return CONN_EV_ERROR;
+            }
+            c->cur->file_name[name_len] = '\0';
+            if (check_file_name(c->cur, name_len) == -1)
+            {
+                c->error = "sent an invalid file name";
+                return CONN_EV_ERROR;
+            }
+            c->cur->recv_len = 0;
+            if (c->state == CONN_NAME)
+            {
+                c->state = CONN_DATA_LEN;
+                return CONN_EV_NONE;
+            }
+            c->state = CONN_FRAME;
+            return CONN_EV_FILE;
+        }
+        case CONN_DATA_LEN:
+        {
+            uint32_t f_data_len;
+
+            if ((c->hdr_recv += *consumed) < sizeof(uint32_t))
+            {
+                return CONN_EV_NONE;
+            }
+            memcpy(&f_data_len, c->hdr, sizeof(uint32_t));
+            c->cur->size = ntohl(f_data_len);
+            c->hdr_recv = 0;
+            c->data_left = c->cur->size;
+            c->state = CONN_DATA;
+            return CONN_EV_FILE;
+        }
+        case CONN_HELLO:
+        {
+            uint32_t magic;
+            uint16_t features;
+
+            if ((c->hdr_recv += *consumed) < PROTO_HELLO_SIZE)
+            {
+                return CONN_EV_NONE;
+            }
+            memcpy(&magic, c->hdr, sizeof(uint32_t));
+            memcpy(&features, c->hdr + sizeof(uint32_t) + sizeof(uint16_t), sizeof(uint16_t));
+            c->hdr_recv = 0;
+            if (ntohl(magic) != PROTO_MAGIC)
+            {
+                c->error = "sent a hello with a bad magic number";
+                return CONN_EV_ERROR;
+            }
+            // A hello always asks for v2 or later; features not spoken here are left off the answer
+            c->version = PROTO_VERSION;
+            c->features = ntohs(features) & PROTO_FEATURES;
+            c->state = CONN_FRAME;
+            return CONN_EV_HELLO;
+        }
+        case CONN_FRAME:
+        {
+            if ((c->hdr_recv += *consumed) < PROTO_FRAME_SIZE)
+            {
+                return CONN_EV_NONE;
+            }
+            c->hdr_recv = 0;
+            return decode_frame(c);
+        }
+        case CONN_FRAME_DIGEST:
+        {
+            if ((c->hdr_recv += *consumed) < PROTO_DIGEST_SIZE)
+            {
+                return CONN_EV_NONE;
+            }
+            c->hdr_recv = 0;
+            c->state = CONN_FRAME;
+            c->done = c->cur;
+            return CONN_EV_END;
+        }
+        case CONN_FRAME_PACKED:
+        {
+            if ((c->hdr_recv += *consumed) < c->packed_len)
+            {
+                return CONN_EV_NONE;
+            }
+            c->hdr_recv = 0;
+            c->state = CONN_FRAME;
+            return CONN_EV_DATA;
+        }
+        case CONN_DATA:
+        default:
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                          69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+        }
+    }
+}
+
+static enum conn_event decode_frame(struct conn *c)
+{
+    struct conn_file *file;
+    uint16_t name_len;
+    uint32_t stream;
+    uint64_t len;
+
+    uint8_t flags = c->hdr[1];
+
+    memcpy(&name_len, c->hdr + 2, sizeof(uint16_t));
+    memcpy(&stream, c->hdr + 4, sizeof(uint32_t));                 // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+    memcpy(&len, c->hdr + 8, sizeof(uint64_t));                    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Frame layout
+    name_len = ntohs(name_len);
+    stream = ntohl(stream);
+    len = be64toh(len);
+    file = find_file(c, stream);
+
+    switch (c->hdr[0])
+    {
+        case PROTO_FRAME_OPEN:
+        {
+            if (file != NULL)
+            {
+                c->error = "opened a stream that is already open";
+                return CONN_EV_ERROR;
+            }
+            if (name_len == 0)
+            {
+                c->error = "sent an empty file name";
+                return CONN_EV_ERROR;
+            }
+            if (flags & ~(PROTO_FLAG_RESUME | PROTO_FLAG_HASH | PROTO_FLAG_DELTA | PROTO_FLAG_STRIPE))
+            {
+                c->error = "sent a frame with unknown flags";
+                return CONN_EV_ERROR;
+            }
+            if ((flags & PROTO_FLAG_RESUME) && !(c->features & PROTO_FEATURE_RESUME))
+            {
+                c->error = "opened a resumable stream without asking to resume";
+                return CONN_EV_ERROR;
+            }
+            if ((flags & PROTO_FLAG_HASH) && !(c->features & PROTO_FEATURE_HAVE))
+            {
+                c->error = "sent a file's digest without asking to skip stored content";
+                return CONN_EV_ERROR;
+            }
+            if ((flags & PROTO_FLAG_DELTA) && !(c->features & PROTO_FEATURE_DELTA))
+            {
+                c->error = "opened a delta stream without asking to send deltas";
+                return CONN_EV_ERROR;
+            }
+            if ((flags & PROTO_FLAG_STRIPE) && !(c->features & PROTO_FEATURE_STRIPE))
+            {
+                c->error = "opened a stripe without asking to send stripes";
+                return CONN_EV_ERROR;
+            }
+            if ((flags & PROTO_FLAG_DELTA) && flags != PROTO_FLAG_DELTA)
+            {
+                c->error = "opened a delta stream that is also resumable, hashed or a stripe";
+                return CONN_EV_ERROR;
+            }
+            if ((flags & PROTO_FLAG_STRIPE) && flags != PROTO_FLAG_STRIPE)
+            {
+                c->error = "opened a stripe that is also resumable or hashed";
+                return CONN_EV_ERROR;
+            }
+            if (flags != 0 && len == PROTO_SIZE_UNKNOWN)
+            {
+                c->error = "opened a resumable, hashed, delta or striped stream of unknown size";
+                return CONN_EV_ERROR;
+            }
+            for (size_t i = 0; i < CONN_MAX_FILES && file == NULL; ++i)
+            {
+                file = c->files[i].open ? NULL : &c->files[i];
+            }
+            if (file == NULL)
+            {
+                c->error = "opened too many streams at once";
+                return CONN_EV_ERROR;
+            }
+            c->cur = file;
+            c->f_name_len = name_len;
+            file->resumable = (flags & PROTO_FLAG_RESUME) != 0;
+            file->hashed = (flags & PROTO_FLAG_HASH) != 0;
+            file->delta = (flags & PROTO_FLAG_DELTA) != 0;
+            file->striped = (flags & PROTO_FLAG_STRIPE) != 0;
+            if (file->resumable)
+            {
+                c->f_name_len += PROTO_TRANSFER_ID_SIZE;
+            }
+            if (file->striped)
+            {
+                c->f_name_len += PROTO_STRIPE_SIZE;
+            }
+            if (file->hashed)
+            {
+                c->f_name_len += PROTO_DIGEST_SIZE;
+            }
+            if (c->f_name_len < name_len)
+            {
+                c->error = "sent a file name too long to follow with its stream's details";
+                return CONN_EV_ERROR;
+            }
+            start_file(c);
+            file->stream = stream;
+            file->size = len;
+            c->state = CONN_FRAME_NAME;
+            return CONN_EV_NONE;
+        }
+        case PROTO_FRAME_DATA:
+        {
+            if (file == NULL)
+            {
+                c->error = "sent data on a stream that is not open";
+                return CONN_EV_ERROR;
+            }
+            if (flags & ~PROTO_FLAG_COMPRESSED)
+            {
+                c->error = "sent a frame with unknown flags";
+                return CONN_EV_ERROR;
+            }
+            if (flags & PROTO_FLAG_COMPRESSED)
+            {
+                if (!(c->features & PROTO_FEATURE_COMPRESS))
+                {
+                    c->error = "sent compressed data without asking to compress";
+                    return CONN_EV_ERROR;
+                }
+                if (len <= sizeof(uint32_t) || len > sizeof(uint32_t) + LZ_BOUND(PROTO_COMPRESS_MAX))
+                {
+                    c->error = "sent a compressed frame of impossible size";
+                    return CONN_EV_ERROR;
+                }
+                // The buffers are only needed by clients that compress
+                if (c->packed == NULL
+                    && ((c->packed = (char *) malloc(sizeof(uint32_t) + LZ_BOUND(PROTO_COMPRESS_MAX))) == NULL
+                        || (c->unpacked = (char *) malloc(PROTO_COMPRESS_MAX)) == NULL))
+                {
+                    fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+                }
+                c->cur = file;
+                c->packed_len = (size_t) len;
+                c->state = CONN_FRAME_PACKED;
+                return CONN_EV_NONE;
+            }
+            if (file->size != PROTO_SIZE_UNKNOWN && len > file->size - file->recv_len)
+            {
+                c->error = "sent more data than its file's size";
+                return CONN_EV_ERROR;
+            }
+            c->cur = file;
+            c->data_left = len;
+            c->state = CONN_DATA;
+            return CONN_EV_NONE;
+        }
+        case PROTO_FRAME_COPY:
+        {
+            if (file == NULL || !file->delta)
+            {
+                c->error = "copied a block into a stream that is not a delta";
+                return CONN_EV_ERROR;
+            }
+            if (len >= file->blocks)
+            {
+                c->error = "copied a block its base file does not have";
+                return CONN_EV_ERROR;
+            }
+            if (file->block_size > file->size - file->recv_len)
+            {
+                c->error = "sent more data than its file's size";
+                return CONN_EV_ERROR;
+            }
+            c->cur = file;
+            file->copy = len;
+            file->recv_len += file->block_size;
+            return CONN_EV_COPY;
+        }
+        case PROTO_FRAME_END:
+        {
+            uint8_t end_flags;
+
+            if (file == NULL)
+            {
+                c->error = "ended a stream that is not open";
+                return CONN_EV_ERROR;
+            }
+            if (len != file->recv_len || (file->size != PROTO_SIZE_UNKNOWN && len != file->size))
+            {
+                c->error = "ended a stream without sending its whole file";
+                return CONN_EV_ERROR;
+            }
+            end_flags = file->resumable ? PROTO_FLAG_RESUME : 0;
+            end_flags = file->delta ? PROTO_FLAG_DELTA : end_flags;
+            if (flags != end_flags)
+            {
+                c->error = "ended a stream with the wrong flags";
+                return CONN_EV_ERROR;
+            }
+            file->size = len;
+            c->cur = file;
+            if (end_flags != 0)
+            {
+                // The digest of the whole file follows
+                c->state = CONN_FRAME_DIGEST;
+                return CONN_EV_NONE;
+            }
+            c->done = file;
+            return CONN_EV_END;
+        }
+        default:
+        {
+            c->error = "sent a frame of unknown type";
+            return CONN_EV_ERROR;
+        }
+    }
+}
+
+static enum conn_event unpack_frame(struct conn *c, size_t *data_len)
+{
+    struct conn_file *file = c->cur;
+    uint32_t raw_len;
+    ssize_t ret_val;
+
+    memcpy(&raw_len, c->packed, sizeof(uint32_t));
+    raw_len = ntohl(raw_len);
+    if (raw_len > PROTO_COMPRESS_MAX || (file->size != PROTO_SIZE_UNKNOWN && raw_len > file->size - file->recv_len))
+    {
+        c->error = "sent more data than its file's size";
+        return CONN_EV_ERROR;
+    }
+    ret_val = lz_decompress(c->packed + sizeof(uint32_t), c->packed_len - sizeof(uint32_t), c->unpacked, raw_len);
+    if (ret_val != (ssize_t) raw_len)
+    {
+        c->error = "sent compressed data that does not decompress";
+        return CONN_EV_ERROR;
+    }
+    file->recv_len += raw_len;
+    *data_len = raw_len;
+    return CONN_EV_DATA;
+}
+
+static int decode_stripe(struct conn_file *file, size_t *name_len)
+{
+    const char *trailer;
+    uint64_t offset;
+    uint64_t len;
+
+    *name_len -= PROTO_STRIPE_SIZE;
+    trailer = file->file_name + *name_len;
+    memcpy(file->transfer_id, trailer, PROTO_TRANSFER_ID_SIZE);
+    memcpy(&offset, trailer + PROTO_TRANSFER_ID_SIZE, sizeof(uint64_t));
+    memcpy(&len, trailer + PROTO_TRANSFER_ID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+    offset = be64toh(offset);
+    len = be64toh(len);
+    if (len == 0 || offset >= file->size || len > file->size - offset)
+    {
+        return -1;
+    }
+    file->stripe_offset = offset;
+    file->stripe_size = file->size;
+    file->size = len;
+    return 0;
+}
+
+static struct conn_file *find_file(struct conn *c, uint32_t stream)
+{
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        if (c->files[i].open && c->files[i].stream == stream)
+        {
+            return &c->files[i];
+        }
+    }
+    return NULL;
+}
+
+static void start_file(struct conn *c)
+{
+    if ((c->cur->file_name = (char *) calloc(c->f_name_len + 1, sizeof(char))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    c->cur->open = 1;
+    c->cur->recv_len = 0;
+}
+
+static int check_file_name(struct conn_file *file, size_t name_len)
+{
+    const char *base;
+
+    if (strlen(file->file_name) != name_len)
+    {
+        return -1;
+    }
+    base = strrchr(file->file_name, '/');
+    base = base == NULL ? file->file_name : base + 1;
+    if (*base == '\0' || strcmp(base, ".") == 0 || strcmp(base, "..") == 0
+        || strlen(base) > NAME_MAX - VERSION_SUFFIX_MAX)
+    {
+        return -1;
+    }
+    for (const char *dir = file->file_name; dir != base; dir = strchr(dir, '/') + 1)
+    {
+        size_t dir_len = (size_t) (strchr(dir, '/') - dir);
+
+        if (dir_len == 0 || dir_len > NAME_MAX || (dir_len == 1 && dir[0] == '.')
+            || (dir_len == 2 && dir[0] == '.' && dir[1] == '.'))
+        {
+            memmove(file->file_name, base, strlen(base) + 1);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int conn_busy(const struct conn *c)
+{
+    if (c->hdr_recv != 0 || (c->state != CONN_NAME_LEN && c->state != CONN_FRAME))
+    {
+        return 1;
+    }
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        if (c->files[i].open && &c->files[i] != c->done)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int conn_consume(struct conn *c, const struct conn_io *io, const char *buf, size_t len)
+{
+    enum conn_event ev;
+
+    do
+    {
+        const char *data;
+        size_t data_len;
+        size_t consumed;
+
+        ev = conn_decode(c, buf, len, &consumed, &data, &data_len);
+        buf += consumed;
+        len -= consumed;
+
+        switch (ev)
+        {
+            case CONN_EV_HELLO:
+            {
+                if (conn_greet(c, io->features) == -1)
+                {
+                    c->error = "could not be answered";
+                    return -1;
+                }
+                break;
+            }
+            case CONN_EV_FILE:
+            {
+                if (io->sized_only && c->cur->size == PROTO_SIZE_UNKNOWN)
+                {
+                    c->error = "sent a file of unknown size, which the segment store cannot hold";
+                    return -1;
+                }
+                if (conn_start(c, io, c->cur) == -1)
+                {
+                    return -1;
+                }
+                break;
+            }
+            case CONN_EV_DATA:
+            {
+                struct conn_file *file = c->cur;
+
+                if (file->hash != NULL)
+                {
+                    sha256_update(file->hash, data, data_len);
+                }
+                if (file->wfile != NULL)
+                {
+                    writer_file_write(conn_hold(c, file), data, data_len);
+                } else if (file->direct != NULL)
+                {
+                    direct_write(file->direct, data, data_len);
+                } else
+                {
+                    write_to_file(file->save_fd, data, data_len);
+                }
+                break;
+            }
+            case CONN_EV_COPY:
+            {
+                if (conn_copy(c->cur) == -1)
+                {
+                    c->error = "copied a block of a base file that was cut short";
+                    return -1;
+                }
+                break;
+            }
+            case CONN_EV_END:
+            {
+                if (conn_save(c, io, c->cur) == -1)
+                {
+                    return -1;
+                }
+                break;
+            }
+            case CONN_EV_ERROR:
+            {
+                return -1;
+            }
+            case CONN_EV_NONE:
+            default:
+            {
+                break;
+            }
+        }
+    } while (ev != CONN_EV_NONE);
+    return 0;
+}
+
+static int conn_start(struct conn *c, const struct conn_io *io, struct conn_file *file)
+{
+    // A file of unknown size is treated as empty wherever its size is only a hint
+    uint64_t size = file->size == PROTO_SIZE_UNKNOWN ? 0 : file->size;
+
+    if (file->hashed && conn_have(c, file))
+    {
+        return 0;
+    }
+    if ((io->dedup && !file->striped) || file->resumable || file->delta)
+    {
+        if (file->hash == NULL && (file->hash = (struct sha256_ctx *) malloc(sizeof(struct sha256_ctx))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        sha256_init(file->hash);
+    } else if (file->hash != NULL)
+    {
+        free(file->hash);
+        file->hash = NULL;
+    }
+    if (file->resumable)
+    {
+        // The partial file is written here, where it can be picked up again, not by a writer
+        if (conn_resume(c, file) == -1)
+        {
+            c->error = "sent a file that could not be created";
+            return -1;
+        }
+        return 0;
+    }
+    if (file->delta)
+    {
+        // Blocks of the base file are copied here, so the file is written here too
+        if (conn_delta(c, io, file) == -1)
+        {
+            c->error = "sent a file that could not be created";
+            return -1;
+        }
+        return 0;
+    }
+    if (file->striped)
+    {
+        // Stripes of one file arrive on many connections, so each writes its own range here
+        if ((file->stripe = stripe_join(c->addr_str, c->dir_fd, file->transfer_id, file->file_name, file->stripe_size,
+                                        file->stripe_offset, file->size, &file->save_fd)) == NULL)
+        {
+            c->error = "sent a stripe that does not fit the rest of its file, or could not be created";
+            return -1;
+        }
+        return 0;
+    }
+    if (file->hashed)
+    {
+        ack_offset(c->acks, file->stream, 0);
+    }
+    if (io->stream != NULL)
+    {
+        file->wfile = writer_file_open(io->stream, c->dir_fd, c->save_dir, file->file_name, size);
+        return 0;
+    }
+    if ((file->save_fd = open_save_file(c->dir_fd, file->file_name, size, &file->save_path)) == -1)
+    {
+        c->error = "sent a file that could not be created";
+        return -1;
+    }
+    preallocate_file(file->save_fd, size);
+    if (io->direct_io)
+    {
+        file->direct = direct_open(file->save_fd, size);
+    }
+    return 0;
+}
+
+static int conn_have(struct conn *c, struct conn_file *file)
+{
+    char digest[SHA256_HEX_SIZE];
+    struct ack_info ack;
+    int save_fd;
+
+    sha256_hex(file->digest, digest);
+    if ((save_fd = link_blob(c->dir_fd, file->file_name, digest, file->size, &file->save_path)) == -1)
+    {
+        return 0;
+    }
+    ack_have(c->acks, file->stream, file->size);
+
+    // Nothing more comes on the stream, so it ends here
+    ack.chan = c->features & PROTO_FEATURE_ACK ? c->acks : NULL;
+    ack.stream = file->stream;
+    ack.save_name = file->save_path;
+    durable_save(c->dir_fd, save_fd, c->save_dir, file->file_name, file->size, &ack);
+    reset_file(file);
+    return 1;
+}
+
+static int conn_resume(struct conn *c, struct conn_file *file)
+{
+    uint64_t offset = 0;
+
+    if ((file->save_fd = open_partial_file(c->addr_str, file->transfer_id, file->size, file->hash, &offset,
+                                           &file->save_path)) == -1)
+    {
+        // A connection the client has left but the server has not yet noticed still holds it
+        if ((file->save_fd = open_save_file(c->dir_fd, file->file_name, file->size, &file->save_path)) == -1)
+        {
+            return -1;
+        }
+        preallocate_file(file->save_fd, file->size);
+    } else
+    {
+        file->partial = 1;
+    }
+    file->recv_len = offset;
+    ack_offset(c->acks, file->stream, offset);
+    return 0;
+}
+
+static int conn_delta(struct conn *c, const struct conn_io *io, struct conn_file *file)
+{
+    struct sigs_task *task;
+    uint64_t base_size = 0;
+
+    // The base is found before the new version is claimed, or it would be the new version itself
+    if ((file->base_fd = open_base_file(c->dir_fd, file->file_name)) != -1)
+    {
+        struct stat st;
+
+        if (fstat(file->base_fd, &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        base_size = (uint64_t) st.st_size;
+    }
+    file->block_size = delta_block_size(base_size);
+    file->blocks = base_size / file->block_size;
+    if (file->blocks > 0 && (file->block = (char *) malloc(file->block_size)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if ((file->save_fd = open_save_file(c->dir_fd, file->file_name, file->size, &file->save_path)) == -1)
+    {
+        return -1;
+    }
+    preallocate_file(file->save_fd, file->size);
+
+    // The client sends nothing for the stream until it has the signatures, so the file waits idle
+    if ((task = (struct sigs_task *) malloc(sizeof(struct sigs_task))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    task->base_fd = -1;
+    if (file->blocks > 0 && (task->base_fd = fcntl(file->base_fd, F_DUPFD_CLOEXEC, 0)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    task->base_size = base_size;
+    task->block_size = file->block_size;
+    task->blocks = file->blocks;
+    task->acks = ack_hold(c->acks);
+    task->stream = file->stream;
+    writer_pool_run(io->pool, send_sigs, task);
+    return 0;
+}
+
+static void send_sigs(void *arg)
+{
+    struct sigs_task *task = (struct sigs_task *) arg;
+    uint8_t *sigs = NULL;
+
+    if (task->blocks > 0 && delta_sigs(task->base_fd, task->blocks, task->block_size, &sigs) == -1)
+    {
+        // Cut short under us; the file is sent whole instead
+        task->base_size = 0;
+        task->blocks = 0;
+    }
+    ack_sigs(task->acks, task->stream, task->base_size, task->block_size, sigs,
+             (size_t) task->blocks * PROTO_SIG_SIZE);
+    free(sigs);
+    if (task->base_fd != -1)
+    {
+        close(task->base_fd);
+    }
+    ack_release(task->acks);
+    free(task);
+}
+
+static int conn_copy(struct conn_file *file)
+{
+    if (delta_read_block(file->base_fd, file->block, file->block_size, file->copy) == -1)
+    {
+        return -1;
+    }
+    sha256_update(file->hash, file->block, file->block_size);
+    write_to_file(file->save_fd, file->block, file->block_size);
+    return 0;
+}
+
+static struct writer_file *conn_hold(struct conn *c, struct conn_file *file)
+{
+    if (c->held != NULL && c->held != file)
+    {
+        writer_file_flush(c->held->wfile);
+    }
+    c->held = file;
+    return file->wfile;
+}
+
+static void conn_idle(struct conn *c)
+{
+    if (c->held != NULL)
+    {
+        writer_file_flush(c->held->wfile);
+        c->held = NULL;
+    }
+}
+
+static int conn_save(struct conn *c, const struct conn_io *io, struct conn_file *file)
+{
+    char digest[SHA256_HEX_SIZE];
+    struct ack_chan *acks = c->features & PROTO_FEATURE_ACK ? c->acks : NULL;
+    struct ack_info ack;
+
+    if (file->striped)
+    {
+        int ret_val;
+
+        close(file->save_fd);
+        file->save_fd = -1;
+        ack.chan = acks;
+        ack.stream = file->stream;
+        ack.save_name = NULL;
+        if ((ret_val = stripe_end(file->stripe, file->stripe_offset, file->size, &ack, c->save_dir, io->dedup,
+                                  io->pool)) == -1)
+        {
+            c->error = "sent a stripe that overlaps one already received";
+        }
+        file->stripe = NULL;
+        return ret_val;
+    }
+    if (file->resumable || file->hashed || file->delta)
+    {
+        uint8_t raw[SHA256_DIGEST_SIZE];
+
+        sha256_digest(file->hash, raw);
+        if (memcmp(raw, file->digest, SHA256_DIGEST_SIZE) != 0)
+        {
+            if (c->held == file)
+            {
+                c->held = NULL;
+            }
+            conn_discard(c, file);
+            c->error = "sent a file that does not match its digest";
+            return -1;
+        }
+        sha256_hex(raw, digest);
+    } else if (file->hash != NULL)
+    {
+        sha256_final(file->hash, digest);
+    }
+    if (file->wfile != NULL)
+    {
+        if (c->held == file)
+        {
+            c->held = NULL;
+        }
+        writer_file_close(file->wfile, io->dedup ? digest : NULL, acks, file->stream);
+        file->wfile = NULL;
+        return 0;
+    }
+    if (file->direct != NULL)
+    {
+        direct_finish(file->direct);
+        file->direct = NULL;
+    }
+    if (file->partial)
+    {
+        if (finish_partial_file(c->dir_fd, &file->save_path, file->file_name) == -1)
+        {
+            conn_discard(c, file);
+            c->error = "resumed an upload whose partial file was removed";
+            return -1;
+        }
+        file->partial = 0;
+    }
+    finish_save_file(file->save_fd);
+    if (io->dedup)
+    {
+        dedup_file(c->dir_fd, &file->save_fd, file->save_path, digest);
+    }
+    ack.chan = acks;
+    ack.stream = file->stream;
+    ack.save_name = file->save_path;
+    durable_save(c->dir_fd, file->save_fd, c->save_dir, file->file_name, file->recv_len, &ack);
+    file->save_fd = -1;
+    return 0;
+}
+
+static void conn_discard(struct conn *c, struct conn_file *file)
+{
+    if (file->stripe != NULL)
+    {
+        // What the stripe wrote stays with its file, for the stripe to be sent again
+        close(file->save_fd);
+        file->save_fd = -1;
+        stripe_leave(file->stripe);
+        file->stripe = NULL;
+    }
+    if (file->direct != NULL)
+    {
+        direct_discard(file->direct);
+        file->direct = NULL;
+    }
+    if (file->save_fd != -1 && file->partial)
+    {
+        discard_partial_file(file->save_fd, file->save_path);
+    } else if (file->save_fd != -1)
+    {
+        discard_file(c->dir_fd, file->save_fd, file->save_path);
+    }
+    file->save_fd = -1;
+    file->partial = 0;
+    if (file->wfile != NULL)
+    {
+        writer_file_discard(file->wfile);
+        file->wfile = NULL;
+    }
+}
+
+static void reset_file(struct conn_file *file)
+{
+    free(file->file_name);
+    free(file->save_path);
+    file->file_name = NULL;
+    file->save_path = NULL;
+    file->open = 0;
+    file->stream = 0;
+    file->size = 0;
+    file->recv_len = 0;
+    file->resumable = 0;
+    file->hashed = 0;
+    file->partial = 0;
+    memset(file->transfer_id, 0, PROTO_TRANSFER_ID_SIZE); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    memset(file->digest, 0, PROTO_DIGEST_SIZE);           // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    if (file->base_fd != -1)
+    {
+        close(file->base_fd);
+        file->base_fd = -1;
+    }
+    free(file->block);
+    file->block = NULL;
+    file->delta = 0;
+    file->block_size = 0;
+    file->blocks = 0;
+    file->copy = 0;
+    file->striped = 0;
+    file->stripe_offset = 0;
+    file->stripe_size = 0;
+}
@@ -0,0 +1,91 @@
+#include "delta.h"
+#include "error.h"
+#include "proto.h"
+#include "sha256.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+uint32_t delta_block_size(uint64_t size)
+{
+    uint32_t block_size = DELTA_MIN_BLOCK;
+
+    while (block_size < DELTA_MAX_BLOCK && (uint64_t) block_size * block_size < size)
+    {
+        block_size <<= 1;
+    }
+    return block_size;
+}
+
+uint32_t delta_weak(const uint8_t *data, size_t len)
+{
+    uint32_t a = 0;
+    uint32_t b = 0;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        a += data[i];
+        b += (uint32_t) (len - i) * data[i];
+    }
+    return (a & 0xffffU) | (b << 16); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Two 16-bit sums
+}
+
+int delta_sigs(int base_fd, uint64_t blocks, uint32_t block_size, uint8_t **sigs)
+{
+    char *block;
+    uint8_t *sig;
+
+    if ((*sigs = (uint8_t *) malloc(blocks * PROTO_SIG_SIZE + 1)) == NULL
+        || (block = (char *) malloc(block_size)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    sig = *sigs;
+    for (uint64_t i = 0; i < blocks; ++i, sig += PROTO_SIG_SIZE)
+    {
+        struct sha256_ctx hash;
+        uint8_t digest[SHA256_DIGEST_SIZE];
+        uint32_t weak;
+
+        if (delta_read_block(base_fd, block, block_size, i) == -1)
+        {
+            free(block);
+            free(*sigs);
+            *sigs = NULL;
+            return -1;
+        }
+        weak = htonl(delta_weak((const uint8_t *) block, block_size));
+        sha256_init(&hash);
+        sha256_update(&hash, block, block_size);
+        sha256_digest(&hash, digest);
+        memcpy(sig, &weak, sizeof(uint32_t));
+        memcpy(sig + sizeof(uint32_t), digest, PROTO_SIG_SIZE - sizeof(uint32_t));
+    }
+    free(block);
+    return 0;
+}
+
+int delta_read_block(int base_fd, char *block, uint32_t block_size, uint64_t index)
+{
+    for (size_t got = 0; got < block_size;)
+    {
+        ssize_t ret_val;
+
+        if ((ret_val = pread(base_fd, block + got, block_size - got, (off_t) (index * block_size + got))) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ret_val == 0)
+        {
+            return -1;
+        }
+        got += (size_t) ret_val;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#define _GNU_SOURCE
+#include "direct.h"
+#include "error.h"
+#include "save.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct direct_file
+{
+    int fd;
+    int direct;
+    char *buf;
+    size_t fill;
+};
+
+/**
+ * The free buffers, each holding a pointer to the next in its first bytes.
+ */
+static char *free_bufs;                                         // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * take_buf
+ * <p>
+ * Take a buffer from the pool, allocating one if the pool is empty.
+ * </p>
+ * @return the buffer, DIRECT_BUF_SIZE bytes aligned to DIRECT_ALIGN
+ */
+static char *take_buf(void);
+
+/**
+ * give_buf
+ * <p>
+ * Return a buffer to the pool.
+ * </p>
+ * @param buf - char *: the buffer
+ */
+static void give_buf(char *buf);
+
+/**
+ * write_blocks
+ * <p>
+ * Write len bytes of data, bypassing the page cache while the file still allows it.
+ * </p>
+ * @param df - direct_file *: the file
+ * @param data - char *: the data, aligned to DIRECT_ALIGN while direct I/O is in use
+ * @param len - size_t: the number of bytes of data, a multiple of DIRECT_ALIGN while direct I/O is in use
+ */
+static void write_blocks(struct direct_file *df, const char *data, size_t len);
+
+/**
+ * drop_direct
+ * <p>
+ * Switch the file back to writing through the page cache.
+ * </p>
+ * @param df - direct_file *: the file
+ */
+static void drop_direct(struct direct_file *df);
+
+struct direct_file *direct_open(int save_fd, uint64_t size)
+{
+    struct direct_file *df;
+    int flags;
+
+    if (size < DIRECT_MIN_SIZE)
+    {
+        return NULL;
+    }
+    // Filesystems without direct I/O refuse the flag here
+    if ((flags = fcntl(save_fd, F_GETFL)) == -1 || fcntl(save_fd, F_SETFL, flags | O_DIRECT) == -1)
+    {
+        return NULL;
+    }
+
+    if ((df = (struct direct_file *) malloc(sizeof(struct direct_file))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    df->fd = save_fd;
+    df->direct = 1;
+    df->buf = take_buf();
+    df->fill = 0;
+    return df;
+}
+
+void direct_write(struct direct_file *df, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n;
+
+        n = len < DIRECT_BUF_SIZE - df->fill ? len : DIRECT_BUF_SIZE - df->fill;
+        memcpy(df->buf + df->fill, data, n);
+        df->fill += n;
+        data += n;
+        len -= n;
+
+        if (df->fill == DIRECT_BUF_SIZE)
+        {
+            write_blocks(df, df->buf, DIRECT_BUF_SIZE);
+            df->fill = 0;
+        }
+    }
+}
+
+void direct_finish(struct direct_file *df)
+{
+    size_t blocks;
+
+    blocks = df->fill & ~((size_t) DIRECT_ALIGN - 1);
+    write_blocks(df, df->buf, blocks);
+    if (df->fill > blocks)
+    {
+        drop_direct(df);
+        write_to_file(df->fd, df->buf + blocks, df->fill - blocks);
+    }
+    direct_discard(df);
+}
+
+void direct_discard(struct direct_file *df)
+{
+    give_buf(df->buf);
+    free(df);
+}
+
+void direct_pool_free(void)
+{
+    while (free_bufs != NULL)
+    {
+        char *next;
+
+        memcpy(&next, free_bufs, sizeof(char *));
+
+        free(free_bufs);
+        free_bufs = next;
+    }
+}
+
+static char *take_buf(void)
+{
+    char *buf;
+    int err;
+
+    if ((err = pthread_mutex_lock(&pool_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    if ((buf = free_bufs) != NULL)
+    {
+        memcpy(&free_bufs, buf, sizeof(char *));
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (buf == NULL && (buf = (char *) aligned_alloc(DIRECT_ALIGN, DIRECT_BUF_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    return buf;
+}
+
+static void give_buf(char *buf)
+{
+    int err;
+
+    if ((err = pthread_mutex_lock(&pool_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    // The link is copied in, as the buffer is only known to be a char array
+    memcpy(buf, &free_bufs, sizeof(char *));
+    free_bufs = buf;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void write_blocks(struct direct_file *df, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t ret_val;
+
+        if ((ret_val = write(df->fd, data, len)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // Some filesystems accept O_DIRECT but reject the writes; a short write also leaves the rest unaligned
+            if (errno == EINVAL && df->direct)
+            {
+                drop_direct(df);
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        data += ret_val;
+        len -= (size_t) ret_val;
+    }
+}
+
+static void drop_direct(struct direct_file *df)
+{
+    int flags;
+
+    if (!df->direct)
+    {
+        return;
+    }
+    if ((flags = fcntl(df->fd, F_GETFL)) == -1 || fcntl(df->fd, F_SETFL, flags & ~O_DIRECT) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    df->direct = 0;
+}
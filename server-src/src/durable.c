@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include "durable.h"
+#include "error.h"
+#include "mpsc.h"
+#include "save.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The most distinct directories whose filesystems one group tracks; past this, a group's
+ * directories are synced without checking for a shared filesystem.
+ */
+#define DURABLE_MAX_DEVS 16
+
+/**
+ * Nanoseconds per millisecond.
+ */
+#define NS_PER_MS 1000000L
+
+/**
+ * Nanoseconds per second.
+ */
+#define NS_PER_S 1000000000L
+
+/**
+ * saved_file
+ * <p>
+ * Struct storing a written file waiting for its group to be synced before it is reported.
+ * <ul>
+ * <li>struct mpsc_node node: link in the group commit queue</li>
+ * <li>int dir_fd: file descriptor for the directory holding the file</li>
+ * <li>char *save_dir: the directory's path</li>
+ * <li>char *file_name: the name the client sent</li>
+ * <li>uint64_t len: the size of the file</li>
+ * <li>char *save_name: the file's own copy of the name it was stored under, or NULL if the client takes no acks</li>
+ * <li>struct ack_info ack: what to acknowledge to the client, holding its channel and naming save_name</li>
+ * <li>struct saved_file *next: the next file in the same group</li>
+ * </ul>
+ * </p>
+ */
+struct saved_file
+{
+    struct mpsc_node node;
+    int dir_fd;
+    char *save_dir;
+    char *file_name;
+    uint64_t len;
+    char *save_name;
+    struct ack_info ack;
+    struct saved_file *next;
+};
+
+/**
+ * group_commit
+ * <p>
+ * Struct storing the durability mode and, under DURABILITY_GROUP, the thread committing groups.
+ * <ul>
+ * <li>enum durability mode: the durability mode</li>
+ * <li>long window_ns: the longest a group waits for more files</li>
+ * <li>uint64_t max_bytes: the number of file bytes that ends a group early</li>
+ * <li>struct mpsc_queue queue: written files waiting to join a group</li>
+ * <li>struct saved_file stop: the entry telling the thread to stop</li>
+ * <li>pthread_t thread: the thread</li>
+ * </ul>
+ * </p>
+ */
+struct group_commit
+{
+    enum durability mode;
+    long window_ns;
+    uint64_t max_bytes;
+    struct mpsc_queue queue;
+    struct saved_file stop;
+    pthread_t thread;
+};
+
+static struct group_commit gc;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * committer_main
+ * <p>
+ * Thread entry point: gather written files into groups, sync each group, then report its files.
+ * </p>
+ * @param arg - void *: unused
+ * @return NULL
+ */
+static void *committer_main(void *arg);
+
+/**
+ * sync_group
+ * <p>
+ * Make every file of a group durable: one syncfs for each filesystem the group's directories are on.
+ * </p>
+ * @param group - saved_file *: the first file of the group
+ */
+static void sync_group(const struct saved_file *group);
+
+/**
+ * report_saved
+ * <p>
+ * Report a file as saved, and acknowledge it if the client asked.
+ * </p>
+ * @param save_dir - char *: the directory's path
+ * @param file_name - char *: the name the client sent
+ * @param len - uint64_t: the size of the file
+ * @param ack - ack_info *: what to acknowledge to the client
+ */
+static void report_saved(const char *save_dir, const char *file_name, uint64_t len, const struct ack_info *ack);
+
+void durable_start(enum durability mode, unsigned int group_ms, uint64_t group_bytes)
+{
+    sigset_t mask;
+    sigset_t old_mask;
+    int err;
+
+    gc.mode = mode;
+    if (mode != DURABILITY_GROUP)
+    {
+        return;
+    }
+
+    gc.window_ns = (long) group_ms * NS_PER_MS;
+    gc.max_bytes = group_bytes;
+    gc.stop.dir_fd = -1;
+    mpsc_init(&gc.queue);
+
+    // The committer never handles SIGINT; it must keep interrupting the network threads
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    if ((err = pthread_sigmask(SIG_BLOCK, &mask, &old_mask)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 2);
+    }
+    if ((err = pthread_create(&gc.thread, NULL, committer_main, NULL)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    if ((err = pthread_sigmask(SIG_SETMASK, &old_mask, NULL)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 2);
+    }
+}
+
+void durable_stop(void)
+{
+    if (gc.mode != DURABILITY_GROUP)
+    {
+        return;
+    }
+    mpsc_push(&gc.queue, &gc.stop.node);
+    pthread_join(gc.thread, NULL);
+    mpsc_destroy(&gc.queue);
+}
+
+void durable_save(int dir_fd, int save_fd, const char *save_dir, const char *file_name, uint64_t len,
+                  const struct ack_info *ack)
+{
+    struct saved_file *f;
+
+    switch (gc.mode)
+    {
+        case DURABILITY_NONE:
+        {
+            break;
+        }
+        case DURABILITY_FILE:
+        {
+            // The directories hold the new file's name, so they are synced as well as the data
+            if (save_fd != -1 && (fdatasync(save_fd) == -1 || sync_save_dirs(dir_fd, file_name) == -1))
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+            }
+            break;
+        }
+        case DURABILITY_GROUP:
+        {
+            if (save_fd != -1)
+            {
+                close(save_fd);
+            }
+            if ((f = (struct saved_file *) malloc(sizeof(struct saved_file))) == NULL
+                || (f->save_dir = strdup(save_dir)) == NULL
+                || (f->file_name = strdup(file_name)) == NULL)
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+            }
+            f->dir_fd = dir_fd;
+            f->len = len;
+            f->ack.chan = ack_hold(ack->chan);
+            f->ack.stream = ack->stream;
+            f->save_name = NULL;
+            if (ack->chan != NULL && (f->save_name = strdup(ack->save_name)) == NULL)
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+            }
+            f->ack.save_name = f->save_name;
+            mpsc_push(&gc.queue, &f->node);
+            return;
+        }
+        default:
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                          69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+        }
+    }
+
+    if (save_fd != -1)
+    {
+        close(save_fd);
+    }
+    report_saved(save_dir, file_name, len, ack);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static void *committer_main(void *arg)
+{
+    int stopping = 0;
+
+    while (!stopping)
+    {
+        struct saved_file *group;
+        struct saved_file **tail;
+        struct timespec deadline;
+        uint64_t bytes;
+
+        // A group opens with the first file to arrive and closes when its window or budget runs out
+        group = (struct saved_file *) mpsc_pop(&gc.queue);
+        if (group == &gc.stop)
+        {
+            break;
+        }
+        group->next = NULL;
+        tail = &group->next;
+        bytes = group->len;
+
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_nsec += gc.window_ns;
+        deadline.tv_sec += deadline.tv_nsec / NS_PER_S;
+        deadline.tv_nsec %= NS_PER_S;
+
+        while (bytes < gc.max_bytes)
+        {
+            struct saved_file *f;
+
+            if ((f = (struct saved_file *) mpsc_pop_until(&gc.queue, &deadline)) == NULL)
+            {
+                break;
+            }
+            if (f == &gc.stop)
+            {
+                stopping = 1;
+                break;
+            }
+            f->next = NULL;
+            *tail = f;
+            tail = &f->next;
+            bytes += f->len;
+        }
+
+        sync_group(group);
+        while (group != NULL)
+        {
+            struct saved_file *next = group->next;
+
+            report_saved(group->save_dir, group->file_name, group->len, &group->ack);
+            ack_release(group->ack.chan);
+            free(group->save_name);
+            free(group->save_dir);
+            free(group->file_name);
+            free(group);
+            group = next;
+        }
+    }
+    return NULL;
+}
+
+#pragma GCC diagnostic pop
+
+static void sync_group(const struct saved_file *group)
+{
+    dev_t devs[DURABLE_MAX_DEVS];
+    size_t n_devs = 0;
+
+    for (const struct saved_file *f = group; f != NULL; f = f->next)
+    {
+        struct stat st;
+        size_t i;
+
+        if (fstat(f->dir_fd, &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        for (i = 0; i < n_devs && devs[i] != st.st_dev; ++i)
+        {
+        }
+        if (i < n_devs)
+        {
+            continue;
+        }
+
+        if (syncfs(f->dir_fd) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (n_devs < DURABLE_MAX_DEVS)
+        {
+            devs[n_devs++] = st.st_dev;
+        }
+    }
+}
+
+static void report_saved(const char *save_dir, const char *file_name, uint64_t len, const struct ack_info *ack)
+{
+    printf("Received: %s\nSaved to: %s\n\n", file_name, save_dir);
+    if (ack->chan != NULL)
+    {
+        ack_send(ack, len);
+    }
+}
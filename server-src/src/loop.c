@@ -0,0 +1,414 @@
+#define _GNU_SOURCE
+#include "loop.h"
+#include "conn.h"
+#include "error.h"
+#include "uring.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of events handled per call to epoll_wait.
+ */
+#define MAX_EVENTS 256
+
+/**
+ * How long, in milliseconds, a worker waits for events before checking whether the server is stopping.
+ * Only the main thread receives SIGINT, so the other workers rely on this timeout to notice.
+ */
+#define LOOP_TIMEOUT_MS 250
+
+/**
+ * conn_table
+ * <p>
+ * Struct storing the connections served by an event loop, indexed by socket file descriptor.
+ * <ul>
+ * <li>struct conn **conns: the connections; NULL where no client is connected</li>
+ * <li>size_t size: the number of slots in conns</li>
+ * </ul>
+ * </p>
+ */
+struct conn_table
+{
+    struct conn **conns;
+    size_t size;
+};
+
+/**
+ * loop_args
+ * <p>
+ * Struct storing what one worker thread needs to run its event loop.
+ * <ul>
+ * <li>const struct server_settings *set: pointer to the settings for this server</li>
+ * <li>struct worker *w: the worker's sockets</li>
+ * <li>unsigned int id: the worker's index, used to pick the CPU it runs on</li>
+ * <li>const volatile sig_atomic_t *running: the flag cleared by the signal handler</li>
+ * <li>pthread_t thread: the worker's thread</li>
+ * </ul>
+ * </p>
+ */
+struct loop_args
+{
+    const struct server_settings *set;
+    struct worker *w;
+    unsigned int id;
+    const volatile sig_atomic_t *running;
+    pthread_t thread;
+};
+
+/**
+ * worker_main
+ * <p>
+ * Thread entry point: pin the worker to a CPU, then run its epoll or io_uring event loop.
+ * </p>
+ * @param arg - void *: the worker's loop_args
+ * @return NULL
+ */
+static void *worker_main(void *arg);
+
+/**
+ * serve_worker
+ * <p>
+ * While the running flag is set, accept and serve clients on one worker's listening socket. The
+ * event loop and connection table are private to the worker.
+ * </p>
+ * @param args - loop_args *: the worker's loop_args
+ */
+static void serve_worker(const struct loop_args *args);
+
+/**
+ * pin_worker
+ * <p>
+ * Bind the calling thread to one CPU so each worker's connections stay on one core. Failure is not
+ * fatal; the worker then runs wherever the scheduler puts it.
+ * </p>
+ * @param id - unsigned int: the worker's index
+ */
+static void pin_worker(unsigned int id);
+
+/**
+ * set_nonblocking
+ * <p>
+ * Set O_NONBLOCK on a file descriptor.
+ * </p>
+ * @param fd - int: the file descriptor
+ */
+static void set_nonblocking(int fd);
+
+/**
+ * accept_clients
+ * <p>
+ * Accept every pending connection on the listening socket and register each with the event loop.
+ * </p>
+ * @param set - server_settings *: pointer to the settings for this server
+ * @param w - worker *: the worker whose listening socket has connections pending
+ * @param fd_epoll - int: the event loop's epoll file descriptor
+ * @param table - conn_table *: the event loop's connections
+ * @return 0 once no connection is pending, -1 if the process is out of file descriptors
+ */
+static int accept_clients(const struct server_settings *set, const struct worker *w, int fd_epoll,
+                          struct conn_table *table);
+
+/**
+ * watch_listener
+ * <p>
+ * Add the listening socket to the event loop, or take it out while connections cannot be accepted.
+ * </p>
+ * @param fd_epoll - int: the event loop's epoll file descriptor
+ * @param fd_listen_sock - int: the listening socket
+ * @param op - int: EPOLL_CTL_ADD or EPOLL_CTL_DEL
+ */
+static void watch_listener(int fd_epoll, int fd_listen_sock, int op);
+
+/**
+ * table_put
+ * <p>
+ * Store a connection in the table, growing the table if necessary.
+ * </p>
+ * @param table - conn_table *: the event loop's connections
+ * @param c - conn *: the connection
+ */
+static void table_put(struct conn_table *table, struct conn *c);
+
+/**
+ * drop_client
+ * <p>
+ * Remove a connection from the event loop and close it.
+ * </p>
+ * @param fd_epoll - int: the event loop's epoll file descriptor
+ * @param table - conn_table *: the event loop's connections
+ * @param fd - int: file descriptor for socket of the client
+ */
+static void drop_client(int fd_epoll, struct conn_table *table, int fd);
+
+void run_event_loop(struct server_settings *set, const volatile sig_atomic_t *running)
+{
+    struct loop_args *args;
+    sigset_t mask;
+    sigset_t old_mask;
+    int err;
+
+    if ((args = (struct loop_args *) calloc(set->n_workers, sizeof(struct loop_args))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (unsigned int i = 0; i < set->n_workers; ++i)
+    {
+        args[i].set = set;
+        args[i].w = &set->workers[i];
+        args[i].id = i;
+        args[i].running = running;
+    }
+
+    // Spawned workers inherit a mask blocking SIGINT, so the signal always interrupts the main thread
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    if ((err = pthread_sigmask(SIG_BLOCK, &mask, &old_mask)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 2);
+    }
+    for (unsigned int i = 1; i < set->n_workers; ++i)
+    {
+        if ((err = pthread_create(&args[i].thread, NULL, worker_main, &args[i])) != 0)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+        }
+    }
+    if ((err = pthread_sigmask(SIG_SETMASK, &old_mask, NULL)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 2);
+    }
+
+    worker_main(&args[0]);
+
+    for (unsigned int i = 1; i < set->n_workers; ++i)
+    {
+        pthread_join(args[i].thread, NULL);
+    }
+    free(args);
+
+    printf("\n\nClosed server on: %s:%d\n\n", set->ip, set->port);
+}
+
+static void *worker_main(void *arg)
+{
+    const struct loop_args *args = (const struct loop_args *) arg;
+
+    if (args->set->n_workers > 1)
+    {
+        pin_worker(args->id);
+    }
+#ifdef HAVE_IO_URING
+    if (args->set->io_mode == IO_MODE_URING)
+    {
+        serve_worker_uring(args->set, args->w, args->running);
+        return NULL;
+    }
+#endif
+    serve_worker(args);
+
+    return NULL;
+}
+
+static void serve_worker(const struct loop_args *args)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct conn_table table;
+    const struct worker *w = args->w;
+    struct conn_io io;
+    time_t deferred_at = 0;
+    int accepting = 1;
+    int fd_epoll;
+
+    table.conns = NULL;
+    table.size = 0;
+
+    // Every connection of this worker streams file data through the same buffer or pipe
+    conn_io_open(&io, args->set);
+
+    set_nonblocking(w->fd_listen_sock);
+
+    if ((fd_epoll = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    watch_listener(fd_epoll, w->fd_listen_sock, EPOLL_CTL_ADD);
+
+    while (*args->running)
+    {
+        int n_events;
+
+        // Descriptors freed by other workers are only noticed by trying again, at most once a second
+        if (!accepting && time(NULL) != deferred_at)
+        {
+            watch_listener(fd_epoll, w->fd_listen_sock, EPOLL_CTL_ADD);
+            accepting = 1;
+        }
+
+        if ((n_events = epoll_wait(fd_epoll, events, MAX_EVENTS, LOOP_TIMEOUT_MS)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+
+        for (int i = 0; i < n_events; ++i)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == w->fd_listen_sock)
+            {
+                // Out of descriptors, the listener would wake the loop at once; clients wait in the backlog
+                if (accept_clients(args->set, w, fd_epoll, &table) == -1)
+                {
+                    watch_listener(fd_epoll, w->fd_listen_sock, EPOLL_CTL_DEL);
+                    deferred_at = time(NULL);
+                    accepting = 0;
+                }
+            } else if (conn_recv(table.conns[fd], &io) == 0)
+            {
+                drop_client(fd_epoll, &table, fd);
+                if (!accepting)
+                {
+                    watch_listener(fd_epoll, w->fd_listen_sock, EPOLL_CTL_ADD);
+                    accepting = 1;
+                }
+            }
+        }
+    }
+
+    for (size_t fd = 0; fd < table.size; ++fd)
+    {
+        if (table.conns[fd] != NULL)
+        {
+            drop_client(fd_epoll, &table, (int) fd);
+        }
+    }
+    free(table.conns);
+    conn_io_close(&io);
+    close(fd_epoll);
+}
+
+static void pin_worker(unsigned int id)
+{
+    cpu_set_t cpus;
+    long n_cpus;
+
+    if ((n_cpus = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    {
+        return;
+    }
+    CPU_ZERO(&cpus);
+    CPU_SET(id % (unsigned long) n_cpus, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+}
+
+static void set_nonblocking(int fd)
+{
+    int flags;
+
+    if ((flags = fcntl(fd, F_GETFL)) == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+static int accept_clients(const struct server_settings *set, const struct worker *w, int fd_epoll,
+                          struct conn_table *table)
+{
+    for (;;)
+    {
+        struct sockaddr_in client_addr;
+        struct epoll_event ev;
+        struct conn *c;
+        socklen_t sockaddr_in_size;
+        int fd_client;
+
+        sockaddr_in_size = sizeof(struct sockaddr_in);
+        if ((fd_client = accept(w->fd_listen_sock, (struct sockaddr *) &client_addr, &sockaddr_in_size)) == -1)  // NOLINT(android-cloexec-accept) : SOCK_CLOEXEC dne
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                return -1;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+
+        set_nonblocking(fd_client);
+        if ((c = conn_open(fd_client, &client_addr, set->wr_dir)) == NULL)
+        {
+            continue;
+        }
+        table_put(table, c);
+
+        ev.events = EPOLLIN;
+        ev.data.fd = fd_client;
+        if (epoll_ctl(fd_epoll, EPOLL_CTL_ADD, fd_client, &ev) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+    }
+}
+
+static void watch_listener(int fd_epoll, int fd_listen_sock, int op)
+{
+    struct epoll_event ev;
+
+    ev.events = EPOLLIN;
+    ev.data.fd = fd_listen_sock;
+    if (epoll_ctl(fd_epoll, op, fd_listen_sock, &ev) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+static void table_put(struct conn_table *table, struct conn *c)
+{
+    size_t fd = (size_t) c->fd;
+
+    if (fd >= table->size)
+    {
+        struct conn **conns;
+        size_t size = table->size ? table->size : MAX_EVENTS;
+
+        while (size <= fd)
+        {
+            size *= 2;
+        }
+        if ((conns = (struct conn **) realloc(table->conns, size * sizeof(struct conn *))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        for (size_t i = table->size; i < size; ++i)
+        {
+            conns[i] = NULL;
+        }
+        table->conns = conns;
+        table->size = size;
+    }
+    table->conns[fd] = c;
+}
+
+static void drop_client(int fd_epoll, struct conn_table *table, int fd)
+{
+    epoll_ctl(fd_epoll, EPOLL_CTL_DEL, fd, NULL);
+    conn_close(table->conns[fd]);
+    table->conns[fd] = NULL;
+}
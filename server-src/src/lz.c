@@ -0,0 +1,109 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The shortest match the format can express.
+ */
+#define LZ_MIN_MATCH 4
+
+/**
+ * The largest length held in a token's nibble; longer lengths continue in the bytes that follow.
+ */
+#define LZ_NIBBLE_MAX 15
+
+/**
+ * The most literals copied with one fixed-size copy when both buffers have room for it.
+ */
+#define LZ_SHORT_COPY 16
+
+/**
+ * get_length
+ * <p>
+ * Read the part of a length that did not fit in its token's nibble.
+ * </p>
+ * @param src - char **: pointer to where to read, moved past the bytes read
+ * @param end - char *: the end of the block
+ * @param len - size_t *: pointer to the length, added to
+ * @return 0 on success, -1 if the block ends first
+ */
+static int get_length(const char **src, const char *end, size_t *len);
+
+ssize_t lz_decompress(const char *src, size_t len, char *dst, size_t cap)
+{
+    const char *end = src + len;
+    size_t out = 0;
+
+    while (src < end)
+    {
+        uint8_t token = (uint8_t) *src++;
+        size_t lit_len = token >> 4;                    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : High nibble
+        size_t match_len = (token & LZ_NIBBLE_MAX) + LZ_MIN_MATCH;
+        size_t offset;
+
+        if ((lit_len == LZ_NIBBLE_MAX && get_length(&src, end, &lit_len) == -1)
+            || lit_len > (size_t) (end - src) || lit_len > cap - out)
+        {
+            return -1;
+        }
+        // Most runs are short; a fixed-size copy is cheaper than one of exactly their length
+        if (lit_len <= LZ_SHORT_COPY && end - src >= LZ_SHORT_COPY && cap - out >= LZ_SHORT_COPY)
+        {
+            memcpy(dst + out, src, LZ_SHORT_COPY);
+        } else
+        {
+            memcpy(dst + out, src, lit_len);
+        }
+        src += lit_len;
+        out += lit_len;
+        if (src == end)
+        {
+            // The last sequence has literals only
+            break;
+        }
+
+        if (end - src < 2)
+        {
+            return -1;
+        }
+        offset = (uint8_t) src[0] | (size_t) (uint8_t) src[1] << 8; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Little-endian offset
+        src += 2;
+        if ((match_len == LZ_NIBBLE_MAX + LZ_MIN_MATCH && get_length(&src, end, &match_len) == -1)
+            || offset == 0 || offset > out || match_len > cap - out)
+        {
+            return -1;
+        }
+        if (offset >= sizeof(uint64_t) && cap - out >= match_len + sizeof(uint64_t))
+        {
+            // Copying a word at a time past the match's end is fine, since those bytes are written again
+            for (size_t i = 0; i < match_len; i += sizeof(uint64_t))
+            {
+                memcpy(dst + out + i, dst + out + i - offset, sizeof(uint64_t));
+            }
+            out += match_len;
+            continue;
+        }
+        // A match overlapping the bytes it produces repeats a short run
+        for (size_t i = 0; i < match_len; ++i, ++out)
+        {
+            dst[out] = dst[out - offset];
+        }
+    }
+    return (ssize_t) out;
+}
+
+static int get_length(const char **src, const char *end, size_t *len)
+{
+    uint8_t byte;
+
+    do
+    {
+        if (*src == end)
+        {
+            return -1;
+        }
+        byte = (uint8_t) *(*src)++;
+        *len += byte;
+    } while (byte == UINT8_MAX);
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "mpsc.h"
+#include "error.h"
+#include <sched.h>
+
+/**
+ * link_node
+ * <p>
+ * Link a node onto the head of the list without counting it as an item.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ * @param node - mpsc_node *: the node
+ */
+static void link_node(struct mpsc_queue *q, struct mpsc_node *node);
+
+/**
+ * try_pop
+ * <p>
+ * Unlink the node at the front of the list.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ * @return the node, or NULL if a producer has claimed the head but not yet linked its node
+ */
+static struct mpsc_node *try_pop(struct mpsc_queue *q);
+
+/**
+ * take_item
+ * <p>
+ * Wait for a node to be counted as pushed and take it from the count.
+ * </p>
+ * @param q - mpsc_queue *: the queue
+ * @param deadline - timespec *: the latest time to wait until, by CLOCK_MONOTONIC, or NULL to wait for as long as it takes
+ * @return 0 on success, -1 if the deadline passed with the queue empty
+ */
+static int take_item(struct mpsc_queue *q, const struct timespec *deadline);
+
+void mpsc_init(struct mpsc_queue *q)
+{
+    pthread_condattr_t attr;
+    int err;
+
+    atomic_init(&q->stub.next, NULL);
+    atomic_init(&q->head, &q->stub);
+    q->tail = &q->stub;
+    q->items = 0;
+    if ((err = pthread_mutex_init(&q->lock, NULL)) != 0
+        || (err = pthread_condattr_init(&attr)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    if ((err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC)) != 0
+        || (err = pthread_cond_init(&q->ready, &attr)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    pthread_condattr_destroy(&attr);
+}
+
+void mpsc_destroy(struct mpsc_queue *q)
+{
+    pthread_cond_destroy(&q->ready);
+    pthread_mutex_destroy(&q->lock);
+}
+
+void mpsc_push(struct mpsc_queue *q, struct mpsc_node *node)
+{
+    int err;
+
+    link_node(q, node);
+    if ((err = pthread_mutex_lock(&q->lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    ++q->items;
+    pthread_cond_signal(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+struct mpsc_node *mpsc_pop(struct mpsc_queue *q)
+{
+    struct mpsc_node *node;
+
+    take_item(q, NULL);
+
+    // The count guarantees a node is coming; it may only be a moment from being linked
+    while ((node = try_pop(q)) == NULL)
+    {
+        sched_yield();
+    }
+    return node;
+}
+
+struct mpsc_node *mpsc_pop_until(struct mpsc_queue *q, const struct timespec *deadline)
+{
+    struct mpsc_node *node;
+
+    if (take_item(q, deadline) == -1)
+    {
+        return NULL;
+    }
+
+    while ((node = try_pop(q)) == NULL)
+    {
+        sched_yield();
+    }
+    return node;
+}
+
+static void link_node(struct mpsc_queue *q, struct mpsc_node *node)
+{
+    struct mpsc_node *prev;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+static struct mpsc_node *try_pop(struct mpsc_queue *q)
+{
+    struct mpsc_node *tail = q->tail;
+    struct mpsc_node *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &q->stub)
+    {
+        if (next == NULL)
+        {
+            return NULL;
+        }
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (next != NULL)
+    {
+        q->tail = next;
+        return tail;
+    }
+
+    if (tail != atomic_load_explicit(&q->head, memory_order_acquire))
+    {
+        return NULL;
+    }
+
+    // tail is the last node: put the stub behind it so tail can be unlinked
+    link_node(q, &q->stub);
+    if ((next = atomic_load_explicit(&tail->next, memory_order_acquire)) != NULL)
+    {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static int take_item(struct mpsc_queue *q, const struct timespec *deadline)
+{
+    int err;
+
+    if ((err = pthread_mutex_lock(&q->lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    while (q->items == 0)
+    {
+        err = deadline == NULL ? pthread_cond_wait(&q->ready, &q->lock)
+                               : pthread_cond_timedwait(&q->ready, &q->lock, deadline);
+        if (err == ETIMEDOUT && q->items == 0)
+        {
+            pthread_mutex_unlock(&q->lock);
+            return -1;
+        }
+        if (err != 0 && err != ETIMEDOUT)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+        }
+    }
+    --q->items;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
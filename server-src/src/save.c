@@ -2,38 +2,169 @@
 // Created by Maxwell Babey on 10/11/22.
 //
 
+#define _GNU_SOURCE
 #include "error.h"
+#include "proto.h"
 #include "save.h"
+#include "segment.h"
+#include "sha256.h"
 #include "util.h"
+#include "version.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/fcntl.h>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-#define VERSION_START_INDEX 2
+/**
+ * The number of hash buckets holding cached client directories.
+ */
+#define SAVE_DIR_BUCKETS 256
+
+/**
+ * The size of a blob's name: two hex digits of directory, a slash, then the rest of the digest.
+ */
+#define SAVE_BLOB_NAME_SIZE (SHA256_HEX_SIZE + 1)
+
+/**
+ * The size of the buffer holding a temporary name in SAVE_BLOB_DIR.
+ */
+#define SAVE_BLOB_TMP_SIZE 48
+
+/**
+ * The size of the buffer holding a partial file's name: the client's address, a dash, then the
+ * transfer ID in hexadecimal.
+ */
+#define SAVE_PARTIAL_NAME_SIZE 64
+
+/**
+ * The suffix naming the file beside a partial file that keeps the hash of what it holds.
+ */
+#define SAVE_PARTIAL_HASH_SUFFIX ".sha"
 
-#define WR_DIR_FLAGS (S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+/**
+ * The number of seconds between looks for partial files older than SAVE_PARTIAL_MAX_AGE.
+ */
+#define SAVE_PARTIAL_SWEEP_SECS (60 * 60)
+
+/**
+ * save_dir_entry
+ * <p>
+ * Struct storing one cached client directory.
+ * <ul>
+ * <li>char *addr_str: the client's IP address, which is the directory's name</li>
+ * <li>int fd: file descriptor for the open directory</li>
+ * <li>struct save_dir_entry *next: the next directory in the same bucket</li>
+ * </ul>
+ * </p>
+ */
+struct save_dir_entry
+{
+    char *addr_str;
+    int fd;
+    struct save_dir_entry *next;
+};
+
+static struct save_dir_entry *save_dirs[SAVE_DIR_BUCKETS];          // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int wr_dir_fd = -1;                                          // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static enum save_store save_store = SAVE_STORE_FILES;               // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int blob_dir_fd = -1;                                        // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static int partial_dir_fd = -1;                                     // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static atomic_ulong blob_tmp_seq;                                   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static atomic_long partial_swept_at;                                // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_mutex_t save_dir_lock = PTHREAD_MUTEX_INITIALIZER;   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * open_wr_dir
+ * <p>
+ * Create and open the write directory, the first time it is needed.
+ * </p>
+ * @param wr_dir - char *: the base write directory stored in server_settings
+ */
+static void open_wr_dir(const char *wr_dir);
+
+/**
+ * open_partial_dir
+ * <p>
+ * Create and open SAVE_PARTIAL_DIR, the first time it is needed.
+ * </p>
+ */
+static void open_partial_dir(void);
+
+/**
+ * load_partial_hash
+ * <p>
+ * Read the hash kept beside a partial file by keep_partial_file.
+ * </p>
+ * @param partial_name - char *: the name of the file in SAVE_PARTIAL_DIR
+ * @param hash - sha256_ctx *: the hash to fill
+ * @return 0 on success, -1 if no whole hash is kept
+ */
+static int load_partial_hash(const char *partial_name, struct sha256_ctx *hash);
 
 /**
- * version_file
+ * sweep_partial_files
  * <p>
- * Add a version number to a file name, if necessary.
+ * Remove the partial files not written for SAVE_PARTIAL_MAX_AGE seconds, with their kept hashes,
+ * at most once every SAVE_PARTIAL_SWEEP_SECS. A file a connection is receiving into is left alone.
  * </p>
- * @param save_str - char **: file name to which a version number will be added.
  */
-void version_file(char **save_str);
+static void sweep_partial_files(void);
 
 /**
- * create_file_ver_suffix
+ * remove_partial_hash
  * <p>
- * Create a string in the format "-v2".
+ * Remove the hash kept beside a partial file, if any.
  * </p>
- * @param file_ver_suffix - char **: pointer to string to hold the suffix
- * @param v_num - int: the version number to put in the suffix
+ * @param partial_name - char *: the name of the file in SAVE_PARTIAL_DIR
  */
-void create_file_ver_suffix(char **file_ver_suffix, int v_num);
+static void remove_partial_hash(const char *partial_name);
+
+void save_store_open(enum save_store store, const char *wr_dir, int sync, int dedup) // NOLINT(bugprone-easily-swappable-parameters)
+{
+    save_store = store;
+    if (store == SAVE_STORE_SEGMENTS)
+    {
+        open_wr_dir(wr_dir);
+        segment_store_open(wr_dir_fd, sync);
+    }
+    if (dedup)
+    {
+        open_wr_dir(wr_dir);
+        if (mkdirat(wr_dir_fd, SAVE_BLOB_DIR, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if ((blob_dir_fd = openat(wr_dir_fd, SAVE_BLOB_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+    }
+}
+
+void save_store_close(void)
+{
+    if (save_store == SAVE_STORE_SEGMENTS)
+    {
+        segment_store_close();
+    }
+    if (blob_dir_fd != -1)
+    {
+        close(blob_dir_fd);
+        blob_dir_fd = -1;
+    }
+    if (partial_dir_fd != -1)
+    {
+        close(partial_dir_fd);
+        partial_dir_fd = -1;
+    }
+}
 
 void create_dir_str(char **save_dir, const char *wr_dir, const char *client_addr_str) // NOLINT(bugprone-easily-swappable-parameters)
 {
@@ -60,7 +191,7 @@ void create_dir(const char *save_dir)
         {
             if (access(path, F_OK) != 0)
             {
-                if ((mkdir(path, WR_DIR_FLAGS)) == -1)
+                if ((mkdir(path, WR_DIR_FLAGS)) == -1 && errno != EEXIST) // Another worker may have created it
                 {
                     fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
                 }
@@ -70,85 +201,564 @@ void create_dir(const char *save_dir)
     free(path);
 }
 
-void write_to_dir(char *save_dir, const char *file_name, const char *data_buffer, uint32_t data_buf_size) // NOLINT(bugprone-easily-swappable-parameters)
+int open_save_dir(const char *wr_dir, const char *client_addr_str)
+{
+    struct save_dir_entry *entry;
+    size_t bucket = 0;
+    int err;
+
+    for (const char *ch = client_addr_str; *ch != '\0'; ++ch)
+    {
+        bucket = bucket * 31 + (unsigned char) *ch; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : String hash multiplier
+    }
+    bucket %= SAVE_DIR_BUCKETS;
+
+    if ((err = pthread_mutex_lock(&save_dir_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+
+    for (entry = save_dirs[bucket]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->addr_str, client_addr_str) == 0)
+        {
+            pthread_mutex_unlock(&save_dir_lock);
+            return entry->fd;
+        }
+    }
+
+    // The write directory's path is only walked the first time any client connects
+    open_wr_dir(wr_dir);
+
+    if ((entry = (struct save_dir_entry *) malloc(sizeof(struct save_dir_entry))) == NULL
+        || (entry->addr_str = strdup(client_addr_str)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if (save_store == SAVE_STORE_SEGMENTS)
+    {
+        entry->fd = segment_client(client_addr_str);
+    } else if ((mkdirat(wr_dir_fd, client_addr_str, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+               || (entry->fd = openat(wr_dir_fd, client_addr_str, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        // Only this client is turned away; the next one to connect from the address tries again
+        int saved_errno = errno;
+
+        pthread_mutex_unlock(&save_dir_lock);
+        free(entry->addr_str);
+        free(entry);
+        errno = saved_errno;
+        return -1;
+    }
+    entry->next = save_dirs[bucket];
+    save_dirs[bucket] = entry;
+
+    pthread_mutex_unlock(&save_dir_lock);
+    return entry->fd;
+}
+
+void close_save_dirs(void)
+{
+    for (size_t bucket = 0; bucket < SAVE_DIR_BUCKETS; ++bucket)
+    {
+        while (save_dirs[bucket] != NULL)
+        {
+            struct save_dir_entry *entry = save_dirs[bucket];
+
+            save_dirs[bucket] = entry->next;
+            close(entry->fd);
+            free(entry->addr_str);
+            free(entry);
+        }
+    }
+    if (wr_dir_fd != -1)
+    {
+        close(wr_dir_fd);
+        wr_dir_fd = -1;
+    }
+}
+
+int open_save_file(int dir_fd, const char *file_name, uint64_t size, char **save_file_name)
 {
-    char *save_file_name = NULL;
     int save_fd;
 
-    set_string(&save_file_name, save_dir);
-    append_string(&save_file_name, "/");
-    append_string(&save_file_name, file_name);
+    if (save_store == SAVE_STORE_SEGMENTS)
+    {
+        return segment_open(dir_fd, file_name, size, save_file_name);
+    }
+
+    // O_EXCL claims the versioned name; if a file the index missed holds it, pick the next version
+    do
+    {
+        create_save_path(save_file_name, dir_fd, file_name);
+    } while ((save_fd = openat(dir_fd, *save_file_name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, WR_DIR_FLAGS)) == -1 && errno == EEXIST);
 
-    version_file(&save_file_name);
+    // A file that cannot be created fails its upload alone, not the server
+    if (save_fd == -1)
+    {
+        int saved_errno = errno;
 
-    if ((save_fd = open(save_file_name, O_CREAT | O_WRONLY | O_CLOEXEC, WR_DIR_FLAGS)) == -1)
+        free(*save_file_name);
+        *save_file_name = NULL;
+        errno = saved_errno;
+    }
+    return save_fd;
+}
+
+void preallocate_file(int save_fd, uint64_t len)
+{
+    if (len < SAVE_PREALLOC_MIN)
+    {
+        return;
+    }
+    if (save_store == SAVE_STORE_SEGMENTS)
+    {
+        segment_preallocate(save_fd);
+        return;
+    }
+    // Failure only loses the hint; filesystems without fallocate are written as before
+    fallocate(save_fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) len);
+}
+
+void write_to_file(int save_fd, const char *data_buffer, size_t data_buf_size)
+{
+    while (data_buf_size > 0)
+    {
+        ssize_t ret_val;
+
+        if ((ret_val = write(save_fd, data_buffer, data_buf_size)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        data_buffer += ret_val;
+        data_buf_size -= (size_t) ret_val;
+    }
+}
+
+void finish_save_file(int save_fd)
+{
+    if (save_store == SAVE_STORE_SEGMENTS)
+    {
+        segment_finish(save_fd);
+    }
+}
+
+int dedup_file(int dir_fd, int *save_fd, const char *save_file_name, const char *digest)
+{
+    char blob[SAVE_BLOB_NAME_SIZE];
+    char tmp[SAVE_BLOB_TMP_SIZE];
+    int stored = 0;
+
+    // Blobs are spread over 256 directories named by the digest's first two hex digits
+    snprintf(blob, sizeof(blob), "%.2s/%s", digest, digest + 2); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    while (linkat(dir_fd, save_file_name, blob_dir_fd, blob, 0) == -1)
+    {
+        if (errno == EEXIST)
+        {
+            stored = 1;
+            break;
+        }
+        if (errno != ENOENT)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        blob[2] = '\0';
+        if (mkdirat(blob_dir_fd, blob, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        blob[2] = '/';
+    }
+    if (!stored)
+    {
+        // This file is the first with its content and is now the blob
+        return 0;
+    }
+
+    // Link the blob under a temporary name, then rename that over this copy in one step
+    snprintf(tmp, sizeof(tmp), "tmp-%d-%lu", getpid(), atomic_fetch_add(&blob_tmp_seq, 1)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    if (linkat(blob_dir_fd, blob, blob_dir_fd, tmp, 0) == -1)
+    {
+        if (errno != EMLINK)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        // The blob has as many links as the filesystem allows; this copy takes its place for later files
+        if (linkat(dir_fd, save_file_name, blob_dir_fd, tmp, 0) == -1
+            || renameat(blob_dir_fd, tmp, blob_dir_fd, blob) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        return 0;
+    }
+    if (renameat(blob_dir_fd, tmp, dir_fd, save_file_name) == -1)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
 
-    if (write(save_fd, data_buffer, data_buf_size) == -1)
+    if (save_fd != NULL)
+    {
+        close(*save_fd);
+        if ((*save_fd = openat(dir_fd, save_file_name, O_RDONLY | O_CLOEXEC)) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+    }
+    return 1;
+}
+
+int link_blob(int dir_fd, const char *file_name, const char *digest, uint64_t size, char **save_file_name)
+{
+    char blob[SAVE_BLOB_NAME_SIZE];
+    struct stat st;
+    int save_fd;
+    int ret_val;
+
+    snprintf(blob, sizeof(blob), "%.2s/%s", digest, digest + 2); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    if ((save_fd = openat(blob_dir_fd, blob, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        if (errno != ENOENT)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        return -1;
+    }
+    if (fstat(save_fd, &st) == -1)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
+    if ((uint64_t) st.st_size != size)
+    {
+        close(save_fd);
+        return -1;
+    }
 
-    free(save_file_name);
+    // Linking claims the versioned name as O_EXCL would
+    do
+    {
+        create_save_path(save_file_name, dir_fd, file_name);
+    } while ((ret_val = linkat(blob_dir_fd, blob, dir_fd, *save_file_name, 0)) == -1 && errno == EEXIST);
+
+    if (ret_val == -1)
+    {
+        if (errno != EMLINK)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        // The blob has as many links as the filesystem allows; the file is received and becomes the next blob
+        free(*save_file_name);
+        *save_file_name = NULL;
+        close(save_fd);
+        return -1;
+    }
+    return save_fd;
 }
 
-void version_file(char **save_str)
+int open_base_file(int dir_fd, const char *file_name)
 {
-    int v_num = VERSION_START_INDEX;
-    char *file_ver_suffix = NULL;
-    char *save_str_cpy = NULL;
-    char *ext = NULL;
-    char *ext_ptr;
+    char *name = NULL;
+    int base_fd = -1;
 
-    set_string(&save_str_cpy, *save_str);
+    // A version still being received may change under a delta; the digest ending the delta catches that
+    for (unsigned int version = version_latest(dir_fd, file_name); version > 0 && base_fd == -1; --version)
+    {
+        version_name(&name, file_name, version);
+        if ((base_fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC)) == -1 && errno != ENOENT)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+    }
+    free(name);
+    return base_fd;
+}
+
+int open_partial_file(const char *client_addr_str, const uint8_t *transfer_id, uint64_t size,
+                      struct sha256_ctx *hash, uint64_t *offset, char **partial_name)
+{
+    char name[SAVE_PARTIAL_NAME_SIZE];
+    struct stat st;
+    size_t len;
+    int save_fd;
+
+    len = (size_t) snprintf(name, sizeof(name), "%s-", client_addr_str); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    for (size_t i = 0; i < PROTO_TRANSFER_ID_SIZE; ++i)
+    {
+        len += (size_t) snprintf(name + len, sizeof(name) - len, "%02x", transfer_id[i]); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    }
 
-    while (access(save_str_cpy, F_OK) == 0) // does exist
+    open_partial_dir();
+    sweep_partial_files();
+    for (;;)
     {
-        if (v_num > VERSION_START_INDEX)
+        if ((save_fd = openat(partial_dir_fd, name, O_CREAT | O_RDWR | O_CLOEXEC, WR_DIR_FLAGS)) == -1)
         {
-            set_string(&save_str_cpy, *save_str);
+            return -1;
         }
+        if (flock(save_fd, LOCK_EX | LOCK_NB) == -1)
+        {
+            if (errno != EWOULDBLOCK)
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+            }
+            close(save_fd);
+            return -1;
+        }
+        if (fstat(save_fd, &st) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        // The holder finished or discarded the file between the open and the lock; take a fresh one
+        if (st.st_nlink > 0)
+        {
+            break;
+        }
+        close(save_fd);
+    }
 
-        ext_ptr = strrchr(save_str_cpy, '.');
-        set_string(&ext, ext_ptr);
+    // Only data covered by the kept hash counts; a hash past the file's end, or past the upload's,
+    // was kept for other data, so the upload starts over
+    *offset = 0;
+    if (load_partial_hash(name, hash) == 0 && hash->len <= (uint64_t) st.st_size && hash->len <= size)
+    {
+        *offset = hash->len;
+    } else
+    {
+        sha256_init(hash);
+    }
+    if (*offset < (uint64_t) st.st_size && ftruncate(save_fd, (off_t) *offset) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if (lseek(save_fd, (off_t) *offset, SEEK_SET) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    set_string(partial_name, name);
+    return save_fd;
+}
 
-        create_file_ver_suffix(&file_ver_suffix, v_num);
+void keep_partial_file(int save_fd, const char *partial_name, const struct sha256_ctx *hash)
+{
+    char name[SAVE_PARTIAL_NAME_SIZE + sizeof(SAVE_PARTIAL_HASH_SUFFIX)];
+    int hash_fd;
 
-        *ext_ptr = '\0';
-        append_string(&save_str_cpy, file_ver_suffix);
-        append_string(&save_str_cpy, ext);
+    // Written while the partial file is still locked, so no resume can read it half written
+    snprintf(name, sizeof(name), "%s%s", partial_name, SAVE_PARTIAL_HASH_SUFFIX); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    if ((hash_fd = openat(partial_dir_fd, name, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, WR_DIR_FLAGS)) != -1)
+    {
+        // A hash that cannot be kept only costs the upload its progress
+        if (write(hash_fd, hash, sizeof(struct sha256_ctx)) != (ssize_t) sizeof(struct sha256_ctx))
+        {
+            unlinkat(partial_dir_fd, name, 0);
+        }
+        close(hash_fd);
+    }
+    close(save_fd);
+}
+
+int finish_partial_file(int dir_fd, char **save_file_name, const char *file_name)
+{
+    char *partial_name = *save_file_name;
+    int ret_val;
 
-        ++v_num;
+    // Linking claims the versioned name as O_EXCL would, then the partial name is dropped
+    *save_file_name = NULL;
+    do
+    {
+        create_save_path(save_file_name, dir_fd, file_name);
+    } while ((ret_val = linkat(partial_dir_fd, partial_name, dir_fd, *save_file_name, 0)) == -1 && errno == EEXIST);
+
+    if (ret_val == -1 && errno == ENOENT)
+    {
+        // Removed while this upload held it; the upload fails, not the server
+        free(*save_file_name);
+        *save_file_name = partial_name;
+        return -1;
+    }
+    if (ret_val == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
-    set_string(save_str, save_str_cpy);
+    if (unlinkat(partial_dir_fd, partial_name, 0) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    remove_partial_hash(partial_name);
+    free(partial_name);
+    return 0;
+}
+
+void discard_partial_file(int save_fd, const char *partial_name)
+{
+    remove_partial_hash(partial_name);
+    close(save_fd);
+    unlinkat(partial_dir_fd, partial_name, 0);
+}
+
+void discard_file(int dir_fd, int save_fd, const char *save_file_name)
+{
+    if (save_store == SAVE_STORE_SEGMENTS)
+    {
+        segment_discard(save_fd);
+        close(save_fd);
+        return;
+    }
+    close(save_fd);
+    unlinkat(dir_fd, save_file_name, 0);
+}
 
-    free(file_ver_suffix);
-    free(save_str_cpy);
-    free(ext);
+void create_save_path(char **save_file_name, int dir_fd, const char *file_name)
+{
+    version_dirs(dir_fd, file_name);
+    version_name(save_file_name, file_name, version_claim(dir_fd, file_name));
 }
 
-void create_file_ver_suffix(char **file_ver_suffix, int v_num)
+int sync_save_dirs(int dir_fd, const char *file_name)
 {
-    int v_num_len;
-    char *v_num_suffix = NULL;
+    char *path;
+    char *slash;
+    int ret_val = 0;
 
-    if ((v_num_len = snprintf(NULL, 0, "%d", v_num)) < 0) // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    // A segment keeps the name in its record, so there are no subdirectories to sync
+    if (save_store == SAVE_STORE_SEGMENTS)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        return fsync(dir_fd);
     }
-    if ((v_num_suffix = (char *) calloc(v_num_len + 1, sizeof(char))) == NULL)
+    if ((path = strdup(file_name)) == NULL)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
     }
-    if (snprintf(v_num_suffix, v_num_len + 1, "%d", v_num) < 0) // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    // Each directory holds the name of the one below it, so every one up to dir_fd is synced
+    while (ret_val == 0 && (slash = strrchr(path, '/')) != NULL)
     {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        int fd;
+
+        *slash = '\0';
+        if ((fd = openat(dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 || fsync(fd) == -1)
+        {
+            ret_val = -1;
+        }
+        if (fd != -1)
+        {
+            close(fd);
+        }
     }
+    free(path);
+    return ret_val == -1 ? -1 : fsync(dir_fd);
+}
 
-    set_string(file_ver_suffix, "-v");
-    append_string(file_ver_suffix, v_num_suffix);
+static void open_partial_dir(void)
+{
+    int err;
 
-    free(v_num_suffix);
+    if ((err = pthread_mutex_lock(&save_dir_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    if (partial_dir_fd == -1)
+    {
+        if (mkdirat(wr_dir_fd, SAVE_PARTIAL_DIR, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if ((partial_dir_fd = openat(wr_dir_fd, SAVE_PARTIAL_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+    }
+    pthread_mutex_unlock(&save_dir_lock);
+}
+
+static int load_partial_hash(const char *partial_name, struct sha256_ctx *hash)
+{
+    char name[SAVE_PARTIAL_NAME_SIZE + sizeof(SAVE_PARTIAL_HASH_SUFFIX)];
+    ssize_t ret_val;
+    int hash_fd;
+
+    snprintf(name, sizeof(name), "%s%s", partial_name, SAVE_PARTIAL_HASH_SUFFIX); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    if ((hash_fd = openat(partial_dir_fd, name, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        return -1;
+    }
+    ret_val = read(hash_fd, hash, sizeof(struct sha256_ctx));
+    close(hash_fd);
+    return ret_val == (ssize_t) sizeof(struct sha256_ctx) ? 0 : -1;
+}
+
+static void sweep_partial_files(void)
+{
+    struct dirent *entry;
+    time_t now = time(NULL);
+    long swept_at = atomic_load(&partial_swept_at);
+    DIR *dir;
+    int fd;
+
+    // Only the thread that moves the time forward sweeps
+    if (now - swept_at < SAVE_PARTIAL_SWEEP_SECS
+        || !atomic_compare_exchange_strong(&partial_swept_at, &swept_at, (long) now))
+    {
+        return;
+    }
+
+    // Scan through a descriptor of its own, since closedir closes it
+    if ((fd = openat(partial_dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 || (dir = fdopendir(fd)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    while ((entry = readdir(dir)) != NULL) // NOLINT(concurrency-mt-unsafe) : The stream is this thread's own
+    {
+        size_t len = strlen(entry->d_name);
+        size_t suffix_len = strlen(SAVE_PARTIAL_HASH_SUFFIX);
+        struct stat st;
+        int save_fd;
+
+        // A kept hash goes with its partial file
+        if (entry->d_name[0] == '.'
+            || (len > suffix_len && strcmp(entry->d_name + len - suffix_len, SAVE_PARTIAL_HASH_SUFFIX) == 0))
+        {
+            continue;
+        }
+        if (fstatat(partial_dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 || !S_ISREG(st.st_mode)
+            || now - st.st_mtime < SAVE_PARTIAL_MAX_AGE)
+        {
+            continue;
+        }
+        if ((save_fd = openat(partial_dir_fd, entry->d_name, O_RDWR | O_CLOEXEC)) == -1)
+        {
+            continue;
+        }
+        if (flock(save_fd, LOCK_EX | LOCK_NB) == -1)
+        {
+            close(save_fd);
+            continue;
+        }
+        printf("%s was not resumed in time; discarded it.\n", entry->d_name);
+        discard_partial_file(save_fd, entry->d_name);
+    }
+    closedir(dir);
+}
+
+static void remove_partial_hash(const char *partial_name)
+{
+    char name[SAVE_PARTIAL_NAME_SIZE + sizeof(SAVE_PARTIAL_HASH_SUFFIX)];
+
+    snprintf(name, sizeof(name), "%s%s", partial_name, SAVE_PARTIAL_HASH_SUFFIX); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    unlinkat(partial_dir_fd, name, 0);
+}
+
+static void open_wr_dir(const char *wr_dir)
+{
+    if (wr_dir_fd != -1)
+    {
+        return;
+    }
+    create_dir(wr_dir);
+    if ((wr_dir_fd = open(wr_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
 }
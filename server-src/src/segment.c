@@ -0,0 +1,695 @@
+#define _GNU_SOURCE
+#include "segment.h"
+#include "direct.h"
+#include "error.h"
+#include "save.h"
+#include "version.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The size of the fixed part of an index record.
+ */
+#define SEGMENT_RECORD_HDR 32
+
+/**
+ * The number of buckets the version table starts with. Always a power of two.
+ */
+#define SEGMENT_MIN_BUCKETS 1024
+
+/**
+ * FNV-1a offset basis.
+ */
+#define FNV_OFFSET 2166136261U
+
+/**
+ * FNV-1a prime.
+ */
+#define FNV_PRIME 16777619U
+
+/**
+ * segment_upload
+ * <p>
+ * Struct storing the room reserved for a file being written.
+ * <ul>
+ * <li>const char *client: the client's IP address, owned by the client table</li>
+ * <li>char *name: the name the client sent, or NULL if the slot is free</li>
+ * <li>unsigned int version: the version claimed for the file</li>
+ * <li>uint32_t segment: the segment holding the room</li>
+ * <li>uint64_t offset: the offset of the room in the segment</li>
+ * <li>uint64_t len: the size of the room</li>
+ * </ul>
+ * </p>
+ */
+struct segment_upload
+{
+    const char *client;
+    char *name;
+    unsigned int version;
+    uint32_t segment;
+    uint64_t offset;
+    uint64_t len;
+};
+
+/**
+ * segment_version
+ * <p>
+ * Struct storing the last version claimed for one client's file name.
+ * <ul>
+ * <li>struct segment_version *next: the next entry in the same bucket</li>
+ * <li>char *key: the client's IP address and the name, separated by a null byte</li>
+ * <li>size_t key_len: the number of bytes in key</li>
+ * <li>uint32_t hash: the hash of key</li>
+ * <li>unsigned int version: the last version claimed</li>
+ * </ul>
+ * </p>
+ */
+struct segment_version
+{
+    struct segment_version *next;
+    char *key;
+    size_t key_len;
+    uint32_t hash;
+    unsigned int version;
+};
+
+/**
+ * segment_store
+ * <p>
+ * Struct storing the open segment store.
+ * <ul>
+ * <li>int dir_fd: file descriptor for SEGMENT_DIR</li>
+ * <li>int index_fd: file descriptor for the index, opened for appending</li>
+ * <li>int sync: whether data and records are synced as files are finished</li>
+ * <li>uint32_t segment: the segment new files are put in</li>
+ * <li>int segment_created: whether that segment's file exists yet</li>
+ * <li>uint64_t end: the end of the room reserved in that segment</li>
+ * <li>char **clients: the client of each descriptor from segment_client, indexed by descriptor</li>
+ * <li>size_t n_clients: the number of slots in clients</li>
+ * <li>struct segment_upload *uploads: the room of each descriptor from segment_open, indexed by descriptor</li>
+ * <li>size_t n_uploads: the number of slots in uploads</li>
+ * <li>struct segment_version **buckets: the version table</li>
+ * <li>size_t n_buckets: the number of buckets, a power of two</li>
+ * <li>size_t n_versions: the number of entries in the version table</li>
+ * </ul>
+ * </p>
+ */
+struct segment_store
+{
+    int dir_fd;
+    int index_fd;
+    int sync;
+    uint32_t segment;
+    int segment_created;
+    uint64_t end;
+    char **clients;
+    size_t n_clients;
+    struct segment_upload *uploads;
+    size_t n_uploads;
+    struct segment_version **buckets;
+    size_t n_buckets;
+    size_t n_versions;
+};
+
+static struct segment_store store = {.dir_fd = -1, .index_fd = -1};   // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;      // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * scan_segments
+ * <p>
+ * Move the current segment past every segment already in SEGMENT_DIR.
+ * </p>
+ */
+static void scan_segments(void);
+
+/**
+ * load_index
+ * <p>
+ * Read every record of the index into the version table, then cut off any incomplete record at
+ * its end so new records follow the last good one.
+ * </p>
+ */
+static void load_index(void);
+
+/**
+ * create_segment
+ * <p>
+ * Create the current segment's file.
+ * </p>
+ */
+static void create_segment(void);
+
+/**
+ * find_version
+ * <p>
+ * Find the version table entry for a client's file name, adding one with no versions if there is
+ * none. The caller holds store_lock.
+ * </p>
+ * @param client - char *: the client's IP address
+ * @param name - char *: the file name
+ * @return the entry
+ */
+static struct segment_version *find_version(const char *client, const char *name);
+
+/**
+ * grow_versions
+ * <p>
+ * Double the number of buckets in the version table.
+ * </p>
+ */
+static void grow_versions(void);
+
+/**
+ * grow_slots
+ * <p>
+ * Make a table indexed by file descriptor large enough to hold a descriptor, zeroing new slots.
+ * </p>
+ * @param table - void **: pointer to the table
+ * @param n_slots - size_t *: pointer to the number of slots in the table
+ * @param slot_size - size_t: the size of one slot
+ * @param fd - int: the descriptor
+ */
+static void grow_slots(void **table, size_t *n_slots, size_t slot_size, int fd);
+
+/**
+ * take_upload
+ * <p>
+ * Remove the room of a descriptor from segment_open from the upload table.
+ * </p>
+ * @param save_fd - int: the descriptor
+ * @param upload - segment_upload *: pointer to the memory to hold the room
+ */
+static void take_upload(int save_fd, struct segment_upload *upload);
+
+/**
+ * fnv_update
+ * <p>
+ * Add bytes to an FNV-1a hash.
+ * </p>
+ * @param hash - uint32_t: the hash so far
+ * @param data - void *: the bytes
+ * @param len - size_t: the number of bytes
+ * @return the new hash
+ */
+static uint32_t fnv_update(uint32_t hash, const void *data, size_t len);
+
+/**
+ * put_be
+ * <p>
+ * Store the low n bytes of a value in big-endian order.
+ * </p>
+ * @param dst - uint8_t *: the memory to store into
+ * @param value - uint64_t: the value
+ * @param n - size_t: the number of bytes
+ */
+static void put_be(uint8_t *dst, uint64_t value, size_t n);
+
+/**
+ * get_be
+ * <p>
+ * Load an n byte big-endian value.
+ * </p>
+ * @param src - uint8_t *: the memory to load from
+ * @param n - size_t: the number of bytes
+ * @return the value
+ */
+static uint64_t get_be(const uint8_t *src, size_t n);
+
+void segment_store_open(int wr_dir_fd, int sync)
+{
+    int flags;
+
+    if (mkdirat(wr_dir_fd, SEGMENT_DIR, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((store.dir_fd = openat(wr_dir_fd, SEGMENT_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    // Records are appended whole; synced stores write each one through to the disk
+    flags = O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC | (sync ? O_DSYNC : 0);
+    if ((store.index_fd = openat(store.dir_fd, SEGMENT_INDEX, flags, WR_DIR_FLAGS)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    store.sync = sync;
+    store.segment = 1;
+    store.n_buckets = SEGMENT_MIN_BUCKETS;
+    if ((store.buckets = (struct segment_version **) calloc(store.n_buckets, sizeof(struct segment_version *))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    scan_segments();
+    load_index();
+}
+
+void segment_store_close(void)
+{
+    for (size_t i = 0; i < store.n_buckets; ++i)
+    {
+        while (store.buckets[i] != NULL)
+        {
+            struct segment_version *v = store.buckets[i];
+
+            store.buckets[i] = v->next;
+            free(v->key);
+            free(v);
+        }
+    }
+    for (size_t i = 0; i < store.n_uploads; ++i)
+    {
+        free(store.uploads[i].name);
+    }
+    for (size_t i = 0; i < store.n_clients; ++i)
+    {
+        free(store.clients[i]);
+    }
+    free(store.buckets);
+    free(store.uploads);
+    free(store.clients);
+    close(store.index_fd);
+    close(store.dir_fd);
+    memset(&store, 0, sizeof(struct segment_store)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    store.dir_fd = -1;
+    store.index_fd = -1;
+}
+
+int segment_client(const char *client_addr_str)
+{
+    int client_fd;
+    int err;
+
+    if ((client_fd = fcntl(store.dir_fd, F_DUPFD_CLOEXEC, 0)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    if ((err = pthread_mutex_lock(&store_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    grow_slots((void **) &store.clients, &store.n_clients, sizeof(char *), client_fd);
+    if ((store.clients[client_fd] = strdup(client_addr_str)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    pthread_mutex_unlock(&store_lock);
+    return client_fd;
+}
+
+int segment_open(int client_fd, const char *file_name, uint64_t size, char **save_file_name)
+{
+    struct segment_upload upload;
+    char seg_name[SEGMENT_NAME_SIZE];
+    uint64_t offset;
+    int save_fd;
+    int err;
+
+    if ((err = pthread_mutex_lock(&store_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    upload.client = store.clients[client_fd];
+    upload.version = ++find_version(upload.client, file_name)->version;
+
+    // Large bodies start on a page boundary, so they are written in whole pages and can use direct I/O
+    offset = store.end;
+    if (size >= DIRECT_MIN_SIZE)
+    {
+        offset = (offset + DIRECT_ALIGN - 1) & ~((uint64_t) DIRECT_ALIGN - 1);
+    }
+    if (offset > 0 && offset + size > SEGMENT_MAX_SIZE)
+    {
+        ++store.segment;
+        store.segment_created = 0;
+        offset = 0;
+    }
+    if (!store.segment_created)
+    {
+        create_segment();
+    }
+    store.end = offset + size;
+    upload.segment = store.segment;
+    upload.offset = offset;
+    upload.len = size;
+    pthread_mutex_unlock(&store_lock);
+
+    // Each file gets its own descriptor, so its position is its own
+    segment_file_name(seg_name, upload.segment);
+    if ((save_fd = openat(store.dir_fd, seg_name, O_WRONLY | O_CLOEXEC)) == -1
+        || lseek(save_fd, (off_t) offset, SEEK_SET) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((upload.name = strdup(file_name)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    if ((err = pthread_mutex_lock(&store_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    grow_slots((void **) &store.uploads, &store.n_uploads, sizeof(struct segment_upload), save_fd);
+    store.uploads[save_fd] = upload;
+    pthread_mutex_unlock(&store_lock);
+
+    version_name(save_file_name, file_name, upload.version);
+    return save_fd;
+}
+
+void segment_preallocate(int save_fd)
+{
+    uint64_t offset;
+    uint64_t len;
+    int err;
+
+    if ((err = pthread_mutex_lock(&store_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    offset = store.uploads[save_fd].offset;
+    len = store.uploads[save_fd].len;
+    pthread_mutex_unlock(&store_lock);
+
+    // Failure only loses the hint
+    fallocate(save_fd, FALLOC_FL_KEEP_SIZE, (off_t) offset, (off_t) len);
+}
+
+void segment_finish(int save_fd)
+{
+    struct segment_upload upload;
+    uint8_t *rec;
+    size_t client_len;
+    size_t name_len;
+    size_t rec_len;
+    ssize_t ret_val;
+
+    take_upload(save_fd, &upload);
+
+    // The body must be on the disk before a synced record can point at it
+    if (store.sync && fdatasync(save_fd) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    client_len = strlen(upload.client);
+    name_len = strlen(upload.name);
+    rec_len = SEGMENT_RECORD_HDR + client_len + name_len;
+    if ((rec = (uint8_t *) malloc(rec_len)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    put_be(rec + 4, client_len, sizeof(uint16_t));                      // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    put_be(rec + 6, name_len, sizeof(uint16_t));                        // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    put_be(rec + 8, upload.version, sizeof(uint32_t));                  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    put_be(rec + 12, upload.segment, sizeof(uint32_t));                 // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    put_be(rec + 16, upload.offset, sizeof(uint64_t));                  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    put_be(rec + 24, upload.len, sizeof(uint64_t));                     // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    memcpy(rec + SEGMENT_RECORD_HDR, upload.client, client_len);
+    memcpy(rec + SEGMENT_RECORD_HDR + client_len, upload.name, name_len);
+    put_be(rec, fnv_update(FNV_OFFSET, rec + 4, rec_len - 4), sizeof(uint32_t)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+
+    // An appended record lands whole at the end, however many threads append; a short write means the disk is full
+    if ((ret_val = write(store.index_fd, rec, rec_len)) != (ssize_t) rec_len)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, ret_val == -1 ? errno : ENOSPC, 4);
+    }
+
+    free(rec);
+    free(upload.name);
+}
+
+void segment_discard(int save_fd)
+{
+    struct segment_upload upload;
+
+    take_upload(save_fd, &upload);
+    // The version stays claimed, as a removed file's does; only the space is given back
+    fallocate(save_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) upload.offset, (off_t) upload.len);
+    free(upload.name);
+}
+
+int segment_read_record(FILE *index, struct segment_record *rec)
+{
+    uint8_t hdr[SEGMENT_RECORD_HDR];
+    size_t client_len;
+    size_t name_len;
+    uint32_t hash;
+
+    if (fread(hdr, 1, sizeof(hdr), index) != sizeof(hdr))
+    {
+        return 0;
+    }
+    client_len = (size_t) get_be(hdr + 4, sizeof(uint16_t));            // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    name_len = (size_t) get_be(hdr + 6, sizeof(uint16_t));              // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    if (client_len == 0 || name_len == 0)
+    {
+        return 0;
+    }
+
+    if ((rec->client = (char *) malloc(client_len + 1)) == NULL
+        || (rec->name = (char *) malloc(name_len + 1)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    hash = fnv_update(FNV_OFFSET, hdr + 4, sizeof(hdr) - 4);
+    if (fread(rec->client, 1, client_len, index) != client_len
+        || fread(rec->name, 1, name_len, index) != name_len
+        || (hash = fnv_update(fnv_update(hash, rec->client, client_len), rec->name, name_len)) != get_be(hdr, sizeof(uint32_t)))
+    {
+        free(rec->client);
+        free(rec->name);
+        return 0;
+    }
+    rec->client[client_len] = '\0';
+    rec->name[name_len] = '\0';
+
+    rec->version = (unsigned int) get_be(hdr + 8, sizeof(uint32_t));    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    rec->segment = (uint32_t) get_be(hdr + 12, sizeof(uint32_t));       // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    rec->offset = get_be(hdr + 16, sizeof(uint64_t));                   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    rec->len = get_be(hdr + 24, sizeof(uint64_t));                      // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Record layout
+    return 1;
+}
+
+void segment_file_name(char name[SEGMENT_NAME_SIZE], uint32_t segment)
+{
+    snprintf(name, SEGMENT_NAME_SIZE, "seg-%08u.dat", segment); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+}
+
+static void scan_segments(void)
+{
+    struct dirent *entry;
+    DIR *dir;
+    int fd;
+
+    if ((fd = openat(store.dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1
+        || (dir = fdopendir(fd)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    while ((entry = readdir(dir)) != NULL) // NOLINT(concurrency-mt-unsafe) : The stream is this thread's own
+    {
+        unsigned int segment;
+
+        if (sscanf(entry->d_name, "seg-%8u.dat", &segment) == 1 && segment >= store.segment) // NOLINT(cert-err34-c) : A name that does not parse is not a segment
+        {
+            store.segment = segment + 1;
+        }
+    }
+    closedir(dir);
+}
+
+static void load_index(void)
+{
+    struct segment_record rec;
+    FILE *index;
+    long valid = 0;
+    int fd;
+
+    if ((fd = dup(store.index_fd)) == -1 || (index = fdopen(fd, "r")) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    while (segment_read_record(index, &rec))
+    {
+        struct segment_version *v = find_version(rec.client, rec.name);
+
+        if (rec.version > v->version)
+        {
+            v->version = rec.version;
+        }
+        if (rec.segment >= store.segment)
+        {
+            store.segment = rec.segment + 1;
+        }
+        free(rec.client);
+        free(rec.name);
+        valid = ftell(index);
+    }
+    fclose(index);
+
+    if (ftruncate(store.index_fd, valid) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+static void create_segment(void)
+{
+    char seg_name[SEGMENT_NAME_SIZE];
+    int fd;
+
+    // A segment left by a crashed run may hold the number; move past it
+    for (;;)
+    {
+        segment_file_name(seg_name, store.segment);
+        if ((fd = openat(store.dir_fd, seg_name, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, WR_DIR_FLAGS)) != -1)
+        {
+            break;
+        }
+        if (errno != EEXIST)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        ++store.segment;
+    }
+    close(fd);
+    store.segment_created = 1;
+}
+
+static struct segment_version *find_version(const char *client, const char *name)
+{
+    struct segment_version *v;
+    size_t client_len;
+    size_t key_len;
+    uint32_t hash;
+
+    client_len = strlen(client) + 1;
+    key_len = client_len + strlen(name);
+    hash = fnv_update(fnv_update(FNV_OFFSET, client, client_len), name, key_len - client_len);
+
+    for (v = store.buckets[hash & (store.n_buckets - 1)]; v != NULL; v = v->next)
+    {
+        if (v->hash == hash && v->key_len == key_len && memcmp(v->key, client, client_len) == 0
+            && memcmp(v->key + client_len, name, key_len - client_len) == 0)
+        {
+            return v;
+        }
+    }
+
+    if (store.n_versions >= store.n_buckets)
+    {
+        grow_versions();
+    }
+    if ((v = (struct segment_version *) calloc(1, sizeof(struct segment_version))) == NULL
+        || (v->key = (char *) malloc(key_len)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(v->key, client, client_len);
+    memcpy(v->key + client_len, name, key_len - client_len);
+    v->key_len = key_len;
+    v->hash = hash;
+    v->next = store.buckets[hash & (store.n_buckets - 1)];
+    store.buckets[hash & (store.n_buckets - 1)] = v;
+    ++store.n_versions;
+    return v;
+}
+
+static void grow_versions(void)
+{
+    struct segment_version **buckets;
+    size_t n_buckets = store.n_buckets * 2;
+
+    if ((buckets = (struct segment_version **) calloc(n_buckets, sizeof(struct segment_version *))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (size_t i = 0; i < store.n_buckets; ++i)
+    {
+        while (store.buckets[i] != NULL)
+        {
+            struct segment_version *v = store.buckets[i];
+
+            store.buckets[i] = v->next;
+            v->next = buckets[v->hash & (n_buckets - 1)];
+            buckets[v->hash & (n_buckets - 1)] = v;
+        }
+    }
+    free(store.buckets);
+    store.buckets = buckets;
+    store.n_buckets = n_buckets;
+}
+
+static void grow_slots(void **table, size_t *n_slots, size_t slot_size, int fd)
+{
+    size_t n;
+    char *grown;
+
+    if ((size_t) fd < *n_slots)
+    {
+        return;
+    }
+    n = *n_slots * 2 > (size_t) fd ? *n_slots * 2 : (size_t) fd + 1;
+    if ((grown = (char *) realloc(*table, n * slot_size)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memset(grown + *n_slots * slot_size, 0, (n - *n_slots) * slot_size); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    *table = grown;
+    *n_slots = n;
+}
+
+static void take_upload(int save_fd, struct segment_upload *upload)
+{
+    int err;
+
+    if ((err = pthread_mutex_lock(&store_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+    *upload = store.uploads[save_fd];
+    store.uploads[save_fd].name = NULL;
+    pthread_mutex_unlock(&store_lock);
+}
+
+static uint32_t fnv_update(uint32_t hash, const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static void put_be(uint8_t *dst, uint64_t value, size_t n)
+{
+    for (size_t i = n; i > 0; --i)
+    {
+        dst[i - 1] = (uint8_t) value;
+        value >>= 8; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Bits per byte
+    }
+}
+
+static uint64_t get_be(const uint8_t *src, size_t n)
+{
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        value = value << 8 | src[i]; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Bits per byte
+    }
+    return value;
+}
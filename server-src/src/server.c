@@ -5,6 +5,7 @@
 #include "server.h"
 #include "error.h"
 #include "util.h"
+#include "writer.h"
 #include <arpa/inet.h>
 #include <limits.h>
 #include <netdb.h>
@@ -12,6 +13,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -21,6 +23,31 @@
  */
 #define DEFAULT_PORT 5000
 
+/**
+ * The maximum number of worker threads.
+ */
+#define MAX_WORKERS 1024
+
+/**
+ * The maximum number of disk-writer threads.
+ */
+#define MAX_WRITERS 256
+
+/**
+ * The maximum number of buffers each network thread may queue for the disk writers.
+ */
+#define MAX_QUEUE_DEPTH 4096
+
+/**
+ * The longest group commit window, in milliseconds.
+ */
+#define MAX_GROUP_MS 10000
+
+/**
+ * The largest group commit byte budget, in KiB.
+ */
+#define MAX_GROUP_KIB (4 * 1024 * 1024)
+
 /**
  * The default write directory.
  */
@@ -49,12 +76,36 @@ void read_args(int argc, char *argv[], struct server_settings *set);
 /**
  * open_server
  * <p>
- * Create a socket, bind the IP specified in server_settings to the socket, then listen on the socket.
+ * For each worker, create a socket, bind the IP specified in server_settings to the socket, then
+ * listen on the socket. With more than one worker, the sockets share the address through SO_REUSEPORT.
  * </p>
  * @param set - server_settings *: pointer to the settings for this server
  */
 void open_server(struct server_settings *set);
 
+/**
+ * raise_fd_limit
+ * <p>
+ * Raise the soft limit on open file descriptors to the hard limit. Every client holds a socket, an
+ * acknowledgement descriptor and the files it is sending, so the default limit is soon reached.
+ * Failure is not fatal; the server then runs within the limit it was given.
+ * </p>
+ */
+void raise_fd_limit(void);
+
+/**
+ * open_listen_sock
+ * <p>
+ * Create a socket, bind the address to the socket, then listen on the socket. A socket that is one of
+ * several workers' sets SO_REUSEPORT to share the address; a lone socket does not, so a second
+ * server started on the same address fails to bind instead of silently taking half the clients.
+ * </p>
+ * @param host_addr - sockaddr_in *: the address to bind
+ * @param n_workers - unsigned int: the number of workers, each listening on a socket of its own
+ * @return file descriptor for the listening socket
+ */
+int open_listen_sock(const struct sockaddr_in *host_addr, unsigned int n_workers);
+
 /**
  * parse_port
  * <p>
@@ -68,6 +119,53 @@ void open_server(struct server_settings *set);
  */
 in_port_t parse_port(const char *buffer, int base);
 
+/**
+ * parse_io_mode
+ * <p>
+ * Convert the user input I/O mode name to an io_mode. Accepted names are "blocking", "epoll" and,
+ * when built with io_uring support, "uring".
+ * </p>
+ * @param mode_str - char *: string containing the mode name
+ * @return the I/O mode, an enum io_mode
+ */
+enum io_mode parse_io_mode(const char *mode_str);
+
+/**
+ * parse_durability
+ * <p>
+ * Convert the user input durability mode name to a durability. Accepted names are "none", "file"
+ * and "group".
+ * </p>
+ * @param mode_str - char *: string containing the mode name
+ * @return the durability mode, an enum durability
+ */
+enum durability parse_durability(const char *mode_str);
+
+/**
+ * parse_store
+ * <p>
+ * Convert the user input storage engine name to a save_store. Accepted names are "files" and
+ * "segments".
+ * </p>
+ * @param store_str - char *: string containing the engine name
+ * @return the storage engine, an enum save_store
+ */
+enum save_store parse_store(const char *store_str);
+
+/**
+ * parse_count
+ * <p>
+ * Check a user input count, such as a number of threads, to ensure it is within parameters.
+ * Namely, that it is at least min and at most max.
+ * </p>
+ * @param buffer - char *: string containing the count
+ * @param base - int: base in which to interpret the count
+ * @param min - long: the smallest count allowed
+ * @param max - long: the largest count allowed
+ * @return the count
+ */
+unsigned int parse_count(const char *buffer, int base, long min, long max);
+
 /**
  * check_ip
  * <p>
@@ -136,6 +234,7 @@ void run_server(int argc, char *argv[], struct server_settings *set)
 {
     set_simple_defaults(set);
     read_args(argc, argv, set);
+    raise_fd_limit();
     open_server(set);
 }
 
@@ -143,6 +242,13 @@ void set_simple_defaults(struct server_settings *set)
 {
     memset(set, 0, sizeof(struct server_settings)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
     set->port = DEFAULT_PORT;
+    set->io_mode = IO_MODE_EPOLL;
+    set->n_workers = 1;
+    set->queue_depth = WRITER_DEF_QUEUE_DEPTH;
+    set->durability = DURABILITY_NONE;
+    set->group_ms = DURABLE_DEF_GROUP_MS;
+    set->group_bytes = DURABLE_DEF_GROUP_BYTES;
+    set->store = SAVE_STORE_FILES;
 }
 
 void read_args(int argc, char *argv[], struct server_settings *set)
@@ -150,7 +256,7 @@ void read_args(int argc, char *argv[], struct server_settings *set)
     const int base = 10;
     int c;
 
-    while ((c = getopt(argc, argv, ":s:d:p:")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
+    while ((c = getopt(argc, argv, ":s:d:p:m:t:zw:q:D:G:B:Oe:c")) != -1) // NOLINT(concurrency-mt-unsafe) : No threads here
     {
         switch (c)
         {
@@ -170,6 +276,61 @@ void read_args(int argc, char *argv[], struct server_settings *set)
                 set->port = parse_port(optarg, base);
                 break;
             }
+            case 'm':
+            {
+                set->io_mode = parse_io_mode(optarg);
+                break;
+            }
+            case 't':
+            {
+                set->n_workers = parse_count(optarg, base, 1, MAX_WORKERS);
+                break;
+            }
+            case 'w':
+            {
+                set->n_writers = parse_count(optarg, base, 0, MAX_WRITERS);
+                break;
+            }
+            case 'q':
+            {
+                set->queue_depth = parse_count(optarg, base, 1, MAX_QUEUE_DEPTH);
+                break;
+            }
+            case 'D':
+            {
+                set->durability = parse_durability(optarg);
+                break;
+            }
+            case 'G':
+            {
+                set->group_ms = parse_count(optarg, base, 0, MAX_GROUP_MS);
+                break;
+            }
+            case 'B':
+            {
+                set->group_bytes = (uint64_t) parse_count(optarg, base, 1, MAX_GROUP_KIB) * 1024; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Bytes per KiB
+                break;
+            }
+            case 'z':
+            {
+                set->use_splice = 1;
+                break;
+            }
+            case 'O':
+            {
+                set->direct_io = 1;
+                break;
+            }
+            case 'e':
+            {
+                set->store = parse_store(optarg);
+                break;
+            }
+            case 'c':
+            {
+                set->dedup = 1;
+                break;
+            }
             case ':':
             {
                 fatal_message(__FILE__, __func__, __LINE__, "\"Option requires an operand\"",
@@ -195,6 +356,42 @@ void read_args(int argc, char *argv[], struct server_settings *set)
     {
         set_self_ip(&set->ip);
     }
+    if (set->io_mode == IO_MODE_BLOCKING && set->n_workers > 1)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Multiple worker threads require an event loop I/O mode", 2);
+    }
+    if (set->use_splice && set->io_mode == IO_MODE_URING)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Splicing (-z) is not used by the io_uring I/O mode", 2);
+    }
+    if (set->n_writers > 0 && set->io_mode == IO_MODE_URING)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Disk writers (-w) are not used by the io_uring I/O mode", 2);
+    }
+    if (set->n_writers > 0 && set->use_splice)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Splicing (-z) writes on the network threads and cannot use disk writers (-w)", 2);
+    }
+    if (set->direct_io && set->io_mode == IO_MODE_URING)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Direct I/O (-O) is not used by the io_uring I/O mode", 2);
+    }
+    if (set->direct_io && set->use_splice)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Splicing (-z) moves unaligned data and cannot use direct I/O (-O)", 2);
+    }
+    if (set->store == SAVE_STORE_SEGMENTS && set->io_mode == IO_MODE_URING)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "The segment store (-e segments) is not used by the io_uring I/O mode", 2);
+    }
+    if (set->dedup && set->use_splice)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Splicing (-z) never brings data into the server and cannot hash it for deduplication (-c)", 2);
+    }
+    if (set->dedup && set->store == SAVE_STORE_SEGMENTS)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, "Deduplication (-c) links whole files and is not used by the segment store (-e segments)", 2);
+    }
 }
 
 void check_ip(char *ip, int base)
@@ -291,6 +488,93 @@ in_port_t parse_port(const char *buffer, int base)
     return port;
 }
 
+enum io_mode parse_io_mode(const char *mode_str)
+{
+    if (strcmp(mode_str, "blocking") == 0)
+    {
+        return IO_MODE_BLOCKING;
+    }
+    if (strcmp(mode_str, "epoll") == 0)
+    {
+        return IO_MODE_EPOLL;
+    }
+#ifdef HAVE_IO_URING
+    if (strcmp(mode_str, "uring") == 0)
+    {
+        return IO_MODE_URING;
+    }
+    fatal_message(__FILE__, __func__, __LINE__, "I/O mode must be one of: blocking, epoll, uring", 2);
+#else
+    fatal_message(__FILE__, __func__, __LINE__, "I/O mode must be one of: blocking, epoll", 2);
+#endif
+}
+
+enum durability parse_durability(const char *mode_str)
+{
+    if (strcmp(mode_str, "none") == 0)
+    {
+        return DURABILITY_NONE;
+    }
+    if (strcmp(mode_str, "file") == 0)
+    {
+        return DURABILITY_FILE;
+    }
+    if (strcmp(mode_str, "group") == 0)
+    {
+        return DURABILITY_GROUP;
+    }
+    fatal_message(__FILE__, __func__, __LINE__, "Durability must be one of: none, file, group", 2);
+}
+
+enum save_store parse_store(const char *store_str)
+{
+    if (strcmp(store_str, "files") == 0)
+    {
+        return SAVE_STORE_FILES;
+    }
+    if (strcmp(store_str, "segments") == 0)
+    {
+        return SAVE_STORE_SEGMENTS;
+    }
+    fatal_message(__FILE__, __func__, __LINE__, "Storage engine must be one of: files, segments", 2);
+}
+
+unsigned int parse_count(const char *buffer, int base, long min, long max) // NOLINT(bugprone-easily-swappable-parameters)
+{
+    char *end;
+    long sl;
+    const char *msg;
+
+    errno = 0;
+    sl = strtol(buffer, &end, base);
+
+    if (end == buffer)
+    {
+        msg = "not a decimal number";
+    } else if (*end != '\0')
+    {
+        msg = "%s: extra characters at end of input";
+    } else if ((LONG_MIN == sl || LONG_MAX == sl) && ERANGE == errno)
+    {
+        msg = "out of range of type long";
+    } else if (sl > max)
+    {
+        msg = "greater than the maximum";
+    } else if (sl < min)
+    {
+        msg = "less than the minimum";
+    } else
+    {
+        msg = NULL;
+    }
+    if (msg)
+    {
+        fatal_message(__FILE__, __func__, __LINE__, msg, 2);
+    }
+
+    return (unsigned int) sl;
+}
+
 void set_self_ip(char **ip)
 {
     struct addrinfo hints;
@@ -379,13 +663,6 @@ void set_def_wr_dir(struct server_settings *set)
 void open_server(struct server_settings *set)
 {
     struct sockaddr_in host_addr;
-    int sock_option;
-    const int backlog = 5;
-
-    if ((set->fd_listen_sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) // NOLINT(android-cloexec-socket) : SOCK_CLOEXEC dne
-    {
-        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
-    }
 
     host_addr.sin_family = AF_INET;
     host_addr.sin_port = htons(set->port);
@@ -394,16 +671,56 @@ void open_server(struct server_settings *set)
         fatal_errno(__FILE__, __func__, __LINE__, errno, 2);
     }
 
+    if ((set->workers = (struct worker *) calloc(set->n_workers, sizeof(struct worker))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    for (unsigned int i = 0; i < set->n_workers; ++i)
+    {
+        set->workers[i].fd_listen_sock = open_listen_sock(&host_addr, set->n_workers);
+        set->workers[i].fd_client_sock = -1;
+    }
+}
+
+void raise_fd_limit(void)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int open_listen_sock(const struct sockaddr_in *host_addr, unsigned int n_workers)
+{
+    int fd_listen_sock;
+    int sock_option;
+    const int backlog = SOMAXCONN;
+
+    if ((fd_listen_sock = socket(AF_INET, SOCK_STREAM, 0)) == -1) // NOLINT(android-cloexec-socket) : SOCK_CLOEXEC dne
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
     sock_option = 1;
-    setsockopt(set->fd_listen_sock, SOL_SOCKET, SO_REUSEADDR, &sock_option, sizeof(sock_option));
+    setsockopt(fd_listen_sock, SOL_SOCKET, SO_REUSEADDR, &sock_option, sizeof(sock_option));
+    if (n_workers > 1 && setsockopt(fd_listen_sock, SOL_SOCKET, SO_REUSEPORT, &sock_option, sizeof(sock_option)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
 
-    if (bind(set->fd_listen_sock, (struct sockaddr *) &host_addr, sizeof(struct sockaddr_in)) == -1)
+    if (bind(fd_listen_sock, (const struct sockaddr *) host_addr, sizeof(struct sockaddr_in)) == -1)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
 
-    if (listen(set->fd_listen_sock, backlog) == -1)
+    if (listen(fd_listen_sock, backlog) == -1)
     {
         fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
     }
+
+    return fd_listen_sock;
 }
@@ -0,0 +1,163 @@
+#include "sha256.h"
+#include <string.h>
+
+/**
+ * Rotate a 32-bit word right by n bits.
+ */
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * The round constants: the first 32 bits of the fractional parts of the cube roots of the first
+ * 64 primes.
+ */
+static const uint32_t K[64] = {   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : SHA-256 constants
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/**
+ * compress
+ * <p>
+ * Add one block to the hash state.
+ * </p>
+ * @param state - uint32_t[]: the hash state
+ * @param block - uint8_t *: the block, SHA256_BLOCK_SIZE bytes
+ */
+static void compress(uint32_t state[8], const uint8_t *block);
+
+void sha256_init(struct sha256_ctx *ctx)
+{
+    static const uint32_t H0[8] = {   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : SHA-256 initial hash
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+    memcpy(ctx->state, H0, sizeof(H0));
+    ctx->len = 0;
+}
+
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t len)
+{
+    const uint8_t *bytes = (const uint8_t *) data;
+    size_t have = ctx->len % SHA256_BLOCK_SIZE;
+
+    ctx->len += len;
+    if (have > 0)
+    {
+        size_t n = len < SHA256_BLOCK_SIZE - have ? len : SHA256_BLOCK_SIZE - have;
+
+        memcpy(ctx->block + have, bytes, n);
+        bytes += n;
+        len -= n;
+        if (have + n < SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+        compress(ctx->state, ctx->block);
+    }
+
+    // Whole blocks are hashed where they lie
+    for (; len >= SHA256_BLOCK_SIZE; bytes += SHA256_BLOCK_SIZE, len -= SHA256_BLOCK_SIZE)
+    {
+        compress(ctx->state, bytes);
+    }
+    memcpy(ctx->block, bytes, len);
+}
+
+void sha256_digest(struct sha256_ctx *ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    uint64_t bits = ctx->len * 8;   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Bits per byte
+    size_t have = ctx->len % SHA256_BLOCK_SIZE;
+
+    // Pad with a one bit, zeros, then the length in bits in the last 8 bytes of a block
+    ctx->block[have++] = 0x80;      // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : The one bit
+    if (have > SHA256_BLOCK_SIZE - sizeof(uint64_t))
+    {
+        memset(ctx->block + have, 0, SHA256_BLOCK_SIZE - have); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        compress(ctx->state, ctx->block);
+        have = 0;
+    }
+    memset(ctx->block + have, 0, SHA256_BLOCK_SIZE - sizeof(uint64_t) - have); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    for (size_t i = 0; i < sizeof(uint64_t); ++i)
+    {
+        ctx->block[SHA256_BLOCK_SIZE - 1 - i] = (uint8_t) (bits >> (8 * i)); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Bits per byte
+    }
+    compress(ctx->state, ctx->block);
+
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; ++i)
+    {
+        digest[i] = (uint8_t) (ctx->state[i / 4] >> (24 - 8 * (i % 4)));     // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Big-endian words
+    }
+}
+
+void sha256_final(struct sha256_ctx *ctx, char hex[SHA256_HEX_SIZE])
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    sha256_digest(ctx, digest);
+    sha256_hex(digest, hex);
+}
+
+void sha256_hex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_HEX_SIZE])
+{
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; ++i)
+    {
+        hex[2 * i] = digits[digest[i] >> 4];                                // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : High nibble
+        hex[2 * i + 1] = digits[digest[i] & 0xf];                           // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Low nibble
+    }
+    hex[2 * SHA256_DIGEST_SIZE] = '\0';
+}
+
+static void compress(uint32_t state[8], const uint8_t *block)
+{
+    uint32_t w[64];     // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Message schedule
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+    uint32_t f = state[5];  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+    uint32_t g = state[6];  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+    uint32_t h = state[7];  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+
+    for (size_t i = 0; i < 16; ++i)     // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Words per block
+    {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16 | (uint32_t) block[4 * i + 2] << 8 | block[4 * i + 3]; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Big-endian words
+    }
+    for (size_t i = 16; i < 64; ++i)    // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Message schedule
+    {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : SHA-256 sigma0
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : SHA-256 sigma1
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Message schedule
+    }
+
+    for (size_t i = 0; i < 64; ++i)     // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Rounds
+    {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];   // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : SHA-256 T1
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));          // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : SHA-256 T2
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+    state[5] += f;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+    state[6] += g;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+    state[7] += h;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Working variables
+}
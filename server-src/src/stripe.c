@@ -0,0 +1,411 @@
+#include "stripe.h"
+#include "durable.h"
+#include "error.h"
+#include "proto.h"
+#include "save.h"
+#include "sha256.h"
+#include "writer.h"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The size of the buffer through which a finished file is read back to be hashed.
+ */
+#define STRIPE_HASH_BUF_SIZE (64 * 1024)
+
+/**
+ * stripe_range
+ * <p>
+ * Struct storing one completely received stripe.
+ * <ul>
+ * <li>uint64_t offset: where in the file the stripe starts</li>
+ * <li>uint64_t len: the size of the stripe</li>
+ * <li>struct ack_info ack: what to acknowledge for the stripe once the file is stored, its
+ * channel held</li>
+ * </ul>
+ * </p>
+ */
+struct stripe_range
+{
+    uint64_t offset;
+    uint64_t len;
+    struct ack_info ack;
+};
+
+struct stripe
+{
+    struct stripe *next;
+    char addr_str[INET_ADDRSTRLEN];
+    uint8_t transfer_id[PROTO_TRANSFER_ID_SIZE];
+    char *file_name;
+    int dir_fd;
+    int save_fd;
+    char *save_path;
+    uint64_t size;
+    uint64_t received;
+    struct stripe_range *ranges;
+    size_t n_ranges;
+    size_t cap_ranges;
+    unsigned int streams;
+    int finished;
+    time_t idle_since;
+    char *save_dir;
+    int dedup;
+};
+
+static struct stripe *stripes = NULL;                               // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_mutex_t stripes_lock = PTHREAD_MUTEX_INITIALIZER;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * find_stripe
+ * <p>
+ * Find the file a client is sending in stripes under a transfer ID. Call with stripes_lock held.
+ * </p>
+ * @param client_addr_str - char *: the client's IP address
+ * @param transfer_id - uint8_t *: the transfer ID, of PROTO_TRANSFER_ID_SIZE bytes
+ * @return the file, or NULL if none of its stripes has arrived
+ */
+static struct stripe *find_stripe(const char *client_addr_str, const uint8_t *transfer_id);
+
+/**
+ * overlaps
+ * <p>
+ * Check whether a stripe shares any byte with a stripe of the file already received. Call with
+ * stripes_lock held.
+ * </p>
+ * @param s - stripe *: the file
+ * @param offset - uint64_t: where in the file the stripe starts
+ * @param len - uint64_t: the size of the stripe
+ * @return 1 if it does, 0 otherwise
+ */
+static int overlaps(const struct stripe *s, uint64_t offset, uint64_t len);
+
+/**
+ * store_stripes
+ * <p>
+ * Writer task: store a file whose stripes are all received and report it for each stripe, then
+ * drop the hold its last stripe kept on it.
+ * </p>
+ * @param arg - void *: the stripe, out of the list of files being received
+ */
+static void store_stripes(void *arg);
+
+/**
+ * hash_saved
+ * <p>
+ * Hash the content of a saved file by reading it back, since its stripes arrived out of order.
+ * </p>
+ * @param s - stripe *: the file
+ * @param digest - char[]: the buffer to hold the SHA-256 digest, as hexadecimal
+ */
+static void hash_saved(const struct stripe *s, char digest[SHA256_HEX_SIZE]);
+
+/**
+ * sweep_idle
+ * <p>
+ * Discard every file none of whose stripes has been received for STRIPE_IDLE_SECS. Call with
+ * stripes_lock held.
+ * </p>
+ * @param now - time_t: the current time
+ * @param all - int: whether to discard every unfinished file however recently it was received
+ */
+static void sweep_idle(time_t now, int all);
+
+/**
+ * put_stripe
+ * <p>
+ * Free a stored file once no stream holds it any longer. Call with stripes_lock held.
+ * </p>
+ * @param s - stripe *: the file
+ */
+static void put_stripe(struct stripe *s);
+
+/**
+ * free_stripe
+ * <p>
+ * Free a file, releasing the channels of stripes not yet acknowledged.
+ * </p>
+ * @param s - stripe *: the file
+ */
+static void free_stripe(struct stripe *s);
+
+/**
+ * monotonic_secs
+ * <p>
+ * Get the time from a clock that is never set back.
+ * </p>
+ * @return the time, in seconds
+ */
+static time_t monotonic_secs(void);
+
+struct stripe *stripe_join(const char *client_addr_str, int dir_fd, const uint8_t *transfer_id, const char *file_name,
+                           uint64_t size, uint64_t offset, uint64_t len, int *save_fd)
+{
+    struct stripe *s;
+
+    pthread_mutex_lock(&stripes_lock);
+    sweep_idle(monotonic_secs(), 0);
+    if ((s = find_stripe(client_addr_str, transfer_id)) == NULL)
+    {
+        if ((s = (struct stripe *) calloc(1, sizeof(struct stripe))) == NULL || (s->file_name = strdup(file_name)) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        strncpy(s->addr_str, client_addr_str, sizeof(s->addr_str) - 1);
+        memcpy(s->transfer_id, transfer_id, PROTO_TRANSFER_ID_SIZE);
+        s->dir_fd = dir_fd;
+        s->size = size;
+        // Every stripe writes its own part of one file, claimed and reserved by the first to arrive
+        if ((s->save_fd = open_save_file(dir_fd, file_name, size, &s->save_path)) == -1)
+        {
+            pthread_mutex_unlock(&stripes_lock);
+            free(s->file_name);
+            free(s);
+            return NULL;
+        }
+        preallocate_file(s->save_fd, size);
+        s->next = stripes;
+        stripes = s;
+    } else if (s->size != size || strcmp(s->file_name, file_name) != 0 || overlaps(s, offset, len))
+    {
+        pthread_mutex_unlock(&stripes_lock);
+        return NULL;
+    }
+    ++s->streams;
+    pthread_mutex_unlock(&stripes_lock);
+
+    if ((*save_fd = openat(s->dir_fd, s->save_path, O_WRONLY | O_CLOEXEC)) == -1
+        || lseek(*save_fd, (off_t) offset, SEEK_SET) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    return s;
+}
+
+int stripe_end(struct stripe *s, uint64_t offset, uint64_t len, const struct ack_info *ack, const char *save_dir,
+               int dedup, struct writer_pool *pool)
+{
+    struct stripe_range *range;
+
+    pthread_mutex_lock(&stripes_lock);
+    --s->streams;
+    s->idle_since = monotonic_secs();
+    if (s->finished || overlaps(s, offset, len))
+    {
+        put_stripe(s);
+        pthread_mutex_unlock(&stripes_lock);
+        return -1;
+    }
+    if (s->n_ranges == s->cap_ranges)
+    {
+        s->cap_ranges = s->cap_ranges == 0 ? PROTO_MAX_STREAMS : s->cap_ranges * 2;
+        if ((s->ranges = (struct stripe_range *) realloc(s->ranges, s->cap_ranges * sizeof(struct stripe_range))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+    }
+    range = &s->ranges[s->n_ranges++];
+    range->offset = offset;
+    range->len = len;
+    range->ack.chan = ack_hold(ack->chan);
+    range->ack.stream = ack->stream;
+    range->ack.save_name = NULL;
+    s->received += len;
+    if (s->received < s->size)
+    {
+        pthread_mutex_unlock(&stripes_lock);
+        return 0;
+    }
+
+    // The last stripe stores the file; holding it keeps a late duplicate stripe from freeing it meanwhile
+    s->finished = 1;
+    ++s->streams;
+    for (struct stripe **p = &stripes; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == s)
+        {
+            *p = s->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stripes_lock);
+
+    // Reading the whole file back to hash it would hold up every other connection of this thread
+    if ((s->save_dir = strdup(save_dir)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    s->dedup = dedup;
+    writer_pool_run(pool, store_stripes, s);
+    return 0;
+}
+
+void stripe_leave(struct stripe *s)
+{
+    time_t now = monotonic_secs();
+
+    pthread_mutex_lock(&stripes_lock);
+    --s->streams;
+    s->idle_since = now;
+    put_stripe(s);
+    sweep_idle(now, 0);
+    pthread_mutex_unlock(&stripes_lock);
+}
+
+void stripe_discard_all(void)
+{
+    pthread_mutex_lock(&stripes_lock);
+    sweep_idle(monotonic_secs(), 1);
+    pthread_mutex_unlock(&stripes_lock);
+}
+
+static struct stripe *find_stripe(const char *client_addr_str, const uint8_t *transfer_id)
+{
+    for (struct stripe *s = stripes; s != NULL; s = s->next)
+    {
+        if (memcmp(s->transfer_id, transfer_id, PROTO_TRANSFER_ID_SIZE) == 0 && strcmp(s->addr_str, client_addr_str) == 0)
+        {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static int overlaps(const struct stripe *s, uint64_t offset, uint64_t len)
+{
+    for (size_t i = 0; i < s->n_ranges; ++i)
+    {
+        if (offset < s->ranges[i].offset + s->ranges[i].len && s->ranges[i].offset < offset + len)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void store_stripes(void *arg)
+{
+    struct stripe *s = (struct stripe *) arg;
+
+    finish_save_file(s->save_fd);
+    if (s->dedup)
+    {
+        char digest[SHA256_HEX_SIZE];
+
+        hash_saved(s, digest);
+        dedup_file(s->dir_fd, &s->save_fd, s->save_path, digest);
+    }
+
+    // The file is made durable with the first report; the others follow it, so none is acknowledged early
+    for (size_t i = 0; i < s->n_ranges; ++i)
+    {
+        struct ack_info ack = s->ranges[i].ack;
+
+        ack.save_name = s->save_path;
+        durable_save(s->dir_fd, i == 0 ? s->save_fd : -1, s->save_dir, s->file_name, s->ranges[i].len, &ack);
+        ack_release(s->ranges[i].ack.chan);
+    }
+    s->save_fd = -1;
+    s->n_ranges = 0;
+
+    pthread_mutex_lock(&stripes_lock);
+    --s->streams;
+    put_stripe(s);
+    pthread_mutex_unlock(&stripes_lock);
+}
+
+static void hash_saved(const struct stripe *s, char digest[SHA256_HEX_SIZE])
+{
+    struct sha256_ctx hash;
+    char *buf;
+    int fd;
+
+    if ((buf = (char *) malloc(STRIPE_HASH_BUF_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    // The save descriptor is write-only; the bytes were just written, so they come from the page cache
+    if ((fd = openat(s->dir_fd, s->save_path, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    sha256_init(&hash);
+    for (uint64_t pos = 0; pos < s->size;)
+    {
+        size_t n = s->size - pos < STRIPE_HASH_BUF_SIZE ? (size_t) (s->size - pos) : STRIPE_HASH_BUF_SIZE;
+        ssize_t ret_val;
+
+        if ((ret_val = pread(fd, buf, n, (off_t) pos)) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ret_val == 0)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "A striped file was cut short under the server", 4);
+        }
+        sha256_update(&hash, buf, (size_t) ret_val);
+        pos += (uint64_t) ret_val;
+    }
+    sha256_final(&hash, digest);
+    close(fd);
+    free(buf);
+}
+
+static void sweep_idle(time_t now, int all)
+{
+    struct stripe **p = &stripes;
+
+    while (*p != NULL)
+    {
+        struct stripe *s = *p;
+
+        if (!all && (s->streams > 0 || now - s->idle_since < STRIPE_IDLE_SECS))
+        {
+            p = &s->next;
+            continue;
+        }
+        *p = s->next;
+        printf("%s never sent the rest of %s; discarded it.\n", s->addr_str, s->file_name);
+        discard_file(s->dir_fd, s->save_fd, s->save_path);
+        free_stripe(s);
+    }
+}
+
+static void put_stripe(struct stripe *s)
+{
+    if (s->finished && s->streams == 0)
+    {
+        free_stripe(s);
+    }
+}
+
+static void free_stripe(struct stripe *s)
+{
+    for (size_t i = 0; i < s->n_ranges; ++i)
+    {
+        ack_release(s->ranges[i].ack.chan);
+    }
+    free(s->ranges);
+    free(s->file_name);
+    free(s->save_path);
+    free(s->save_dir);
+    free(s);
+}
+
+static time_t monotonic_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
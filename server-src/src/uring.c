@@ -0,0 +1,1439 @@
+#define _GNU_SOURCE
+#include "uring.h"
+#include "conn.h"
+#include "durable.h"
+#include "error.h"
+#include "proto.h"
+#include "save.h"
+#include "sha256.h"
+#include "util.h"
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The number of submission queue entries in each worker's ring.
+ */
+#define URING_ENTRIES 1024
+
+/**
+ * The number of provided receive buffers in each worker's ring. Must be a power of 2.
+ */
+#define URING_BUFS 256
+
+/**
+ * The size of each provided receive buffer.
+ */
+#define URING_BUF_SIZE (64 * 1024)
+
+/**
+ * The buffer group ID of the provided receive buffers.
+ */
+#define URING_BGID 0
+
+/**
+ * The number of direct file descriptor slots, which is also the most files one worker saves at once.
+ */
+#define URING_FILE_SLOTS 4096
+
+/**
+ * The most file operations submitted for one connection as one linked chain.
+ */
+#define URING_CHAIN_MAX 32
+
+/**
+ * How long, in milliseconds, a worker waits for completions before checking whether the server is stopping.
+ */
+#define URING_TIMEOUT_MS 250
+
+/**
+ * The number of bits of user_data holding the kind of request.
+ */
+#define UD_TYPE_BITS 8
+
+/**
+ * The bit at which user_data holds the socket file descriptor of a request's connection.
+ */
+#define UD_FD_SHIFT 32
+
+/**
+ * ud_type
+ * <p>
+ * The kind of request a completion belongs to, stored in the low bits of its user_data.
+ * </p>
+ */
+enum ud_type
+{
+    UD_ACCEPT,
+    UD_RECV,
+    UD_FILE
+};
+
+/**
+ * file_op_type
+ * <p>
+ * A file operation queued for a connection.
+ * </p>
+ */
+enum file_op_type
+{
+    FOP_OPEN,
+    FOP_FALLOCATE,
+    FOP_WRITE,
+    FOP_FSYNC,
+    FOP_DIRSYNC,
+    FOP_CLOSE,
+    FOP_UNLINK
+};
+
+/**
+ * file_op
+ * <p>
+ * Struct storing one file operation of a connection.
+ * <ul>
+ * <li>enum file_op_type type: the operation</li>
+ * <li>unsigned long seq: which of the connection's files the operation belongs to</li>
+ * <li>unsigned int slot: the direct file descriptor slot of the file</li>
+ * <li>char *path: FOP_OPEN and FOP_UNLINK: the file's name in the client's save directory;
+ * FOP_CLOSE: the same, or NULL if the file is being discarded</li>
+ * <li>char *file_name: FOP_OPEN: the name to re-version the path with; FOP_CLOSE: the name to
+ * report as saved, or NULL if the file is being discarded</li>
+ * <li>const char *data: FOP_WRITE: the data, inside a provided buffer</li>
+ * <li>uint32_t len: FOP_WRITE: the number of bytes to write</li>
+ * <li>uint64_t offset: FOP_WRITE: the offset in the file; FOP_FALLOCATE and FOP_CLOSE: the size
+ * of the file</li>
+ * <li>uint16_t bid: FOP_WRITE: the provided buffer holding the data</li>
+ * <li>char *digest: FOP_CLOSE: the SHA-256 digest of the file's data, or NULL not to deduplicate it</li>
+ * <li>uint32_t stream: FOP_CLOSE: the stream that carried the file, for its acknowledgement</li>
+ * <li>int res: the result of the operation once complete</li>
+ * </ul>
+ * </p>
+ */
+struct file_op
+{
+    enum file_op_type type;
+    unsigned long seq;
+    unsigned int slot;
+    char *path;
+    char *file_name;
+    const char *data;
+    uint32_t len;
+    uint64_t offset;
+    uint16_t bid;
+    char *digest;
+    uint32_t stream;
+    int res;
+};
+
+/**
+ * op_list
+ * <p>
+ * Struct storing a growable queue of file operations.
+ * </p>
+ */
+struct op_list
+{
+    struct file_op *ops;
+    size_t len;
+    size_t cap;
+};
+
+/**
+ * ufile
+ * <p>
+ * Struct storing the io_uring state of one file a client is sending.
+ * <ul>
+ * <li>char *path: the saved name of the file, or NULL if none is being received</li>
+ * <li>unsigned long seq: the sequence number of the file</li>
+ * <li>unsigned int slot: the direct file descriptor slot the file is opened into</li>
+ * <li>uint64_t off: the number of bytes of the file queued for writing</li>
+ * </ul>
+ * </p>
+ */
+struct ufile
+{
+    char *path;
+    unsigned long seq;
+    unsigned int slot;
+    uint64_t off;
+};
+
+/**
+ * uconn
+ * <p>
+ * Struct storing the io_uring state of one connected client.
+ * <ul>
+ * <li>struct conn *c: the protocol state</li>
+ * <li>struct op_list queue: file operations not yet submitted</li>
+ * <li>struct file_op chain[]: the file operations submitted as the current linked chain</li>
+ * <li>size_t chain_len: the number of operations in chain</li>
+ * <li>size_t chain_pending: the number of operations in chain not yet complete</li>
+ * <li>unsigned long file_seq: the sequence number of the last file started</li>
+ * <li>struct ufile files[]: the files being received, indexed like the protocol state's files</li>
+ * <li>int recv_armed: whether a multishot receive is active</li>
+ * <li>int starved: whether receiving stopped because no buffers were free</li>
+ * <li>int eof: whether the client is done sending</li>
+ * </ul>
+ * </p>
+ */
+struct uconn
+{
+    struct conn *c;
+    struct op_list queue;
+    struct file_op chain[URING_CHAIN_MAX];
+    size_t chain_len;
+    size_t chain_pending;
+    unsigned long file_seq;
+    struct ufile files[CONN_MAX_FILES];
+    int recv_armed;
+    int starved;
+    int eof;
+};
+
+/**
+ * ring
+ * <p>
+ * Struct storing the memory shared with the kernel for one io_uring.
+ * </p>
+ */
+struct ring
+{
+    int fd;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    size_t sq_len;
+    void *cq_ptr;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned int sq_entries;
+    unsigned int sqe_tail;
+    unsigned int to_submit;
+};
+
+/**
+ * uring_worker
+ * <p>
+ * Struct storing everything one worker's io_uring event loop owns.
+ * <ul>
+ * <li>struct ring ring: the io_uring</li>
+ * <li>struct io_uring_buf_ring *br: the ring of provided receive buffers</li>
+ * <li>char *bufs: the memory of the provided receive buffers</li>
+ * <li>uint16_t buf_refs[]: per buffer, the number of unfinished users of its data</li>
+ * <li>uint16_t br_tail: the provided buffer ring's tail</li>
+ * <li>int recycled: whether a buffer was returned to the ring since starved clients were last rearmed</li>
+ * <li>size_t n_starved: the number of clients waiting for a free buffer</li>
+ * <li>struct uconn **conns: the connections, indexed by socket file descriptor</li>
+ * <li>size_t size: the number of slots in conns</li>
+ * <li>size_t n_conns: the number of connections</li>
+ * <li>unsigned int free_slots[]: the unused direct file descriptor slots</li>
+ * <li>size_t n_free_slots: the number of entries in free_slots</li>
+ * <li>int accept_armed: whether a multishot accept is active</li>
+ * <li>time_t deferred_at: when accepting was put off for want of file descriptors, or 0</li>
+ * <li>int stopping: whether the worker is shutting down</li>
+ * </ul>
+ * </p>
+ */
+struct uring_worker
+{
+    const struct server_settings *set;
+    const struct worker *w;
+    struct ring ring;
+    struct io_uring_buf_ring *br;
+    char *bufs;
+    uint16_t buf_refs[URING_BUFS];
+    uint16_t br_tail;
+    int recycled;
+    size_t n_starved;
+    struct uconn **conns;
+    size_t size;
+    size_t n_conns;
+    unsigned int free_slots[URING_FILE_SLOTS];
+    size_t n_free_slots;
+    int accept_armed;
+    time_t deferred_at;
+    int stopping;
+};
+
+/**
+ * ring_init
+ * <p>
+ * Create an io_uring and map its queues.
+ * </p>
+ * @param r - ring *: the ring to initialize
+ */
+static void ring_init(struct ring *r);
+
+/**
+ * ring_free
+ * <p>
+ * Unmap and close an io_uring.
+ * </p>
+ * @param r - ring *: the ring
+ */
+static void ring_free(struct ring *r);
+
+/**
+ * ring_sqe
+ * <p>
+ * Get a zeroed submission queue entry, submitting queued entries first if the queue is full.
+ * </p>
+ * @param r - ring *: the ring
+ * @return the entry
+ */
+static struct io_uring_sqe *ring_sqe(struct ring *r);
+
+/**
+ * ring_reserve
+ * <p>
+ * Make sure n submission queue entries are free, so a linked chain is never split across submissions.
+ * </p>
+ * @param r - ring *: the ring
+ * @param n - size_t: the number of entries needed
+ */
+static void ring_reserve(struct ring *r, size_t n);
+
+/**
+ * ring_enter
+ * <p>
+ * Submit queued entries and, if wait is set, wait up to URING_TIMEOUT_MS for a completion.
+ * </p>
+ * @param r - ring *: the ring
+ * @param wait - int: whether to wait for a completion
+ */
+static void ring_enter(struct ring *r, int wait);
+
+/**
+ * setup_buffers
+ * <p>
+ * Register the provided receive buffers and the sparse direct file descriptor table with the ring.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ */
+static void setup_buffers(struct uring_worker *uw);
+
+/**
+ * buf_release
+ * <p>
+ * Drop one user of a provided buffer, returning it to the ring when it has none left.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param bid - uint16_t: the buffer
+ */
+static void buf_release(struct uring_worker *uw, uint16_t bid);
+
+/**
+ * reap
+ * <p>
+ * Handle every completion in the completion queue.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ */
+static void reap(struct uring_worker *uw);
+
+/**
+ * arm_accept
+ * <p>
+ * Submit a multishot accept on the worker's listening socket.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ */
+static void arm_accept(struct uring_worker *uw);
+
+/**
+ * arm_recv
+ * <p>
+ * Submit a multishot receive into the provided buffers on a client's socket.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ */
+static void arm_recv(struct uring_worker *uw, struct uconn *uc);
+
+/**
+ * handle_accept
+ * <p>
+ * Start serving a newly accepted client.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param cqe - io_uring_cqe *: the accept completion
+ */
+static void handle_accept(struct uring_worker *uw, const struct io_uring_cqe *cqe);
+
+/**
+ * handle_recv
+ * <p>
+ * Decode the bytes a client sent into queued file operations, or note the end of its stream.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ * @param cqe - io_uring_cqe *: the receive completion
+ */
+static void handle_recv(struct uring_worker *uw, struct uconn *uc, const struct io_uring_cqe *cqe);
+
+/**
+ * feed
+ * <p>
+ * Decode one received buffer, queueing an open at each file header, a write for each span of data
+ * and a close at each file end.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ * @param bid - uint16_t: the provided buffer holding the bytes
+ * @param len - size_t: the number of bytes received
+ */
+static void feed(struct uring_worker *uw, struct uconn *uc, uint16_t bid, size_t len);
+
+/**
+ * queue_op
+ * <p>
+ * Append a file operation to a connection's queue.
+ * </p>
+ * @param uc - uconn *: the connection
+ * @param op - file_op *: the operation
+ */
+static void queue_op(struct uconn *uc, const struct file_op *op);
+
+/**
+ * submit_chain
+ * <p>
+ * If the connection has no chain in flight, submit its queued file operations as one linked chain.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ */
+static void submit_chain(struct uring_worker *uw, struct uconn *uc);
+
+/**
+ * handle_file
+ * <p>
+ * Record the result of one operation of a connection's chain, finishing the chain when it is the last.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ * @param idx - size_t: the operation's index in the chain
+ * @param res - int: the result
+ */
+static void handle_file(struct uring_worker *uw, struct uconn *uc, size_t idx, int res);
+
+/**
+ * finish_chain
+ * <p>
+ * Release what each completed operation held. If an open lost a race for its versioned name, pick
+ * the next version and queue that operation and the rest of the chain again. If the name cannot be
+ * created at all, only that connection is dropped.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ */
+static void finish_chain(struct uring_worker *uw, struct uconn *uc);
+
+/**
+ * retry_open
+ * <p>
+ * Put chain operations from idx on back at the front of the queue under a newly versioned path.
+ * The failed open cancelled every operation linked after it, so none of them has run.
+ * </p>
+ * @param uc - uconn *: the connection
+ * @param idx - size_t: the index in the chain of the failed open
+ * @param len - size_t: the number of operations in the chain
+ */
+static void retry_open(struct uconn *uc, size_t idx, size_t len);
+
+/**
+ * fail_open
+ * <p>
+ * Drop a connection whose file cannot be created under any name. The operations cancelled behind
+ * the failed open are queued again, except the file's own, which are released with its slot.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ * @param idx - size_t: the index in the chain of the failed open
+ * @param len - size_t: the number of operations in the chain
+ */
+static void fail_open(struct uring_worker *uw, struct uconn *uc, size_t idx, size_t len);
+
+/**
+ * requeue_chain
+ * <p>
+ * Put chain operations from idx on back at the front of the queue, in order.
+ * </p>
+ * @param uc - uconn *: the connection
+ * @param idx - size_t: the index in the chain of the first operation to queue again
+ * @param len - size_t: the number of operations in the chain
+ */
+static void requeue_chain(struct uconn *uc, size_t idx, size_t len);
+
+/**
+ * maybe_close
+ * <p>
+ * Close a connection once its client is done sending and all of its file operations are complete.
+ * A file cut off by the disconnect is closed and unlinked first.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ * @param uc - uconn *: the connection
+ */
+static void maybe_close(struct uring_worker *uw, struct uconn *uc);
+
+/**
+ * stop_worker
+ * <p>
+ * Stop accepting and shut down every client socket, so outstanding requests complete and the
+ * event loop can drain.
+ * </p>
+ * @param uw - uring_worker *: the worker
+ */
+static void stop_worker(struct uring_worker *uw);
+
+void serve_worker_uring(const struct server_settings *set, const struct worker *w,
+                        const volatile sig_atomic_t *running)
+{
+    struct uring_worker *uw;
+
+    if ((uw = (struct uring_worker *) calloc(1, sizeof(struct uring_worker))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    uw->set = set;
+    uw->w = w;
+    for (unsigned int i = 0; i < URING_FILE_SLOTS; ++i)
+    {
+        uw->free_slots[uw->n_free_slots++] = URING_FILE_SLOTS - 1 - i;
+    }
+
+    ring_init(&uw->ring);
+    setup_buffers(uw);
+    arm_accept(uw);
+
+    while (!uw->stopping || uw->accept_armed || uw->n_conns > 0)
+    {
+        if (!uw->stopping && !*running)
+        {
+            stop_worker(uw);
+        }
+
+        // Descriptors freed by other workers are only noticed by trying again, at most once a second
+        if (uw->deferred_at != 0 && !uw->stopping && time(NULL) != uw->deferred_at)
+        {
+            uw->deferred_at = 0;
+            arm_accept(uw);
+        }
+        ring_enter(&uw->ring, 1);
+        reap(uw);
+
+        if (uw->recycled && uw->n_starved > 0)
+        {
+            for (size_t fd = 0; fd < uw->size; ++fd)
+            {
+                if (uw->conns[fd] != NULL && uw->conns[fd]->starved)
+                {
+                    uw->conns[fd]->starved = 0;
+                    --uw->n_starved;
+                    arm_recv(uw, uw->conns[fd]);
+                }
+            }
+        }
+        uw->recycled = 0;
+    }
+
+    ring_free(&uw->ring);
+    munmap(uw->br, URING_BUFS * sizeof(struct io_uring_buf));
+    free(uw->bufs);
+    free(uw->conns);
+    free(uw);
+}
+
+static void ring_init(struct ring *r)
+{
+    struct io_uring_params p;
+    long fd;
+
+    memset(&p, 0, sizeof(struct io_uring_params)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    p.flags = IORING_SETUP_CLAMP;
+    if ((fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    r->fd = (int) fd;
+
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        r->sq_len = r->sq_len > r->cq_len ? r->sq_len : r->cq_len;
+        r->cq_len = r->sq_len;
+    }
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        r->cq_ptr = r->sq_ptr;
+    } else if ((r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                                 IORING_OFF_CQ_RING)) == MAP_FAILED)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    if ((r->sqes = (struct io_uring_sqe *) mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                                r->fd, IORING_OFF_SQES)) == MAP_FAILED)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    r->sq_head = (unsigned int *) (void *) ((char *) r->sq_ptr + p.sq_off.head);
+    r->sq_tail = (unsigned int *) (void *) ((char *) r->sq_ptr + p.sq_off.tail);
+    r->sq_mask = (unsigned int *) (void *) ((char *) r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *) (void *) ((char *) r->sq_ptr + p.sq_off.array);
+    r->cq_head = (unsigned int *) (void *) ((char *) r->cq_ptr + p.cq_off.head);
+    r->cq_tail = (unsigned int *) (void *) ((char *) r->cq_ptr + p.cq_off.tail);
+    r->cq_mask = (unsigned int *) (void *) ((char *) r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (void *) ((char *) r->cq_ptr + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->sqe_tail = *r->sq_tail;
+    r->to_submit = 0;
+}
+
+static void ring_free(struct ring *r)
+{
+    munmap(r->sqes, r->sqes_len);
+    if (r->cq_ptr != r->sq_ptr)
+    {
+        munmap(r->cq_ptr, r->cq_len);
+    }
+    munmap(r->sq_ptr, r->sq_len);
+    close(r->fd);
+}
+
+static struct io_uring_sqe *ring_sqe(struct ring *r)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    if (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries)
+    {
+        ring_enter(r, 0);
+    }
+
+    idx = r->sqe_tail & *r->sq_mask;
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    r->sq_array[idx] = idx;
+    ++r->sqe_tail;
+    ++r->to_submit;
+
+    return sqe;
+}
+
+static void ring_reserve(struct ring *r, size_t n)
+{
+    if (r->sq_entries - (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE)) < n)
+    {
+        ring_enter(r, 0);
+    }
+}
+
+static void ring_enter(struct ring *r, int wait)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned int flags = 0;
+    long ret;
+
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+
+    if (wait)
+    {
+        ts.tv_sec = 0;
+        ts.tv_nsec = (long long) URING_TIMEOUT_MS * 1000000;
+        memset(&arg, 0, sizeof(struct io_uring_getevents_arg)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    ret = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait ? 1 : 0, flags,
+                  wait ? &arg : NULL, wait ? sizeof(struct io_uring_getevents_arg) : 0);
+    if (ret == -1)
+    {
+        if (errno == EINTR || errno == ETIME || errno == EBUSY || errno == EAGAIN)
+        {
+            return;
+        }
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    r->to_submit -= (unsigned int) ret;
+}
+
+static void setup_buffers(struct uring_worker *uw)
+{
+    struct io_uring_buf_reg reg;
+    struct io_uring_rsrc_register files;
+
+    uw->br = (struct io_uring_buf_ring *) mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (uw->br == MAP_FAILED)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if ((uw->bufs = (char *) aligned_alloc(URING_BUF_SIZE, (size_t) URING_BUFS * URING_BUF_SIZE)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    memset(&reg, 0, sizeof(struct io_uring_buf_reg)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    reg.ring_addr = (uint64_t) (uintptr_t) uw->br;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BGID;
+    if (syscall(__NR_io_uring_register, uw->ring.fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    uw->br_tail = 0;
+    for (uint16_t bid = 0; bid < URING_BUFS; ++bid)
+    {
+        uw->buf_refs[bid] = 1;
+        buf_release(uw, bid);
+    }
+
+    memset(&files, 0, sizeof(struct io_uring_rsrc_register)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    files.nr = URING_FILE_SLOTS;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, uw->ring.fd, IORING_REGISTER_FILES2, &files,
+                sizeof(struct io_uring_rsrc_register)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+}
+
+static void buf_release(struct uring_worker *uw, uint16_t bid)
+{
+    struct io_uring_buf *buf;
+
+    if (--uw->buf_refs[bid] > 0)
+    {
+        return;
+    }
+
+    // Set fields one by one: the ring's tail overlays the first entry's resv field
+    buf = &uw->br->bufs[uw->br_tail & (URING_BUFS - 1)];
+    buf->addr = (uint64_t) (uintptr_t) (uw->bufs + (size_t) bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ++uw->br_tail;
+    __atomic_store_n(&uw->br->tail, uw->br_tail, __ATOMIC_RELEASE);
+    uw->recycled = 1;
+}
+
+static void reap(struct uring_worker *uw)
+{
+    struct ring *r = &uw->ring;
+    unsigned int head = *r->cq_head;
+
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe cqe = r->cqes[head & *r->cq_mask];
+        struct uconn *uc;
+        int fd;
+
+        __atomic_store_n(r->cq_head, ++head, __ATOMIC_RELEASE);
+
+        fd = (int) (cqe.user_data >> UD_FD_SHIFT);
+        uc = (size_t) fd < uw->size ? uw->conns[fd] : NULL;
+        switch ((enum ud_type) (cqe.user_data & ((1U << UD_TYPE_BITS) - 1)))
+        {
+            case UD_ACCEPT:
+            {
+                handle_accept(uw, &cqe);
+                break;
+            }
+            case UD_RECV:
+            {
+                handle_recv(uw, uc, &cqe);
+                break;
+            }
+            case UD_FILE:
+            {
+                handle_file(uw, uc, (size_t) ((cqe.user_data & 0xFFFFFFFFU) >> UD_TYPE_BITS), cqe.res);
+                break;
+            }
+            default:
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                              69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+            }
+        }
+    }
+}
+
+static void arm_accept(struct uring_worker *uw)
+{
+    struct io_uring_sqe *sqe = ring_sqe(&uw->ring);
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = uw->w->fd_listen_sock;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = UD_ACCEPT;
+    uw->accept_armed = 1;
+}
+
+static void arm_recv(struct uring_worker *uw, struct uconn *uc)
+{
+    struct io_uring_sqe *sqe = ring_sqe(&uw->ring);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = uc->c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = ((uint64_t) uc->c->fd << UD_FD_SHIFT) | UD_RECV;
+    uc->recv_armed = 1;
+}
+
+static void handle_accept(struct uring_worker *uw, const struct io_uring_cqe *cqe)
+{
+    struct sockaddr_in client_addr;
+    socklen_t sockaddr_in_size;
+    struct uconn *uc;
+    size_t fd;
+
+    // Out of descriptors, a new accept would fail at once; clients wait in the backlog instead
+    if (cqe->res == -EMFILE || cqe->res == -ENFILE)
+    {
+        if (!(cqe->flags & IORING_CQE_F_MORE))
+        {
+            uw->accept_armed = 0;
+            uw->deferred_at = time(NULL);
+        }
+        return;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        uw->accept_armed = 0;
+        if (!uw->stopping)
+        {
+            arm_accept(uw);
+        }
+    }
+
+    if (cqe->res < 0)
+    {
+        if (!uw->stopping && cqe->res != -ECONNABORTED && cqe->res != -EINTR)
+        {
+            printf("Accept failed: %s\n", strerror(-cqe->res)); // NOLINT(concurrency-mt-unsafe) : Message only
+        }
+        return;
+    }
+
+    fd = (size_t) cqe->res;
+    if (uw->stopping || uw->n_free_slots == 0)
+    {
+        close(cqe->res);
+        return;
+    }
+
+    sockaddr_in_size = sizeof(struct sockaddr_in);
+    if (getpeername(cqe->res, (struct sockaddr *) &client_addr, &sockaddr_in_size) == -1)
+    {
+        close(cqe->res);
+        return;
+    }
+
+    if ((uc = (struct uconn *) calloc(1, sizeof(struct uconn))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    if ((uc->c = conn_open(cqe->res, &client_addr, uw->set->wr_dir)) == NULL)
+    {
+        free(uc);
+        return;
+    }
+
+    if (fd >= uw->size)
+    {
+        struct uconn **conns;
+        size_t size = uw->size ? uw->size : URING_BUFS;
+
+        while (size <= fd)
+        {
+            size *= 2;
+        }
+        if ((conns = (struct uconn **) realloc(uw->conns, size * sizeof(struct uconn *))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        for (size_t i = uw->size; i < size; ++i)
+        {
+            conns[i] = NULL;
+        }
+        uw->conns = conns;
+        uw->size = size;
+    }
+    uw->conns[fd] = uc;
+    ++uw->n_conns;
+
+    arm_recv(uw, uc);
+}
+
+static void handle_recv(struct uring_worker *uw, struct uconn *uc, const struct io_uring_cqe *cqe)
+{
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        uc->recv_armed = 0;
+    }
+
+    if (cqe->res > 0)
+    {
+        feed(uw, uc, (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT), (size_t) cqe->res);
+        if (!uc->recv_armed && !uc->eof)
+        {
+            arm_recv(uw, uc);
+        }
+    } else if (cqe->res == -ENOBUFS)
+    {
+        if (!uc->eof)
+        {
+            uc->starved = 1;
+            ++uw->n_starved;
+        }
+    } else if (cqe->res < 0 && !uc->eof)
+    {
+        printf("%s:%d dropped: %s\n", uc->c->addr_str, uc->c->port, strerror(-cqe->res)); // NOLINT(concurrency-mt-unsafe) : Message only
+        uc->eof = 1;
+    } else if (cqe->res == 0)
+    {
+        uc->eof = 1;
+    }
+
+    submit_chain(uw, uc);
+    maybe_close(uw, uc);
+}
+
+static void feed(struct uring_worker *uw, struct uconn *uc, uint16_t bid, size_t len)
+{
+    const char *buf = uw->bufs + (size_t) bid * URING_BUF_SIZE;
+    size_t off = 0;
+    enum conn_event ev = CONN_EV_NONE;
+
+    ++uw->buf_refs[bid];
+    while (!uc->eof)
+    {
+        struct conn_file *file;
+        struct ufile *uf;
+        struct file_op op;
+        const char *data;
+        size_t data_len;
+        size_t n;
+
+        ev = conn_decode(uc->c, buf + off, len - off, &n, &data, &data_len);
+        off += n;
+        if (ev == CONN_EV_NONE)
+        {
+            break;
+        }
+
+        file = uc->c->cur;
+        uf = file != NULL ? &uc->files[file - uc->c->files] : NULL;
+        memset(&op, 0, sizeof(struct file_op)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        if (uf != NULL)
+        {
+            op.seq = uf->seq;
+            op.slot = uf->slot;
+        }
+        switch (ev)
+        {
+            case CONN_EV_HELLO:
+            {
+                if (conn_greet(uc->c, PROTO_FEATURE_ACK) == -1)
+                {
+                    shutdown(uc->c->fd, SHUT_RDWR);
+                    uc->eof = 1;
+                }
+                continue;
+            }
+            case CONN_EV_FILE:
+            {
+                // A file of unknown size is treated as empty wherever its size is only a hint
+                uint64_t size = file->size == PROTO_SIZE_UNKNOWN ? 0 : file->size;
+
+                if (uw->n_free_slots == 0)
+                {
+                    printf("%s:%d dropped: too many files open\n", uc->c->addr_str, uc->c->port);
+                    shutdown(uc->c->fd, SHUT_RDWR);
+                    uc->eof = 1;
+                    continue;
+                }
+                uf->seq = ++uc->file_seq;
+                uf->slot = uw->free_slots[--uw->n_free_slots];
+                uf->off = 0;
+                op.type = FOP_OPEN;
+                op.seq = uf->seq;
+                op.slot = uf->slot;
+                create_save_path(&op.path, uc->c->dir_fd, file->file_name);
+                set_string(&op.file_name, file->file_name);
+                set_string(&uf->path, op.path);
+                if (uw->set->dedup)
+                {
+                    if (file->hash == NULL && (file->hash = (struct sha256_ctx *) malloc(sizeof(struct sha256_ctx))) == NULL)
+                    {
+                        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+                    }
+                    sha256_init(file->hash);
+                }
+                if (size >= SAVE_PREALLOC_MIN)
+                {
+                    queue_op(uc, &op);
+                    memset(&op, 0, sizeof(struct file_op)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+                    op.seq = uf->seq;
+                    op.slot = uf->slot;
+                    op.type = FOP_FALLOCATE;
+                    op.offset = size;
+                }
+                break;
+            }
+            case CONN_EV_DATA:
+            {
+                op.type = FOP_WRITE;
+                op.data = data;
+                op.len = (uint32_t) data_len;
+                op.offset = uf->off;
+                op.bid = bid;
+                ++uw->buf_refs[bid];
+                uf->off += data_len;
+                if (file->hash != NULL)
+                {
+                    sha256_update(file->hash, data, data_len);
+                }
+                break;
+            }
+            case CONN_EV_END:
+            {
+                // Under per-file durability the data and the new name are synced before closing
+                if (uw->set->durability == DURABILITY_FILE)
+                {
+                    op.type = FOP_FSYNC;
+                    queue_op(uc, &op);
+                    op.type = FOP_DIRSYNC;
+                    queue_op(uc, &op);
+                }
+                op.type = FOP_CLOSE;
+                op.offset = uf->off;
+                op.stream = file->stream;
+                set_string(&op.file_name, file->file_name);
+                if (file->hash != NULL)
+                {
+                    char digest[SHA256_HEX_SIZE];
+
+                    sha256_final(file->hash, digest);
+                    set_string(&op.digest, digest);
+                }
+                op.path = uf->path;
+                uf->path = NULL;
+                break;
+            }
+            case CONN_EV_ERROR:
+            {
+                printf("%s:%d %s.\n", uc->c->addr_str, uc->c->port, uc->c->error);
+                shutdown(uc->c->fd, SHUT_RDWR);
+                uc->eof = 1;
+                continue;
+            }
+            case CONN_EV_COPY:
+            case CONN_EV_NONE:
+            default:
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                              69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+            }
+        }
+        queue_op(uc, &op);
+    }
+    buf_release(uw, bid);
+}
+
+static void queue_op(struct uconn *uc, const struct file_op *op)
+{
+    if (uc->queue.len == uc->queue.cap)
+    {
+        struct file_op *ops;
+        size_t cap = uc->queue.cap ? uc->queue.cap * 2 : URING_CHAIN_MAX;
+
+        if ((ops = (struct file_op *) realloc(uc->queue.ops, cap * sizeof(struct file_op))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        uc->queue.ops = ops;
+        uc->queue.cap = cap;
+    }
+    uc->queue.ops[uc->queue.len++] = *op;
+}
+
+static void submit_chain(struct uring_worker *uw, struct uconn *uc)
+{
+    size_t n;
+
+    if (uc->chain_len > 0 || uc->queue.len == 0)
+    {
+        return;
+    }
+
+    n = uc->queue.len < URING_CHAIN_MAX ? uc->queue.len : URING_CHAIN_MAX;
+    ring_reserve(&uw->ring, n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        const struct file_op *op = &uc->queue.ops[i];
+        struct io_uring_sqe *sqe = ring_sqe(&uw->ring);
+
+        switch (op->type)
+        {
+            case FOP_OPEN:
+            {
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = uc->c->dir_fd;
+                sqe->addr = (uint64_t) (uintptr_t) op->path;
+                sqe->len = WR_DIR_FLAGS;
+                sqe->open_flags = O_CREAT | O_EXCL | O_WRONLY;
+                sqe->file_index = op->slot + 1;
+                break;
+            }
+            case FOP_FALLOCATE:
+            {
+                sqe->opcode = IORING_OP_FALLOCATE;
+                sqe->fd = (int) op->slot;
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->addr = op->offset;
+                sqe->len = FALLOC_FL_KEEP_SIZE;
+                break;
+            }
+            case FOP_WRITE:
+            {
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->fd = (int) op->slot;
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->addr = (uint64_t) (uintptr_t) op->data;
+                sqe->len = op->len;
+                sqe->off = op->offset;
+                break;
+            }
+            case FOP_FSYNC:
+            {
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = (int) op->slot;
+                sqe->flags = IOSQE_FIXED_FILE;
+                sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+                break;
+            }
+            case FOP_DIRSYNC:
+            {
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = uc->c->dir_fd;
+                break;
+            }
+            case FOP_CLOSE:
+            {
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->file_index = op->slot + 1;
+                break;
+            }
+            case FOP_UNLINK:
+            {
+                sqe->opcode = IORING_OP_UNLINKAT;
+                sqe->fd = uc->c->dir_fd;
+                sqe->addr = (uint64_t) (uintptr_t) op->path;
+                break;
+            }
+            default:
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                              69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+            }
+        }
+        // Preallocation is only a hint, so its failure must not cancel the writes linked after it
+        if (i + 1 < n)
+        {
+            sqe->flags |= op->type == FOP_FALLOCATE ? IOSQE_IO_HARDLINK : IOSQE_IO_LINK;
+        }
+        sqe->user_data = ((uint64_t) uc->c->fd << UD_FD_SHIFT) | ((uint64_t) i << UD_TYPE_BITS) | UD_FILE;
+        uc->chain[i] = *op;
+    }
+
+    uc->queue.len -= n;
+    memmove(uc->queue.ops, uc->queue.ops + n, uc->queue.len * sizeof(struct file_op));
+    uc->chain_len = n;
+    uc->chain_pending = n;
+}
+
+static void handle_file(struct uring_worker *uw, struct uconn *uc, size_t idx, int res)
+{
+    uc->chain[idx].res = res;
+    if (--uc->chain_pending == 0)
+    {
+        finish_chain(uw, uc);
+        submit_chain(uw, uc);
+        maybe_close(uw, uc);
+    }
+}
+
+static void finish_chain(struct uring_worker *uw, struct uconn *uc)
+{
+    size_t len = uc->chain_len;
+
+    uc->chain_len = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        struct file_op *op = &uc->chain[i];
+
+        if (op->type == FOP_OPEN && op->res == -EEXIST)
+        {
+            retry_open(uc, i, len);
+            return;
+        }
+        if (op->type == FOP_OPEN && op->res < 0)
+        {
+            fail_open(uw, uc, i, len);
+            return;
+        }
+        if (op->res < 0 && op->type != FOP_FALLOCATE)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, -op->res, 4);
+        }
+
+        switch (op->type)
+        {
+            case FOP_OPEN:
+            case FOP_UNLINK:
+            {
+                free(op->path);
+                free(op->file_name);
+                break;
+            }
+            case FOP_WRITE:
+            {
+                if ((uint32_t) op->res != op->len)
+                {
+                    fatal_message(__FILE__, __func__, __LINE__, "Short write to saved file", 4);
+                }
+                buf_release(uw, op->bid);
+                break;
+            }
+            case FOP_FALLOCATE:
+            case FOP_FSYNC:
+            case FOP_DIRSYNC:
+            {
+                break;
+            }
+            case FOP_CLOSE:
+            {
+                // The file is deduplicated once closed; a new link must be synced like the name was,
+                // as must the subdirectories of a nested name, which the ring's DIRSYNC does not reach
+                if (((op->digest != NULL && dedup_file(uc->c->dir_fd, NULL, op->path, op->digest))
+                     || strchr(op->path, '/') != NULL)
+                    && uw->set->durability == DURABILITY_FILE && sync_save_dirs(uc->c->dir_fd, op->path) == -1)
+                {
+                    fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+                }
+                uw->free_slots[uw->n_free_slots++] = op->slot;
+                if (op->file_name != NULL)
+                {
+                    struct ack_info ack;
+
+                    ack.chan = uc->c->features & PROTO_FEATURE_ACK ? uc->c->acks : NULL;
+                    ack.stream = op->stream;
+                    ack.save_name = op->path;
+                    durable_save(uc->c->dir_fd, -1, uc->c->save_dir, op->file_name, op->offset, &ack);
+                }
+                free(op->file_name);
+                free(op->path);
+                free(op->digest);
+                break;
+            }
+            default:
+            {
+                fatal_message(__FILE__, __func__, __LINE__, "\nYou shouldn't be here.\n",
+                              69); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : 69 is a very magic number
+            }
+        }
+    }
+}
+
+static void retry_open(struct uconn *uc, size_t idx, size_t len)
+{
+    struct file_op *open_op = &uc->chain[idx];
+
+    create_save_path(&open_op->path, uc->c->dir_fd, open_op->file_name);
+    requeue_chain(uc, idx, len);
+
+    for (size_t i = 0; i < uc->queue.len; ++i)
+    {
+        struct file_op *op = &uc->queue.ops[i];
+
+        if (op->seq == open_op->seq && (op->type == FOP_UNLINK || (op->type == FOP_CLOSE && op->path != NULL)))
+        {
+            set_string(&op->path, uc->queue.ops[0].path);
+        }
+    }
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        if (uc->files[i].path != NULL && uc->files[i].seq == open_op->seq)
+        {
+            set_string(&uc->files[i].path, uc->queue.ops[0].path);
+        }
+    }
+}
+
+static void fail_open(struct uring_worker *uw, struct uconn *uc, size_t idx, size_t len)
+{
+    struct file_op *open_op = &uc->chain[idx];
+    unsigned long seq = open_op->seq;
+    size_t kept = 0;
+
+    printf("%s:%d dropped: %s could not be created: %s\n", uc->c->addr_str, uc->c->port, open_op->file_name,
+           strerror(-open_op->res)); // NOLINT(concurrency-mt-unsafe) : Message only
+    uw->free_slots[uw->n_free_slots++] = open_op->slot;
+    free(open_op->path);
+    free(open_op->file_name);
+    requeue_chain(uc, idx + 1, len);
+
+    for (size_t i = 0; i < uc->queue.len; ++i)
+    {
+        struct file_op *op = &uc->queue.ops[i];
+
+        if (op->seq != seq)
+        {
+            uc->queue.ops[kept++] = *op;
+            continue;
+        }
+        if (op->type == FOP_WRITE)
+        {
+            buf_release(uw, op->bid);
+        }
+        free(op->path);
+        free(op->file_name);
+        free(op->digest);
+    }
+    uc->queue.len = kept;
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        if (uc->files[i].path != NULL && uc->files[i].seq == seq)
+        {
+            free(uc->files[i].path);
+            uc->files[i].path = NULL;
+        }
+    }
+
+    shutdown(uc->c->fd, SHUT_RDWR);
+    uc->eof = 1;
+}
+
+static void requeue_chain(struct uconn *uc, size_t idx, size_t len)
+{
+    size_t n = len - idx;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        queue_op(uc, &uc->chain[idx + i]);
+    }
+    // Move the re-queued operations ahead of anything queued meanwhile
+    for (size_t i = 0; i < n; ++i)
+    {
+        struct file_op op = uc->queue.ops[uc->queue.len - 1];
+
+        memmove(uc->queue.ops + 1, uc->queue.ops, (uc->queue.len - 1) * sizeof(struct file_op));
+        uc->queue.ops[0] = op;
+    }
+}
+
+static void maybe_close(struct uring_worker *uw, struct uconn *uc)
+{
+    if (!uc->eof || uc->recv_armed || uc->chain_len > 0 || uc->queue.len > 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < CONN_MAX_FILES; ++i)
+    {
+        struct ufile *uf = &uc->files[i];
+        struct file_op op;
+
+        if (uf->path == NULL)
+        {
+            continue;
+        }
+        if (uc->queue.len == 0)
+        {
+            printf("%s:%d disconnected mid-file; discarded partial upload.\n", uc->c->addr_str, uc->c->port);
+        }
+        memset(&op, 0, sizeof(struct file_op)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        op.seq = uf->seq;
+        op.slot = uf->slot;
+        op.type = FOP_CLOSE;
+        queue_op(uc, &op);
+        op.type = FOP_UNLINK;
+        op.path = uf->path;
+        queue_op(uc, &op);
+        uf->path = NULL;
+    }
+    if (uc->queue.len > 0)
+    {
+        submit_chain(uw, uc);
+        return;
+    }
+
+    if (uc->starved)
+    {
+        --uw->n_starved;
+    }
+    uw->conns[uc->c->fd] = NULL;
+    --uw->n_conns;
+    conn_close(uc->c);
+    if (uw->deferred_at != 0 && !uw->stopping)
+    {
+        uw->deferred_at = 0;
+        arm_accept(uw);
+    }
+    free(uc->queue.ops);
+    free(uc);
+}
+
+static void stop_worker(struct uring_worker *uw)
+{
+    uw->stopping = 1;
+    shutdown(uw->w->fd_listen_sock, SHUT_RD);
+
+    for (size_t fd = 0; fd < uw->size; ++fd)
+    {
+        struct uconn *uc = uw->conns[fd];
+
+        if (uc != NULL)
+        {
+            shutdown(uc->c->fd, SHUT_RDWR);
+            if (uc->starved)
+            {
+                uc->starved = 0;
+                --uw->n_starved;
+                uc->eof = 1;
+                maybe_close(uw, uc);
+            }
+        }
+    }
+}
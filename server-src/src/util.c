@@ -3,14 +3,28 @@
 //
 
 #include "util.h"
+#include "direct.h"
 #include "error.h"
+#include "save.h"
+#include "version.h"
 #include <stdlib.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
 void cleanup(struct server_settings *sets)
 {
-    close(sets->fd_listen_sock);
+    for (unsigned int i = 0; i < sets->n_workers; ++i)
+    {
+        close(sets->workers[i].fd_listen_sock);
+    }
+    free(sets->workers);
+    free(sets->wr_dir);
+    version_index_free();
+    close_save_dirs();
+    direct_pool_free();
+    sets->workers = NULL;
+    sets->wr_dir = NULL;
+    sets->n_workers = 0;
 }
 
 void set_string(char **str, const char *new_str)
@@ -0,0 +1,515 @@
+#include "version.h"
+#include "error.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * The number of slots a directory's name table starts with. Always a power of two.
+ */
+#define VERSION_MIN_SLOTS 64
+
+/**
+ * The first version given a "-vN" suffix.
+ */
+#define VERSION_START_INDEX 2
+
+/**
+ * The most digits read as a version number, keeping it within an unsigned int.
+ */
+#define VERSION_MAX_DIGITS 9
+
+/**
+ * The permissions of a directory made to hold a nested file name.
+ */
+#define VERSION_DIR_FLAGS (S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+
+/**
+ * version_entry
+ * <p>
+ * Struct storing the versions taken of one file name in a directory.
+ * <ul>
+ * <li>char *name: the file name without a version suffix, or NULL for an empty slot</li>
+ * <li>unsigned int next: the next "-vN" version to give out</li>
+ * <li>int base_free: whether the name itself, without a suffix, is free</li>
+ * </ul>
+ * A name ending in '/' marks a subdirectory, whose base_free says whether it is yet to be scanned.
+ * </p>
+ */
+struct version_entry
+{
+    char *name;
+    unsigned int next;
+    int base_free;
+};
+
+/**
+ * version_dir
+ * <p>
+ * Struct storing the version index of one directory: an open-addressed table of file names.
+ * <ul>
+ * <li>struct version_entry *entries: the table</li>
+ * <li>size_t n_slots: the number of slots in the table</li>
+ * <li>size_t n_entries: the number of names in the table</li>
+ * </ul>
+ * </p>
+ */
+struct version_dir
+{
+    struct version_entry *entries;
+    size_t n_slots;
+    size_t n_entries;
+};
+
+/**
+ * version_index
+ * <p>
+ * Struct storing the version index of every directory, indexed by the directory's file descriptor.
+ * <ul>
+ * <li>struct version_dir **dirs: the index of each directory, or NULL if not yet scanned</li>
+ * <li>size_t size: the number of elements in dirs</li>
+ * </ul>
+ * </p>
+ */
+struct version_index
+{
+    struct version_dir **dirs;
+    size_t size;
+};
+
+static struct version_index index_table;                               // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;  // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * hash_str
+ * <p>
+ * Hash a string with FNV-1a.
+ * </p>
+ * @param str - char *: the string
+ * @return the hash
+ */
+static size_t hash_str(const char *str);
+
+/**
+ * find_dir
+ * <p>
+ * Find the index of a directory, creating it from a scan of the directory if it is not indexed.
+ * </p>
+ * @param dir_fd - int: file descriptor for the directory
+ * @return the directory's index
+ */
+static struct version_dir *find_dir(int dir_fd);
+
+/**
+ * scan_dir
+ * <p>
+ * Read every file name in a directory, or in one of its subdirectories, into the directory's index,
+ * recording which versions are taken. A subdirectory's names are indexed under its prefix.
+ * </p>
+ * @param d - version_dir *: the directory's index
+ * @param dir_fd - int: file descriptor for the directory
+ * @param prefix - char *: the subdirectory's path ending in '/', or "" for the directory itself
+ */
+static void scan_dir(struct version_dir *d, int dir_fd, const char *prefix);
+
+/**
+ * find_name
+ * <p>
+ * Find the entry of a file name in a directory's index, first scanning the subdirectory holding a
+ * nested name if it has not been scanned.
+ * </p>
+ * @param d - version_dir *: the directory's index
+ * @param dir_fd - int: file descriptor for the directory
+ * @param file_name - char *: the file name, relative to the directory, without a version suffix
+ * @return the entry
+ */
+static struct version_entry *find_name(struct version_dir *d, int dir_fd, const char *file_name);
+
+/**
+ * find_entry
+ * <p>
+ * Find the entry of a file name in a directory's index, adding a free entry if there is none.
+ * </p>
+ * @param d - version_dir *: the directory's index
+ * @param name - char *: the file name without a version suffix
+ * @return the entry
+ */
+static struct version_entry *find_entry(struct version_dir *d, const char *name);
+
+/**
+ * grow_dir
+ * <p>
+ * Double the size of a directory's table, moving every entry to its new slot.
+ * </p>
+ * @param d - version_dir *: the directory's index
+ */
+static void grow_dir(struct version_dir *d);
+
+/**
+ * parse_version
+ * <p>
+ * Split a file name that may carry a "-vN" suffix into the name without it and its version.
+ * </p>
+ * @param name - char *: the file name
+ * @param base - char *: buffer of at least strlen(name) + 1 bytes to hold the name without a suffix
+ * @return the version: N for a suffixed name, otherwise 1
+ */
+static unsigned int parse_version(const char *name, char *base);
+
+unsigned int version_claim(int dir_fd, const char *file_name)
+{
+    struct version_entry *e;
+    unsigned int version;
+    int err;
+
+    if ((err = pthread_mutex_lock(&index_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+
+    e = find_name(find_dir(dir_fd), dir_fd, file_name);
+    if (e->base_free)
+    {
+        e->base_free = 0;
+        version = 1;
+    } else
+    {
+        version = e->next++;
+    }
+
+    pthread_mutex_unlock(&index_lock);
+    return version;
+}
+
+unsigned int version_latest(int dir_fd, const char *file_name)
+{
+    struct version_entry *e;
+    unsigned int version;
+    int err;
+
+    if ((err = pthread_mutex_lock(&index_lock)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+    }
+
+    e = find_name(find_dir(dir_fd), dir_fd, file_name);
+    if (e->next > VERSION_START_INDEX)
+    {
+        version = e->next - 1;
+    } else
+    {
+        version = e->base_free ? 0 : 1;
+    }
+
+    pthread_mutex_unlock(&index_lock);
+    return version;
+}
+
+const char *version_ext(const char *file_name)
+{
+    const char *base;
+    const char *dot;
+
+    // Only the last component has an extension, and a leading dot marks a hidden file, not one
+    base = strrchr(file_name, '/');
+    base = base == NULL ? file_name : base + 1;
+    dot = strrchr(base, '.');
+    return (dot == NULL || dot == base) ? file_name + strlen(file_name) : dot;
+}
+
+void version_dirs(int dir_fd, const char *file_name)
+{
+    char *path;
+
+    if (strchr(file_name, '/') == NULL)
+    {
+        return;
+    }
+    if ((path = strdup(file_name)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    for (char *slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        // A directory that cannot be made fails the open of the file below it, which reports it
+        if (mkdirat(dir_fd, path, VERSION_DIR_FLAGS) == -1 && errno != EEXIST)
+        {
+            break;
+        }
+        *slash = '/';
+    }
+    free(path);
+}
+
+void version_name(char **save_file_name, const char *file_name, unsigned int version)
+{
+    char suffix[VERSION_SUFFIX_MAX + 1];
+    const char *ext;
+    size_t stem_len;
+    size_t ext_len;
+    int suffix_len;
+
+    free(*save_file_name);
+    if (version == 1)
+    {
+        if ((*save_file_name = strdup(file_name)) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        return;
+    }
+
+    // Build the versioned name in one allocation: "stem-vN.ext"
+    if ((suffix_len = snprintf(suffix, sizeof(suffix), "-v%u", version)) < 0) // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    ext = version_ext(file_name);
+    stem_len = (size_t) (ext - file_name);
+    ext_len = strlen(ext);
+    if ((*save_file_name = (char *) malloc(stem_len + (size_t) suffix_len + ext_len + 1)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(*save_file_name, file_name, stem_len);
+    memcpy(*save_file_name + stem_len, suffix, (size_t) suffix_len);
+    memcpy(*save_file_name + stem_len + suffix_len, ext, ext_len + 1);
+}
+
+void version_index_free(void)
+{
+    for (size_t fd = 0; fd < index_table.size; ++fd)
+    {
+        struct version_dir *d = index_table.dirs[fd];
+
+        if (d == NULL)
+        {
+            continue;
+        }
+        for (size_t slot = 0; slot < d->n_slots; ++slot)
+        {
+            free(d->entries[slot].name);
+        }
+        free(d->entries);
+        free(d);
+    }
+    free(index_table.dirs);
+    index_table.dirs = NULL;
+    index_table.size = 0;
+}
+
+static size_t hash_str(const char *str)
+{
+    size_t hash = 14695981039346656037ULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : FNV offset basis
+
+    for (; *str != '\0'; ++str)
+    {
+        hash ^= (unsigned char) *str;
+        hash *= 1099511628211ULL; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : FNV prime
+    }
+    return hash;
+}
+
+static struct version_dir *find_dir(int dir_fd)
+{
+    struct version_dir *d;
+
+    if ((size_t) dir_fd >= index_table.size)
+    {
+        size_t size = index_table.size == 0 ? (size_t) dir_fd + 1 : index_table.size;
+        struct version_dir **dirs;
+
+        while (size <= (size_t) dir_fd)
+        {
+            size *= 2;
+        }
+        if ((dirs = (struct version_dir **) realloc(index_table.dirs, size * sizeof(struct version_dir *))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        memset(dirs + index_table.size, 0, (size - index_table.size) * sizeof(struct version_dir *)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+        index_table.dirs = dirs;
+        index_table.size = size;
+    }
+
+    if ((d = index_table.dirs[dir_fd]) != NULL)
+    {
+        return d;
+    }
+
+    if ((d = (struct version_dir *) calloc(1, sizeof(struct version_dir))) == NULL
+        || (d->entries = (struct version_entry *) calloc(VERSION_MIN_SLOTS, sizeof(struct version_entry))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    d->n_slots = VERSION_MIN_SLOTS;
+    scan_dir(d, dir_fd, "");
+
+    index_table.dirs[dir_fd] = d;
+    return d;
+}
+
+static void scan_dir(struct version_dir *d, int dir_fd, const char *prefix)
+{
+    struct dirent *entry;
+    size_t prefix_len = strlen(prefix);
+    char *key;
+    DIR *dir;
+    int fd;
+
+    // Scan through a descriptor of its own, since closedir closes it
+    if ((fd = openat(dir_fd, prefix_len == 0 ? "." : prefix, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        // A subdirectory not made yet holds no versions
+        if (prefix_len != 0 && (errno == ENOENT || errno == ENOTDIR))
+        {
+            return;
+        }
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((dir = fdopendir(fd)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((key = (char *) malloc(prefix_len + NAME_MAX + 1)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    memcpy(key, prefix, prefix_len);
+    while ((entry = readdir(dir)) != NULL) // NOLINT(concurrency-mt-unsafe) : Under index_lock
+    {
+        struct version_entry *e;
+        unsigned int version;
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        version = parse_version(entry->d_name, key + prefix_len);
+        e = find_entry(d, key);
+        if (version == 1)
+        {
+            e->base_free = 0;
+        } else if (version >= e->next)
+        {
+            e->next = version + 1;
+        }
+    }
+    free(key);
+    closedir(dir);
+}
+
+static struct version_entry *find_name(struct version_dir *d, int dir_fd, const char *file_name)
+{
+    const char *slash;
+
+    if ((slash = strrchr(file_name, '/')) != NULL)
+    {
+        struct version_entry *e;
+        char *prefix;
+
+        if ((prefix = strndup(file_name, (size_t) (slash + 1 - file_name))) == NULL)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+        }
+        // Marked before scanning, since the scan may move the entry
+        e = find_entry(d, prefix);
+        if (e->base_free)
+        {
+            e->base_free = 0;
+            scan_dir(d, dir_fd, prefix);
+        }
+        free(prefix);
+    }
+    return find_entry(d, file_name);
+}
+
+static struct version_entry *find_entry(struct version_dir *d, const char *name)
+{
+    size_t slot;
+
+    // Keep the table at most three quarters full so probes stay short
+    if ((d->n_entries + 1) * 4 > d->n_slots * 3)
+    {
+        grow_dir(d);
+    }
+
+    for (slot = hash_str(name) & (d->n_slots - 1); d->entries[slot].name != NULL; slot = (slot + 1) & (d->n_slots - 1))
+    {
+        if (strcmp(d->entries[slot].name, name) == 0)
+        {
+            return &d->entries[slot];
+        }
+    }
+
+    if ((d->entries[slot].name = strdup(name)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    d->entries[slot].next = VERSION_START_INDEX;
+    d->entries[slot].base_free = 1;
+    ++d->n_entries;
+    return &d->entries[slot];
+}
+
+static void grow_dir(struct version_dir *d)
+{
+    struct version_entry *old = d->entries;
+    size_t old_slots = d->n_slots;
+
+    d->n_slots *= 2;
+    if ((d->entries = (struct version_entry *) calloc(d->n_slots, sizeof(struct version_entry))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    for (size_t i = 0; i < old_slots; ++i)
+    {
+        size_t slot;
+
+        if (old[i].name == NULL)
+        {
+            continue;
+        }
+        for (slot = hash_str(old[i].name) & (d->n_slots - 1); d->entries[slot].name != NULL; slot = (slot + 1) & (d->n_slots - 1))
+        {
+        }
+        d->entries[slot] = old[i];
+    }
+    free(old);
+}
+
+static unsigned int parse_version(const char *name, char *base)
+{
+    const char *ext;
+    size_t stem_len;
+    size_t digits;
+    unsigned long version;
+
+    ext = version_ext(name);
+    stem_len = (size_t) (ext - name);
+    for (digits = 0; digits < stem_len && name[stem_len - digits - 1] >= '0' && name[stem_len - digits - 1] <= '9'; ++digits)
+    {
+    }
+
+    // A suffix is "-v" and a number of at least 2 with no leading zero, after a non-empty name
+    if (digits == 0 || digits > VERSION_MAX_DIGITS || stem_len < digits + 3
+        || name[stem_len - digits - 2] != '-' || name[stem_len - digits - 1] != 'v'
+        || name[stem_len - digits] == '0'
+        || (version = strtoul(name + stem_len - digits, NULL, 10)) < VERSION_START_INDEX) // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Base 10
+    {
+        strcpy(base, name); // NOLINT(clang-analyzer-security.insecureAPI.strcpy) : base is large enough
+        return 1;
+    }
+
+    memcpy(base, name, stem_len - digits - 2);
+    strcpy(base + stem_len - digits - 2, ext); // NOLINT(clang-analyzer-security.insecureAPI.strcpy) : base is large enough
+    return (unsigned int) version;
+}
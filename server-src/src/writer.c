@@ -0,0 +1,496 @@
+#include "writer.h"
+#include "direct.h"
+#include "durable.h"
+#include "error.h"
+#include "mpsc.h"
+#include "save.h"
+#include "sha256.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Operation flag: create the file before writing.
+ */
+#define WOP_OPEN 0x1U
+
+/**
+ * Operation flag: close the file and report it as saved after writing.
+ */
+#define WOP_CLOSE 0x2U
+
+/**
+ * Operation flag: close and remove the file.
+ */
+#define WOP_DISCARD 0x4U
+
+/**
+ * Operation flag: stop the writer thread.
+ */
+#define WOP_STOP 0x8U
+
+/**
+ * Operation flag: call the operation's function instead of writing; the operation is then freed.
+ */
+#define WOP_TASK 0x10U
+
+/**
+ * write_op
+ * <p>
+ * Struct storing one operation handed to a writer, and the buffer holding its data. Operations
+ * belong to a writer_stream and return to it once performed.
+ * <ul>
+ * <li>struct mpsc_node node: link in a writer's queue or in the stream's free list</li>
+ * <li>unsigned int flags: WOP_ flags saying what to do besides writing the data</li>
+ * <li>struct writer_file *file: the file operated on</li>
+ * <li>struct writer_stream *stream: the stream the operation returns to</li>
+ * <li>char *data: the buffer</li>
+ * <li>size_t len: the number of bytes of data to write</li>
+ * <li>void (*run)(void *): the function a WOP_TASK operation calls</li>
+ * <li>void *arg: the argument passed to run</li>
+ * </ul>
+ * </p>
+ */
+struct write_op
+{
+    struct mpsc_node node;
+    unsigned int flags;
+    struct writer_file *file;
+    struct writer_stream *stream;
+    char *data;
+    size_t len;
+    void (*run)(void *);
+    void *arg;
+};
+
+/**
+ * writer
+ * <p>
+ * Struct storing one writer thread and its queue of operations.
+ * </p>
+ */
+struct writer
+{
+    struct mpsc_queue queue;
+    struct write_op stop;
+    pthread_t thread;
+};
+
+struct writer_pool
+{
+    struct writer *writers;
+    unsigned int n_writers;
+    int direct_io;
+    atomic_uint next_task;
+};
+
+struct writer_stream
+{
+    struct writer_pool *pool;
+    struct mpsc_queue free_ops;
+    struct write_op *ops;
+    char *bufs;
+    unsigned int depth;
+    size_t buf_size;
+    unsigned int next_writer;
+};
+
+/**
+ * writer_file
+ * <p>
+ * The network thread only touches op and pending_flags, and sets digest, acks and ack_stream before
+ * the close is handed off; the writer only touches fd, direct, path and written.
+ * </p>
+ */
+struct writer_file
+{
+    struct writer_stream *stream;
+    struct writer *w;
+    struct write_op *op;
+    unsigned int pending_flags;
+    int dir_fd;
+    char *save_dir;
+    char *file_name;
+    uint64_t size;
+    int fd;
+    struct direct_file *direct;
+    char *path;
+    uint64_t written;
+    char digest[SHA256_HEX_SIZE];
+    struct ack_chan *acks;
+    uint32_t ack_stream;
+};
+
+/**
+ * writer_main
+ * <p>
+ * Thread entry point: perform the operations in the writer's queue until told to stop.
+ * </p>
+ * @param arg - void *: the writer
+ * @return NULL
+ */
+static void *writer_main(void *arg);
+
+/**
+ * run_op
+ * <p>
+ * Perform one operation on its file.
+ * </p>
+ * @param op - write_op *: the operation
+ */
+static void run_op(const struct write_op *op);
+
+/**
+ * take_op
+ * <p>
+ * Take a free operation from the stream, waiting for a writer to return one if none is free.
+ * </p>
+ * @param stream - writer_stream *: the stream
+ * @return the operation, with no data
+ */
+static struct write_op *take_op(struct writer_stream *stream);
+
+/**
+ * hand_off
+ * <p>
+ * Queue the file's buffer to its writer with the given flags, taking a free operation if the
+ * file holds none.
+ * </p>
+ * @param file - writer_file *: the file
+ * @param flags - unsigned int: WOP_ flags to add
+ */
+static void hand_off(struct writer_file *file, unsigned int flags);
+
+struct writer_pool *writer_pool_open(unsigned int n_writers, int direct_io)
+{
+    struct writer_pool *pool;
+    sigset_t mask;
+    sigset_t old_mask;
+    int err;
+
+    if ((pool = (struct writer_pool *) malloc(sizeof(struct writer_pool))) == NULL
+        || (pool->writers = (struct writer *) calloc(n_writers, sizeof(struct writer))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    pool->n_writers = n_writers;
+    pool->direct_io = direct_io;
+    atomic_init(&pool->next_task, 0);
+
+    // Writers never handle SIGINT; it must keep interrupting the network threads
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    if ((err = pthread_sigmask(SIG_BLOCK, &mask, &old_mask)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 2);
+    }
+    for (unsigned int i = 0; i < n_writers; ++i)
+    {
+        struct writer *w = &pool->writers[i];
+
+        mpsc_init(&w->queue);
+        w->stop.flags = WOP_STOP;
+        if ((err = pthread_create(&w->thread, NULL, writer_main, w)) != 0)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, err, 4);
+        }
+    }
+    if ((err = pthread_sigmask(SIG_SETMASK, &old_mask, NULL)) != 0)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, err, 2);
+    }
+
+    return pool;
+}
+
+void writer_pool_close(struct writer_pool *pool)
+{
+    for (unsigned int i = 0; i < pool->n_writers; ++i)
+    {
+        mpsc_push(&pool->writers[i].queue, &pool->writers[i].stop.node);
+    }
+    for (unsigned int i = 0; i < pool->n_writers; ++i)
+    {
+        pthread_join(pool->writers[i].thread, NULL);
+        mpsc_destroy(&pool->writers[i].queue);
+    }
+    free(pool->writers);
+    free(pool);
+}
+
+void writer_pool_run(struct writer_pool *pool, void (*run)(void *), void *arg)
+{
+    struct write_op *op;
+    unsigned int i;
+
+    if ((op = (struct write_op *) calloc(1, sizeof(struct write_op))) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    op->flags = WOP_TASK;
+    op->run = run;
+    op->arg = arg;
+
+    // Any network thread may hand off work, so the writers are taken in turn across all of them
+    i = atomic_fetch_add(&pool->next_task, 1) % pool->n_writers;
+    mpsc_push(&pool->writers[i].queue, &op->node);
+}
+
+struct writer_stream *writer_stream_open(struct writer_pool *pool, unsigned int depth, size_t buf_size)
+{
+    struct writer_stream *stream;
+
+    if ((stream = (struct writer_stream *) calloc(1, sizeof(struct writer_stream))) == NULL
+        || (stream->ops = (struct write_op *) calloc(depth, sizeof(struct write_op))) == NULL
+        || (stream->bufs = (char *) malloc(depth * buf_size)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+    stream->pool = pool;
+    stream->depth = depth;
+    stream->buf_size = buf_size;
+
+    mpsc_init(&stream->free_ops);
+    for (unsigned int i = 0; i < depth; ++i)
+    {
+        stream->ops[i].stream = stream;
+        stream->ops[i].data = stream->bufs + (size_t) i * buf_size;
+        mpsc_push(&stream->free_ops, &stream->ops[i].node);
+    }
+    return stream;
+}
+
+void writer_stream_close(struct writer_stream *stream)
+{
+    // Every buffer is back once every queued operation has been performed
+    for (unsigned int i = 0; i < stream->depth; ++i)
+    {
+        mpsc_pop(&stream->free_ops);
+    }
+    mpsc_destroy(&stream->free_ops);
+    free(stream->bufs);
+    free(stream->ops);
+    free(stream);
+}
+
+struct writer_file *writer_file_open(struct writer_stream *stream, int dir_fd, const char *save_dir,
+                                     const char *file_name, uint64_t size)
+{
+    struct writer_file *file;
+
+    if ((file = (struct writer_file *) calloc(1, sizeof(struct writer_file))) == NULL
+        || (file->save_dir = strdup(save_dir)) == NULL
+        || (file->file_name = strdup(file_name)) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+    }
+
+    // Spread files across writers; all of one file's operations go to the same writer, in order
+    file->stream = stream;
+    file->w = &stream->pool->writers[stream->next_writer];
+    stream->next_writer = (stream->next_writer + 1) % stream->pool->n_writers;
+    file->pending_flags = WOP_OPEN;
+    file->dir_fd = dir_fd;
+    file->size = size;
+    file->fd = -1;
+    return file;
+}
+
+char *writer_file_space(struct writer_file *file, size_t *len)
+{
+    if (file->op == NULL)
+    {
+        file->op = take_op(file->stream);
+    }
+    *len = file->stream->buf_size - file->op->len;
+    return file->op->data + file->op->len;
+}
+
+void writer_file_commit(struct writer_file *file, size_t len)
+{
+    file->op->len += len;
+    if (file->op->len == file->stream->buf_size)
+    {
+        hand_off(file, 0);
+    }
+}
+
+void writer_file_write(struct writer_file *file, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t space;
+        char *dst;
+
+        dst = writer_file_space(file, &space);
+        space = len < space ? len : space;
+        memcpy(dst, data, space);
+        writer_file_commit(file, space);
+        data += space;
+        len -= space;
+    }
+}
+
+void writer_file_flush(struct writer_file *file)
+{
+    if (file->op == NULL)
+    {
+        return;
+    }
+    if (file->op->len > 0)
+    {
+        hand_off(file, 0);
+    } else
+    {
+        mpsc_push(&file->stream->free_ops, &file->op->node);
+        file->op = NULL;
+    }
+}
+
+void writer_file_close(struct writer_file *file, const char *digest, struct ack_chan *acks, uint32_t stream)
+{
+    if (digest != NULL)
+    {
+        memcpy(file->digest, digest, SHA256_HEX_SIZE);
+    }
+    file->acks = ack_hold(acks);
+    file->ack_stream = stream;
+    hand_off(file, WOP_CLOSE);
+}
+
+void writer_file_discard(struct writer_file *file)
+{
+    if (file->op != NULL)
+    {
+        file->op->len = 0;
+    }
+    hand_off(file, WOP_DISCARD);
+}
+
+static void *writer_main(void *arg)
+{
+    struct writer *w = (struct writer *) arg;
+
+    for (;;)
+    {
+        struct write_op *op = (struct write_op *) mpsc_pop(&w->queue);
+        struct writer_file *file = op->file;
+
+        if (op->flags & WOP_STOP)
+        {
+            break;
+        }
+        if (op->flags & WOP_TASK)
+        {
+            op->run(op->arg);
+            free(op);
+            continue;
+        }
+
+        run_op(op);
+        if (op->flags & (WOP_CLOSE | WOP_DISCARD))
+        {
+            ack_release(file->acks);
+            free(file->path);
+            free(file->file_name);
+            free(file->save_dir);
+            free(file);
+        }
+
+        op->file = NULL;
+        op->flags = 0;
+        op->len = 0;
+        mpsc_push(&op->stream->free_ops, &op->node);
+    }
+    return NULL;
+}
+
+static void run_op(const struct write_op *op)
+{
+    struct writer_file *file = op->file;
+
+    // A file abandoned before any of it was handed off was never created
+    if ((op->flags & WOP_OPEN) && (op->flags & WOP_DISCARD))
+    {
+        return;
+    }
+
+    if ((op->flags & WOP_OPEN)
+        && (file->fd = open_save_file(file->dir_fd, file->file_name, file->size, &file->path)) != -1)
+    {
+        preallocate_file(file->fd, file->size);
+        if (file->stream->pool->direct_io)
+        {
+            file->direct = direct_open(file->fd, file->size);
+        }
+    }
+    // A file the file system refused is received but dropped, and its client with it once it ends
+    if (file->fd == -1)
+    {
+        if (op->flags & WOP_CLOSE)
+        {
+            printf("Could not create %s in %s; discarded it.\n", file->file_name, file->save_dir);
+            ack_drop(file->acks);
+        }
+        return;
+    }
+    if (op->len > 0)
+    {
+        if (file->direct != NULL)
+        {
+            direct_write(file->direct, op->data, op->len);
+        } else
+        {
+            write_to_file(file->fd, op->data, op->len);
+        }
+        file->written += op->len;
+    }
+
+    if (op->flags & WOP_DISCARD)
+    {
+        if (file->direct != NULL)
+        {
+            direct_discard(file->direct);
+        }
+        discard_file(file->dir_fd, file->fd, file->path);
+    } else if (op->flags & WOP_CLOSE)
+    {
+        struct ack_info ack;
+
+        if (file->direct != NULL)
+        {
+            direct_finish(file->direct);
+        }
+        finish_save_file(file->fd);
+        if (file->digest[0] != '\0')
+        {
+            dedup_file(file->dir_fd, &file->fd, file->path, file->digest);
+        }
+        ack.chan = file->acks;
+        ack.stream = file->ack_stream;
+        ack.save_name = file->path;
+        durable_save(file->dir_fd, file->fd, file->save_dir, file->file_name, file->written, &ack);
+    }
+}
+
+static struct write_op *take_op(struct writer_stream *stream)
+{
+    return (struct write_op *) mpsc_pop(&stream->free_ops);
+}
+
+static void hand_off(struct writer_file *file, unsigned int flags)
+{
+    struct write_op *op;
+
+    op = file->op != NULL ? file->op : take_op(file->stream);
+    op->flags = file->pending_flags | flags;
+    op->file = file;
+    file->pending_flags = 0;
+    file->op = NULL;
+    mpsc_push(&file->w->queue, &op->node);
+}
@@ -0,0 +1,209 @@
+#include "lz.h"
+#include "../../client-src/include/lz.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The size of the largest input compressed; past LZ's 64 KiB reach, so far matches must be passed up.
+ */
+#define TEST_MAX_LEN (256 * 1024)
+
+/**
+ * The number of blocks of random bytes decompressed to check that no malformed block is trusted.
+ */
+#define TEST_GARBAGE_BLOCKS 2000
+
+/**
+ * The size of each block of random bytes decompressed.
+ */
+#define TEST_GARBAGE_LEN 64
+
+static int failures;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+static uint64_t rng = 88172645463325252ULL; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables,cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift seed
+
+/**
+ * check
+ * <p>
+ * Count and report a failed check.
+ * </p>
+ * @param ok - int: whether the check passed
+ * @param what - char *: what was checked
+ */
+static void check(int ok, const char *what);
+
+/**
+ * next_random
+ * <p>
+ * Draw the next number from a fixed-seed xorshift generator, so every run tests the same bytes.
+ * </p>
+ * @return the number
+ */
+static uint64_t next_random(void);
+
+/**
+ * round_trip
+ * <p>
+ * Compress data as the client does and decompress it as the server does. The compressed block
+ * must fit in LZ_BOUND, decompress to the same bytes, and be refused by a buffer one byte short.
+ * </p>
+ * @param data - char *: the data
+ * @param len - size_t: the number of bytes of data
+ * @param what - char *: what the data is, for reports
+ */
+static void round_trip(const char *data, size_t len, const char *what);
+
+/**
+ * test_round_trips
+ * <p>
+ * Round-trip empty, short, repeating, random and mixed data, and data repeating beyond the
+ * farthest a match may reach.
+ * </p>
+ */
+static void test_round_trips(void);
+
+/**
+ * test_malformed
+ * <p>
+ * Decompress blocks that are cut short, hold an offset of 0 or reach back before the output's
+ * start, and blocks of random bytes, none of which may be trusted.
+ * </p>
+ */
+static void test_malformed(void);
+
+int main(void)
+{
+    test_round_trips();
+    test_malformed();
+    printf("lz: %d failed\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void check(int ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static uint64_t next_random(void)
+{
+    rng ^= rng << 13; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift64
+    rng ^= rng >> 7;  // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift64
+    rng ^= rng << 17; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : xorshift64
+    return rng;
+}
+
+static void round_trip(const char *data, size_t len, const char *what)
+{
+    char *comp;
+    char *out;
+    size_t comp_len;
+
+    // One spare byte lets an empty output be allocated and a short one be told from a full one
+    if ((comp = (char *) malloc(LZ_BOUND(len))) == NULL || (out = (char *) malloc(len + 1)) == NULL)
+    {
+        check(0, "allocate buffers");
+        exit(EXIT_FAILURE);
+    }
+    comp_len = lz_compress(data, len, comp);
+    check(comp_len <= LZ_BOUND(len), what);
+    check(lz_decompress(comp, comp_len, out, len) == (ssize_t) len && memcmp(out, data, len) == 0, what);
+    check(len == 0 || lz_decompress(comp, comp_len, out, len - 1) == -1, what);
+    free(out);
+    free(comp);
+}
+
+static void test_round_trips(void)
+{
+    static const char text[] = "the quick brown fox jumps over the lazy dog; the quick brown fox jumps again";
+    char *data;
+
+    if ((data = (char *) malloc(TEST_MAX_LEN)) == NULL)
+    {
+        check(0, "allocate data");
+        exit(EXIT_FAILURE);
+    }
+
+    round_trip("", 0, "empty");
+    round_trip("x", 1, "one byte");
+    round_trip(text, 12, "shorter than the last match limit"); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : At the match limit
+    round_trip(text, 13, "just past the last match limit"); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Past the match limit
+    round_trip(text, sizeof(text) - 1, "text");
+
+    memset(data, 0, TEST_MAX_LEN); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    round_trip(data, TEST_MAX_LEN, "zeros");
+
+    // A period shorter than a word makes matches overlap the bytes they produce
+    for (size_t i = 0; i < TEST_MAX_LEN; ++i)
+    {
+        data[i] = "abc"[i % 3];
+    }
+    round_trip(data, TEST_MAX_LEN, "period of three");
+
+    for (size_t i = 0; i < TEST_MAX_LEN; ++i)
+    {
+        data[i] = (char) next_random();
+    }
+    round_trip(data, TEST_MAX_LEN, "random");
+
+    // Random runs repeated at every distance up to past the 64 KiB reach
+    for (size_t dist = 1; dist < TEST_MAX_LEN / 2; dist *= 3)
+    {
+        memcpy(data + TEST_MAX_LEN / 2, data + TEST_MAX_LEN / 2 - dist, dist);
+        round_trip(data, TEST_MAX_LEN, "repeats at a distance");
+    }
+
+    // Long literal runs and long matches both need continued lengths
+    for (size_t i = 0; i < TEST_MAX_LEN; ++i)
+    {
+        data[i] = (i / 1000) % 2 == 0 ? (char) next_random() : 'z'; // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Runs of 1000 bytes
+    }
+    round_trip(data, TEST_MAX_LEN, "long runs");
+    free(data);
+}
+
+static void test_malformed(void)
+{
+    static const char zero_offset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+    static const char far_offset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+    static const char short_literals[] = {0x50, 'a', 'b'};
+    static const char short_length[] = {(char) 0xf0};
+    static const char short_offset[] = {0x10, 'a', 0x01};
+    char garbage[TEST_GARBAGE_LEN];
+    char comp[LZ_BOUND(sizeof(garbage))];
+    char out[TEST_MAX_LEN / 64];
+    size_t comp_len;
+
+    check(lz_decompress(zero_offset, sizeof(zero_offset), out, sizeof(out)) == -1, "offset of 0");
+    check(lz_decompress(far_offset, sizeof(far_offset), out, sizeof(out)) == -1, "offset before the start");
+    check(lz_decompress(short_literals, sizeof(short_literals), out, sizeof(out)) == -1, "literals cut short");
+    check(lz_decompress(short_length, sizeof(short_length), out, sizeof(out)) == -1, "length cut short");
+    check(lz_decompress(short_offset, sizeof(short_offset), out, sizeof(out)) == -1, "offset cut short");
+
+    // Every cut of a valid block either fails or yields no more than the block held
+    memset(garbage, 'q', sizeof(garbage)); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    comp_len = lz_compress(garbage, sizeof(garbage), comp);
+    for (size_t cut = 0; cut < comp_len; ++cut)
+    {
+        ssize_t n = lz_decompress(comp, cut, out, sizeof(out));
+
+        check(n == -1 || (size_t) n <= sizeof(garbage), "block cut short");
+    }
+
+    // Run under the sanitizers, this also shows no malformed block reads or writes out of bounds
+    for (int i = 0; i < TEST_GARBAGE_BLOCKS; ++i)
+    {
+        ssize_t n;
+
+        for (size_t j = 0; j < sizeof(garbage); ++j)
+        {
+            garbage[j] = (char) next_random();
+        }
+        n = lz_decompress(garbage, sizeof(garbage), out, sizeof(out));
+        check(n >= -1 && n <= (ssize_t) sizeof(out), "random bytes");
+    }
+}
@@ -0,0 +1,252 @@
+#include "mpsc.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * The number of threads pushing at once.
+ */
+#define TEST_PRODUCERS 4
+
+/**
+ * The number of nodes each thread pushes.
+ */
+#define TEST_PUSHES 20000
+
+/**
+ * How long a pop waits on an empty queue, in milliseconds.
+ */
+#define TEST_WAIT_MS 50
+
+/**
+ * The number of nanoseconds in a millisecond.
+ */
+#define NS_PER_MS 1000000L
+
+/**
+ * The number of nanoseconds in a second.
+ */
+#define NS_PER_S 1000000000L
+
+/**
+ * item
+ * <p>
+ * Struct storing one node pushed in a test.
+ * <ul>
+ * <li>struct mpsc_node node: link in the queue</li>
+ * <li>unsigned int producer: the thread that pushed it</li>
+ * <li>unsigned int seq: its place among that thread's pushes</li>
+ * </ul>
+ * </p>
+ */
+struct item
+{
+    struct mpsc_node node;
+    unsigned int producer;
+    unsigned int seq;
+};
+
+/**
+ * producer_args
+ * <p>
+ * Struct storing what one producer thread pushes.
+ * <ul>
+ * <li>struct mpsc_queue *queue: the queue</li>
+ * <li>struct item *items: the thread's TEST_PUSHES items</li>
+ * </ul>
+ * </p>
+ */
+struct producer_args
+{
+    struct mpsc_queue *queue;
+    struct item *items;
+};
+
+static int failures; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * check
+ * <p>
+ * Count and report a failed check.
+ * </p>
+ * @param ok - int: whether the check passed
+ * @param what - char *: what was checked
+ */
+static void check(int ok, const char *what);
+
+/**
+ * produce
+ * <p>
+ * Thread start routine: push every one of a producer's items in order.
+ * </p>
+ * @param arg - void *: the producer_args
+ * @return NULL
+ */
+static void *produce(void *arg);
+
+/**
+ * elapsed_ms
+ * <p>
+ * Measure the time since a point on the monotonic clock.
+ * </p>
+ * @param start - timespec *: the point
+ * @return the milliseconds since start
+ */
+static long elapsed_ms(const struct timespec *start);
+
+/**
+ * test_order
+ * <p>
+ * Pop nodes pushed by one thread in the order they were pushed.
+ * </p>
+ */
+static void test_order(void);
+
+/**
+ * test_producers
+ * <p>
+ * Pop every node pushed by TEST_PRODUCERS threads at once, each thread's nodes in its order.
+ * </p>
+ */
+static void test_producers(void);
+
+/**
+ * test_deadline
+ * <p>
+ * Time out a pop on an empty queue at its deadline, and return at once from one with a node.
+ * </p>
+ */
+static void test_deadline(void);
+
+int main(void)
+{
+    test_order();
+    test_producers();
+    test_deadline();
+    printf("mpsc: %d failed\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void check(int ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static void *produce(void *arg)
+{
+    struct producer_args *args = (struct producer_args *) arg;
+
+    for (unsigned int i = 0; i < TEST_PUSHES; ++i)
+    {
+        mpsc_push(args->queue, &args->items[i].node);
+    }
+    return NULL;
+}
+
+static long elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * (NS_PER_S / NS_PER_MS) + (now.tv_nsec - start->tv_nsec) / NS_PER_MS;
+}
+
+static void test_order(void)
+{
+    struct mpsc_queue queue;
+    struct item items[TEST_PRODUCERS];
+
+    mpsc_init(&queue);
+    for (unsigned int i = 0; i < TEST_PRODUCERS; ++i)
+    {
+        items[i].seq = i;
+        mpsc_push(&queue, &items[i].node);
+    }
+    for (unsigned int i = 0; i < TEST_PRODUCERS; ++i)
+    {
+        check(((struct item *) mpsc_pop(&queue))->seq == i, "order of one producer");
+    }
+    mpsc_destroy(&queue);
+}
+
+static void test_producers(void)
+{
+    struct mpsc_queue queue;
+    struct producer_args args[TEST_PRODUCERS];
+    pthread_t threads[TEST_PRODUCERS];
+    unsigned int next[TEST_PRODUCERS] = {0};
+    int in_order = 1;
+
+    mpsc_init(&queue);
+    for (unsigned int p = 0; p < TEST_PRODUCERS; ++p)
+    {
+        args[p].queue = &queue;
+        if ((args[p].items = (struct item *) malloc(TEST_PUSHES * sizeof(struct item))) == NULL)
+        {
+            check(0, "allocate items");
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned int i = 0; i < TEST_PUSHES; ++i)
+        {
+            args[p].items[i].producer = p;
+            args[p].items[i].seq = i;
+        }
+    }
+    for (unsigned int p = 0; p < TEST_PRODUCERS; ++p)
+    {
+        if (pthread_create(&threads[p], NULL, produce, &args[p]) != 0)
+        {
+            check(0, "start a producer");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (unsigned int n = 0; n < TEST_PRODUCERS * TEST_PUSHES; ++n)
+    {
+        struct item *it = (struct item *) mpsc_pop(&queue);
+
+        in_order &= it->seq == next[it->producer]++;
+    }
+    check(in_order, "order of each producer");
+
+    for (unsigned int p = 0; p < TEST_PRODUCERS; ++p)
+    {
+        pthread_join(threads[p], NULL);
+        check(next[p] == TEST_PUSHES, "every node popped");
+        free(args[p].items);
+    }
+    mpsc_destroy(&queue);
+}
+
+static void test_deadline(void)
+{
+    struct mpsc_queue queue;
+    struct item it;
+    struct timespec start;
+    struct timespec deadline;
+    long waited;
+
+    mpsc_init(&queue);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline = start;
+    deadline.tv_nsec += TEST_WAIT_MS * NS_PER_MS;
+    deadline.tv_sec += deadline.tv_nsec / NS_PER_S;
+    deadline.tv_nsec %= NS_PER_S;
+
+    check(mpsc_pop_until(&queue, &deadline) == NULL, "empty queue times out");
+    waited = elapsed_ms(&start);
+    check(waited >= TEST_WAIT_MS - 1 && waited < TEST_WAIT_MS * 20, "timed out at the deadline"); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Slack for a loaded machine
+
+    mpsc_push(&queue, &it.node);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    deadline = start;
+    ++deadline.tv_sec;
+    check(mpsc_pop_until(&queue, &deadline) == &it.node, "queued node popped before the deadline");
+    check(elapsed_ms(&start) < TEST_WAIT_MS, "queued node popped at once");
+    mpsc_destroy(&queue);
+}
@@ -0,0 +1,176 @@
+#include "sha256.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of 'a' bytes in the longest known-answer message.
+ */
+#define MILLION_A 1000000
+
+/**
+ * known_answer
+ * <p>
+ * Struct storing a SHA-256 known-answer vector from FIPS 180-2.
+ * <ul>
+ * <li>const char *msg: the message</li>
+ * <li>const char *hex: the message's digest as hexadecimal</li>
+ * </ul>
+ * </p>
+ */
+struct known_answer
+{
+    const char *msg;
+    const char *hex;
+};
+
+static const struct known_answer answers[] = {
+        {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        {"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+         "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"},
+};
+
+static int failures; // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+/**
+ * check
+ * <p>
+ * Count and report a failed check.
+ * </p>
+ * @param ok - int: whether the check passed
+ * @param what - char *: what was checked
+ */
+static void check(int ok, const char *what);
+
+/**
+ * hash_hex
+ * <p>
+ * Hash data in one piece and write its digest as hexadecimal.
+ * </p>
+ * @param data - void *: the data
+ * @param len - size_t: the number of bytes of data
+ * @param hex - char[]: the buffer to hold the digest, of SHA256_HEX_SIZE bytes
+ */
+static void hash_hex(const void *data, size_t len, char hex[SHA256_HEX_SIZE]);
+
+/**
+ * test_known_answers
+ * <p>
+ * Hash the FIPS 180-2 messages, one million 'a' bytes included, and compare their digests.
+ * </p>
+ */
+static void test_known_answers(void);
+
+/**
+ * test_pieces
+ * <p>
+ * Hash a message of several blocks in two pieces split at every byte, and in pieces of every
+ * size, and compare each digest with the one-piece digest.
+ * </p>
+ */
+static void test_pieces(void);
+
+/**
+ * test_digest
+ * <p>
+ * Check that sha256_digest and sha256_hex agree with sha256_final.
+ * </p>
+ */
+static void test_digest(void);
+
+int main(void)
+{
+    test_known_answers();
+    test_pieces();
+    test_digest();
+    printf("sha256: %d failed\n", failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void check(int ok, const char *what)
+{
+    if (!ok)
+    {
+        printf("FAIL: %s\n", what);
+        ++failures;
+    }
+}
+
+static void hash_hex(const void *data, size_t len, char hex[SHA256_HEX_SIZE])
+{
+    struct sha256_ctx ctx;
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, hex);
+}
+
+static void test_known_answers(void)
+{
+    char hex[SHA256_HEX_SIZE];
+    char *million;
+
+    for (size_t i = 0; i < sizeof(answers) / sizeof(answers[0]); ++i)
+    {
+        hash_hex(answers[i].msg, strlen(answers[i].msg), hex);
+        check(strcmp(hex, answers[i].hex) == 0, answers[i].msg);
+    }
+
+    if ((million = (char *) malloc(MILLION_A)) == NULL)
+    {
+        check(0, "allocate one million bytes");
+        return;
+    }
+    memset(million, 'a', MILLION_A); // NOLINT(clang-analyzer-security.insecureAPI.DeprecatedOrUnsafeBufferHandling) : Not a POSIX function
+    hash_hex(million, MILLION_A, hex);
+    check(strcmp(hex, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0") == 0, "one million 'a'");
+    free(million);
+}
+
+static void test_pieces(void)
+{
+    const char *msg = answers[3].msg;
+    size_t len = strlen(msg);
+
+    for (size_t split = 0; split <= len; ++split)
+    {
+        struct sha256_ctx ctx;
+        char hex[SHA256_HEX_SIZE];
+
+        sha256_init(&ctx);
+        sha256_update(&ctx, msg, split);
+        sha256_update(&ctx, msg + split, len - split);
+        sha256_final(&ctx, hex);
+        check(strcmp(hex, answers[3].hex) == 0, "two pieces");
+    }
+    for (size_t piece = 1; piece <= len; ++piece)
+    {
+        struct sha256_ctx ctx;
+        char hex[SHA256_HEX_SIZE];
+
+        sha256_init(&ctx);
+        for (size_t done = 0; done < len; done += piece)
+        {
+            sha256_update(&ctx, msg + done, len - done < piece ? len - done : piece);
+        }
+        sha256_final(&ctx, hex);
+        check(strcmp(hex, answers[3].hex) == 0, "pieces of one size");
+    }
+}
+
+static void test_digest(void)
+{
+    struct sha256_ctx ctx;
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char hex[SHA256_HEX_SIZE];
+
+    sha256_init(&ctx);
+    sha256_update(&ctx, "abc", 3);
+    sha256_digest(&ctx, digest);
+    check(digest[0] == 0xbaU && digest[SHA256_DIGEST_SIZE - 1] == 0xadU, "digest bytes"); // NOLINT(cppcoreguidelines-avoid-magic-numbers,readability-magic-numbers) : Known answer
+    sha256_hex(digest, hex);
+    check(strcmp(hex, answers[1].hex) == 0, "digest as hexadecimal");
+}
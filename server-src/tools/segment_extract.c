@@ -0,0 +1,191 @@
+#define _GNU_SOURCE
+#include "error.h"
+#include "save.h"
+#include "segment.h"
+#include "version.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * The size of the buffer through which a body is copied when the kernel cannot copy it directly.
+ */
+#define EXTRACT_BUF_SIZE (64 * 1024)
+
+/**
+ * extract_record
+ * <p>
+ * Write the body of one record to <out>/<client>/<name>, with the version suffix the files store
+ * would have given it. A file already there is overwritten.
+ * </p>
+ * @param seg_dir_fd - int: file descriptor for the segment directory
+ * @param out_fd - int: file descriptor for the output directory
+ * @param rec - segment_record *: the record
+ * @param seg_fd - int *: pointer to the descriptor of the segment last read, or -1; updated
+ * @param seg - uint32_t *: pointer to the number of the segment last read; updated
+ */
+static void extract_record(int seg_dir_fd, int out_fd, const struct segment_record *rec, int *seg_fd, uint32_t *seg);
+
+/**
+ * copy_body
+ * <p>
+ * Copy len bytes at offset in a segment to the end of a file, inside the kernel when it can.
+ * </p>
+ * @param seg_fd - int: file descriptor for the segment
+ * @param offset - uint64_t: the offset of the body
+ * @param dst_fd - int: file descriptor for the file
+ * @param len - uint64_t: the length of the body
+ */
+static void copy_body(int seg_fd, uint64_t offset, int dst_fd, uint64_t len);
+
+/**
+ * main
+ * <p>
+ * Rebuild the tree of saved files from a segment store: every file recorded in the index is
+ * written to <output-dir>/<client>/<name>, the layout the files store uses. The output directory
+ * defaults to the write directory itself.
+ * </p>
+ * @param argc - int: number of command line arguments
+ * @param argv - char**: command line arguments
+ * @return 0 on successful execution
+ */
+int main(int argc, char *argv[])
+{
+    struct segment_record rec;
+    const char *out_dir;
+    FILE *index;
+    size_t n_files = 0;
+    uint32_t seg = 0;
+    int seg_fd = -1;
+    int wr_dir_fd;
+    int seg_dir_fd;
+    int index_fd;
+    int out_fd;
+
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <write-dir> [<output-dir>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    out_dir = argc == 3 ? argv[2] : argv[1];
+
+    if ((wr_dir_fd = open(argv[1], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1
+        || (seg_dir_fd = openat(wr_dir_fd, SEGMENT_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1
+        || (index_fd = openat(seg_dir_fd, SEGMENT_INDEX, O_RDONLY | O_CLOEXEC)) == -1
+        || (index = fdopen(index_fd, "r")) == NULL)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    if ((mkdir(out_dir, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+        || (out_fd = open(out_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    while (segment_read_record(index, &rec))
+    {
+        extract_record(seg_dir_fd, out_fd, &rec, &seg_fd, &seg);
+        free(rec.client);
+        free(rec.name);
+        ++n_files;
+    }
+    printf("Extracted %zu files to %s\n", n_files, out_dir);
+
+    if (seg_fd != -1)
+    {
+        close(seg_fd);
+    }
+    fclose(index);
+    close(out_fd);
+    close(seg_dir_fd);
+    close(wr_dir_fd);
+    return EXIT_SUCCESS;
+}
+
+static void extract_record(int seg_dir_fd, int out_fd, const struct segment_record *rec, int *seg_fd, uint32_t *seg)
+{
+    char seg_name[SEGMENT_NAME_SIZE];
+    char *name = NULL;
+    int client_fd;
+    int dst_fd;
+
+    // Records of one run are in one or a few segments, so keep the last one open
+    if (*seg_fd == -1 || *seg != rec->segment)
+    {
+        if (*seg_fd != -1)
+        {
+            close(*seg_fd);
+        }
+        segment_file_name(seg_name, rec->segment);
+        if ((*seg_fd = openat(seg_dir_fd, seg_name, O_RDONLY | O_CLOEXEC)) == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        *seg = rec->segment;
+    }
+
+    if ((mkdirat(out_fd, rec->client, WR_DIR_FLAGS) == -1 && errno != EEXIST)
+        || (client_fd = openat(out_fd, rec->client, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+    version_name(&name, rec->name, rec->version);
+    version_dirs(client_fd, rec->name);
+    if ((dst_fd = openat(client_fd, name, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, WR_DIR_FLAGS)) == -1)
+    {
+        fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+    }
+
+    copy_body(*seg_fd, rec->offset, dst_fd, rec->len);
+
+    close(dst_fd);
+    close(client_fd);
+    free(name);
+}
+
+static void copy_body(int seg_fd, uint64_t offset, int dst_fd, uint64_t len)
+{
+    char *buf = NULL;
+    off_t src_off = (off_t) offset;
+
+    while (len > 0)
+    {
+        ssize_t ret_val;
+
+        if (buf == NULL)
+        {
+            ret_val = copy_file_range(seg_fd, &src_off, dst_fd, NULL, len, 0);
+            if (ret_val == -1 && (errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == ENOSYS))
+            {
+                // Fall back to copying through user space
+                if ((buf = (char *) malloc(EXTRACT_BUF_SIZE)) == NULL)
+                {
+                    fatal_errno(__FILE__, __func__, __LINE__, errno, 3);
+                }
+                continue;
+            }
+        } else if ((ret_val = pread(seg_fd, buf, len < EXTRACT_BUF_SIZE ? len : EXTRACT_BUF_SIZE, src_off)) > 0)
+        {
+            ssize_t written;
+
+            if ((written = write(dst_fd, buf, (size_t) ret_val)) != ret_val)
+            {
+                fatal_errno(__FILE__, __func__, __LINE__, written == -1 ? errno : ENOSPC, 4);
+            }
+            src_off += ret_val;
+        }
+
+        if (ret_val == -1)
+        {
+            fatal_errno(__FILE__, __func__, __LINE__, errno, 4);
+        }
+        if (ret_val == 0)
+        {
+            fatal_message(__FILE__, __func__, __LINE__, "Segment is shorter than its index says", 4);
+        }
+        len -= (uint64_t) ret_val;
+    }
+    free(buf);
+}